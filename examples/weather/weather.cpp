@@ -20,8 +20,8 @@ int main() {
             continue;
         }
 
-        for (const Pair& pair: forecast.getObject().pairs()) {
-            std::cout << pair.getKey() << ": " << pair.getValue().toString() << std::endl;
+        for (const auto& member: forecast.getObject()) {
+            std::cout << member.getKey() << ": " << member.getValue().toString() << std::endl;
         }
     }
 
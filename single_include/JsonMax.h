@@ -29,21 +29,284 @@ SOFTWARE.
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <memory>
 #include <sstream>
+#include <ostream>
 #include <fstream>
+#include <cstddef>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <iterator>
+#include <algorithm>
+#include <mutex>
+#include <future>
+#include <functional>
+#include <cstdlib>
+#include <climits>
+#include <cctype>
+#include <cstdio>
+#include <cerrno>
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#include <string_view>
+#endif
 
 namespace JsonMax {
 
 
+/// Defined when SSE2 instructions can be used, the FlatHashMap groups and the Writer's string escaping use them
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONMAX_SSE2
+#endif
+
+/// Defined when POSIX file descriptors are available, see DescriptorOutput
+#if defined(__unix__) || defined(__APPLE__)
+#define JSONMAX_POSIX
+#endif
+
+/**
+ * The library can be built with -fno-exceptions
+ * Every throw then prints the message of the exception and aborts, use the non throwing functions
+ * (parse with a ParseError, find, tryGet, getOr) to handle errors in that case.
+ */
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define JSONMAX_THROW(exception) throw exception
+#define JSONMAX_TRY try
+#define JSONMAX_CATCH_ALL catch (...)
+#define JSONMAX_RETHROW throw
+#else
+#define JSONMAX_THROW(exception) abortWith(exception)
+#define JSONMAX_TRY if (true)
+#define JSONMAX_CATCH_ALL else
+#define JSONMAX_RETHROW (void) 0
+#endif
+
+    /// Replaces throwing the given exception when exceptions are disabled
+    [[noreturn]] inline void abortWith(const std::exception &exception) {
+        std::fputs(exception.what(), stderr);
+        std::fputc('\n', stderr);
+        std::abort();
+    }
+
+
+
+    /// Layout of the json written by a Writer
+    struct WriteOptions {
+
+        /// Constructor, the defaults give the same json as toString()
+        explicit WriteOptions(bool compact = false, unsigned int indent = 0, unsigned int threads = 1,
+                              bool exactSize = false);
+
+        /// Leaves out the space after every ',' and ':'
+        bool compact;
+
+        /// Spaces per nesting level, every value of a non empty object or array then gets its own line
+        unsigned int indent;
+
+        /**
+         * Threads used for large objects and arrays, see Writer::parallelThreshold
+         * Their values are split in one chunk per thread, each chunk is written to its own buffer
+         * and the buffers are handed to the output in order. The json is the same as with one thread.
+         * Only one object or array is split at a time, the containers in a chunk are written by its thread alone.
+         * No more threads are used than std::thread::hardware_concurrency.
+         */
+        unsigned int threads;
+
+        /// toString measures the json with Writer::serializedSize first, so the string is allocated exactly once
+        bool exactSize;
+
+        /**
+         * Every object keeps its json, which is written again as long as the object is unchanged
+         * A change marks the objects on the way to it (operator[], non const find, Path, insert, remove, ...)
+         * and the objects around it, so writing a large document again after a small edit only serializes
+         * the changed objects. Nested objects are referred to rather than copied, so the caches take about
+         * the size of the json. The caches come from the memory resource of each object.
+         * A value assigned through an element reference obtained before writing outdates every cache, and
+         * strings and arrays handed out by non-const reference are written again every time.
+         * Only used without indentation, and the json is then written with one thread. The same document should
+         * not be written with caching from multiple threads at once. Off by default.
+         */
+        bool cacheFragments;
+
+    };
+
+
+
+#if __cplusplus >= 201703L
+
+    /// In C++17 builds every std::pmr resource (pools, monotonic buffers,...) can be used directly
+    using MemoryResource = std::pmr::memory_resource;
+
+    /// Allocator that hands out memory from a MemoryResource
+    template<typename T>
+    using Allocator = std::pmr::polymorphic_allocator<T>;
+
+#else
+
+    /**
+     * Source of memory for Elements, Objects and Arrays
+     * Mirrors the interface of std::pmr::memory_resource, so resources written for C++11
+     * keep working unchanged when the library is built as C++17
+     */
+    class MemoryResource {
+    public:
+
+        virtual ~MemoryResource() = default;
+
+        /// Allocates at least the given amount of bytes with the given alignment
+        void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+            return do_allocate(bytes, alignment);
+        }
+
+        /// Returns memory that was previously allocated by this resource
+        void deallocate(void *pointer, size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+            do_deallocate(pointer, bytes, alignment);
+        }
+
+        /// @return true if memory allocated by one resource can be deallocated by the other
+        bool is_equal(const MemoryResource &other) const noexcept {
+            return do_is_equal(other);
+        }
+
+    protected:
+
+        virtual void *do_allocate(size_t bytes, size_t alignment) = 0;
+
+        virtual void do_deallocate(void *pointer, size_t bytes, size_t alignment) = 0;
+
+        virtual bool do_is_equal(const MemoryResource &other) const noexcept = 0;
+
+    };
+
+#endif
+
+    /**
+     * The resource used when none is given
+     * Uses new/delete, or std::pmr::get_default_resource() in C++17 builds
+     */
+    MemoryResource *defaultResource();
+
+#if __cplusplus < 201703L
+
+    /// Allocator that hands out memory from a MemoryResource, a C++11 take on std::pmr::polymorphic_allocator
+    template<typename T>
+    class Allocator {
+    public:
+
+        using value_type = T;
+
+        /// Constructor, uses the default resource
+        Allocator() noexcept : memoryResource(defaultResource()) {}
+
+        /// Constructor, uses the given resource
+        Allocator(MemoryResource *resource) noexcept : memoryResource(resource) {}
+
+        /// Rebinding constructor
+        template<typename U>
+        Allocator(const Allocator<U> &other) noexcept : memoryResource(other.resource()) {}
+
+        T *allocate(size_t amount) {
+            return static_cast<T *>(memoryResource->allocate(amount * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *pointer, size_t amount) {
+            memoryResource->deallocate(pointer, amount * sizeof(T), alignof(T));
+        }
+
+        /// Copies of containers use the default resource, just like std::pmr
+        Allocator select_on_container_copy_construction() const {
+            return Allocator();
+        }
+
+        /// Getter for the resource
+        MemoryResource *resource() const noexcept {
+            return memoryResource;
+        }
+
+    private:
+
+        MemoryResource *memoryResource;
+
+    };
+
+    template<typename T, typename U>
+    bool operator==(const Allocator<T> &first, const Allocator<U> &second) noexcept {
+        return first.resource() == second.resource() or first.resource()->is_equal(*second.resource());
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const Allocator<T> &first, const Allocator<U> &second) noexcept {
+        return not(first == second);
+    }
+
+#endif
+
+    namespace Memory {
+
+        /// Allocates a T from the given resource and constructs it with the given arguments
+        template<typename T, typename... Args>
+        T *create(MemoryResource *resource, Args &&... args) {
+            void *memory = resource->allocate(sizeof(T), alignof(T));
+            JSONMAX_TRY {
+                return new(memory) T(std::forward<Args>(args)...);
+            } JSONMAX_CATCH_ALL {
+                resource->deallocate(memory, sizeof(T), alignof(T));
+                JSONMAX_RETHROW;
+            }
+        }
+
+        /// Destroys a T that was made with create and gives its memory back to the resource
+        template<typename T>
+        void destroy(MemoryResource *resource, T *pointer) {
+            if (pointer) {
+                pointer->~T();
+                resource->deallocate(pointer, sizeof(T), alignof(T));
+            }
+        }
+
+    }
+
+
+
     /// Forward declarations
     class Element;
     class Pair;
+    class AdaptiveStorage;
+    class FlatHashMap;
+    class FrozenObject;
+    class ShapedStorage;
+    class Path;
+    struct WriteOptions;
+    class KeyIterator;
+    template <typename Value> class ObjectIterator;
+    template <typename Value> class ValueIterator;
+    template <typename Iterator> class ObjectRange;
 
     /// Storage options for the Object
     enum Storage {
         HASHMAP,
         MAP,
-        VECTOR
+        VECTOR,
+        ADAPTIVE,
+        FLAT_HASHMAP,
+        INDEXED,
+        SHAPED
     };
 
     /// JSON Object representation
@@ -54,32 +317,39 @@ namespace JsonMax {
          * Constructor
          * Pick the storage type most suitable to your situation (see readme for more info)
          * @param storage the wanted storage type
+         * @param resource the memory resource used for the storage and every element added to it
          */
-        explicit Object(Storage storage = HASHMAP);
+        explicit Object(Storage storage = HASHMAP, MemoryResource *resource = defaultResource());
 
         /**
          * Copy constructor
-         * Deep copies all elements and uses the same storage type
+         * Deep copies all elements into the default resource and uses the same storage type
          */
         Object(const Object&);
 
+        /**
+         * Copy constructor with memory resource
+         * Deep copies all elements into the given resource and uses the same storage type
+         */
+        Object(const Object&, MemoryResource *resource);
+
         /**
          * Move constructor
-         * Moves the complete storage from the temp object
+         * Moves the complete storage and its memory resource from the temp object
          */
         Object(Object&&) noexcept;
 
         /**
          * Copy assignment
          * Resets the current object
-         * Deep copies all elements and uses the same storage type
+         * Deep copies all elements, keeps the current memory resource and uses the same storage type
          */
         Object& operator=(const Object&);
 
         /**
          * Move assignment
          * Resets the current object
-         * Moves the complete storage from the temp object
+         * Moves the complete storage and its memory resource from the temp object
          */
         Object& operator=(Object&&) noexcept;
 
@@ -97,12 +367,47 @@ namespace JsonMax {
          */
         Element &operator[](const std::string &key);
 
+        /// Same as above, but doesn't construct a string for keys that are already present
+        Element &operator[](const char *key);
+
+        /**
+         * Looks up the Element with the given key, never inserts anything
+         * @param key str key of the object
+         * @return pointer to the element, nullptr if the key is not present
+         */
+        Element *find(const std::string &key);
+
+        /// Same as above, const version
+        const Element *find(const std::string &key) const;
+
+        /// Same as above, but takes a c string
+        Element *find(const char *key);
+
+        /// Same as above, const version
+        const Element *find(const char *key) const;
+
+#if __cplusplus >= 201703L
+
+        /// Same as above, but takes a string view (C++17 only)
+        Element &operator[](std::string_view key);
+
+        /// Same as find(const std::string&), but takes a string view (C++17 only)
+        Element *find(std::string_view key);
+
+        /// Same as above, const version
+        const Element *find(std::string_view key) const;
+
+#endif
+
         /**
          * @param indent the wanted indentation (in spaces)
          * @return string representation of the object
          */
         std::string toString(unsigned int indent = 0) const;
 
+        /// @return json with the given layout, see Writer
+        std::string toString(const WriteOptions &options) const;
+
         /**
          * Removes an item from the object
          * Does nothing when the object does not exist
@@ -111,11 +416,36 @@ namespace JsonMax {
 
         /**
          * Fetches all pairs in the object
+         * Copies every key and value, prefer iterating the object itself
          * @return vector of pairs, easy to loop over
          */
         std::vector<Pair> pairs() const;
 
-        /// @return amount of items in the object
+        /**
+         * Iteration over the pairs without copying them (include ObjectIterator.h)
+         * Yields a Member with references to the key and value, uninitialized elements are skipped
+         */
+        ObjectIterator<Element> begin();
+
+        ObjectIterator<Element> end();
+
+        ObjectIterator<const Element> begin() const;
+
+        ObjectIterator<const Element> end() const;
+
+        /// Range over the keys of the object, without copying them
+        ObjectRange<KeyIterator> keys() const;
+
+        /// Range over the values of the object, without copying them
+        ObjectRange<ValueIterator<Element>> values();
+
+        /// Same as above, const version
+        ObjectRange<ValueIterator<const Element>> values() const;
+
+        /**
+         * Keys created by operator[] but never assigned are counted as well
+         * @return amount of items in the object
+         */
         size_t size() const;
 
         /// @return true if the item with the given key exists
@@ -127,22 +457,179 @@ namespace JsonMax {
         /// Clears all items from the object
         void clear();
 
+        /// Makes room for the given amount of items, so adding them doesn't reallocate the storage
+        void reserve(size_t items);
+
+        /// Getter for the memory resource used by the storage and its elements
+        MemoryResource *getResource() const;
+
+        /**
+         * Copies the object into a read only FrozenObject with a perfect hash (include FrozenObject.h)
+         * @param resource the memory resource for the frozen pairs
+         */
+        FrozenObject freeze(MemoryResource *resource = defaultResource()) const;
+
+        /**
+         * Deep equality, the order of the keys doesn't matter and numbers compare by value (1 equals 1.0)
+         * Returns false right away when both objects have a cached hash that is still valid and the hashes differ
+         */
+        bool operator==(const Object &other) const;
+
+        bool operator!=(const Object &other) const;
+
+        /**
+         * Hash of the pairs and all nested elements, independent of the order of the keys
+         * The hash is cached until the object is accessed in a way that can change it (operator[], non const find
+         * or iteration, remove, clear), so unchanged nested objects are not hashed again.
+         * A change to a nested object also clears the hashes of the objects around it. A value assigned through
+         * an element reference obtained before hashing clears every cached hash, as the element doesn't know its
+         * object. Values handed out by reference (getString, getArray, tryGetInt, ...) are hashed every time, and
+         * so are the objects that contain them.
+         * Hashes are seeded per process, so don't store them.
+         */
+        uint64_t hash() const;
+
+        /**
+         * ADAPTIVE objects scan their pairs until they hold more than the threshold, then they build a hash index
+         * Only affects objects that grow afterwards, defaults to 8
+         */
+        static void setAdaptiveThreshold(size_t threshold);
+
     private:
 
+        template <typename> friend class ObjectIterator;
+
+        friend class ObjectBuilder;
+
+        friend class Path;
+
+        friend class Query;
+
+        friend class Writer;
+
+        friend class ObjectParser;
+
+        friend class Element;
+
+        /**
+         * Json of the object as written by a Writer with WriteOptions::cacheFragments, allocated from its resource
+         * Nested objects are not copied into the text, they are written from their own caches at their positions.
+         * Objects parsed with parseWithSource start with their slice of the source instead
+         */
+        struct JsonCache {
+
+            /// Nested object, or exposed element when object is nullptr, that is written at the given position
+            struct Nested {
+                size_t position;
+                const Object *object;
+                const Element *element;
+            };
+
+            explicit JsonCache(MemoryResource *resource)
+                    : text(resource), nested(resource), offset(0), size(0), epoch(0), compact(false), flat(true),
+                      valid(false) {}
+
+            std::vector<char, Allocator<char>> text;
+            std::vector<Nested, Allocator<Nested>> nested;
+            std::shared_ptr<const std::string> source;
+            size_t offset;
+            size_t size;
+            /// Object::epoch when the cache was filled, the cache is outdated once it moves on
+            uint64_t epoch;
+            bool compact;
+            /// True if the object has no nested objects, so the text is all of its json
+            bool flat;
+            bool valid;
+        };
+
         /// Cleans up resources
         void reset();
 
         /// Moves the given temp object to this
         void move(Object&&);
 
-        /// Deep copies the given object to this
+        /// Deep copies the given object to this, using the current memory resource
         void copy(const Object&);
 
+        /// Returns the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const std::string &key) const;
+
+        /// Same as above, but takes the characters of the key
+        Element *lookup(const char *key, size_t length) const;
+
+        /**
+         * Same as the first one, with the precomputed Utils::hash of the key for the storages that use it
+         * (ADAPTIVE, INDEXED, FLAT_HASHMAP and SHAPED). HASHMAP hashes the key itself, MAP and VECTOR compare it
+         */
+        Element *lookup(const std::string &key, uint64_t hash) const;
+
+        /// Inserts a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
+
+        /// Same as above, cacheable is set to false if the hash includes exposed values and can't be cached
+        uint64_t hash(bool &cacheable) const;
+
+        /// @return the cached hash if it is still valid, zero otherwise
+        uint64_t freshHash() const;
+
+        /// Clears the values cached for the current pairs and those of the enclosing objects, see linkChildren
+        void markChanged();
+
+        /// Clears the cached values of the enclosing objects, which no longer contain this one, and forgets them
+        void detach();
+
+        /// Clears the cached values of the enclosing objects, stops at the first one that is already stale
+        void markParentsChanged();
+
+        /// Clears the values cached for the current pairs, the elements no longer count as cached
+        void clearCaches();
+
+        /**
+         * Makes the nested objects, including those in arrays that are not exposed, point to this one as their parent
+         * Called whenever a cache of this object is filled, so a change below it can clear that cache
+         */
+        void linkChildren() const;
+
+        /**
+         * Called after a cache was filled, links the nested objects and marks the elements as cached,
+         * so the next change clears the caches again
+         */
+        void cacheFilled() const;
+
+        /// Links the objects in the given value to the given parent
+        static void linkValue(const Element &value, Object *parent);
+
+        /**
+         * Counts the changes that can't be traced to the objects they affect: values assigned through element
+         * references kept from before a cache was filled. Caches filled before the last one of them are not used.
+         */
+        static std::atomic<uint64_t> epoch;
+
+        /// Storage types, all of them allocate from the memory resource
+        using VectorStorage = std::vector<std::pair<std::string, Element>, Allocator<std::pair<std::string, Element>>>;
+#if __cplusplus >= 201703L
+        using MapStorage = std::map<std::string, Element, std::less<>,
+                Allocator<std::pair<const std::string, Element>>>;
+#else
+        using MapStorage = std::map<std::string, Element, std::less<std::string>,
+                Allocator<std::pair<const std::string, Element>>>;
+#endif
+        /// Keyed Utils::hash for the HASHMAP storage, protects against keys crafted to collide
+        struct KeyHash {
+            size_t operator()(const std::string &key) const;
+        };
+
+        using HashmapStorage = std::unordered_map<std::string, Element, KeyHash,
+                std::equal_to<std::string>, Allocator<std::pair<const std::string, Element>>>;
+
         /// Union with pointer to the different kinds of storage types
         union Data {
-            std::vector<std::pair<std::string, Element>>* elementsVector;
-            std::map<std::string, Element>* elementsMap;
-            std::unordered_map<std::string, Element>* elementsHashmap;
+            VectorStorage* elementsVector;
+            MapStorage* elementsMap;
+            HashmapStorage* elementsHashmap;
+            AdaptiveStorage* elementsAdaptive;
+            FlatHashMap* elementsFlatHashmap;
+            ShapedStorage* elementsShaped;
         };
 
         /// Actual data
@@ -151,6 +638,33 @@ namespace JsonMax {
         /// Storage type
         Storage storage;
 
+        /// Memory resource for the storage and its elements
+        MemoryResource* resource;
+
+        /**
+         * Cached hash of the pairs, zero if it has to be computed again
+         * Atomic because const objects, such as the values of a FrozenObject, can be hashed from multiple threads
+         */
+        mutable std::atomic<uint64_t> cachedHash;
+
+        /// Epoch in which the cached hash was computed
+        mutable std::atomic<uint64_t> hashEpoch;
+
+        /// Cached json, nullptr until the object is written with WriteOptions::cacheFragments or parsed with its source
+        mutable JsonCache *jsonCache;
+
+        /**
+         * Object whose cached values include this one, nullptr if there is none
+         * Set when the parent fills a cache, cleared when this object is moved out of it
+         */
+        mutable std::atomic<Object *> parent;
+
+        /// True if the caches are empty and the parents know, so further changes don't have to tell them again
+        mutable std::atomic<bool> stale;
+
+        /// True if nested objects may point to this one as their parent
+        mutable std::atomic<bool> linked;
+
     };
 
 
@@ -192,9 +706,10 @@ namespace JsonMax {
     /// Forward declarations
     class Object;
     class Element;
+    class Path;
 
-    /// Name alias for a Json Array
-    using Array = std::vector<Element>;
+    /// Name alias for a Json Array, its elements come from the memory resource of the array
+    using Array = std::vector<Element, Allocator<Element>>;
 
     /**
      * Representation of an Element in a JSON Object
@@ -205,10 +720,25 @@ namespace JsonMax {
         /// Default constructor, sets type to uninitialized
         Element();
 
-        /// Copy constructor
+        /**
+         * Constructor, sets type to uninitialized
+         * Every value assigned afterwards is allocated from the given resource
+         */
+        explicit Element(MemoryResource *resource);
+
+        /**
+         * Copy constructor
+         * Deep copies the element into the default resource
+         */
         Element(const Element&);
 
-        /// Move constructor
+        /// Deep copies the element into the given resource
+        Element(const Element&, MemoryResource *resource);
+
+        /**
+         * Move constructor
+         * The element keeps using the memory resource of the temp element
+         */
         Element(Element&&) noexcept;
 
         /// Constructor for string
@@ -229,9 +759,15 @@ namespace JsonMax {
         /// Constructor for a JSON Object
         Element(const Object &obj);
 
+        /// Constructor for a JSON Object, takes over the memory resource of the object
+        Element(Object &&obj);
+
         /// Constructor for a JSON Array
         Element(const Array &arr);
 
+        /// Constructor for a JSON Array, takes over the memory resource of the array
+        Element(Array &&arr);
+
         /// Constructor for a JSON Array (initializer list)
         Element(const std::initializer_list<Element> &arr);
 
@@ -241,10 +777,14 @@ namespace JsonMax {
         /// Destructor, cleans up resources
         ~Element();
 
-        /// Copy assignment
+        /// Copy assignment, keeps using the current memory resource
         Element& operator=(const Element&);
 
-        /// Move assignment
+        /**
+         * Move assignment, keeps using the current memory resource
+         * Steals the value when both elements share a resource, copies it otherwise.
+         * Never throws: if the copy fails, the value is stolen together with its resource.
+         */
         Element& operator=(Element&&) noexcept;
 
         /// String assignment
@@ -265,27 +805,105 @@ namespace JsonMax {
         /// JSON Object assignment
         Element &operator=(const Object &obj);
 
+        /// JSON Object assignment, moves the storage of the temp object if it shares the memory resource
+        Element &operator=(Object &&obj);
+
         /// JSON Array assignment
         Element &operator=(const Array &arr);
 
+        /// JSON Array assignment, moves the elements of the temp array if it shares the memory resource
+        Element &operator=(Array &&arr);
+
         /// JSON Array (initializer list) assignment
         Element &operator=(const std::initializer_list<Element> &arr);
 
         /// JSON null assignment
         Element &operator=(std::nullptr_t pointer);
 
+        /**
+         * Deep equality, objects ignore the order of their keys and numbers compare by value (1 equals 1.0)
+         * Nested objects with different cached hashes are rejected without comparing them
+         */
+        bool operator==(const Element &other) const;
+
+        bool operator!=(const Element &other) const;
+
+        /// Hash of the value, consistent with operator==, nested objects cache theirs (see Object::hash)
+        uint64_t hash() const;
+
+        /// Hash of the elements of an array, in order (arrays compare with the operator== of std::vector)
+        static uint64_t hash(const Array &array);
+
         /// Getter for the current type
         Type getType() const;
 
+        /// Getter for the memory resource used for strings, objects and arrays
+        MemoryResource *getResource() const;
+
         /// Returns the operator[] of the Object, throws exception if not an Object
         Element &operator[](const std::string&);
 
+        /// Returns the operator[] of the Object, throws exception if not an Object
+        Element &operator[](const char*);
+
+        /// Returns the find of the Object, nullptr if not an Object or if the key is not present
+        Element *find(const std::string&);
+
+        /// Same as above, const version
+        const Element *find(const std::string&) const;
+
+        /// Returns the find of the Object, nullptr if not an Object or if the key is not present
+        Element *find(const char*);
+
+        /// Same as above, const version
+        const Element *find(const char*) const;
+
+        /// Resolves the compiled JSON Pointer, nullptr if it does not exist (include Path.h)
+        Element *find(const Path&);
+
+        /// Same as above, const version
+        const Element *find(const Path&) const;
+
+        /// Resolves the compiled JSON Pointer, throws a PathException if it does not exist
+        Element &at(const Path&);
+
+        /// Same as above, const version
+        const Element &at(const Path&) const;
+
+#if __cplusplus >= 201703L
+
+        /// Returns the operator[] of the Object, throws exception if not an Object (C++17 only)
+        Element &operator[](std::string_view);
+
+        /// Returns the find of the Object, nullptr if not an Object or if the key is not present (C++17 only)
+        Element *find(std::string_view);
+
+        /// Same as above, const version
+        const Element *find(std::string_view) const;
+
+#endif
+
         /**
          * @param indent the wanted indentation (in spaces)
          * @return string representation of the object
          */
         std::string toString(unsigned int indent = 0) const;
 
+        /// @return json with the given layout, see Writer
+        std::string toString(const WriteOptions &options) const;
+
+        /// @return exact amount of characters of the json with the given layout, without writing it
+        size_t serializedSize(const WriteOptions &options = WriteOptions()) const;
+
+        /// Writes the json to the stream through a fixed size buffer, the document is never held in memory as a whole
+        void write(std::ostream &stream, const WriteOptions &options = WriteOptions()) const;
+
+        /// Same as above, writes to a C file, throws a WriteException if writing fails
+        void write(std::FILE *file, const WriteOptions &options = WriteOptions()) const;
+
+        /// Same as above, creates or overwrites the file with the given name
+        void writeFile(const std::string &fileName, const WriteOptions &options = WriteOptions()) const;
+
         /// Int getter, throws type exception if wrong type
         int getInt() const;
 
@@ -295,14 +913,92 @@ namespace JsonMax {
         /// Double getter, throws type exception if wrong type
         double getDouble() const;
 
-        /// String getter, throws type exception if wrong type
-        std::string& getString() const;
+        /**
+         * String getter, throws type exception if wrong type
+         * The string can be changed through the reference, so it is hashed and written again every time afterwards
+         */
+        std::string& getString();
+
+        /// Same as above, const version
+        const std::string& getString() const;
 
         /// Object getter, throws type exception if wrong type
         Object& getObject() const;
 
-        /// Array getter, throws type exception if wrong type
-        Array& getArray() const;
+        /**
+         * Array getter, throws type exception if wrong type
+         * The array can be changed through the reference, so it is hashed and written again every time afterwards
+         */
+        Array& getArray();
+
+        /// Same as above, const version
+        const Array& getArray() const;
+
+        /// Int getter, nullptr if wrong type
+        int *tryGetInt();
+
+        /// Same as above, const version
+        const int *tryGetInt() const;
+
+        /// Boolean getter, nullptr if wrong type
+        bool *tryGetBool();
+
+        /// Same as above, const version
+        const bool *tryGetBool() const;
+
+        /// Double getter, nullptr if wrong type
+        double *tryGetDouble();
+
+        /// Same as above, const version
+        const double *tryGetDouble() const;
+
+        /// String getter, nullptr if wrong type
+        std::string *tryGetString();
+
+        /// Same as above, const version
+        const std::string *tryGetString() const;
+
+        /// Object getter, nullptr if wrong type
+        Object *tryGetObject();
+
+        /// Same as above, const version
+        const Object *tryGetObject() const;
+
+        /// Array getter, nullptr if wrong type
+        Array *tryGetArray();
+
+        /// Same as above, const version
+        const Array *tryGetArray() const;
+
+        /// @return the int, or the given default if wrong type
+        int getOr(int defaultValue) const;
+
+        /// @return the boolean, or the given default if wrong type
+        bool getOr(bool defaultValue) const;
+
+        /// @return the double, or the given default if wrong type (integers are not converted)
+        double getOr(double defaultValue) const;
+
+        /// @return a copy of the string, or the given default if wrong type
+        std::string getOr(const std::string &defaultValue) const;
+
+        /// @return the characters of the string, or the given default if wrong type, without copying
+        const char *getOr(const char *defaultValue) const;
+
+#if __cplusplus >= 201703L
+
+        /// @return a view on the string, or the given default if wrong type, without copying (C++17 only)
+        std::string_view getOr(std::string_view defaultValue) const;
+
+#endif
+
+        /**
+         * Calls the visitor once with the value of the element, dispatched on its type
+         * The visitor is called with an int, bool, double, const std::string&, const Object& or const Array&,
+         * and with nullptr for null (and uninitialized) elements. All calls must return the same type.
+         */
+        template <typename Visitor>
+        auto visit(Visitor &&visitor) const -> decltype(visitor(nullptr));
         
         /// Check if type is int
         bool isInt() const;
@@ -327,15 +1023,43 @@ namespace JsonMax {
 
     private:
 
-        /// Moves the given temp object to this
+        friend class Object;
+
+        friend class Writer;
+
+        friend class ArrayParser;
+
+        /// Moves the given temp object to this, including its memory resource
         void move(Element&&);
 
-        /// Deep copies the given object to this
+        /**
+         * Called before the value changes
+         * If the element is a pair of an object with a filled cache, that object can't know about the change,
+         * so every cache filled so far is dropped, see Object::epoch
+         */
+        void change();
+
+        /// Called before a reference into the value is handed out, which can change it without the element knowing
+        void expose();
+
+        /// Hash of the value, cacheable is set to false if it includes exposed values
+        uint64_t hash(bool &cacheable) const;
+
+        /// Hash of the elements of an array, cacheable is set to false if it includes exposed values
+        static uint64_t hash(const Array &array, bool &cacheable);
+
+        /// Unlinks the objects held by this element from the objects whose caches include them, see Object::hash
+        void detach();
+
+        /// Deep copies the given object to this, using the current memory resource
         void copy(const Element&);
 
         /// Cleans up resources
         void reset();
 
+        /// @return true if memory of the given resource can be used by this element
+        bool sharesResource(MemoryResource* other) const;
+
         /// Throws a TypeException if the given type is not equal to the current one
         void checkType(Type castType) const;
 
@@ -351,17 +1075,29 @@ namespace JsonMax {
         /// Makes the element an object
         void setObject(const Object& object);
 
+        /// Makes the element an object by moving the given one, copies it if it uses another resource
+        void setObject(Object&& object);
+
         /// Makes the element a string
         void setString(const std::string& string);
 
         /// Makes the element an array
         void setArray(const Array& array);
 
-        /// Union with pointers to the different kinds of types
+        /// Makes the element an array by moving the given one, copies it if it uses another resource
+        void setArray(Array&& array);
+
+        /// Makes the element an array from an initializer list
+        void setArray(const std::initializer_list<Element>& list);
+
+        /**
+         * Union with the different kinds of types
+         * Numbers and booleans are stored inline, the others point into the memory resource
+         */
         union Data {
-            int* number;
+            int number;
             bool boolean;
-            double* fraction;
+            double fraction;
             Object* object;
             std::string* string;
             Array* array;
@@ -373,1236 +1109,7835 @@ namespace JsonMax {
         /// Element type
         Type type;
 
+        /// True while the element is a pair of an object with a filled cache, the flags fit in the padding
+        mutable std::atomic<bool> cached{false};
+
+        /// True if the element is an array whose objects may be linked to an enclosing object
+        mutable std::atomic<bool> linked{false};
+
+        /**
+         * True once a reference into the value was handed out (getString, getArray, tryGetInt, ...)
+         * The value can then change at any time, so it is hashed and written again instead of cached
+         */
+        bool exposed = false;
+
+        /// Memory resource for strings, objects and arrays
+        MemoryResource* resource;
+
     };
 
+    template <typename Visitor>
+    auto Element::visit(Visitor &&visitor) const -> decltype(visitor(nullptr)) {
+        switch (type) {
+            case INTEGER:
+                return visitor(data.number);
+            case BOOLEAN:
+                return visitor(data.boolean);
+            case FRACTION:
+                return visitor(data.fraction);
+            case STRING:
+                return visitor(static_cast<const std::string &>(*data.string));
+            case OBJECT:
+                return visitor(static_cast<const Object &>(*data.object));
+            case ARRAY:
+                return visitor(static_cast<const Array &>(*data.array));
+            default:
+                return visitor(nullptr);
+        }
+    }
+
 
 
-    /// Pair in a JSON Object
-    class Pair {
+    /**
+     * Storage behind ADAPTIVE objects
+     * Keeps the pairs in insertion order in a small vector, the first few live inline without any allocation.
+     * Once the object grows past the threshold, a compact hash index over the vector is built for O(1) lookups.
+     * INDEXED objects use the same storage, but keep the index from the first pair on.
+     */
+    class AdaptiveStorage {
     public:
 
-        /// Constructor with key and value
-        Pair(std::string , Element);
+        /// Key/value pair as stored in the vector
+        using Entry = std::pair<std::string, Element>;
 
-        /// Getter for key
-        const std::string &getKey() const;
+        /// Amount of pairs stored inline
+        static const uint32_t inlineCapacity = 4;
 
-        /// Getter vor value
-        const Element &getValue() const;
+        /**
+         * Constructor, allocates from the given resource once the inline pairs are used up
+         * @param indexed true to always keep the hash index, regardless of the threshold
+         */
+        explicit AdaptiveStorage(MemoryResource *resource, bool indexed = false);
 
-    private:
+        /// Deep copies the given storage into the given resource
+        AdaptiveStorage(const AdaptiveStorage &other, MemoryResource *resource);
 
-        std::string key;
-        Element value;
+        AdaptiveStorage(const AdaptiveStorage &) = delete;
 
-    };
+        AdaptiveStorage &operator=(const AdaptiveStorage &) = delete;
 
+        /// Destructor, cleans up the pairs and the index
+        ~AdaptiveStorage();
 
+        /// @return the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const char *key, size_t length) const;
 
-    namespace Utils {
+        /// Same as above, with the precomputed Utils::hash of the key
+        Element *lookup(const char *key, size_t length, uint64_t hash) const;
 
-        /// Indents the given string with the given indentation (in spaces)
-        std::string indent(const std::string &json, int indentation);
+        /// Appends a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
 
-        /// Returns the string representation of a double, without any trailing zeroes after the comma
-        std::string doubleToString(const double&);
+        /// Makes room for at least the given amount of pairs
+        void reserve(size_t pairs);
 
-    }
+        /// Removes the pair with the given key, keeps the order of the others
+        void remove(const char *key, size_t length);
 
+        /// Removes all pairs
+        void clear();
 
+        /// @return amount of pairs
+        size_t size() const;
 
-    /// Runtime JSON parsing exception
-    class ParseException : public std::runtime_error {
-    public:
+        /// Iteration over the pairs, in insertion order
+        Entry *begin() const;
 
-        explicit ParseException(const std::string &message, const std::string &json, size_t pos)
-                : std::runtime_error(craftMessage(message, json, pos)) {}
+        Entry *end() const;
 
-        static std::string craftMessage(const std::string &message, const std::string &json, size_t pos) {
-            int line = 1;
-            int lineStart = 0;
-            for (int i = 0; i < pos; i++) {
-                if (json[i] == '\n') {
-                    line++;
-                }
-            }
-            return "Error on Line " + std::to_string(line) + ": " + message;
-        }
+        /// Amount of pairs above which objects build a hash index
+        static size_t getThreshold();
 
-        friend class Parser;
+        /// Setter for the threshold, only affects objects that grow afterwards
+        static void setThreshold(size_t threshold);
 
-    };
+    private:
 
+        /// Slot in the hash index, position is one based so zero marks an empty slot
+        struct Slot {
+            uint32_t hash;
+            uint32_t position;
+        };
 
+        /// @return position of the pair with the given key, count if not present
+        uint32_t position(const char *key, size_t length) const;
 
-    namespace Utils {
+        /// Position lookup through the hash index, which must exist
+        uint32_t probe(const char *key, size_t length, uint64_t hash) const;
 
-        std::string fileToString(const std::string &fileName) {
-            std::ifstream in(fileName);
-            if (not in.good()) {
-                throw ParseException("Couldn't open " + fileName, "", 0);
-            }
-            std::ostringstream stream;
-            stream << in.rdbuf();
-            return stream.str();
-        }
+        /// Position lookup by comparing every key
+        uint32_t scan(const char *key, size_t length) const;
 
-    }
+        /// Makes room for at least the given amount of pairs
+        void grow(uint32_t wanted);
 
+        /// (Re)builds the hash index with the given amount of slots, a power of two
+        void buildIndex(uint32_t slots);
 
+        /// Adds the pair at the given position to the index
+        void addToIndex(uint32_t entry, uint64_t hash);
 
-    /**
-     * Parses a given string into a json element (object, array, int,...)
-     * @param json string
-     * @return JSON Element, use appropriate getter to get the value
-     */
-    Element parse(const std::string& json);
+        /// Destroys all pairs and releases the index
+        void destroy();
 
-    /**
-     * @param fileName the name of the file
-     * @return JSON Element parsed from file
-     */
-    Element parseFile(const std::string& fileName);
+        /// Pairs in insertion order, either the inline ones or allocated from the resource
+        Entry *entries;
 
+        /// Amount of pairs
+        uint32_t count;
 
-    /**
-     * Main Parser class
-     * Can parse any JSON string.
-     * Base class for all other parsers such as ObjectParser etc
-     */
-    class Parser {
-    public:
+        /// Amount of pairs that fit in entries
+        uint32_t capacity;
 
-        /// Constructor, stores the reference of a JSON string
-        explicit Parser(const std::string& str) : Parser(str, 0, str.size()) {}
+        /// Hash index, nullptr as long as the object is small
+        Slot *index;
 
-        /// Constructor, takes JSON but also the start and end positions (end position is not including)
-        Parser(const std::string& str, size_t start, size_t end) : json(str), index(start), endIndex(end) {}
+        /// Amount of slots in the index minus one
+        uint32_t indexMask;
 
-        /// Parses the stored json
-        virtual Element parse();
+        /// Memory resource for the pairs and the index
+        MemoryResource *resource;
 
-    protected:
+        /// True if the index is kept regardless of the threshold
+        bool indexed;
 
-        /**
-         *  Returns true if end of parsing is reached
-         *  This also includes being positioned on the last char of the json
-         */
-        bool endOfParsing() const;
+        /// Storage for the inline pairs
+        alignas(Entry) unsigned char inlineEntries[inlineCapacity * sizeof(Entry)];
 
-        /**
-         * Finds the given symbol in the json, starting from the current position
-         * Skips any element such as an object, array or string
-         * @return the index of the symbol
-         */
-        size_t findIndexAfterElement(char symbol);
+        /// Global threshold
+        static std::atomic<size_t> threshold;
 
-        /// Throws a parsing exception with a given message
-        void throwException(const std::string& msg) const;
+    };
 
-        /// Returns the stored json
-        const std::string& getJson() const;
 
-        /// Remaining characters in the json, includes the current position
-        size_t remainingSize() const;
 
-        /// Returns the current position/index
-        size_t currentPosition() const;
+    /**
+     * Storage behind FLAT_HASHMAP objects
+     * Open addressing hash table in the style of SwissTable: keys and values are stored inline in one array,
+     * next to an array of control bytes holding 7 bits of the hash of every slot.
+     * Lookups compare a whole group of control bytes at once (16 with SSE2, 8 otherwise) and only touch the
+     * pairs whose control byte matches.
+     */
+    class FlatHashMap {
+    public:
 
-        /// Returns the char in the json at the current position
-        char currentSymbol() const;
+        /// Key/value pair as stored in the table
+        using Entry = std::pair<std::string, Element>;
 
-        /// Returns the last position/index (which is still part of the json)
-        size_t lastPosition() const;
+        /// Forward iterator over the pairs, in no particular order
+        class Iterator {
+        public:
 
-        /// Incrementer for the position
-        void incrementPosition();
+            Iterator(const int8_t *control, Entry *slot, const int8_t *end);
 
-        /// Setter for the position
-        void setPosition(size_t pos);
+            Entry &operator*() const;
 
-        /// Trims any whitespace at the end by adjusting the endIndex/lastPosition
-        void trimEndWhitespace();
+            Entry *operator->() const;
 
-        /// Moves the position to the first element that is not whitespace
-        void moveToNonEmptyPosition();
+            Iterator &operator++();
 
-        /// Trims the whitespace around the element
-        void trim();
+            bool operator==(const Iterator &other) const;
 
-    private:
+            bool operator!=(const Iterator &other) const;
 
-        /// Reference to the json string parsed
-        const std::string& json;
+        private:
 
-        /// Current index in the json
-        size_t index;
+            /// Skips slots that don't hold a pair
+            void skipEmpty();
 
-        /// One after the last index of the json
-        size_t endIndex;
+            const int8_t *control;
+            Entry *slot;
+            const int8_t *end;
 
-    };
+        };
 
+        /// Constructor, the table is allocated from the given resource on the first insert
+        explicit FlatHashMap(MemoryResource *resource);
 
+        /// Deep copies the given table into the given resource
+        FlatHashMap(const FlatHashMap &other, MemoryResource *resource);
 
-    /// Parses JSON arrays
-    class ArrayParser: public Parser {
-    public:
+        FlatHashMap(const FlatHashMap &) = delete;
 
-        ArrayParser(const std::string& str, size_t start, size_t end) : Parser(str, start, end) {}
+        FlatHashMap &operator=(const FlatHashMap &) = delete;
 
-        Element parse() override;
+        /// Destructor, cleans up the pairs and the table
+        ~FlatHashMap();
 
-    protected:
+        /// @return the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const char *key, size_t length) const;
 
-        void checkArraySemantics();
+        /// Same as above, with the precomputed Utils::hash of the key
+        Element *lookup(const char *key, size_t length, uint64_t hash) const;
 
-    };
+        /// Inserts a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
 
+        /// Makes room for at least the given amount of pairs without growing
+        void reserve(size_t pairs);
 
+        /// Removes the pair with the given key
+        void remove(const char *key, size_t length);
 
-    /// Parses integers and doubles
-    class NumberParser : public Parser {
-    public:
+        /// Removes all pairs, keeps the table
+        void clear();
+
+        /// @return amount of pairs
+        size_t size() const;
 
-        NumberParser(const std::string &str, size_t start, size_t end) : Parser(str, start, end) {}
+        Iterator begin() const;
 
-        Element parse() override;
+        Iterator end() const;
 
-    public:
+    private:
 
-        double parseNumber(const std::string& str);
+        /// Control byte of an empty slot
+        static const int8_t empty = -128;
 
-    };
+        /// Control byte of a slot whose pair was removed
+        static const int8_t deleted = -2;
 
+        /// Allocates a table with the given amount of slots (a multiple of the group width) and moves all pairs to it
+        void rehash(size_t slots);
 
+        /// @return slot of the pair with the given key and hash, nullptr if not present
+        Entry *findSlot(const char *key, size_t length, uint64_t hash) const;
 
-    /// Parses JSON objects
-    class ObjectParser: public Parser {
-    public:
+        /// @return index of a free slot for the given hash
+        size_t findFreeSlot(uint64_t hash) const;
 
-        ObjectParser(const std::string& str, size_t start, size_t end) : Parser(str, start, end) {}
+        /// Size in bytes of the control bytes of a table with the given amount of slots
+        static size_t controlBytes(size_t slots);
 
-        Element parse() override;
+        /// Destroys all pairs and releases the table
+        void destroy();
 
-    protected:
+        /// Control bytes, one per slot
+        int8_t *control;
 
-        std::string extractKeyAndAdjustIndex();
+        /// The pairs, only those with a non negative control byte are constructed
+        Entry *slots;
+
+        /// Amount of slots, zero or a multiple of the group width
+        size_t capacity;
 
-        void checkForDoublePointAndAdjustIndex();
+        /// Amount of pairs
+        size_t count;
 
-        void checkObjectSemantics();
+        /// Amount of pairs that can be added before the table has to grow, deleted slots count as used
+        size_t growthLeft;
+
+        /// Memory resource for the table
+        MemoryResource *resource;
 
     };
 
 
 
     /**
-     * Parses JSON strings
-     * Mainly checks if they adhere to the standard
+     * Key sequence shared by all SHAPED objects that have the same keys in the same order
+     * A shape never changes: adding a key moves the object to the next shape, found through the transitions.
+     * Every shape stores only the key it adds and points to its parent for the others, the objects only store their
+     * values. The table of all keys and the lookup index are built when the shape is first searched.
+     * Shapes are allocated from the memory resource of the objects that use them, and only shared between objects
+     * of the same resource. They are reference counted and can be used from multiple threads: existing transitions
+     * are found without locking, each shape has a mutex for adding and removing its own transitions.
      */
-    class StringParser : public Parser {
+    class Shape {
     public:
 
-        StringParser(const std::string &str, size_t start, size_t end) : Parser(str, start, end) {}
+        /// @return the shape without any keys, which is never destroyed
+        static Shape *root();
 
-        Element parse() override;
+        /**
+         * @return the shape with the keys of this one followed by the given key, which must not be present yet
+         * A shape that has to be created is allocated from the given resource. The caller owns a reference to it
+         */
+        Shape *extend(const std::string &key, MemoryResource *resource);
 
-    protected:
+        /// Same as above, moves the key into the shape if it has to be created
+        Shape *extend(std::string &&key, MemoryResource *resource);
 
-        bool isValidString();
+        /// @return position of the given key, size() if not present
+        uint32_t find(const char *key, size_t length) const;
 
-        bool isHexadecimalCorrect();
+        /// Same as above, with the precomputed Utils::hash of the key
+        uint32_t find(const char *key, size_t length, uint64_t hash) const;
 
-        bool isEscapedPartCorrect();
+        /// @return key at the given position
+        const std::string &getKey(uint32_t position) const;
 
-    };
+        /// @return amount of keys
+        uint32_t size() const;
 
+        /// @return memory resource of the shape, the default one for the root
+        MemoryResource *getResource() const;
 
+        /// Adds a reference to the shape
+        void acquire();
 
-Element::Element() : type(UNINITIALIZED) {}
+        /// Removes a reference, the shape is destroyed once the last one is gone
+        void release();
 
-std::string Element::toString(unsigned int ind) const {
-    switch (type) {
-        case INTEGER:
-            return std::to_string(*data.number);
-        case BOOLEAN:
-            if (data.boolean) return "true";
-            else return "false";
-        case FRACTION:
-            return Utils::doubleToString(*data.fraction);
-        case OBJECT:
-            return data.object->toString(ind);
-        case STRING:
-            return "\"" + *data.string + "\"";
-        case ARRAY: {
-            std::string arrayElements = "[";
-            for (size_t i = 0; i < data.array->size(); i++) {
-                arrayElements += data.array->at(i).toString();
-                if (i != data.array->size() - 1) arrayElements += ", ";
-            }
-            arrayElements += "]";
-            if (ind) return Utils::indent(arrayElements, ind);
-            return arrayElements;
-        }
-        case JSON_NULL:
-            return "null";
-        case UNINITIALIZED:
-            return "UNINITIALIZED";
-    }
-}
+    private:
 
+        /// Slot in the hash index, position is one based so zero marks an empty slot
+        struct Slot {
+            uint32_t hash;
+            uint32_t position;
+        };
 
-Element &Element::operator=(int num) {
-    reset();
-    setNumber(num);
-    return *this;
-}
+        /// All keys in order and the hash index over them
+        struct Table {
+            explicit Table(MemoryResource *resource) : keys(resource), index(resource) {}
 
-Element &Element::operator=(double fraction) {
-    reset();
-    setFraction(fraction);
-    return *this;
-}
+            std::vector<const std::string *, Allocator<const std::string *>> keys;
+            std::vector<Slot, Allocator<Slot>> index;
+        };
 
-Element &Element::operator=(const Object &obj) {
-    reset();
-    setObject(obj);
-    return *this;
-}
+        /// Open addressing table of the shapes with one more key, replaced by a larger one when half full
+        struct Transitions {
+            Transitions(uint32_t capacity, MemoryResource *resource) : slots(capacity, resource), used(0) {}
 
-Element &Element::operator=(const std::string &string) {
-    reset();
-    setString(string);
-    return *this;
-}
+            /// Child shapes, nullptr for a free slot and the owning shape itself for a removed one
+            std::vector<std::atomic<Shape *>, Allocator<std::atomic<Shape *>>> slots;
 
-Element &Element::operator=(const std::vector<Element> &arr) {
-    reset();
-    setArray(arr);
-    return *this;
-}
+            /// Slots that are not free, removed ones included
+            uint32_t used;
+        };
 
-Element &Element::operator=(bool boolean) {
-    reset();
-    setBoolean(boolean);
-    return *this;
-}
+        /// Constructor for the root shape
+        Shape();
 
-Element &Element::operator=(const char *c_string) {
-    reset();
-    setString(c_string);
-    return *this;
-}
+        /// Constructor for a shape that adds one key, with the given Utils::hash, to its parent
+        Shape(Shape *parent, std::string key, uint64_t hash, MemoryResource *resource);
 
-Element& Element::operator[](const std::string &str) {
-    if (type == OBJECT) {
-        return data.object->operator[](str);
-    }
-    throw TypeException("Invalid use of operator[](const char*), element is not a json object.");
-}
+        Shape(const Shape &) = delete;
 
-void Element::setNumber(int number) {
-    Element::data.number = new int(number);
-    type = INTEGER;
-}
+        Shape &operator=(const Shape &) = delete;
 
-void Element::setBoolean(bool boolean) {
-    Element::data.boolean = boolean;
-    type = BOOLEAN;
-}
+        /// Destructor, only called once the last reference is gone
+        ~Shape();
 
-void Element::setFraction(double fraction) {
-    Element::data.fraction = new double(fraction);
-    type = FRACTION;
-}
+        /// Destroys the given shape and gives its memory back to its resource
+        static void destroy(Shape *shape);
 
-void Element::setObject(const Object& object) {
-    Element::data.object = new Object(object);
-    type = OBJECT;
-}
+        /**
+         * @return the shape in the transitions with the given key and resource with a reference for the caller,
+         * nullptr if none. Doesn't need the transitions mutex
+         */
+        Shape *acquireTransition(const std::string &key, uint64_t hash, MemoryResource *resource);
 
-void Element::setString(const std::string &string) {
-    Element::data.string = new std::string(string);
-    type = STRING;
-}
+        /// @return a new shape in the transitions with the given key, the caller holds the mutex and owns the reference
+        Shape *addTransition(std::string &&key, uint64_t hash, MemoryResource *resource);
 
-void Element::setArray(const std::vector<Element> &array) {
-    Element::data.array = new std::vector<Element>(array);
-    type = ARRAY;
-}
+        /// Removes the given child from the transitions, the caller holds the mutex
+        void removeTransition(Shape *child);
 
-int Element::getInt() const {
-    checkType(INTEGER);
-    return *data.number;
-}
+        /// Waits until every search of the transitions that may have seen a removed slot is done
+        void waitForReaders();
 
-double Element::getDouble() const {
-    checkType(FRACTION);
-    return *data.fraction;
-}
+        /// Adds a reference unless the last one is already gone, @return true if it was added
+        bool tryAcquire();
 
-std::string& Element::getString() const {
-    checkType(STRING);
-    return *data.string;
-}
+        /// @return the table of this large shape, built by the first caller
+        const Table &getTable() const;
 
-bool Element::getBool() const {
-    checkType(BOOLEAN);
-    return data.boolean;
-}
+        /// The key added by this shape, empty for the root
+        std::string key;
 
-Object& Element::getObject() const {
-    checkType(OBJECT);
-    return *data.object;
-}
+        /// Utils::hash of the key
+        uint64_t hash;
 
-Array& Element::getArray() const {
-    checkType(ARRAY);
-    return *data.array;
-}
+        /// Amount of keys, the position of the own key plus one
+        uint32_t count;
 
-Type Element::getType() const {
-    return type;
-}
+        /// Shape without the last key, holds a reference
+        Shape *parent;
 
-void Element::checkType(Type castType) const {
-    if (type != castType) {
-        throw TypeException(type, castType);
-    }
-}
+        /// Memory resource of the shape, its table and its transitions
+        MemoryResource *resource;
 
-Element::Element(const std::string &string) {
+        /// Table for shapes with more keys than can be scanned, nullptr until it is needed
+        mutable std::atomic<const Table *> table;
+
+        /// Shapes with one more key, nullptr until the first one is added. Replaced and changed under the mutex
+        std::atomic<Transitions *> transitions;
+
+        /// Guards changes to the transitions and the last release of the shapes in them
+        std::mutex transitionsMutex;
+
+        /// Searches of the transitions in progress, per phase, see waitForReaders
+        std::atomic<uint32_t> readers[2];
+
+        /// Phase that new searches count themselves in
+        std::atomic<uint32_t> readerPhase;
+
+        /// Amount of objects and shapes that refer to this one
+        std::atomic<size_t> references;
+
+    };
+
+
+
+    /**
+     * Storage behind SHAPED objects
+     * Refers to a Shape for the keys and their index and only stores the values, in the order of the keys.
+     * Objects that grow past maxShapeKeys switch to a dictionary: an indexed AdaptiveStorage of their own.
+     */
+    class ShapedStorage {
+    public:
+
+        /// Objects with more keys than this stop sharing shapes
+        static const uint32_t maxShapeKeys = 64;
+
+        /// Constructor, allocates the values from the given resource
+        explicit ShapedStorage(MemoryResource *resource);
+
+        /// Deep copies the given storage into the given resource, the shape is shared within the same resource
+        ShapedStorage(const ShapedStorage &other, MemoryResource *resource);
+
+        ShapedStorage(const ShapedStorage &) = delete;
+
+        ShapedStorage &operator=(const ShapedStorage &) = delete;
+
+        /// Destructor, cleans up the values and releases the shape
+        ~ShapedStorage();
+
+        /// @return the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const char *key, size_t length) const;
+
+        /// Same as above, with the precomputed Utils::hash of the key
+        Element *lookup(const char *key, size_t length, uint64_t hash) const;
+
+        /// Appends a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
+
+        /// Makes room for at least the given amount of values
+        void reserve(size_t pairs);
+
+        /// Removes the pair with the given key, keeps the order of the others
+        void remove(const char *key, size_t length);
+
+        /// Removes all pairs, a dictionary object goes back to sharing shapes
+        void clear();
+
+        /// @return amount of pairs
+        size_t size() const;
+
+        /// @return the shared shape, nullptr once the object uses a dictionary
+        const Shape *getShape() const;
+
+        /// @return the values in the order of the keys of the shape
+        Element *getValues() const;
+
+        /// @return the dictionary, nullptr as long as the object shares shapes
+        AdaptiveStorage *getDictionary() const;
+
+    private:
+
+        /// Makes room for at least the given amount of values
+        void grow(uint32_t wanted);
+
+        /// Moves all pairs to a dictionary
+        void toDictionary();
+
+        /// Destroys the values and the dictionary
+        void destroy();
+
+        /// @return shape for this resource with the keys of the given one, except the skipped position, with a reference
+        Shape *buildShape(const Shape &keys, uint32_t skipped) const;
+
+        /// Shape of the object, holds a reference
+        Shape *shape;
+
+        /// Values, as many as the shape has keys
+        Element *values;
+
+        /// Amount of values that fit in the values
+        uint32_t capacity;
+
+        /// Storage for objects with too many keys
+        AdaptiveStorage *dictionary;
+
+        /// Memory resource for the values and the dictionary
+        MemoryResource *resource;
+
+    };
+
+
+
+    /// References to the key and value of a pair in an Object, nothing is copied
+    template <typename Value>
+    class Member {
+    public:
+
+        /// Constructor with key and value
+        Member(const std::string *key, Value *value);
+
+        /// Getter for key
+        const std::string &getKey() const;
+
+        /// Getter for value, mutable when iterating a non const object
+        Value &getValue() const;
+
+    private:
+
+        template <typename> friend class ObjectIterator;
+
+        const std::string *key;
+        Value *value;
+
+    };
+
+    /**
+     * Forward iterator over the pairs of an Object, for every storage type
+     * Skips uninitialized elements, the order is the order of the storage
+     * Adding or removing pairs invalidates the iterators
+     */
+    template <typename Value>
+    class ObjectIterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Member<Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Member<Value> *;
+        using reference = const Member<Value> &;
+
+        /**
+         * Constructor, points to the first pair of the object or past the last one
+         * @param uninitialized true to yield the uninitialized elements as well
+         */
+        ObjectIterator(const Object &object, bool end, bool uninitialized = false);
+
+        reference operator*() const;
+
+        pointer operator->() const;
+
+        ObjectIterator &operator++();
+
+        ObjectIterator operator++(int);
+
+        bool operator==(const ObjectIterator &other) const;
+
+        bool operator!=(const ObjectIterator &other) const;
+
+    private:
+
+        /// Points the member to the current position, or to nothing once the end is reached
+        void load();
+
+        /// Moves to the next position of the storage
+        void advance();
+
+        /// Object that is iterated
+        const Object *object;
+
+        /// Current pair
+        Member<Value> member;
+
+        /// True if uninitialized elements are not skipped
+        bool uninitialized;
+
+        /// Position in VECTOR, ADAPTIVE and INDEXED objects, and in SHAPED objects that use a dictionary
+        std::pair<std::string, Element> *entry;
+        std::pair<std::string, Element> *entryEnd;
+
+        /// Position in MAP objects
+        Object::MapStorage::iterator mapPosition;
+
+        /// Position in HASHMAP objects
+        Object::HashmapStorage::iterator hashmapPosition;
+
+        /// Position in FLAT_HASHMAP objects
+        FlatHashMap::Iterator flatPosition;
+
+        /// Position in SHAPED objects that share a shape
+        uint32_t shapedPosition;
+
+    };
+
+    /// Iterator over the keys of an Object
+    class KeyIterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string *;
+        using reference = const std::string &;
+
+        explicit KeyIterator(ObjectIterator<const Element> position);
+
+        reference operator*() const;
+
+        KeyIterator &operator++();
+
+        bool operator==(const KeyIterator &other) const;
+
+        bool operator!=(const KeyIterator &other) const;
+
+    private:
+
+        ObjectIterator<const Element> position;
+
+    };
+
+    /// Iterator over the values of an Object
+    template <typename Value>
+    class ValueIterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Element;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value *;
+        using reference = Value &;
+
+        explicit ValueIterator(ObjectIterator<Value> position);
+
+        reference operator*() const;
+
+        pointer operator->() const;
+
+        ValueIterator &operator++();
+
+        bool operator==(const ValueIterator &other) const;
+
+        bool operator!=(const ValueIterator &other) const;
+
+    private:
+
+        ObjectIterator<Value> position;
+
+    };
+
+    /// Pair of iterators that can be used in a range based for loop
+    template <typename Iterator>
+    class ObjectRange {
+    public:
+
+        ObjectRange(Iterator first, Iterator last);
+
+        Iterator begin() const;
+
+        Iterator end() const;
+
+    private:
+
+        Iterator first;
+        Iterator last;
+
+    };
+
+
+
+    /**
+     * Read only snapshot of an Object, see Object::freeze
+     * The pairs are stored in one contiguous array, placed by a minimal perfect hash that is built when freezing.
+     * Every lookup is a single probe: one displacement, one slot and one key comparison.
+     * The pairs can't be changed afterwards, so lookups, iteration and writing the frozen object itself can be done
+     * from multiple threads without locking. Writing it never fills the caches of WriteOptions::cacheFragments.
+     * Nested objects are only reachable as const, but still cache their json when written on their own with
+     * cacheFragments, so do that from one thread at a time. Hashing them from multiple threads is safe.
+     */
+    class FrozenObject {
+    public:
+
+        /// Key/value pair as stored in the array
+        using Entry = std::pair<std::string, Element>;
+
+        /**
+         * Constructor
+         * Deep copies all initialized pairs of the object into the given resource
+         * Building the hash takes linear time on average
+         */
+        explicit FrozenObject(const Object &object, MemoryResource *resource = defaultResource());
+
+        /// Move constructor, the temp object is left empty
+        FrozenObject(FrozenObject &&) noexcept;
+
+        FrozenObject(const FrozenObject &) = delete;
+
+        FrozenObject &operator=(const FrozenObject &) = delete;
+
+        FrozenObject &operator=(FrozenObject &&) = delete;
+
+        /// Destructor, cleans up the pairs and the tables
+        ~FrozenObject();
+
+        /// @return pointer to the element with the given key, nullptr if not present
+        const Element *find(const std::string &key) const;
+
+        /// Same as above, but takes a c string
+        const Element *find(const char *key) const;
+
+#if __cplusplus >= 201703L
+
+        /// Same as above, but takes a string view (C++17 only)
+        const Element *find(std::string_view key) const;
+
+#endif
+
+        /// @return true if the pair with the given key exists
+        bool exists(const std::string &key) const;
+
+        /// @return amount of pairs
+        size_t size() const;
+
+        /// @return true if there are no pairs
+        bool empty() const;
+
+        /// Iteration over the pairs, in the order of the hash
+        const Entry *begin() const;
+
+        const Entry *end() const;
+
+        /**
+         * @param indent the wanted indentation (in spaces)
+         * @return string representation of the object
+         */
+        std::string toString(unsigned int indent = 0) const;
+
+        /// @return json with the given layout, see Writer
+        std::string toString(const WriteOptions &options) const;
+
+        /// Getter for the memory resource of the pairs and the tables
+        MemoryResource *getResource() const;
+
+    private:
+
+        /// @return the element with the given characters as key, nullptr if not present
+        const Element *lookup(const char *key, size_t length) const;
+
+        /// Slot of the key with the given hash
+        uint32_t slot(uint64_t hash) const;
+
+        /// Pairs, placed at the slot the hash gives them
+        Entry *entries;
+
+        /**
+         * One displacement per bucket of keys
+         * Positive values are mixed into the hash of the keys of the bucket to get their slot,
+         * negative values directly hold the slot (minus one) of a bucket with a single key
+         * nullptr if no seed placed the keys, the pairs are then kept in their order and scanned
+         */
+        int32_t *displacements;
+
+        /// Amount of pairs, slots and buckets
+        uint32_t count;
+
+        /// Seed for hashing the keys and picking the bucket, changed when no displacements are found
+        uint64_t seed;
+
+        /// Memory resource for the pairs and the tables
+        MemoryResource *resource;
+
+    };
+
+
+
+    /**
+     * Collects the pairs of an Object and creates it in one go
+     * Adding a pair is a plain append, without any lookup. The object is only built once all pairs are known,
+     * so its storage is allocated with the right size right away.
+     */
+    class ObjectBuilder {
+    public:
+
+        /**
+         * Constructor
+         * @param storage the storage type of the built object
+         * @param resource the memory resource of the built object and every value added to it
+         */
+        explicit ObjectBuilder(Storage storage = HASHMAP, MemoryResource *resource = defaultResource());
+
+        /// Makes room for the given amount of pairs
+        void reserve(size_t pairs);
+
+        /**
+         * Appends a pair, the value is moved if it uses the resource of the builder and copied otherwise
+         * If a key is added more than once, the object gets the last value at the position of the first key
+         */
+        void add(std::string key, Element value);
+
+        /// @return amount of pairs added since the last build
+        size_t size() const;
+
+        /// Creates the object with all added pairs, the builder is empty afterwards
+        Object build();
+
+    private:
+
+        /// Merges pairs with the same key into the first one of them
+        void removeDuplicates();
+
+        /// Pairs in the order they were added
+        std::vector<std::pair<std::string, Element>> pairs;
+
+        /// Storage type of the built object
+        Storage storage;
+
+        /// Memory resource for the values and the built object
+        MemoryResource *resource;
+
+    };
+
+
+
+    /// Collects the elements of an Array and hands it over in one go, the counterpart of the ObjectBuilder
+    class ArrayBuilder {
+    public:
+
+        /// Constructor, the built array and every element added to it use the given resource
+        explicit ArrayBuilder(MemoryResource *resource = defaultResource());
+
+        /// Makes room for the given amount of elements
+        void reserve(size_t elements);
+
+        /// Appends an element, moved if it uses the resource of the builder and copied otherwise
+        void add(Element element);
+
+        /// @return amount of elements added since the last build
+        size_t size() const;
+
+        /// Hands over the array with all added elements, the builder is empty afterwards
+        Array build();
+
+    private:
+
+        /// Elements in the order they were added
+        Array array;
+
+    };
+
+
+
+    /// Forward declaration
+    class Element;
+
+    /// Invalid JSON Pointer, or a pointer that doesn't resolve
+    class PathException : public std::runtime_error {
+    public:
+
+        explicit PathException(const std::string &message) : std::runtime_error(message) {}
+
+    };
+
+    /**
+     * Compiled JSON Pointer (RFC 6901), such as "/users/3/name"
+     * The pointer is parsed once: every key is unescaped and hashed up front, and every array index is converted.
+     * Resolving it walks the elements with a single lookup per level and never allocates. ADAPTIVE, INDEXED,
+     * FLAT_HASHMAP and SHAPED objects use the hash of the key from the path, HASHMAP objects hash it again.
+     */
+    class Path {
+    public:
+
+        /**
+         * Constructor, compiles the given pointer
+         * The empty pointer refers to the whole document, any other pointer starts with '/'
+         * Throws a PathException if the pointer is malformed
+         */
+        explicit Path(const std::string &pointer);
+
+        /// @return the element the path refers to, nullptr if it does not exist
+        Element *resolve(Element &root) const;
+
+        /// Same as above, const version
+        const Element *resolve(const Element &root) const;
+
+        /// @return amount of reference tokens
+        size_t size() const;
+
+        /// @return the pointer the path was compiled from
+        const std::string &toString() const;
+
+    private:
+
+        /// Reference token of the pointer
+        struct Token {
+            /// Unescaped key, used when the token is applied to an object
+            std::string key;
+
+            /// Hash of the key
+            uint64_t hash;
+
+            /// Index, used when the token is applied to an array; npos if the token is not a valid index
+            size_t index;
+        };
+
+        /// Resolves the path, marks the objects on the way as changed if the result may be changed
+        Element *walk(const Element &root, bool changing) const;
+
+        /// The original pointer
+        std::string pointer;
+
+        /// Tokens of the pointer, in order
+        std::vector<Token> tokens;
+
+    };
+
+
+
+    /**
+     * Hash index over an Array, from the value of a field of its elements to the elements that have that value
+     * The field is given as a JSON Pointer relative to every element, such as "/customer/id".
+     * Strings, numbers, booleans and null are indexed; numbers compare by value, so 3 finds 3.0 as well.
+     * Elements appended to the array are indexed by the next lookup, other changes to the array need a rebuild.
+     * The array must outlive the index, any amount of indexes can refer to the same array.
+     */
+    class ArrayIndex {
+    public:
+
+        /// Iterates the elements with the same value, in the order of the array
+        class Iterator {
+        public:
+
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = const Element;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Element *;
+            using reference = const Element &;
+
+            Iterator(const ArrayIndex *index, uint32_t position);
+
+            reference operator*() const;
+
+            pointer operator->() const;
+
+            Iterator &operator++();
+
+            Iterator operator++(int);
+
+            bool operator==(const Iterator &other) const;
+
+            bool operator!=(const Iterator &other) const;
+
+        private:
+
+            const ArrayIndex *index;
+
+            uint32_t position;
+
+        };
+
+        /// Elements with the same value, see findAll
+        class Range {
+        public:
+
+            Range(const ArrayIndex *index, uint32_t first);
+
+            Iterator begin() const;
+
+            Iterator end() const;
+
+            bool empty() const;
+
+        private:
+
+            const ArrayIndex *index;
+
+            uint32_t first;
+
+        };
+
+        /// Constructor, indexes the array on the field with the given JSON Pointer
+        ArrayIndex(const Array &array, const std::string &pointer);
+
+        /// Constructor, indexes the array on the field the given path refers to
+        ArrayIndex(const Array &array, Path path);
+
+        /// @return the first element whose field has the given value, nullptr if there is none
+        const Element *find(const Element &value);
+
+        /// @return all elements whose field has the given value
+        Range findAll(const Element &value);
+
+        /// @return amount of elements whose field has the given value
+        size_t count(const Element &value);
+
+        /// Indexes the elements appended to the array since the last lookup
+        void update();
+
+        /// Indexes the whole array again, needed after elements were changed, inserted or removed
+        void rebuild();
+
+        /// @return the path of the indexed field
+        const Path &getPath() const;
+
+    private:
+
+        /// Position that marks the end of a chain
+        static const uint32_t none = UINT32_MAX;
+
+        /// First and last position of the elements with the same value
+        struct Chain {
+            uint32_t first;
+            uint32_t last;
+        };
+
+        struct KeyHash {
+            size_t operator()(const std::string &key) const;
+        };
+
+        /// @return the chain of the given value, nullptr if no element has it
+        const Chain *lookup(const Element &value);
+
+        /// The indexed array
+        const Array *array;
+
+        /// Path of the indexed field
+        Path path;
+
+        /// Chains of positions per value, the value is encoded together with its type
+        std::unordered_map<std::string, Chain, KeyHash> chains;
+
+        /// Next position with the same value for every indexed position
+        std::vector<uint32_t> next;
+
+    };
+
+    /// @return an index over the array on the field with the given JSON Pointer, see ArrayIndex
+    ArrayIndex buildIndex(const Array &array, const std::string &pointer);
+
+
+
+    /// Pair in a JSON Object
+    class Pair {
+    public:
+
+        /// Constructor with key and value
+        Pair(std::string , Element);
+
+        /// Getter for key
+        const std::string &getKey() const;
+
+        /// Getter vor value
+        const Element &getValue() const;
+
+    private:
+
+        std::string key;
+        Element value;
+
+    };
+
+
+
+    namespace Utils {
+
+        /// Secret key of the hash, two 64 bit words
+        typedef std::pair<uint64_t, uint64_t> HashKey;
+
+        /**
+         * Hashes the given characters with SipHash-1-3, used for the hash indexes of the Object storages
+         * Keyed with a random secret per process, so keys can't be crafted to collide without knowing it
+         */
+        uint64_t hash(const char *key, size_t length);
+
+        /// Same as above, with the given secret instead of the one of the process
+        uint64_t hash(const char *key, size_t length, const HashKey &secret);
+
+        /// Random key of the hash, picked once per process
+        const HashKey &hashKey();
+
+        /// Scrambles the bits of the given value, used to combine hashes
+        uint64_t mix(uint64_t value);
+
+        /// @return index of the lowest set bit, the mask can't be zero
+        inline size_t lowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return index;
+#else
+            return static_cast<size_t>(__builtin_ctz(mask));
+#endif
+        }
+
+    }
+
+
+
+    /// Reasons why a JSON string is rejected
+    enum ParseErrorCode {
+        PARSE_SUCCESS,
+        INVALID_VALUE,
+        NUMBER_OUT_OF_RANGE,
+        INVALID_STRING,
+        MISSING_KEY,
+        UNTERMINATED_KEY,
+        MISSING_COLON,
+        INVALID_OBJECT_START,
+        INVALID_OBJECT_END,
+        INVALID_ARRAY_START,
+        INVALID_ARRAY_END
+    };
+
+    /**
+     * Result of parsing without exceptions, see parse(const std::string&, Element&)
+     * Stores the code, the byte offset and an excerpt of the json there, the line and column are computed when they
+     * are asked for.
+     */
+    class ParseError {
+    public:
+
+        /// Constructor, no error
+        ParseError();
+
+        /// Constructor, error with the given code at the given byte offset in the json, where it reads the excerpt
+        ParseError(ParseErrorCode code, size_t offset, std::string excerpt = std::string());
+
+        /// @return true if parsing failed
+        explicit operator bool() const;
+
+        /// @return the reason of the error, PARSE_SUCCESS if there is none
+        ParseErrorCode getCode() const;
+
+        /// @return byte offset in the json where the error was found
+        size_t getOffset() const;
+
+        /// @return description of the error code
+        const char *getMessage() const;
+
+        /// @return the json at the error, the offending value for INVALID_VALUE and NUMBER_OUT_OF_RANGE
+        const std::string &getExcerpt() const;
+
+        /// @return description of the error with its excerpt, as in the message of a ParseException
+        std::string getDescription() const;
+
+        /// @return line of the error (one based), the given json must be the parsed one
+        size_t getLine(const std::string &json) const;
+
+        /// @return column of the error in bytes (one based), the given json must be the parsed one
+        size_t getColumn(const std::string &json) const;
+
+    private:
+
+        ParseErrorCode code;
+
+        size_t offset;
+
+        std::string excerpt;
+
+    };
+
+
+
+    /// Runtime JSON parsing exception
+    class ParseException : public std::runtime_error {
+    public:
+
+        explicit ParseException(const std::string &message, const std::string &json, size_t pos)
+                : std::runtime_error(craftMessage(message, json, pos)) {}
+
+        /// Constructor, from the error found while parsing the given json
+        ParseException(const ParseError &error, const std::string &json)
+                : std::runtime_error(craftMessage(error.getDescription(), json, error.getOffset())) {}
+
+        static std::string craftMessage(const std::string &message, const std::string &json, size_t pos) {
+            int line = 1;
+            int lineStart = 0;
+            for (int i = 0; i < pos; i++) {
+                if (json[i] == '\n') {
+                    line++;
+                }
+            }
+            return "Error on Line " + std::to_string(line) + ": " + message;
+        }
+
+        friend class Parser;
+
+    };
+
+
+
+    namespace Utils {
+
+        std::string fileToString(const std::string &fileName) {
+            std::ifstream in(fileName);
+            if (not in.good()) {
+                JSONMAX_THROW(ParseException("Couldn't open " + fileName, "", 0));
+            }
+            std::ostringstream stream;
+            stream << in.rdbuf();
+            return stream.str();
+        }
+
+    }
+
+
+
+    /**
+     * Parses a given string into a json element (object, array, int,...)
+     * @param json string
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result, SHAPED shares the keys of objects that have the same ones
+     * @return JSON Element, use appropriate getter to get the value
+     */
+    Element parse(const std::string& json, MemoryResource* resource = defaultResource(), Storage storage = ADAPTIVE);
+
+    /**
+     * Parses a given string into a json element without throwing
+     * @param json string
+     * @param result receives the parsed element, it is left untouched if the json is invalid
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result
+     * @return the error, evaluates to false if the json is valid
+     */
+    ParseError parse(const std::string& json, Element& result, MemoryResource* resource = defaultResource(),
+                     Storage storage = ADAPTIVE);
+
+    /**
+     * @param fileName the name of the file
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result
+     * @return JSON Element parsed from file
+     */
+    Element parseFile(const std::string& fileName, MemoryResource* resource = defaultResource(),
+                      Storage storage = ADAPTIVE);
+
+    /**
+     * Parses a given string and keeps a copy of it, every object remembers its slice of the text
+     * Objects that are not changed afterwards are written as that slice, see Writer. Only objects keep a slice:
+     * arrays and values are written from their enclosing object's slice, a top level array or value is always
+     * written afresh. An object lets go of the copy when it is changed, the copy is freed with the last one.
+     * @param json string
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result
+     * @return JSON Element parsed from the string
+     */
+    Element parseWithSource(const std::string& json, MemoryResource* resource = defaultResource(),
+                            Storage storage = ADAPTIVE);
+
+
+    /**
+     * Main Parser class
+     * Can parse any JSON string.
+     * Base class for all other parsers such as ObjectParser etc
+     */
+    class Parser {
+    public:
+
+        /// Constructor, stores the reference of a JSON string
+        explicit Parser(const std::string& str, MemoryResource* resource = defaultResource(),
+                        Storage storage = ADAPTIVE)
+                : Parser(str, 0, str.size(), resource, nullptr, nullptr, storage) {}
+
+        /**
+         * Constructor, takes JSON but also the start and end positions (end position is not including)
+         * Errors are reported to the given ParseError, which is shared by the parsers of nested elements
+         * If a source is given, it holds the json and the parsed objects keep their slice of it
+         * The parsed objects get the given storage
+         */
+        Parser(const std::string& str, size_t start, size_t end, MemoryResource* resource = defaultResource(),
+               ParseError* parseError = nullptr, const std::shared_ptr<const std::string>& _source = nullptr,
+               Storage _storage = ADAPTIVE)
+                : json(str), index(start), endIndex(end), memoryResource(resource),
+                  error(parseError ? parseError : &ownError), source(_source), storage(_storage) {}
+
+        virtual ~Parser() = default;
+
+        /// Parses the stored json, throws a ParseException if it is not valid
+        Element parse();
+
+        /// Parses the stored json into the given element, returns the error instead of throwing
+        ParseError parse(Element& result);
+
+        /// Parses the stored json, stops at the first error and reports it without throwing
+        virtual Element parseElement();
+
+    protected:
+
+        /**
+         *  Returns true if end of parsing is reached
+         *  This also includes being positioned on the last char of the json
+         */
+        bool endOfParsing() const;
+
+        /**
+         * Finds the given symbol in the json, starting from the current position
+         * Skips any element such as an object, array or string
+         * @return the index of the symbol
+         */
+        size_t findIndexAfterElement(char symbol);
+
+        /// Reports an error at the current position, the caller stops parsing
+        void fail(ParseErrorCode code);
+
+        /// @return true if an error was reported
+        bool failed() const;
+
+        /// Returns the error reported to this parser
+        ParseError* getError() const;
+
+        /// Returns the stored json
+        const std::string& getJson() const;
+
+        /// Returns the memory resource for the parsed elements
+        MemoryResource* getResource() const;
+
+        /// Returns the source kept by the parsed objects, empty if they don't keep one
+        const std::shared_ptr<const std::string>& getSource() const;
+
+        /// Returns the storage of the parsed objects
+        Storage getStorage() const;
+
+        /// Remaining characters in the json, includes the current position
+        size_t remainingSize() const;
+
+        /// Returns the current position/index
+        size_t currentPosition() const;
+
+        /// Returns the char in the json at the current position
+        char currentSymbol() const;
+
+        /// Returns the last position/index (which is still part of the json)
+        size_t lastPosition() const;
+
+        /// Incrementer for the position
+        void incrementPosition();
+
+        /// Setter for the position
+        void setPosition(size_t pos);
+
+        /// Trims any whitespace at the end by adjusting the endIndex/lastPosition
+        void trimEndWhitespace();
+
+        /// Moves the position to the first element that is not whitespace
+        void moveToNonEmptyPosition();
+
+        /// Trims the whitespace around the element
+        void trim();
+
+    private:
+
+        /// Reference to the json string parsed
+        const std::string& json;
+
+        /// Current index in the json
+        size_t index;
+
+        /// One after the last index of the json
+        size_t endIndex;
+
+        /// Memory resource for the parsed elements
+        MemoryResource* memoryResource;
+
+        /// Error of the whole parse, shared with the parsers of nested elements
+        ParseError* error;
+
+        /// Error used when no shared one is given
+        ParseError ownError;
+
+        /// Shared copy of the json for parseWithSource, empty otherwise
+        std::shared_ptr<const std::string> source;
+
+        /// Storage of the parsed objects
+        Storage storage;
+
+    };
+
+
+
+    /// Parses JSON arrays
+    class ArrayParser: public Parser {
+    public:
+
+        ArrayParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error,
+                const std::shared_ptr<const std::string>& source = nullptr, Storage storage = ADAPTIVE)
+                : Parser(str, start, end, resource, error, source, storage) {}
+
+        Element parseElement() override;
+
+    protected:
+
+        bool checkArraySemantics();
+
+    };
+
+
+
+    /// Parses integers and doubles
+    class NumberParser : public Parser {
+    public:
+
+        NumberParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error)
+                : Parser(str, start, end, resource, error) {}
+
+        Element parseElement() override;
+
+    protected:
+
+        /// Converts the element to a double, returns false and reports the error if it is not a valid number
+        bool parseNumber(double& number);
+
+    };
+
+
+
+    /// Parses JSON objects
+    class ObjectParser: public Parser {
+    public:
+
+        ObjectParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error,
+                const std::shared_ptr<const std::string>& source = nullptr, Storage storage = ADAPTIVE)
+                : Parser(str, start, end, resource, error, source, storage) {}
+
+        Element parseElement() override;
+
+    protected:
+
+        std::string extractKeyAndAdjustIndex();
+
+        bool checkForDoublePointAndAdjustIndex();
+
+        bool checkObjectSemantics();
+
+    };
+
+
+
+    /**
+     * Parses JSON strings
+     * Checks if they adhere to the standard and decodes the escape sequences, unicode escapes become UTF-8
+     */
+    class StringParser : public Parser {
+    public:
+
+        StringParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error)
+                : Parser(str, start, end, resource, error) {}
+
+        Element parseElement() override;
+
+        /**
+         * Decodes the characters between the quotation marks of a json string
+         * @return false if an escape sequence is invalid or an unescaped quotation mark is found
+         */
+        static bool unescape(const char *begin, const char *end, std::string &result);
+
+    };
+
+
+
+    /// Forward declaration
+    class QueryCompiler;
+
+    /// Invalid JSONPath expression
+    class QueryException : public std::runtime_error {
+    public:
+
+        QueryException(const std::string &message, const std::string &expression, size_t position)
+                : std::runtime_error("Invalid JSONPath '" + expression + "' at position " +
+                                     std::to_string(position) + ": " + message) {}
+
+    };
+
+    /**
+     * Compiled JSONPath expression, see compileQuery
+     * The expression is compiled into a small program: one instruction per step of the path,
+     * and a stack based bytecode for the filter expressions.
+     * Evaluating it hands every match to a callback as soon as it is found, no intermediate arrays are built.
+     * A query is immutable and can be evaluated from multiple threads at once.
+     */
+    class Query {
+    public:
+
+        /// Called for every match, in document order
+        using Callback = std::function<void(const Element &)>;
+
+        /// Evaluates the query on the given document and calls the callback for every match
+        void evaluate(const Element &root, const Callback &callback) const;
+
+        /// @return pointers to all matches, in document order
+        std::vector<const Element *> select(const Element &root) const;
+
+        /// @return the first match, nullptr if there is none (stops evaluating once it is found)
+        const Element *first(const Element &root) const;
+
+        /// @return amount of matches
+        size_t count(const Element &root) const;
+
+        /// @return the expression the query was compiled from
+        const std::string &toString() const;
+
+    private:
+
+        friend class QueryCompiler;
+
+        /// Steps of the path
+        enum Opcode : uint8_t {
+            CHILD,          // member with name operand
+            INDEX,          // array element at index first, negative counts from the end
+            WILDCARD,       // every member or array element
+            SLICE,          // array elements from first to second (exclusive) with step third
+            UNION,          // the selectors from first, second of them
+            DESCEND,        // the node itself and all its descendants
+            FILTER          // every member or array element for which the filter at operand holds
+        };
+
+        /// Filter bytecode, evaluated on a stack of operands
+        enum FilterOpcode : uint8_t {
+            PUSH_RELATIVE,  // value of path operand, relative to the current node
+            PUSH_ROOT,      // value of path operand, relative to the document
+            PUSH_CONSTANT,  // constant operand
+            EQUAL,
+            NOT_EQUAL,
+            LESS,
+            LESS_EQUAL,
+            GREATER,
+            GREATER_EQUAL,
+            NOT,
+            AND_JUMP,       // jumps to operand if the top is false, pops it otherwise
+            OR_JUMP,        // jumps to operand if the top is true, pops it otherwise
+            RETURN          // result is the top of the stack
+        };
+
+        struct Instruction {
+            Opcode opcode;
+            uint32_t operand;
+            int64_t first;
+            int64_t second;
+            int64_t third;
+        };
+
+        struct FilterInstruction {
+            FilterOpcode opcode;
+            uint32_t operand;
+        };
+
+        /// Name of a member, hashed when compiling
+        struct Name {
+            std::string key;
+            uint64_t hash;
+        };
+
+        /// Size of the operand stack, comparisons use two and && || pop the left operand before pushing the right one
+        static const size_t maxStack = 4;
+
+        /// Visits the matches, returns false to stop
+        using Visitor = std::function<bool(const Element &)>;
+
+        /// Runs the program from instruction pc on the given node, returns false once the visitor stops
+        bool run(size_t pc, const Element &node, const Element &root, const Visitor &visit) const;
+
+        /// Runs the program from instruction pc on all members or array elements of the node
+        bool runChildren(size_t pc, const Element &node, const Element &root, const Visitor &visit) const;
+
+        /// Applies a CHILD or INDEX instruction to the node, then runs the program from pc
+        bool runSelector(const Instruction &selector, size_t pc, const Element &node, const Element &root,
+                         const Visitor &visit) const;
+
+        /// Evaluates the filter starting at the given instruction on the given node
+        bool matches(uint32_t start, const Element &node, const Element &root) const;
+
+        /// The original expression
+        std::string expression;
+
+        /// Steps of the path
+        std::vector<Instruction> program;
+
+        /// Selectors of the UNION instructions
+        std::vector<Instruction> selectors;
+
+        /// Filter bytecode of all filters, each ends with RETURN
+        std::vector<FilterInstruction> filters;
+
+        /// Member names of CHILD instructions
+        std::vector<Name> names;
+
+        /// Paths used in the filters
+        std::vector<Path> paths;
+
+        /// Literals used in the filters
+        std::vector<Element> constants;
+
+    };
+
+    /**
+     * Compiles a JSONPath expression, for example "$.store.book[?(@.price < 10)].title"
+     * Supports member names (dotted and bracketed), wildcards, recursive descent (..), array indexes,
+     * slices, unions of names and indexes, and filters with comparisons, &&, || and !
+     * Throws a QueryException if the expression is not valid
+     */
+    Query compileQuery(const std::string &expression);
+
+
+
+    namespace Utils {
+
+        /// Size of a buffer that fits every output of formatDouble
+        const size_t maxDoubleLength = 32;
+
+        /// Size of a buffer that fits every output of formatInteger
+        const size_t maxIntegerLength = 12;
+
+        /**
+         * Writes the shortest digits that parse back to exactly the same double (Grisu2)
+         * The output always contains a '.' so it is parsed as a fraction again, large and small values
+         * use an exponent, such as 1.5e+300. NaN and infinity have no json representation and are written as null.
+         * Independent of the locale.
+         * @return amount of characters written to the buffer, which needs maxDoubleLength characters
+         */
+        size_t formatDouble(double value, char *buffer);
+
+        /**
+         * Writes the decimal digits of the integer
+         * @return amount of characters written to the buffer, which needs maxIntegerLength characters
+         */
+        size_t formatInteger(int value, char *buffer);
+
+    }
+
+
+
+    /// Writing to a file failed
+    class WriteException : public std::runtime_error {
+    public:
+
+        explicit WriteException(const std::string &message) : std::runtime_error(message) {}
+
+    };
+
+    /// Destination of a Writer, receives the json in blocks of characters
+    class Output {
+    public:
+
+        /// Characters that are written together with others, see writeBlocks
+        struct Block {
+            const char *data;
+            size_t size;
+        };
+
+        virtual ~Output() = default;
+
+        /// Appends the given characters
+        virtual void write(const char *data, size_t size) = 0;
+
+        /// Appends the blocks in order, the parallel chunks of a Writer are handed over this way
+        virtual void writeBlocks(const Block *blocks, size_t count);
+
+    };
+
+    /// Output that appends to a string, either its own or one supplied by the caller
+    class StringOutput : public Output {
+    public:
+
+        /// Constructor, appends to a string owned by the output
+        StringOutput();
+
+        /// Constructor, appends to the given string, which must outlive the output
+        explicit StringOutput(std::string &target);
+
+        StringOutput(const StringOutput &) = delete;
+
+        StringOutput &operator=(const StringOutput &) = delete;
+
+        void write(const char *data, size_t size) override;
+
+        /// @return the string that is appended to
+        std::string &getString();
+
+    private:
+
+        /// Used when no string is supplied
+        std::string own;
+
+        /// String that is appended to
+        std::string *target;
+
+    };
+
+    /// Output that writes to a stream, errors set the state of the stream
+    class StreamOutput : public Output {
+    public:
+
+        /// Constructor, the stream must outlive the output
+        explicit StreamOutput(std::ostream &stream);
+
+        void write(const char *data, size_t size) override;
+
+    private:
+
+        std::ostream &stream;
+
+    };
+
+    /// Output that writes to a C file, throws a WriteException if not everything could be written
+    class FileOutput : public Output {
+    public:
+
+        /// Constructor, the file stays open and must outlive the output
+        explicit FileOutput(std::FILE *file);
+
+        void write(const char *data, size_t size) override;
+
+    private:
+
+        std::FILE *file;
+
+    };
+
+#ifdef JSONMAX_POSIX
+
+    /**
+     * Output that writes to a file descriptor, throws a WriteException if writing fails
+     * Blocks are written with a single writev call where possible. POSIX only.
+     */
+    class DescriptorOutput : public Output {
+    public:
+
+        /// Constructor, the descriptor stays open
+        explicit DescriptorOutput(int descriptor);
+
+        void write(const char *data, size_t size) override;
+
+        void writeBlocks(const Block *blocks, size_t count) override;
+
+    private:
+
+        int descriptor;
+
+    };
+
+#endif
+
+
+
+    /// Forward declaration
+    class FrozenObject;
+
+    /**
+     * Serializes elements in a single traversal
+     * Characters are gathered in a fixed size buffer that is handed to the Output when full,
+     * so no intermediate strings are built for nested values.
+     */
+    class Writer {
+    public:
+
+        /// Minimal amount of values in an object or array before it is written with multiple threads
+        static const size_t parallelThreshold = 4096;
+
+        /// Constructor, the output must outlive the writer
+        explicit Writer(Output &output, WriteOptions options = WriteOptions());
+
+        Writer(const Writer &) = delete;
+
+        Writer &operator=(const Writer &) = delete;
+
+        /// Writes the element and everything it contains, then flushes
+        void write(const Element &element);
+
+        /// Same as above, for an object
+        void write(const Object &object);
+
+        /// Same as above, for a frozen object
+        void write(const FrozenObject &object);
+
+        /// Same as above, for an array
+        void write(const Array &array);
+
+        /// Hands the buffered characters to the output
+        void flush();
+
+        /**
+         * @return the exact amount of characters write would produce with the given options, nothing is written
+         * Numbers are formatted into a small stack buffer to know their width, strings are scanned for escapes.
+         */
+        static size_t serializedSize(const Element &element, const WriteOptions &options = WriteOptions());
+
+        /// Same as above, for an object
+        static size_t serializedSize(const Object &object, const WriteOptions &options = WriteOptions());
+
+        /// Same as above, for a frozen object
+        static size_t serializedSize(const FrozenObject &object, const WriteOptions &options = WriteOptions());
+
+        /// Same as above, for an array
+        static size_t serializedSize(const Array &array, const WriteOptions &options = WriteOptions());
+
+    private:
+
+        friend class StreamWriter;
+
+        /// Size of the buffer
+        static const size_t bufferSize = 4096;
+
+        /// Value of an object or array that is written in parallel, the key is nullptr for arrays
+        struct Item {
+            const std::string *key;
+            const Element *value;
+        };
+
+        void writeValue(const Element &element);
+
+        /// Writes the object, its slice of the source or its cached json with WriteOptions::cacheFragments
+        void writeObject(const Object &object);
+
+        /**
+         * @return true if the object is written as its slice of the source, see parseWithSource
+         * Only unchanged objects qualify, and only for the default layout, compact and indented json is written afresh
+         */
+        static bool usesSource(const Object &object, const WriteOptions &options);
+
+        /// @return true if the object has a cached json with the given layout
+        static bool usesCache(const Object &object, const WriteOptions &options);
+
+        /// Writes the cached json of the object, which is written and stored first if it is missing or outdated
+        void writeCachedObject(const Object &object);
+
+        /// Writes the pairs of the object into its cache, nested objects are cached as well and only referenced
+        void fillCache(const Object &object);
+
+        /// Refers to the nested object from the cache being recorded, objects without nested objects are copied
+        void recordNested(const Object &object);
+
+        /// Refers to the exposed element from the cache being recorded, its value is written again every time
+        void recordElement(const Element &element);
+
+        /// Writes the braces and the pairs of the object
+        void writeMembers(const Object &object);
+
+        /// Writes the frozen object without filling any caches of the values in it, which may be shared between threads
+        void writeFrozenObject(const FrozenObject &object);
+
+        /// Writes the braces and the pairs of the frozen object
+        void writeFrozenMembers(const FrozenObject &object);
+
+        void writeArray(const Array &array);
+
+        void writeKey(const std::string &key);
+
+        void writeString(const std::string &string);
+
+        /// @return true if an object or array with the given amount of values is split over threads
+        bool parallel(size_t values) const;
+
+        /// @return threads used for the given WriteOptions::threads, at most as many as the hardware runs at once
+        static size_t workers(unsigned int threads);
+
+        /// Writes the values and the separators between them, one chunk per thread, in order
+        void writeParallel(const std::vector<Item> &items);
+
+        /// Writes the values in the given range of the items, with a separator before all but the very first
+        void writeItems(const std::vector<Item> &items, size_t first, size_t last);
+
+        /// Writes ',' between the values of an object or array
+        void writeSeparator();
+
+        /// Size of the given value, nested at the given depth
+        static size_t measureValue(const Element &element, const WriteOptions &options, size_t depth);
+
+        static size_t measureObject(const Object &object, const WriteOptions &options, size_t depth);
+
+        static size_t measureFrozenObject(const FrozenObject &object, const WriteOptions &options, size_t depth);
+
+        static size_t measureArray(const Array &array, const WriteOptions &options, size_t depth);
+
+        static size_t measureString(const std::string &string);
+
+        /// Size of the brackets, separators and line breaks of an object or array with the given amount of values
+        static size_t measureLayout(size_t values, const WriteOptions &options, size_t depth);
+
+        /// Size of the ':' and the space after a key
+        static size_t measureKeySeparator(const WriteOptions &options);
+
+        /// Called before the first value of an object or array, starts an indented line
+        void openNesting();
+
+        /// Called after the last value of an object or array
+        void closeNesting();
+
+        /// Writes a line break and the indentation of the current depth
+        void writeLineBreak();
+
+        void append(const char *data, size_t size);
+
+        void append(char symbol);
+
+        Output &output;
+
+        WriteOptions options;
+
+        /// Line break followed by enough spaces for the deepest level so far, a prefix is written per line
+        std::string lineBreak;
+
+        /// Nesting depth of the value being written
+        size_t depth;
+
+        char buffer[bufferSize];
+
+        /// Amount of characters in the buffer
+        size_t used;
+
+        /// Cache that is being filled by this writer, nullptr when writing to the output itself
+        Object::JsonCache *recording;
+
+    };
+
+
+
+    /**
+     * Writes json straight to an Output without building Objects or Arrays first
+     * Calls describe the document from front to back, such as startObject(), key("id"), value(7), endObject().
+     * Strings, numbers, separators and indentation are written exactly like the Writer writes them.
+     * Debug builds throw a WriteException when the calls don't describe valid json, release builds don't check.
+     */
+    class StreamWriter {
+    public:
+
+        /// Constructor, the output must outlive the writer
+        explicit StreamWriter(Output &output, WriteOptions options = WriteOptions());
+
+        StreamWriter &startObject();
+
+        StreamWriter &endObject();
+
+        StreamWriter &startArray();
+
+        StreamWriter &endArray();
+
+        /// Key of the next value, only in objects
+        StreamWriter &key(const std::string &key);
+
+        StreamWriter &value(const std::string &string);
+
+        StreamWriter &value(const char *string);
+
+        StreamWriter &value(int number);
+
+        StreamWriter &value(double fraction);
+
+        StreamWriter &value(bool boolean);
+
+        StreamWriter &value(std::nullptr_t);
+
+        /// Writes the element and everything it contains
+        StreamWriter &value(const Element &element);
+
+        /// Hands the buffered characters to the output, also done when a document is complete
+        void flush();
+
+    private:
+
+        /// Object or array that is being written
+        struct Level {
+            bool object;
+            bool empty;
+        };
+
+        /// Writes the separator or line break before a value or key, and checks if one is allowed
+        void beforeValue();
+
+        /// Checks if a key is allowed
+        void beforeKey();
+
+        /// Closes the current object or array
+        void end(bool object, char bracket);
+
+        /// Flushes once the outermost value is complete
+        void afterValue();
+
+        Writer writer;
+
+        /// Open objects and arrays, the innermost last
+        std::vector<Level> levels;
+
+        /// True between a key and its value
+        bool afterKey;
+
+    };
+
+
+
+#if __cplusplus >= 201703L
+
+MemoryResource *defaultResource() {
+    return std::pmr::get_default_resource();
+}
+
+#else
+
+namespace {
+
+    /// Resource that simply forwards to the global new and delete
+    class NewDeleteResource : public MemoryResource {
+    protected:
+
+        void *do_allocate(size_t bytes, size_t) override {
+            return ::operator new(bytes);
+        }
+
+        void do_deallocate(void *pointer, size_t, size_t) override {
+            ::operator delete(pointer);
+        }
+
+        bool do_is_equal(const MemoryResource &other) const noexcept override {
+            return this == &other;
+        }
+
+    };
+
+}
+
+MemoryResource *defaultResource() {
+    static NewDeleteResource resource;
+    return &resource;
+}
+
+#endif
+
+
+Element::Element() : type(UNINITIALIZED), resource(defaultResource()) {}
+
+Element::Element(MemoryResource *memoryResource) : type(UNINITIALIZED), resource(memoryResource) {}
+
+std::string Element::toString(unsigned int ind) const {
+    return toString(WriteOptions(false, ind));
+}
+
+std::string Element::toString(const WriteOptions &options) const {
+    StringOutput output;
+    // Cached fragments are measured without visiting the unchanged objects again
+    if (options.exactSize or options.cacheFragments) {
+        output.getString().reserve(Writer::serializedSize(*this, options));
+    }
+    Writer(output, options).write(*this);
+    return std::move(output.getString());
+}
+
+size_t Element::serializedSize(const WriteOptions &options) const {
+    return Writer::serializedSize(*this, options);
+}
+
+void Element::write(std::ostream &stream, const WriteOptions &options) const {
+    StreamOutput output(stream);
+    Writer(output, options).write(*this);
+}
+
+void Element::write(std::FILE *file, const WriteOptions &options) const {
+    FileOutput output(file);
+    Writer(output, options).write(*this);
+}
+
+void Element::writeFile(const std::string &fileName, const WriteOptions &options) const {
+    std::FILE *file = std::fopen(fileName.c_str(), "wb");
+    if (not file) {
+        JSONMAX_THROW(WriteException("Couldn't open " + fileName));
+    }
+    JSONMAX_TRY {
+        write(file, options);
+    } JSONMAX_CATCH_ALL {
+        std::fclose(file);
+        JSONMAX_RETHROW;
+    }
+    if (std::fclose(file) != 0) {
+        JSONMAX_THROW(WriteException("Couldn't write " + fileName));
+    }
+}
+
+
+Element &Element::operator=(int num) {
+    reset();
+    setNumber(num);
+    return *this;
+}
+
+Element &Element::operator=(double fraction) {
+    reset();
+    setFraction(fraction);
+    return *this;
+}
+
+Element &Element::operator=(const Object &obj) {
+    reset();
+    setObject(obj);
+    return *this;
+}
+
+Element &Element::operator=(Object &&obj) {
+    reset();
+    setObject(std::move(obj));
+    return *this;
+}
+
+Element &Element::operator=(const std::string &string) {
+    reset();
+    setString(string);
+    return *this;
+}
+
+Element &Element::operator=(const Array &arr) {
+    reset();
+    setArray(arr);
+    return *this;
+}
+
+Element &Element::operator=(Array &&arr) {
+    reset();
+    setArray(std::move(arr));
+    return *this;
+}
+
+Element &Element::operator=(bool boolean) {
+    reset();
+    setBoolean(boolean);
+    return *this;
+}
+
+Element &Element::operator=(const char *c_string) {
+    reset();
+    setString(c_string);
+    return *this;
+}
+
+Element& Element::operator[](const std::string &str) {
+    if (type == OBJECT) {
+        return data.object->operator[](str);
+    }
+    JSONMAX_THROW(TypeException("Invalid use of operator[](const std::string&), element is not a json object."));
+}
+
+Element& Element::operator[](const char *str) {
+    if (type == OBJECT) {
+        return data.object->operator[](str);
+    }
+    JSONMAX_THROW(TypeException("Invalid use of operator[](const char*), element is not a json object."));
+}
+
+Element *Element::find(const std::string &key) {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+const Element *Element::find(const std::string &key) const {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+Element *Element::find(const Path &path) {
+    return path.resolve(*this);
+}
+
+const Element *Element::find(const Path &path) const {
+    return path.resolve(*this);
+}
+
+Element &Element::at(const Path &path) {
+    Element *element = path.resolve(*this);
+    if (not element) {
+        JSONMAX_THROW(PathException("JSON Pointer '" + path.toString() + "' does not exist in the element."));
+    }
+    return *element;
+}
+
+const Element &Element::at(const Path &path) const {
+    const Element *element = path.resolve(*this);
+    if (not element) {
+        JSONMAX_THROW(PathException("JSON Pointer '" + path.toString() + "' does not exist in the element."));
+    }
+    return *element;
+}
+
+Element *Element::find(const char *key) {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+const Element *Element::find(const char *key) const {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+#if __cplusplus >= 201703L
+
+Element& Element::operator[](std::string_view str) {
+    if (type == OBJECT) {
+        return data.object->operator[](str);
+    }
+    JSONMAX_THROW(TypeException("Invalid use of operator[](std::string_view), element is not a json object."));
+}
+
+Element *Element::find(std::string_view key) {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+const Element *Element::find(std::string_view key) const {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+#endif
+
+void Element::setNumber(int number) {
+    Element::data.number = number;
+    type = INTEGER;
+}
+
+void Element::setBoolean(bool boolean) {
+    Element::data.boolean = boolean;
+    type = BOOLEAN;
+}
+
+void Element::setFraction(double fraction) {
+    Element::data.fraction = fraction;
+    type = FRACTION;
+}
+
+void Element::setObject(const Object& object) {
+    Element::data.object = Memory::create<Object>(resource, object, resource);
+    type = OBJECT;
+}
+
+void Element::setObject(Object &&object) {
+    if (not sharesResource(object.getResource())) {
+        return setObject(object);
+    }
+    Element::data.object = Memory::create<Object>(resource, std::move(object));
+    type = OBJECT;
+}
+
+void Element::setString(const std::string &string) {
+    Element::data.string = Memory::create<std::string>(resource, string);
+    type = STRING;
+}
+
+void Element::setArray(const Array &array) {
+    Element::data.array = Memory::create<Array>(resource, resource);
+    type = ARRAY;
+    data.array->reserve(array.size());
+    for (const Element &element: array) {
+        data.array->emplace_back(element, resource);
+    }
+}
+
+void Element::setArray(Array &&array) {
+    if (not sharesResource(array.get_allocator().resource())) {
+        return setArray(array);
+    }
+    Element::data.array = Memory::create<Array>(resource, std::move(array));
+    type = ARRAY;
+    // The elements keep their place, references to them may still be around
+    exposed = true;
+}
+
+void Element::setArray(const std::initializer_list<Element> &list) {
+    Element::data.array = Memory::create<Array>(resource, resource);
+    type = ARRAY;
+    data.array->reserve(list.size());
+    for (const Element &element: list) {
+        data.array->emplace_back(element, resource);
+    }
+}
+
+int Element::getInt() const {
+    checkType(INTEGER);
+    return data.number;
+}
+
+double Element::getDouble() const {
+    checkType(FRACTION);
+    return data.fraction;
+}
+
+std::string& Element::getString() {
+    checkType(STRING);
+    expose();
+    return *data.string;
+}
+
+const std::string& Element::getString() const {
+    checkType(STRING);
+    return *data.string;
+}
+
+bool Element::getBool() const {
+    checkType(BOOLEAN);
+    return data.boolean;
+}
+
+Object& Element::getObject() const {
+    // Changes through the object reach the objects whose caches include it, see Object::markChanged
+    checkType(OBJECT);
+    return *data.object;
+}
+
+Array& Element::getArray() {
+    checkType(ARRAY);
+    expose();
+    return *data.array;
+}
+
+const Array& Element::getArray() const {
+    checkType(ARRAY);
+    return *data.array;
+}
+
+bool Element::operator==(const Element &other) const {
+    if (this == &other) {
+        return true;
+    }
+    bool number = type == INTEGER or type == FRACTION;
+    bool otherNumber = other.type == INTEGER or other.type == FRACTION;
+    if (number and otherNumber) {
+        if (type == INTEGER and other.type == INTEGER) {
+            return data.number == other.data.number;
+        }
+        double value = type == INTEGER ? data.number : data.fraction;
+        double otherValue = other.type == INTEGER ? other.data.number : other.data.fraction;
+        return value == otherValue;
+    }
+    if (type != other.type) {
+        return false;
+    }
+    switch (type) {
+        case BOOLEAN:
+            return data.boolean == other.data.boolean;
+        case STRING:
+            return *data.string == *other.data.string;
+        case OBJECT:
+            return *data.object == *other.data.object;
+        case ARRAY:
+            return data.array->size() == other.data.array->size() and
+                   std::equal(data.array->begin(), data.array->end(), other.data.array->begin());
+        default:
+            // Null and uninitialized
+            return true;
+    }
+}
+
+bool Element::operator!=(const Element &other) const {
+    return not (*this == other);
+}
+
+uint64_t Element::hash() const {
+    bool cacheable = true;
+    return hash(cacheable);
+}
+
+uint64_t Element::hash(bool &cacheable) const {
+    if (exposed) {
+        cacheable = false;
+    }
+    // Every type gets its own constant, so values of different types don't collide by construction
+    switch (type) {
+        case INTEGER:
+        case FRACTION: {
+            // Integers are hashed as doubles, so they match the fractions they are equal to
+            double value = type == INTEGER ? data.number : data.fraction;
+            value = value == 0 ? 0 : value;
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return Utils::mix(bits ^ 0x1f83d9abfb41bd6bull);
+        }
+        case BOOLEAN:
+            return Utils::mix(data.boolean ? 0x5be0cd19137e2179ull : 0x9b05688c2b3e6c1full);
+        case STRING:
+            return Utils::mix(Utils::hash(data.string->data(), data.string->size()) ^ 0x510e527fade682d1ull);
+        case OBJECT:
+            return data.object->hash(cacheable);
+        case ARRAY:
+            return hash(*data.array, cacheable);
+        case JSON_NULL:
+            return Utils::mix(0x3c6ef372fe94f82bull);
+        default:
+            return Utils::mix(0xa54ff53a5f1d36f1ull);
+    }
+}
+
+uint64_t Element::hash(const Array &array) {
+    bool cacheable = true;
+    return hash(array, cacheable);
+}
+
+uint64_t Element::hash(const Array &array, bool &cacheable) {
+    uint64_t result = Utils::mix(array.size() ^ 0x6a09e667f3bcc908ull);
+    for (const Element &element: array) {
+        result = Utils::mix(result + element.hash(cacheable));
+    }
+    return result;
+}
+
+int *Element::tryGetInt() {
+    if (type != INTEGER) {
+        return nullptr;
+    }
+    expose();
+    return &data.number;
+}
+
+const int *Element::tryGetInt() const {
+    return type == INTEGER ? &data.number : nullptr;
+}
+
+bool *Element::tryGetBool() {
+    if (type != BOOLEAN) {
+        return nullptr;
+    }
+    expose();
+    return &data.boolean;
+}
+
+const bool *Element::tryGetBool() const {
+    return type == BOOLEAN ? &data.boolean : nullptr;
+}
+
+double *Element::tryGetDouble() {
+    if (type != FRACTION) {
+        return nullptr;
+    }
+    expose();
+    return &data.fraction;
+}
+
+const double *Element::tryGetDouble() const {
+    return type == FRACTION ? &data.fraction : nullptr;
+}
+
+std::string *Element::tryGetString() {
+    if (type != STRING) {
+        return nullptr;
+    }
+    expose();
+    return data.string;
+}
+
+const std::string *Element::tryGetString() const {
+    return type == STRING ? data.string : nullptr;
+}
+
+Object *Element::tryGetObject() {
+    return type == OBJECT ? data.object : nullptr;
+}
+
+const Object *Element::tryGetObject() const {
+    return type == OBJECT ? data.object : nullptr;
+}
+
+Array *Element::tryGetArray() {
+    if (type != ARRAY) {
+        return nullptr;
+    }
+    expose();
+    return data.array;
+}
+
+const Array *Element::tryGetArray() const {
+    return type == ARRAY ? data.array : nullptr;
+}
+
+int Element::getOr(int defaultValue) const {
+    return type == INTEGER ? data.number : defaultValue;
+}
+
+bool Element::getOr(bool defaultValue) const {
+    return type == BOOLEAN ? data.boolean : defaultValue;
+}
+
+double Element::getOr(double defaultValue) const {
+    return type == FRACTION ? data.fraction : defaultValue;
+}
+
+std::string Element::getOr(const std::string &defaultValue) const {
+    return type == STRING ? *data.string : defaultValue;
+}
+
+const char *Element::getOr(const char *defaultValue) const {
+    return type == STRING ? data.string->c_str() : defaultValue;
+}
+
+#if __cplusplus >= 201703L
+
+std::string_view Element::getOr(std::string_view defaultValue) const {
+    return type == STRING ? std::string_view(*data.string) : defaultValue;
+}
+
+#endif
+
+Type Element::getType() const {
+    return type;
+}
+
+MemoryResource *Element::getResource() const {
+    return resource;
+}
+
+bool Element::sharesResource(MemoryResource *other) const {
+    return resource == other or resource->is_equal(*other);
+}
+
+void Element::checkType(Type castType) const {
+    if (type != castType) {
+        JSONMAX_THROW(TypeException(type, castType));
+    }
+}
+
+Element::Element(const std::string &string) : resource(defaultResource()) {
     setString(string);
 }
 
-Element::Element(const char *c_string) {
-    setString(c_string);
-}
+Element::Element(const char *c_string) : resource(defaultResource()) {
+    setString(c_string);
+}
+
+Element::Element(int num) : resource(defaultResource()) {
+    setNumber(num);
+}
+
+Element::Element(double fract) : resource(defaultResource()) {
+    setFraction(fract);
+}
+
+Element::Element(bool boolean) : resource(defaultResource()) {
+    setBoolean(boolean);
+}
+
+Element::Element(const Object &obj) : resource(defaultResource()) {
+    setObject(obj);
+}
+
+Element::Element(Object &&obj) : resource(obj.getResource()) {
+    setObject(std::move(obj));
+}
+
+Element::Element(const Array &arr) : resource(defaultResource()) {
+    setArray(arr);
+}
+
+Element::Element(Array &&arr) : resource(arr.get_allocator().resource()) {
+    setArray(std::move(arr));
+}
+
+Element &Element::operator=(std::nullptr_t pointer) {
+    reset();
+    if (pointer == nullptr) {
+        type = JSON_NULL;
+    }
+    return *this;
+}
+
+Element::Element(std::nullptr_t) : type(JSON_NULL), resource(defaultResource()) {}
+
+Element::Element(const std::initializer_list<Element> &arr) : resource(defaultResource()) {
+    setArray(arr);
+}
+
+Element &Element::operator=(const std::initializer_list<Element> &arr) {
+    reset();
+    setArray(arr);
+    return *this;
+}
+
+void Element::reset() {
+    change();
+    switch (type) {
+        case OBJECT: Memory::destroy(resource, data.object);
+            break;
+        case STRING: Memory::destroy(resource, data.string);
+            break;
+        case ARRAY: Memory::destroy(resource, data.array);
+            break;
+        default:
+            break;
+    }
+    type = UNINITIALIZED;
+}
+
+Element::~Element() {
+    reset();
+}
+
+
+void Element::copy(const Element &obj) {
+    switch (obj.type) {
+        case INTEGER: setNumber(obj.data.number);
+            break;
+        case FRACTION: setFraction(obj.data.fraction);
+            break;
+        case STRING: setString(*obj.data.string);
+            break;
+        case OBJECT: setObject(*obj.data.object);
+            break;
+        case ARRAY: setArray(*obj.data.array);
+            break;
+        case BOOLEAN: setBoolean(obj.data.boolean);
+            break;
+        default: type = obj.type;
+            break;
+    }
+}
+
+void Element::move(Element &&obj) {
+    // The value leaves its place, the objects that cached it have to know
+    obj.change();
+    obj.detach();
+    type = obj.type;
+    data = obj.data;
+    resource = obj.resource;
+    // References into the value move along with it
+    exposed = exposed or obj.exposed;
+    obj.type = UNINITIALIZED;
+}
+
+void Element::change() {
+    if (cached.load(std::memory_order_relaxed)) {
+        cached.store(false, std::memory_order_relaxed);
+        Object::epoch.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Element::expose() {
+    change();
+    if (type == ARRAY) {
+        // The array can leave through the reference, its objects must not point to the enclosing object anymore
+        detach();
+    }
+    exposed = true;
+}
+
+
+void Element::detach() {
+    if (type == OBJECT) {
+        data.object->detach();
+    } else if (type == ARRAY and linked.load(std::memory_order_relaxed)) {
+        linked.store(false, std::memory_order_relaxed);
+        for (Element &element: *data.array) {
+            element.detach();
+        }
+    }
+}
+
+Element::Element(const Element &obj) : type(UNINITIALIZED), resource(defaultResource()) {
+    copy(obj);
+}
+
+Element::Element(const Element &obj, MemoryResource *memoryResource)
+        : type(UNINITIALIZED), resource(memoryResource) {
+    copy(obj);
+}
+
+Element::Element(Element &&obj) noexcept {
+    move(std::move(obj));
+}
+
+Element& Element::operator=(Element &&obj) noexcept {
+    if (this != &obj) {
+        reset();
+        if (sharesResource(obj.resource)) {
+            move(std::move(obj));
+            return *this;
+        }
+        // Containers rely on this not throwing, so a copy that runs out of memory takes over the value instead
+        JSONMAX_TRY {
+            copy(obj);
+        } JSONMAX_CATCH_ALL {
+            reset();
+            move(std::move(obj));
+        }
+    }
+    return *this;
+}
+
+Element& Element::operator=(const Element &obj) {
+    if (this != &obj) {
+        reset();
+        copy(obj);
+    }
+    return *this;
+}
+
+bool Element::isInt() const {
+    return type == INTEGER;
+}
+
+bool Element::isDouble() const {
+    return type == FRACTION;
+}
+
+bool Element::isBool() const {
+    return type == BOOLEAN;
+}
+
+bool Element::isObject() const {
+    return type == OBJECT;
+}
+
+bool Element::isArray() const {
+    return type == ARRAY;
+}
+
+bool Element::isString() const {
+    return type == STRING;
+}
+
+bool Element::isNull() const {
+    return type == JSON_NULL;
+}
+
+
+Pair::Pair(std::string str, Element ele): key(std::move(str)), value(std::move(ele)) {}
+
+const std::string& Pair::getKey() const {
+    return key;
+}
+
+const Element& Pair::getValue() const {
+    return value;
+}
+
+
+std::atomic<size_t> AdaptiveStorage::threshold(8);
+
+AdaptiveStorage::AdaptiveStorage(MemoryResource *_resource, bool _indexed)
+        : entries(reinterpret_cast<Entry *>(inlineEntries)), count(0), capacity(inlineCapacity),
+          index(nullptr), indexMask(0), resource(_resource), indexed(_indexed) {}
+
+AdaptiveStorage::AdaptiveStorage(const AdaptiveStorage &other, MemoryResource *_resource)
+        : AdaptiveStorage(_resource, other.indexed) {
+    if (other.count > capacity) {
+        grow(other.count);
+    }
+    JSONMAX_TRY {
+        for (const Entry &entry: other) {
+            new(entries + count) Entry(std::piecewise_construct, std::forward_as_tuple(entry.first),
+                                       std::forward_as_tuple(entry.second, resource));
+            count++;
+        }
+        if (other.index) {
+            buildIndex(other.indexMask + 1);
+        }
+    } JSONMAX_CATCH_ALL {
+        destroy();
+        JSONMAX_RETHROW;
+    }
+}
+
+AdaptiveStorage::~AdaptiveStorage() {
+    destroy();
+}
+
+Element *AdaptiveStorage::lookup(const char *key, size_t length) const {
+    uint32_t found = position(key, length);
+    return found == count ? nullptr : &entries[found].second;
+}
+
+Element *AdaptiveStorage::lookup(const char *key, size_t length, uint64_t hash) const {
+    uint32_t found = index ? probe(key, length, hash) : scan(key, length);
+    return found == count ? nullptr : &entries[found].second;
+}
+
+uint32_t AdaptiveStorage::position(const char *key, size_t length) const {
+    return index ? probe(key, length, Utils::hash(key, length)) : scan(key, length);
+}
+
+uint32_t AdaptiveStorage::probe(const char *key, size_t length, uint64_t hash) const {
+    uint32_t fragment = static_cast<uint32_t>(hash >> 32);
+    for (uint32_t i = static_cast<uint32_t>(hash) & indexMask;; i = (i + 1) & indexMask) {
+        const Slot &slot = index[i];
+        if (slot.position == 0) {
+            return count;
+        }
+        const std::string &candidate = entries[slot.position - 1].first;
+        if (slot.hash == fragment and candidate.size() == length and
+            candidate.compare(0, length, key, length) == 0) {
+            return slot.position - 1;
+        }
+    }
+}
+
+uint32_t AdaptiveStorage::scan(const char *key, size_t length) const {
+    for (uint32_t i = 0; i < count; i++) {
+        const std::string &candidate = entries[i].first;
+        if (candidate.size() == length and candidate.compare(0, length, key, length) == 0) {
+            return i;
+        }
+    }
+    return count;
+}
+
+Element &AdaptiveStorage::insert(std::string key) {
+    if (count == capacity) {
+        grow(capacity * 2);
+    }
+    // Keep the index at most half full, grow it before anything changes
+    if (index and (count + 1) * 2 > indexMask + 1) {
+        buildIndex((indexMask + 1) * 2);
+    }
+
+    new(entries + count) Entry(std::move(key), Element(resource));
+    count++;
+
+    if (index) {
+        const std::string &added = entries[count - 1].first;
+        addToIndex(count - 1, Utils::hash(added.data(), added.size()));
+    } else if (indexed or count > threshold.load(std::memory_order_relaxed)) {
+        uint32_t slots = 16;
+        while (slots < count * 2) {
+            slots *= 2;
+        }
+        buildIndex(slots);
+    }
+    return entries[count - 1].second;
+}
+
+void AdaptiveStorage::remove(const char *key, size_t length) {
+    uint32_t found = position(key, length);
+    if (found == count) {
+        return;
+    }
+
+    // Shift the pairs after the removed one to keep the order
+    for (uint32_t i = found; i + 1 < count; i++) {
+        entries[i].first = std::move(entries[i + 1].first);
+        entries[i].second = std::move(entries[i + 1].second);
+    }
+    entries[count - 1].~Entry();
+    count--;
+
+    if (index) {
+        buildIndex(indexMask + 1);
+    }
+}
+
+void AdaptiveStorage::clear() {
+    for (Entry &entry: *this) {
+        entry.~Entry();
+    }
+    count = 0;
+    if (index) {
+        resource->deallocate(index, (indexMask + 1) * sizeof(Slot), alignof(Slot));
+        index = nullptr;
+        indexMask = 0;
+    }
+}
+
+void AdaptiveStorage::reserve(size_t pairs) {
+    grow(static_cast<uint32_t>(pairs));
+}
+
+size_t AdaptiveStorage::size() const {
+    return count;
+}
+
+AdaptiveStorage::Entry *AdaptiveStorage::begin() const {
+    return entries;
+}
+
+AdaptiveStorage::Entry *AdaptiveStorage::end() const {
+    return entries + count;
+}
+
+size_t AdaptiveStorage::getThreshold() {
+    return threshold.load(std::memory_order_relaxed);
+}
+
+void AdaptiveStorage::setThreshold(size_t newThreshold) {
+    threshold.store(newThreshold, std::memory_order_relaxed);
+}
+
+void AdaptiveStorage::grow(uint32_t wanted) {
+    if (wanted <= capacity) {
+        return;
+    }
+    auto *grown = static_cast<Entry *>(resource->allocate(wanted * sizeof(Entry), alignof(Entry)));
+    for (uint32_t i = 0; i < count; i++) {
+        new(grown + i) Entry(std::move(entries[i]));
+        entries[i].~Entry();
+    }
+    if (entries != reinterpret_cast<Entry *>(inlineEntries)) {
+        resource->deallocate(entries, capacity * sizeof(Entry), alignof(Entry));
+    }
+    entries = grown;
+    capacity = wanted;
+}
+
+void AdaptiveStorage::buildIndex(uint32_t slots) {
+    auto *built = static_cast<Slot *>(resource->allocate(slots * sizeof(Slot), alignof(Slot)));
+    if (index) {
+        resource->deallocate(index, (indexMask + 1) * sizeof(Slot), alignof(Slot));
+    }
+    index = built;
+    indexMask = slots - 1;
+    for (uint32_t i = 0; i < slots; i++) {
+        index[i].position = 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        addToIndex(i, Utils::hash(entries[i].first.data(), entries[i].first.size()));
+    }
+}
+
+void AdaptiveStorage::addToIndex(uint32_t entry, uint64_t hash) {
+    uint32_t i = static_cast<uint32_t>(hash) & indexMask;
+    while (index[i].position != 0) {
+        i = (i + 1) & indexMask;
+    }
+    index[i].hash = static_cast<uint32_t>(hash >> 32);
+    index[i].position = entry + 1;
+}
+
+void AdaptiveStorage::destroy() {
+    clear();
+    if (entries != reinterpret_cast<Entry *>(inlineEntries)) {
+        resource->deallocate(entries, capacity * sizeof(Entry), alignof(Entry));
+        entries = reinterpret_cast<Entry *>(inlineEntries);
+        capacity = inlineCapacity;
+    }
+}
+
+
+namespace {
+
+#ifdef JSONMAX_SSE2
+
+    /// Amount of control bytes that are compared at once
+    const size_t groupWidth = 16;
+
+    /// Group of control bytes, compared with SSE2
+    class Group {
+    public:
+
+        explicit Group(const int8_t *position)
+                : control(_mm_load_si128(reinterpret_cast<const __m128i *>(position))) {}
+
+        /// @return bit set of the slots with the given control byte
+        uint32_t match(int8_t byte) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), control)));
+        }
+
+        /// @return bit set of the empty and deleted slots, both have the sign bit set
+        uint32_t matchFree() const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(control));
+        }
+
+    private:
+
+        __m128i control;
+
+    };
+
+#else
+
+    /// Amount of control bytes that are compared at once
+    const size_t groupWidth = 8;
+
+    /// Group of control bytes, compared one by one (compilers vectorize this where they can)
+    class Group {
+    public:
+
+        explicit Group(const int8_t *position) {
+            std::memcpy(control, position, groupWidth);
+        }
+
+        /// @return bit set of the slots with the given control byte
+        uint32_t match(int8_t byte) const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < groupWidth; i++) {
+                mask |= static_cast<uint32_t>(control[i] == byte) << i;
+            }
+            return mask;
+        }
+
+        /// @return bit set of the empty and deleted slots, both are negative
+        uint32_t matchFree() const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < groupWidth; i++) {
+                mask |= static_cast<uint32_t>(control[i] < 0) << i;
+            }
+            return mask;
+        }
+
+    private:
+
+        int8_t control[groupWidth];
+
+    };
+
+#endif
+
+    /// The lowest 7 bits of the hash are stored in the control byte
+    inline int8_t controlHash(uint64_t hash) {
+        return static_cast<int8_t>(hash & 0x7f);
+    }
+
+    /// The other bits pick the first group to probe
+    inline size_t groupHash(uint64_t hash) {
+        return static_cast<size_t>(hash >> 7);
+    }
+
+    /// Alignment of a table, groups are loaded with aligned loads
+    inline size_t tableAlignment() {
+        return alignof(FlatHashMap::Entry) > groupWidth ? alignof(FlatHashMap::Entry) : groupWidth;
+    }
+
+}
+
+FlatHashMap::Iterator::Iterator(const int8_t *_control, Entry *_slot, const int8_t *_end)
+        : control(_control), slot(_slot), end(_end) {
+    skipEmpty();
+}
+
+FlatHashMap::Entry &FlatHashMap::Iterator::operator*() const {
+    return *slot;
+}
+
+FlatHashMap::Entry *FlatHashMap::Iterator::operator->() const {
+    return slot;
+}
+
+FlatHashMap::Iterator &FlatHashMap::Iterator::operator++() {
+    ++control;
+    ++slot;
+    skipEmpty();
+    return *this;
+}
+
+bool FlatHashMap::Iterator::operator==(const Iterator &other) const {
+    return control == other.control;
+}
+
+bool FlatHashMap::Iterator::operator!=(const Iterator &other) const {
+    return control != other.control;
+}
+
+void FlatHashMap::Iterator::skipEmpty() {
+    while (control != end and *control < 0) {
+        ++control;
+        ++slot;
+    }
+}
+
+FlatHashMap::FlatHashMap(MemoryResource *_resource)
+        : control(nullptr), slots(nullptr), capacity(0), count(0), growthLeft(0), resource(_resource) {}
+
+FlatHashMap::FlatHashMap(const FlatHashMap &other, MemoryResource *_resource) : FlatHashMap(_resource) {
+    if (other.count == 0) {
+        return;
+    }
+    rehash(other.capacity);
+    JSONMAX_TRY {
+        for (const Entry &entry: other) {
+            uint64_t hash = Utils::hash(entry.first.data(), entry.first.size());
+            size_t slot = findFreeSlot(hash);
+            new(slots + slot) Entry(std::piecewise_construct, std::forward_as_tuple(entry.first),
+                                    std::forward_as_tuple(entry.second, resource));
+            control[slot] = controlHash(hash);
+            count++;
+            growthLeft--;
+        }
+    } JSONMAX_CATCH_ALL {
+        destroy();
+        JSONMAX_RETHROW;
+    }
+}
+
+FlatHashMap::~FlatHashMap() {
+    destroy();
+}
+
+Element *FlatHashMap::lookup(const char *key, size_t length) const {
+    return lookup(key, length, Utils::hash(key, length));
+}
+
+Element *FlatHashMap::lookup(const char *key, size_t length, uint64_t hash) const {
+    Entry *entry = findSlot(key, length, hash);
+    return entry ? &entry->second : nullptr;
+}
+
+Element &FlatHashMap::insert(std::string key) {
+    if (growthLeft == 0) {
+        if (capacity == 0) {
+            rehash(groupWidth);
+        } else if (count >= capacity * 7 / 16) {
+            rehash(capacity * 2);
+        } else {
+            // Mostly deleted slots, cleaning them up is enough
+            rehash(capacity);
+        }
+    }
+
+    uint64_t hash = Utils::hash(key.data(), key.size());
+    size_t slot = findFreeSlot(hash);
+    new(slots + slot) Entry(std::move(key), Element(resource));
+    if (control[slot] == empty) {
+        growthLeft--;
+    }
+    control[slot] = controlHash(hash);
+    count++;
+    return slots[slot].second;
+}
+
+void FlatHashMap::reserve(size_t pairs) {
+    size_t wanted = groupWidth;
+    while (wanted * 7 / 8 < pairs) {
+        wanted *= 2;
+    }
+    if (wanted > capacity) {
+        rehash(wanted);
+    }
+}
+
+void FlatHashMap::remove(const char *key, size_t length) {
+    Entry *entry = findSlot(key, length, Utils::hash(key, length));
+    if (not entry) {
+        return;
+    }
+    size_t slot = static_cast<size_t>(entry - slots);
+    entry->~Entry();
+    count--;
+
+    // Lookups stop at groups with an empty slot, so such a group was never passed by another probe
+    Group group(control + slot - slot % groupWidth);
+    if (group.match(empty)) {
+        control[slot] = empty;
+        growthLeft++;
+    } else {
+        control[slot] = deleted;
+    }
+}
+
+void FlatHashMap::clear() {
+    for (Entry &entry: *this) {
+        entry.~Entry();
+    }
+    if (capacity) {
+        std::memset(control, empty, capacity);
+    }
+    count = 0;
+    growthLeft = capacity * 7 / 8;
+}
+
+size_t FlatHashMap::size() const {
+    return count;
+}
+
+FlatHashMap::Iterator FlatHashMap::begin() const {
+    return Iterator(control, slots, control + capacity);
+}
+
+FlatHashMap::Iterator FlatHashMap::end() const {
+    return Iterator(control + capacity, slots + capacity, control + capacity);
+}
+
+void FlatHashMap::rehash(size_t wanted) {
+    size_t bytes = controlBytes(wanted) + wanted * sizeof(Entry);
+    auto *table = static_cast<char *>(resource->allocate(bytes, tableAlignment()));
+
+    int8_t *oldControl = control;
+    Entry *oldSlots = slots;
+    size_t oldCapacity = capacity;
+
+    control = reinterpret_cast<int8_t *>(table);
+    slots = reinterpret_cast<Entry *>(table + controlBytes(wanted));
+    capacity = wanted;
+    growthLeft = wanted * 7 / 8 - count;
+    std::memset(control, empty, wanted);
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldControl[i] >= 0) {
+            Entry &entry = oldSlots[i];
+            uint64_t hash = Utils::hash(entry.first.data(), entry.first.size());
+            size_t slot = findFreeSlot(hash);
+            new(slots + slot) Entry(std::move(entry));
+            control[slot] = controlHash(hash);
+            entry.~Entry();
+        }
+    }
+
+    if (oldCapacity) {
+        resource->deallocate(oldControl, controlBytes(oldCapacity) + oldCapacity * sizeof(Entry),
+                             tableAlignment());
+    }
+}
+
+FlatHashMap::Entry *FlatHashMap::findSlot(const char *key, size_t length, uint64_t hash) const {
+    if (capacity == 0) {
+        return nullptr;
+    }
+    size_t groupMask = capacity / groupWidth - 1;
+    size_t group = groupHash(hash) & groupMask;
+    int8_t byte = controlHash(hash);
+
+    // Triangular probing over the groups visits every group once
+    for (size_t step = 1;; step++) {
+        size_t first = group * groupWidth;
+        Group current(control + first);
+        for (uint32_t mask = current.match(byte); mask; mask &= mask - 1) {
+            Entry &entry = slots[first + Utils::lowestBit(mask)];
+            if (entry.first.size() == length and entry.first.compare(0, length, key, length) == 0) {
+                return &entry;
+            }
+        }
+        if (current.match(empty)) {
+            return nullptr;
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+size_t FlatHashMap::findFreeSlot(uint64_t hash) const {
+    size_t groupMask = capacity / groupWidth - 1;
+    size_t group = groupHash(hash) & groupMask;
+    for (size_t step = 1;; step++) {
+        uint32_t mask = Group(control + group * groupWidth).matchFree();
+        if (mask) {
+            return group * groupWidth + Utils::lowestBit(mask);
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+size_t FlatHashMap::controlBytes(size_t slots) {
+    size_t alignment = alignof(Entry);
+    return (slots + alignment - 1) / alignment * alignment;
+}
+
+void FlatHashMap::destroy() {
+    clear();
+    if (capacity) {
+        resource->deallocate(control, controlBytes(capacity) + capacity * sizeof(Entry), tableAlignment());
+        control = nullptr;
+        slots = nullptr;
+        capacity = 0;
+        growthLeft = 0;
+    }
+}
+
+
+namespace {
+
+    /// Shapes with more keys than this get a table with a hash index
+    const uint32_t shapeScanLimit = 8;
+
+    /// Slots of the first transitions of a shape
+    const uint32_t firstTransitions = 8;
+
+}
+
+Shape *Shape::root() {
+    // Never destroyed, objects may still refer to it while static objects are destroyed
+    static std::aligned_storage<sizeof(Shape), alignof(Shape)>::type storage;
+    static Shape *empty = new(&storage) Shape();
+    return empty;
+}
+
+Shape::Shape() : hash(0), count(0), parent(nullptr), resource(defaultResource()), table(nullptr),
+                 transitions(nullptr), readerPhase(0), references(1) {
+    readers[0].store(0, std::memory_order_relaxed);
+    readers[1].store(0, std::memory_order_relaxed);
+}
+
+Shape::Shape(Shape *_parent, std::string _key, uint64_t _hash, MemoryResource *_resource)
+        : key(std::move(_key)), hash(_hash), count(_parent->count + 1), parent(_parent), resource(_resource),
+          table(nullptr), transitions(nullptr), readerPhase(0), references(1) {
+    readers[0].store(0, std::memory_order_relaxed);
+    readers[1].store(0, std::memory_order_relaxed);
+    parent->acquire();
+}
+
+Shape::~Shape() {
+    Memory::destroy(resource, const_cast<Table *>(table.load(std::memory_order_acquire)));
+    Memory::destroy(resource, transitions.load(std::memory_order_acquire));
+}
+
+void Shape::destroy(Shape *shape) {
+    MemoryResource *memory = shape->resource;
+    shape->~Shape();
+    memory->deallocate(shape, sizeof(Shape), alignof(Shape));
+}
+
+Shape *Shape::extend(const std::string &newKey, MemoryResource *memory) {
+    uint64_t keyHash = Utils::hash(newKey.data(), newKey.size());
+    Shape *existing = acquireTransition(newKey, keyHash, memory);
+    if (existing) {
+        return existing;
+    }
+    std::lock_guard<std::mutex> lock(transitionsMutex);
+    existing = acquireTransition(newKey, keyHash, memory);
+    return existing ? existing : addTransition(std::string(newKey), keyHash, memory);
+}
+
+Shape *Shape::extend(std::string &&newKey, MemoryResource *memory) {
+    uint64_t keyHash = Utils::hash(newKey.data(), newKey.size());
+    Shape *existing = acquireTransition(newKey, keyHash, memory);
+    if (existing) {
+        return existing;
+    }
+    std::lock_guard<std::mutex> lock(transitionsMutex);
+    existing = acquireTransition(newKey, keyHash, memory);
+    return existing ? existing : addTransition(std::move(newKey), keyHash, memory);
+}
+
+uint32_t Shape::find(const char *candidate, size_t length) const {
+    return find(candidate, length, count > shapeScanLimit ? Utils::hash(candidate, length) : 0);
+}
+
+uint32_t Shape::find(const char *candidate, size_t length, uint64_t candidateHash) const {
+    if (count <= shapeScanLimit) {
+        for (const Shape *shape = this; shape->parent; shape = shape->parent) {
+            if (shape->key.size() == length and shape->key.compare(0, length, candidate, length) == 0) {
+                return shape->count - 1;
+            }
+        }
+        return count;
+    }
+
+    const Table &lookup = getTable();
+    auto fragment = static_cast<uint32_t>(candidateHash >> 32);
+    auto mask = static_cast<uint32_t>(lookup.index.size() - 1);
+    for (uint32_t i = static_cast<uint32_t>(candidateHash) & mask;; i = (i + 1) & mask) {
+        const Slot &slot = lookup.index[i];
+        if (slot.position == 0) {
+            return count;
+        }
+        const std::string &stored = *lookup.keys[slot.position - 1];
+        if (slot.hash == fragment and stored.size() == length and stored.compare(0, length, candidate, length) == 0) {
+            return slot.position - 1;
+        }
+    }
+}
+
+const std::string &Shape::getKey(uint32_t position) const {
+    if (count > shapeScanLimit) {
+        return *getTable().keys[position];
+    }
+    const Shape *shape = this;
+    while (shape->count != position + 1) {
+        shape = shape->parent;
+    }
+    return shape->key;
+}
+
+uint32_t Shape::size() const {
+    return count;
+}
+
+MemoryResource *Shape::getResource() const {
+    return resource;
+}
+
+void Shape::acquire() {
+    references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Shape::release() {
+    size_t current = references.load(std::memory_order_relaxed);
+    while (current > 1) {
+        if (references.compare_exchange_weak(current, current - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    // Possibly the last reference: searches may hand out this shape again until it is removed from its parent
+    Shape *ancestor = parent;
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(ancestor->transitionsMutex);
+        last = references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        if (last) {
+            ancestor->removeTransition(this);
+        }
+    }
+    if (last) {
+        destroy(this);
+        ancestor->release();
+    }
+}
+
+bool Shape::tryAcquire() {
+    size_t current = references.load(std::memory_order_relaxed);
+    while (current != 0) {
+        if (references.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Shape *Shape::acquireTransition(const std::string &newKey, uint64_t keyHash, MemoryResource *memory) {
+    // Counting the search keeps the shapes it may see alive, see waitForReaders
+    uint32_t phase = readerPhase.load(std::memory_order_seq_cst);
+    readers[phase].fetch_add(1, std::memory_order_seq_cst);
+    Shape *found = nullptr;
+    const Transitions *current = transitions.load(std::memory_order_seq_cst);
+    if (current) {
+        auto mask = static_cast<uint32_t>(current->slots.size() - 1);
+        for (auto i = static_cast<uint32_t>(keyHash) & mask;; i = (i + 1) & mask) {
+            Shape *child = current->slots[i].load(std::memory_order_seq_cst);
+            if (not child) {
+                break;
+            }
+            // A child whose last reference is being released is not handed out, the caller retries under the lock
+            if (child != this and child->hash == keyHash and child->resource == memory and child->key == newKey) {
+                found = child->tryAcquire() ? child : nullptr;
+                break;
+            }
+        }
+    }
+    readers[phase].fetch_sub(1, std::memory_order_seq_cst);
+    return found;
+}
+
+Shape *Shape::addTransition(std::string &&newKey, uint64_t keyHash, MemoryResource *memory) {
+    Transitions *current = transitions.load(std::memory_order_relaxed);
+    if (not current or (current->used + 1) * 2 > current->slots.size()) {
+        // Removed slots are left out, so the new table is sized for the shapes that are still there
+        uint32_t live = 0;
+        if (current) {
+            for (const std::atomic<Shape *> &slot: current->slots) {
+                Shape *child = slot.load(std::memory_order_relaxed);
+                live += child and child != this;
+            }
+        }
+        uint32_t capacity = firstTransitions;
+        while (capacity < (live + 1) * 4) {
+            capacity *= 2;
+        }
+        auto *grown = Memory::create<Transitions>(resource, capacity, resource);
+        for (uint32_t i = 0; current and i < current->slots.size(); i++) {
+            Shape *child = current->slots[i].load(std::memory_order_relaxed);
+            if (child and child != this) {
+                auto mask = capacity - 1;
+                auto slot = static_cast<uint32_t>(child->hash) & mask;
+                while (grown->slots[slot].load(std::memory_order_relaxed)) {
+                    slot = (slot + 1) & mask;
+                }
+                grown->slots[slot].store(child, std::memory_order_relaxed);
+                grown->used++;
+            }
+        }
+        transitions.store(grown, std::memory_order_seq_cst);
+        if (current) {
+            waitForReaders();
+            Memory::destroy(resource, current);
+        }
+        current = grown;
+    }
+
+    void *memoryOfChild = memory->allocate(sizeof(Shape), alignof(Shape));
+    auto *child = new(memoryOfChild) Shape(this, std::move(newKey), keyHash, memory);
+    auto mask = static_cast<uint32_t>(current->slots.size() - 1);
+    auto slot = static_cast<uint32_t>(keyHash) & mask;
+    while (current->slots[slot].load(std::memory_order_relaxed)) {
+        slot = (slot + 1) & mask;
+    }
+    current->used++;
+    current->slots[slot].store(child, std::memory_order_seq_cst);
+    return child;
+}
+
+void Shape::removeTransition(Shape *child) {
+    Transitions *current = transitions.load(std::memory_order_relaxed);
+    auto mask = static_cast<uint32_t>(current->slots.size() - 1);
+    auto slot = static_cast<uint32_t>(child->hash) & mask;
+    while (current->slots[slot].load(std::memory_order_relaxed) != child) {
+        slot = (slot + 1) & mask;
+    }
+    current->slots[slot].store(this, std::memory_order_seq_cst);
+    waitForReaders();
+}
+
+void Shape::waitForReaders() {
+    // Searches that start from now on count in the other phase and can't see what was removed before.
+    // Those that are still counted in the previous phase only take a few probes
+    uint32_t previous = readerPhase.load(std::memory_order_relaxed);
+    readerPhase.store(previous ^ 1, std::memory_order_seq_cst);
+    while (readers[previous].load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+const Shape::Table &Shape::getTable() const {
+    const Table *current = table.load(std::memory_order_acquire);
+    if (current) {
+        return *current;
+    }
+
+    auto *built = Memory::create<Table>(resource, resource);
+    JSONMAX_TRY {
+        built->keys.resize(count);
+        for (const Shape *shape = this; shape->parent; shape = shape->parent) {
+            built->keys[shape->count - 1] = &shape->key;
+        }
+        size_t slots = 16;
+        while (slots < count * 2) {
+            slots *= 2;
+        }
+        built->index.assign(slots, Slot{0, 0});
+    } JSONMAX_CATCH_ALL {
+        Memory::destroy(resource, built);
+        JSONMAX_RETHROW;
+    }
+    auto mask = static_cast<uint32_t>(built->index.size() - 1);
+    for (uint32_t position = 0; position < count; position++) {
+        uint64_t keyHash = Utils::hash(built->keys[position]->data(), built->keys[position]->size());
+        uint32_t i = static_cast<uint32_t>(keyHash) & mask;
+        while (built->index[i].position != 0) {
+            i = (i + 1) & mask;
+        }
+        built->index[i].hash = static_cast<uint32_t>(keyHash >> 32);
+        built->index[i].position = position + 1;
+    }
+
+    // Threads that search the shape at the same time may build it twice, the first one is kept
+    if (not table.compare_exchange_strong(current, built, std::memory_order_acq_rel)) {
+        Memory::destroy(resource, built);
+        return *current;
+    }
+    return *built;
+}
+
+
+ShapedStorage::ShapedStorage(MemoryResource *_resource)
+        : shape(Shape::root()), values(nullptr), capacity(0), dictionary(nullptr), resource(_resource) {
+    shape->acquire();
+}
+
+ShapedStorage::ShapedStorage(const ShapedStorage &other, MemoryResource *_resource)
+        : ShapedStorage(_resource) {
+    // Delegated constructor, the destructor cleans up if a copy fails
+    if (other.dictionary) {
+        dictionary = Memory::create<AdaptiveStorage>(resource, *other.dictionary, resource);
+        return;
+    }
+    // Shapes come from the resource of their objects, so only objects of the same resource share them
+    uint32_t count = other.shape->size();
+    Shape *copied = other.shape;
+    if (copied->getResource() == resource or copied == Shape::root()) {
+        copied->acquire();
+    } else {
+        copied = buildShape(*other.shape, count);
+    }
+
+    // The values are copied while the object still has the empty shape, so a failed copy only destroys those done
+    JSONMAX_TRY {
+        grow(count);
+        for (uint32_t i = 0; i < count; i++) {
+            new(values + i) Element(resource);
+            JSONMAX_TRY {
+                values[i] = other.values[i];
+            } JSONMAX_CATCH_ALL {
+                for (uint32_t j = 0; j <= i; j++) {
+                    values[j].~Element();
+                }
+                JSONMAX_RETHROW;
+            }
+        }
+    } JSONMAX_CATCH_ALL {
+        copied->release();
+        JSONMAX_RETHROW;
+    }
+    shape->release();
+    shape = copied;
+}
+
+ShapedStorage::~ShapedStorage() {
+    destroy();
+    shape->release();
+}
+
+Element *ShapedStorage::lookup(const char *key, size_t length) const {
+    if (dictionary) {
+        return dictionary->lookup(key, length);
+    }
+    uint32_t position = shape->find(key, length);
+    return position == shape->size() ? nullptr : values + position;
+}
+
+Element *ShapedStorage::lookup(const char *key, size_t length, uint64_t hash) const {
+    if (dictionary) {
+        return dictionary->lookup(key, length, hash);
+    }
+    uint32_t position = shape->find(key, length, hash);
+    return position == shape->size() ? nullptr : values + position;
+}
+
+Element &ShapedStorage::insert(std::string key) {
+    if (dictionary) {
+        return dictionary->insert(std::move(key));
+    }
+    uint32_t count = shape->size();
+    if (count == maxShapeKeys) {
+        toDictionary();
+        return dictionary->insert(std::move(key));
+    }
+    if (count == capacity) {
+        grow(capacity ? capacity * 2 : 4);
+    }
+
+    new(values + count) Element(resource);
+    Shape *next;
+    JSONMAX_TRY {
+        next = shape->extend(std::move(key), resource);
+    } JSONMAX_CATCH_ALL {
+        values[count].~Element();
+        JSONMAX_RETHROW;
+    }
+    shape->release();
+    shape = next;
+    return values[count];
+}
+
+void ShapedStorage::reserve(size_t pairs) {
+    if (dictionary) {
+        dictionary->reserve(pairs);
+    } else {
+        grow(static_cast<uint32_t>(pairs < maxShapeKeys ? pairs : maxShapeKeys));
+    }
+}
+
+void ShapedStorage::remove(const char *key, size_t length) {
+    if (dictionary) {
+        dictionary->remove(key, length);
+        return;
+    }
+    uint32_t count = shape->size();
+    uint32_t found = shape->find(key, length);
+    if (found == count) {
+        return;
+    }
+
+    // Rebuild the shape from the root without the removed key, then close the gap in the values
+    Shape *rebuilt = buildShape(*shape, found);
+    for (uint32_t i = found; i + 1 < count; i++) {
+        values[i] = std::move(values[i + 1]);
+    }
+    values[count - 1].~Element();
+    shape->release();
+    shape = rebuilt;
+}
+
+void ShapedStorage::clear() {
+    destroy();
+    if (shape != Shape::root()) {
+        shape->release();
+        shape = Shape::root();
+        shape->acquire();
+    }
+}
+
+size_t ShapedStorage::size() const {
+    return dictionary ? dictionary->size() : shape->size();
+}
+
+const Shape *ShapedStorage::getShape() const {
+    return dictionary ? nullptr : shape;
+}
+
+Element *ShapedStorage::getValues() const {
+    return values;
+}
+
+AdaptiveStorage *ShapedStorage::getDictionary() const {
+    return dictionary;
+}
+
+void ShapedStorage::grow(uint32_t wanted) {
+    if (wanted <= capacity) {
+        return;
+    }
+    auto *grown = static_cast<Element *>(resource->allocate(wanted * sizeof(Element), alignof(Element)));
+    for (uint32_t i = 0; i < shape->size(); i++) {
+        new(grown + i) Element(std::move(values[i]));
+        values[i].~Element();
+    }
+    if (values) {
+        resource->deallocate(values, capacity * sizeof(Element), alignof(Element));
+    }
+    values = grown;
+    capacity = wanted;
+}
+
+void ShapedStorage::toDictionary() {
+    auto *created = Memory::create<AdaptiveStorage>(resource, resource, true);
+    JSONMAX_TRY {
+        for (uint32_t i = 0; i < shape->size(); i++) {
+            created->insert(shape->getKey(i)) = std::move(values[i]);
+        }
+    } JSONMAX_CATCH_ALL {
+        Memory::destroy(resource, created);
+        JSONMAX_RETHROW;
+    }
+    destroy();
+    dictionary = created;
+    shape->release();
+    shape = Shape::root();
+    shape->acquire();
+}
+
+Shape *ShapedStorage::buildShape(const Shape &keys, uint32_t skipped) const {
+    Shape *built = Shape::root();
+    built->acquire();
+    JSONMAX_TRY {
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            if (i != skipped) {
+                Shape *next = built->extend(keys.getKey(i), resource);
+                built->release();
+                built = next;
+            }
+        }
+    } JSONMAX_CATCH_ALL {
+        built->release();
+        JSONMAX_RETHROW;
+    }
+    return built;
+}
+
+void ShapedStorage::destroy() {
+    if (values) {
+        for (uint32_t i = 0; i < shape->size(); i++) {
+            values[i].~Element();
+        }
+        resource->deallocate(values, capacity * sizeof(Element), alignof(Element));
+        values = nullptr;
+        capacity = 0;
+    }
+    Memory::destroy(resource, dictionary);
+    dictionary = nullptr;
+}
+
+
+template <typename Value>
+Member<Value>::Member(const std::string *_key, Value *_value): key(_key), value(_value) {}
+
+template <typename Value>
+const std::string &Member<Value>::getKey() const {
+    return *key;
+}
+
+template <typename Value>
+Value &Member<Value>::getValue() const {
+    return *value;
+}
+
+template <typename Value>
+ObjectIterator<Value>::ObjectIterator(const Object &_object, bool end, bool _uninitialized)
+        : object(&_object), member(nullptr, nullptr), uninitialized(_uninitialized), entry(nullptr), entryEnd(nullptr),
+          flatPosition(nullptr, nullptr, nullptr), shapedPosition(0) {
+    if (end) {
+        return;
+    }
+    switch (object->storage) {
+        case VECTOR:
+            entry = object->data.elementsVector->data();
+            entryEnd = entry + object->data.elementsVector->size();
+            break;
+        case MAP:
+            mapPosition = object->data.elementsMap->begin();
+            break;
+        case HASHMAP:
+            hashmapPosition = object->data.elementsHashmap->begin();
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            entry = object->data.elementsAdaptive->begin();
+            entryEnd = object->data.elementsAdaptive->end();
+            break;
+        case FLAT_HASHMAP:
+            flatPosition = object->data.elementsFlatHashmap->begin();
+            break;
+        case SHAPED:
+            if (object->data.elementsShaped->getDictionary()) {
+                entry = object->data.elementsShaped->getDictionary()->begin();
+                entryEnd = object->data.elementsShaped->getDictionary()->end();
+            }
+            break;
+    }
+    load();
+}
+
+template <typename Value>
+typename ObjectIterator<Value>::reference ObjectIterator<Value>::operator*() const {
+    return member;
+}
+
+template <typename Value>
+typename ObjectIterator<Value>::pointer ObjectIterator<Value>::operator->() const {
+    return &member;
+}
+
+template <typename Value>
+ObjectIterator<Value> &ObjectIterator<Value>::operator++() {
+    advance();
+    load();
+    return *this;
+}
+
+template <typename Value>
+ObjectIterator<Value> ObjectIterator<Value>::operator++(int) {
+    ObjectIterator<Value> previous = *this;
+    ++*this;
+    return previous;
+}
+
+template <typename Value>
+bool ObjectIterator<Value>::operator==(const ObjectIterator &other) const {
+    // Every pair has its own element, the end points to no element at all
+    return member.value == other.member.value;
+}
+
+template <typename Value>
+bool ObjectIterator<Value>::operator!=(const ObjectIterator &other) const {
+    return member.value != other.member.value;
+}
+
+template <typename Value>
+void ObjectIterator<Value>::load() {
+    while (true) {
+        std::pair<const std::string *, Element *> current(nullptr, nullptr);
+        switch (object->storage) {
+            case VECTOR:
+            case ADAPTIVE:
+            case INDEXED:
+                if (entry != entryEnd) {
+                    current = std::make_pair(&entry->first, &entry->second);
+                }
+                break;
+            case MAP:
+                if (mapPosition != object->data.elementsMap->end()) {
+                    current = std::make_pair(&mapPosition->first, &mapPosition->second);
+                }
+                break;
+            case HASHMAP:
+                if (hashmapPosition != object->data.elementsHashmap->end()) {
+                    current = std::make_pair(&hashmapPosition->first, &hashmapPosition->second);
+                }
+                break;
+            case FLAT_HASHMAP:
+                if (flatPosition != object->data.elementsFlatHashmap->end()) {
+                    current = std::make_pair(&flatPosition->first, &flatPosition->second);
+                }
+                break;
+            case SHAPED: {
+                const ShapedStorage *shaped = object->data.elementsShaped;
+                if (shaped->getDictionary()) {
+                    if (entry != entryEnd) {
+                        current = std::make_pair(&entry->first, &entry->second);
+                    }
+                } else if (shapedPosition < shaped->getShape()->size()) {
+                    current = std::make_pair(&shaped->getShape()->getKey(shapedPosition),
+                                             shaped->getValues() + shapedPosition);
+                }
+                break;
+            }
+        }
+
+        if (not current.second or uninitialized or current.second->getType() != UNINITIALIZED) {
+            member = Member<Value>(current.first, current.second);
+            return;
+        }
+        advance();
+    }
+}
+
+template <typename Value>
+void ObjectIterator<Value>::advance() {
+    switch (object->storage) {
+        case VECTOR:
+        case ADAPTIVE:
+        case INDEXED:
+            ++entry;
+            break;
+        case MAP:
+            ++mapPosition;
+            break;
+        case HASHMAP:
+            ++hashmapPosition;
+            break;
+        case FLAT_HASHMAP:
+            ++flatPosition;
+            break;
+        case SHAPED:
+            if (object->data.elementsShaped->getDictionary()) {
+                ++entry;
+            } else {
+                ++shapedPosition;
+            }
+            break;
+    }
+}
+
+KeyIterator::KeyIterator(ObjectIterator<const Element> _position): position(_position) {}
+
+KeyIterator::reference KeyIterator::operator*() const {
+    return position->getKey();
+}
+
+KeyIterator &KeyIterator::operator++() {
+    ++position;
+    return *this;
+}
+
+bool KeyIterator::operator==(const KeyIterator &other) const {
+    return position == other.position;
+}
+
+bool KeyIterator::operator!=(const KeyIterator &other) const {
+    return position != other.position;
+}
+
+template <typename Value>
+ValueIterator<Value>::ValueIterator(ObjectIterator<Value> _position): position(_position) {}
+
+template <typename Value>
+typename ValueIterator<Value>::reference ValueIterator<Value>::operator*() const {
+    return position->getValue();
+}
+
+template <typename Value>
+typename ValueIterator<Value>::pointer ValueIterator<Value>::operator->() const {
+    return &position->getValue();
+}
+
+template <typename Value>
+ValueIterator<Value> &ValueIterator<Value>::operator++() {
+    ++position;
+    return *this;
+}
+
+template <typename Value>
+bool ValueIterator<Value>::operator==(const ValueIterator &other) const {
+    return position == other.position;
+}
+
+template <typename Value>
+bool ValueIterator<Value>::operator!=(const ValueIterator &other) const {
+    return position != other.position;
+}
+
+template <typename Iterator>
+ObjectRange<Iterator>::ObjectRange(Iterator _first, Iterator _last): first(_first), last(_last) {}
+
+template <typename Iterator>
+Iterator ObjectRange<Iterator>::begin() const {
+    return first;
+}
+
+template <typename Iterator>
+Iterator ObjectRange<Iterator>::end() const {
+    return last;
+}
+
+template class Member<Element>;
+template class Member<const Element>;
+template class ObjectIterator<Element>;
+template class ObjectIterator<const Element>;
+template class ValueIterator<Element>;
+template class ValueIterator<const Element>;
+template class ObjectRange<KeyIterator>;
+template class ObjectRange<ValueIterator<Element>>;
+template class ObjectRange<ValueIterator<const Element>>;
+
+
+namespace {
+
+    /// Maximum displacement tried for a bucket, before starting over with another seed
+    const int32_t maxDisplacement = 1 << 20;
+
+    /// Maximum amount of seeds tried, before the pairs are kept in their order and scanned
+    const uint64_t maxSeeds = 64;
+
+    /// Hash of the key for the given seed, every seed hashes the keys independently of the others
+    inline uint64_t frozenHash(const char *key, size_t length, uint64_t seed) {
+        if (seed == 0) {
+            return Utils::hash(key, length);
+        }
+        const Utils::HashKey &secret = Utils::hashKey();
+        return Utils::hash(key, length, Utils::HashKey(secret.first ^ seed, secret.second));
+    }
+
+    /// @return true if two keys have the same hash, no displacement can tell them apart
+    bool sameHashes(std::vector<uint64_t> hashes) {
+        std::sort(hashes.begin(), hashes.end());
+        return std::adjacent_find(hashes.begin(), hashes.end()) != hashes.end();
+    }
+
+    /// Finalizer of splitmix64, spreads the bits of the given value
+    inline uint64_t mixHash(uint64_t value) {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ull;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    /// Bucket of the key with the given hash
+    inline uint32_t frozenBucket(uint64_t hash, uint64_t seed, uint32_t count) {
+        return static_cast<uint32_t>(mixHash(hash ^ seed) % count);
+    }
+
+    /// Slot of the key with the given hash, in a bucket with the given (positive) displacement
+    inline uint32_t frozenSlot(uint64_t hash, int32_t displacement, uint32_t count) {
+        return static_cast<uint32_t>(mixHash(hash + static_cast<uint64_t>(displacement) * 0x9e3779b97f4a7c15ull) % count);
+    }
+
+    /**
+     * Hash and displace: distributes the keys over as many buckets as there are keys,
+     * then finds a displacement for every bucket that moves all its keys to free slots, largest buckets first.
+     * Buckets with a single key simply take a free slot.
+     * @return false if some bucket has no displacement, another seed has to be tried
+     */
+    bool placeKeys(const std::vector<uint64_t> &hashes, uint64_t seed,
+                   std::vector<int32_t> &displacements, std::vector<uint32_t> &slots) {
+        auto count = static_cast<uint32_t>(hashes.size());
+
+        // Sort the keys on their bucket
+        std::vector<uint32_t> bucketStart(count + 1, 0);
+        for (uint64_t hash: hashes) {
+            bucketStart[frozenBucket(hash, seed, count) + 1]++;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            bucketStart[i + 1] += bucketStart[i];
+        }
+        std::vector<uint32_t> keys(count);
+        std::vector<uint32_t> cursor(bucketStart.begin(), bucketStart.end() - 1);
+        for (uint32_t i = 0; i < count; i++) {
+            keys[cursor[frozenBucket(hashes[i], seed, count)]++] = i;
+        }
+
+        std::vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&bucketStart](uint32_t first, uint32_t second) {
+            return bucketStart[first + 1] - bucketStart[first] > bucketStart[second + 1] - bucketStart[second];
+        });
+
+        std::vector<bool> taken(count, false);
+        std::vector<uint32_t> candidates;
+        uint32_t free = 0;
+        for (uint32_t bucket: order) {
+            uint32_t first = bucketStart[bucket];
+            uint32_t size = bucketStart[bucket + 1] - first;
+
+            if (size == 0) {
+                displacements[bucket] = 0;
+            } else if (size == 1) {
+                while (taken[free]) {
+                    free++;
+                }
+                taken[free] = true;
+                slots[keys[first]] = free;
+                displacements[bucket] = -static_cast<int32_t>(free) - 1;
+            } else {
+                int32_t displacement = 1;
+                for (;; displacement++) {
+                    if (displacement > maxDisplacement) {
+                        return false;
+                    }
+                    candidates.clear();
+                    for (uint32_t i = first; i < first + size; i++) {
+                        uint32_t slot = frozenSlot(hashes[keys[i]], displacement, count);
+                        if (taken[slot] or std::find(candidates.begin(), candidates.end(), slot) != candidates.end()) {
+                            break;
+                        }
+                        candidates.push_back(slot);
+                    }
+                    if (candidates.size() == size) {
+                        break;
+                    }
+                }
+                for (uint32_t i = 0; i < size; i++) {
+                    taken[candidates[i]] = true;
+                    slots[keys[first + i]] = candidates[i];
+                }
+                displacements[bucket] = displacement;
+            }
+        }
+        return true;
+    }
+
+}
+
+FrozenObject::FrozenObject(const Object &object, MemoryResource *_resource)
+        : entries(nullptr), displacements(nullptr), count(0), seed(0), resource(_resource) {
+    std::vector<const std::string *> keys;
+    std::vector<const Element *> values;
+    for (const auto &member: object) {
+        keys.push_back(&member.getKey());
+        values.push_back(&member.getValue());
+    }
+    if (keys.empty()) {
+        return;
+    }
+
+    // Every seed hashes the keys again, so keys with the same hash for one seed are apart for the next
+    auto total = static_cast<uint32_t>(keys.size());
+    std::vector<uint64_t> hashes(total);
+    std::vector<int32_t> placedDisplacements(total);
+    std::vector<uint32_t> slots(total);
+    bool placed = false;
+    while (not placed and seed < maxSeeds) {
+        for (uint32_t i = 0; i < total; i++) {
+            hashes[i] = frozenHash(keys[i]->data(), keys[i]->size(), seed);
+        }
+        placed = not sameHashes(hashes) and placeKeys(hashes, seed, placedDisplacements, slots);
+        if (not placed) {
+            seed++;
+        }
+    }
+
+    std::vector<uint32_t> keyAt(total);
+    for (uint32_t i = 0; i < total; i++) {
+        keyAt[placed ? slots[i] : i] = i;
+    }
+
+    if (placed) {
+        displacements = static_cast<int32_t *>(resource->allocate(total * sizeof(int32_t), alignof(int32_t)));
+        std::copy(placedDisplacements.begin(), placedDisplacements.end(), displacements);
+    }
+    entries = static_cast<Entry *>(resource->allocate(total * sizeof(Entry), alignof(Entry)));
+    JSONMAX_TRY {
+        for (; count < total; count++) {
+            new(entries + count) Entry(std::piecewise_construct, std::forward_as_tuple(*keys[keyAt[count]]),
+                                       std::forward_as_tuple(*values[keyAt[count]], resource));
+        }
+    } JSONMAX_CATCH_ALL {
+        for (uint32_t i = 0; i < count; i++) {
+            entries[i].~Entry();
+        }
+        resource->deallocate(entries, total * sizeof(Entry), alignof(Entry));
+        if (displacements) {
+            resource->deallocate(displacements, total * sizeof(int32_t), alignof(int32_t));
+        }
+        JSONMAX_RETHROW;
+    }
+}
+
+FrozenObject::FrozenObject(FrozenObject &&other) noexcept
+        : entries(other.entries), displacements(other.displacements), count(other.count), seed(other.seed),
+          resource(other.resource) {
+    other.entries = nullptr;
+    other.displacements = nullptr;
+    other.count = 0;
+}
+
+FrozenObject::~FrozenObject() {
+    if (count == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].~Entry();
+    }
+    resource->deallocate(entries, count * sizeof(Entry), alignof(Entry));
+    if (displacements) {
+        resource->deallocate(displacements, count * sizeof(int32_t), alignof(int32_t));
+    }
+}
+
+const Element *FrozenObject::find(const std::string &key) const {
+    return lookup(key.data(), key.size());
+}
+
+const Element *FrozenObject::find(const char *key) const {
+    return lookup(key, std::char_traits<char>::length(key));
+}
+
+#if __cplusplus >= 201703L
+
+const Element *FrozenObject::find(std::string_view key) const {
+    return lookup(key.data(), key.size());
+}
+
+#endif
+
+bool FrozenObject::exists(const std::string &key) const {
+    return find(key) != nullptr;
+}
+
+size_t FrozenObject::size() const {
+    return count;
+}
+
+bool FrozenObject::empty() const {
+    return count == 0;
+}
+
+const FrozenObject::Entry *FrozenObject::begin() const {
+    return entries;
+}
+
+const FrozenObject::Entry *FrozenObject::end() const {
+    return entries + count;
+}
+
+std::string FrozenObject::toString(unsigned int ind) const {
+    return toString(WriteOptions(false, ind));
+}
+
+std::string FrozenObject::toString(const WriteOptions &options) const {
+    StringOutput output;
+    if (options.exactSize) {
+        output.getString().reserve(Writer::serializedSize(*this, options));
+    }
+    Writer(output, options).write(*this);
+    return std::move(output.getString());
+}
+
+MemoryResource *FrozenObject::getResource() const {
+    return resource;
+}
+
+const Element *FrozenObject::lookup(const char *key, size_t length) const {
+    if (count == 0) {
+        return nullptr;
+    }
+    if (not displacements) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (entries[i].first.size() == length and entries[i].first.compare(0, length, key, length) == 0) {
+                return &entries[i].second;
+            }
+        }
+        return nullptr;
+    }
+    const Entry &entry = entries[slot(frozenHash(key, length, seed))];
+    if (entry.first.size() == length and entry.first.compare(0, length, key, length) == 0) {
+        return &entry.second;
+    }
+    return nullptr;
+}
+
+uint32_t FrozenObject::slot(uint64_t hash) const {
+    int32_t displacement = displacements[frozenBucket(hash, seed, count)];
+    if (displacement < 0) {
+        return static_cast<uint32_t>(-(displacement + 1));
+    }
+    return frozenSlot(hash, displacement, count);
+}
+
+
+namespace {
+
+    /// Objects up to this size compare every pair of keys to find duplicates, larger ones sort on the hashes
+    const size_t duplicateScanLimit = 16;
+
+}
+
+ObjectBuilder::ObjectBuilder(Storage _storage, MemoryResource *_resource) : storage(_storage), resource(_resource) {}
+
+void ObjectBuilder::reserve(size_t count) {
+    pairs.reserve(count);
+}
+
+void ObjectBuilder::add(std::string key, Element value) {
+    pairs.emplace_back(std::move(key), Element(resource));
+    pairs.back().second = std::move(value);
+}
+
+size_t ObjectBuilder::size() const {
+    return pairs.size();
+}
+
+Object ObjectBuilder::build() {
+    removeDuplicates();
+
+    Object object(storage, resource);
+    object.reserve(pairs.size());
+    for (auto &pair: pairs) {
+        object.insert(std::move(pair.first)) = std::move(pair.second);
+    }
+    pairs.clear();
+    return object;
+}
+
+void ObjectBuilder::removeDuplicates() {
+    size_t count = pairs.size();
+    std::vector<bool> dropped;
+
+    auto merge = [this, &dropped](size_t first, size_t later) {
+        if (dropped.empty()) {
+            dropped.resize(pairs.size(), false);
+        }
+        pairs[first].second = std::move(pairs[later].second);
+        dropped[later] = true;
+    };
+
+    if (count <= duplicateScanLimit) {
+        for (size_t later = 1; later < count; later++) {
+            for (size_t first = 0; first < later; first++) {
+                if (pairs[first].first == pairs[later].first) {
+                    merge(first, later);
+                    break;
+                }
+            }
+        }
+    } else {
+        // Equal keys end up next to each other, in the order they were added
+        std::vector<std::pair<uint64_t, size_t>> hashes(count);
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = std::make_pair(Utils::hash(pairs[i].first.data(), pairs[i].first.size()), i);
+        }
+        std::sort(hashes.begin(), hashes.end());
+        for (size_t start = 0; start < count;) {
+            size_t end = start + 1;
+            while (end < count and hashes[end].first == hashes[start].first) {
+                end++;
+            }
+            // Pairs with the same hash, almost always just one
+            for (size_t later = start + 1; later < end; later++) {
+                for (size_t first = start; first < later; first++) {
+                    size_t firstIndex = hashes[first].second;
+                    size_t laterIndex = hashes[later].second;
+                    if ((dropped.empty() or not dropped[firstIndex]) and pairs[firstIndex].first == pairs[laterIndex].first) {
+                        merge(firstIndex, laterIndex);
+                        break;
+                    }
+                }
+            }
+            start = end;
+        }
+    }
+
+    if (dropped.empty()) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (not dropped[i]) {
+            if (kept != i) {
+                pairs[kept] = std::move(pairs[i]);
+            }
+            kept++;
+        }
+    }
+    pairs.erase(pairs.begin() + kept, pairs.end());
+}
+
+
+ArrayBuilder::ArrayBuilder(MemoryResource *resource) : array(resource) {}
+
+void ArrayBuilder::reserve(size_t elements) {
+    array.reserve(elements);
+}
+
+void ArrayBuilder::add(Element element) {
+    if (element.getResource() == array.get_allocator().resource()) {
+        array.push_back(std::move(element));
+    } else {
+        array.emplace_back(element, array.get_allocator().resource());
+    }
+}
+
+size_t ArrayBuilder::size() const {
+    return array.size();
+}
+
+Array ArrayBuilder::build() {
+    Array built(std::move(array));
+    array = Array(built.get_allocator().resource());
+    return built;
+}
+
+
+Path::Path(const std::string &_pointer) : pointer(_pointer) {
+    if (pointer.empty()) {
+        return;
+    }
+    if (pointer[0] != '/') {
+        JSONMAX_THROW(PathException("Invalid JSON Pointer '" + pointer + "': it does not start with '/'"));
+    }
+
+    size_t start = 1;
+    while (true) {
+        size_t end = pointer.find('/', start);
+        if (end == std::string::npos) {
+            end = pointer.size();
+        }
+
+        Token token;
+        for (size_t i = start; i < end; i++) {
+            if (pointer[i] != '~') {
+                token.key += pointer[i];
+            } else if (i + 1 < end and pointer[i + 1] == '0') {
+                token.key += '~';
+                i++;
+            } else if (i + 1 < end and pointer[i + 1] == '1') {
+                token.key += '/';
+                i++;
+            } else {
+                JSONMAX_THROW(PathException("Invalid JSON Pointer '" + pointer +
+                                            "': '~' is not followed by '0' or '1'"));
+            }
+        }
+        token.hash = Utils::hash(token.key.data(), token.key.size());
+
+        // Array indexes are digits without leading zeros
+        token.index = std::string::npos;
+        bool digits = not token.key.empty() and token.key.size() < 19 and
+                      (token.key[0] != '0' or token.key.size() == 1);
+        for (char c: token.key) {
+            digits = digits and c >= '0' and c <= '9';
+        }
+        if (digits) {
+            token.index = static_cast<size_t>(std::stoull(token.key));
+        }
+
+        tokens.push_back(std::move(token));
+        if (end == pointer.size()) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+Element *Path::resolve(Element &root) const {
+    return walk(root, true);
+}
+
+const Element *Path::resolve(const Element &root) const {
+    return walk(root, false);
+}
+
+Element *Path::walk(const Element &root, bool changing) const {
+    auto *current = const_cast<Element *>(&root);
+    for (const Token &token: tokens) {
+        if (current->isObject()) {
+            Object &object = current->getObject();
+            if (changing) {
+                // The result can be used to change the object
+                object.markChanged();
+            }
+            current = object.lookup(token.key, token.hash);
+            if (not current or current->getType() == UNINITIALIZED) {
+                return nullptr;
+            }
+        } else if (current->isArray()) {
+            // The result can be used to change the array, so it is exposed like through getArray
+            const Array &array = changing ? current->getArray() : static_cast<const Element *>(current)->getArray();
+            if (token.index >= array.size()) {
+                return nullptr;
+            }
+            current = const_cast<Element *>(&array[token.index]);
+        } else {
+            return nullptr;
+        }
+    }
+    return current;
+}
+
+size_t Path::size() const {
+    return tokens.size();
+}
+
+const std::string &Path::toString() const {
+    return pointer;
+}
+
+
+namespace {
+
+    /**
+     * Encodes a value with its type, returns false if the value can't be indexed
+     * Integers are encoded as doubles so they match fractions with the same value
+     */
+    bool indexKey(const Element &value, std::string &key) {
+        switch (value.getType()) {
+            case STRING:
+                key.assign(1, 's');
+                key += value.getString();
+                return true;
+            case INTEGER:
+            case FRACTION: {
+                double number = value.isInt() ? value.getInt() : value.getDouble();
+                if (number == 0) {
+                    number = 0;  // -0.0 equals 0.0
+                }
+                key.assign(1 + sizeof(double), 'n');
+                std::memcpy(&key[1], &number, sizeof(double));
+                return true;
+            }
+            case BOOLEAN:
+                key.assign(value.getBool() ? "t" : "f");
+                return true;
+            case JSON_NULL:
+                key.assign("z");
+                return true;
+            default:
+                return false;
+        }
+    }
+
+}
+
+const uint32_t ArrayIndex::none;
+
+ArrayIndex::Iterator::Iterator(const ArrayIndex *_index, uint32_t _position) : index(_index), position(_position) {}
+
+ArrayIndex::Iterator::reference ArrayIndex::Iterator::operator*() const {
+    return (*index->array)[position];
+}
+
+ArrayIndex::Iterator::pointer ArrayIndex::Iterator::operator->() const {
+    return &(*index->array)[position];
+}
+
+ArrayIndex::Iterator &ArrayIndex::Iterator::operator++() {
+    position = index->next[position];
+    return *this;
+}
+
+ArrayIndex::Iterator ArrayIndex::Iterator::operator++(int) {
+    Iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool ArrayIndex::Iterator::operator==(const Iterator &other) const {
+    return position == other.position;
+}
+
+bool ArrayIndex::Iterator::operator!=(const Iterator &other) const {
+    return position != other.position;
+}
+
+ArrayIndex::Range::Range(const ArrayIndex *_index, uint32_t _first) : index(_index), first(_first) {}
+
+ArrayIndex::Iterator ArrayIndex::Range::begin() const {
+    return Iterator(index, first);
+}
+
+ArrayIndex::Iterator ArrayIndex::Range::end() const {
+    return Iterator(index, none);
+}
+
+bool ArrayIndex::Range::empty() const {
+    return first == none;
+}
+
+ArrayIndex::ArrayIndex(const Array &_array, const std::string &pointer) : ArrayIndex(_array, Path(pointer)) {}
+
+ArrayIndex::ArrayIndex(const Array &_array, Path _path) : array(&_array), path(std::move(_path)) {
+    update();
+}
+
+const Element *ArrayIndex::find(const Element &value) {
+    const Chain *chain = lookup(value);
+    return chain ? &(*array)[chain->first] : nullptr;
+}
+
+ArrayIndex::Range ArrayIndex::findAll(const Element &value) {
+    const Chain *chain = lookup(value);
+    if (not chain) {
+        return Range(this, none);
+    }
+    return Range(this, chain->first);
+}
+
+size_t ArrayIndex::count(const Element &value) {
+    const Chain *chain = lookup(value);
+    if (not chain) {
+        return 0;
+    }
+    size_t amount = 1;
+    for (uint32_t position = chain->first; next[position] != none; position = next[position]) {
+        amount++;
+    }
+    return amount;
+}
+
+void ArrayIndex::update() {
+    if (array->size() < next.size()) {
+        // Elements were removed, the positions in the chains are no longer valid
+        rebuild();
+        return;
+    }
+
+    std::string key;
+    for (auto position = static_cast<uint32_t>(next.size()); position < array->size(); position++) {
+        next.push_back(none);
+        const Element *field = path.resolve((*array)[position]);
+        if (not field or not indexKey(*field, key)) {
+            continue;
+        }
+        auto inserted = chains.emplace(key, Chain{position, position});
+        if (not inserted.second) {
+            next[inserted.first->second.last] = position;
+            inserted.first->second.last = position;
+        }
+    }
+}
+
+void ArrayIndex::rebuild() {
+    chains.clear();
+    next.clear();
+    update();
+}
+
+const Path &ArrayIndex::getPath() const {
+    return path;
+}
+
+const ArrayIndex::Chain *ArrayIndex::lookup(const Element &value) {
+    update();
+    std::string key;
+    if (not indexKey(value, key)) {
+        return nullptr;
+    }
+    auto itr = chains.find(key);
+    return itr == chains.end() ? nullptr : &itr->second;
+}
+
+size_t ArrayIndex::KeyHash::operator()(const std::string &key) const {
+    return static_cast<size_t>(Utils::hash(key.data(), key.size()));
+}
+
+ArrayIndex buildIndex(const Array &array, const std::string &pointer) {
+    return ArrayIndex(array, pointer);
+}
+
+
+std::atomic<uint64_t> Object::epoch(0);
+
+Object::Object(Storage _storage, MemoryResource *_resource)
+        : storage(_storage), resource(_resource), cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
+    switch (storage) {
+        case HASHMAP: 
+            data.elementsHashmap = Memory::create<HashmapStorage>(resource, resource);
+            break;
+        case MAP:
+            data.elementsMap = Memory::create<MapStorage>(resource, resource);
+            break;
+        case VECTOR:
+            data.elementsVector = Memory::create<VectorStorage>(resource, resource);
+            break;
+        case ADAPTIVE:
+            data.elementsAdaptive = Memory::create<AdaptiveStorage>(resource, resource);
+            break;
+        case INDEXED:
+            data.elementsAdaptive = Memory::create<AdaptiveStorage>(resource, resource, true);
+            break;
+        case FLAT_HASHMAP:
+            data.elementsFlatHashmap = Memory::create<FlatHashMap>(resource, resource);
+            break;
+        case SHAPED:
+            data.elementsShaped = Memory::create<ShapedStorage>(resource, resource);
+            break;
+    }
+}
+
+Object::~Object() {
+    reset();
+}
+
+
+void Object::reset() {
+    markChanged();
+    Memory::destroy(resource, jsonCache);
+    jsonCache = nullptr;
+    switch (storage) {
+        case HASHMAP:
+            Memory::destroy(resource, data.elementsHashmap);
+            break;
+        case MAP:
+            Memory::destroy(resource, data.elementsMap);
+            break;
+        case VECTOR:
+            Memory::destroy(resource, data.elementsVector);
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            Memory::destroy(resource, data.elementsAdaptive);
+            break;
+        case FLAT_HASHMAP:
+            Memory::destroy(resource, data.elementsFlatHashmap);
+            break;
+        case SHAPED:
+            Memory::destroy(resource, data.elementsShaped);
+            break;
+    }
+}
+
+
+void Object::move(Object &&obj) {
+    // The pairs leave the temp object, its parents change
+    obj.detach();
+    storage = obj.storage;
+    resource = obj.resource;
+    cachedHash.store(obj.cachedHash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    hashEpoch.store(obj.hashEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    jsonCache = obj.jsonCache;
+    obj.jsonCache = nullptr;
+    stale.store(obj.stale.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    linked.store(obj.linked.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    obj.cachedHash.store(0, std::memory_order_relaxed);
+    obj.stale.store(true, std::memory_order_relaxed);
+    obj.linked.store(false, std::memory_order_relaxed);
+    switch (obj.storage) {
+        case HASHMAP:
+            data.elementsHashmap = obj.data.elementsHashmap;
+            obj.data.elementsHashmap = nullptr;
+            break;
+        case MAP:
+            data.elementsMap = obj.data.elementsMap;
+            obj.data.elementsMap = nullptr;
+            break;
+        case VECTOR:
+            data.elementsVector = obj.data.elementsVector;
+            obj.data.elementsVector = nullptr;
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            data.elementsAdaptive = obj.data.elementsAdaptive;
+            obj.data.elementsAdaptive = nullptr;
+            break;
+        case FLAT_HASHMAP:
+            data.elementsFlatHashmap = obj.data.elementsFlatHashmap;
+            obj.data.elementsFlatHashmap = nullptr;
+            break;
+        case SHAPED:
+            data.elementsShaped = obj.data.elementsShaped;
+            obj.data.elementsShaped = nullptr;
+            break;
+    }
+    if (linked.load(std::memory_order_relaxed)) {
+        // The nested objects still point to the temp object
+        linkChildren();
+    }
+}
+
+void Object::copy(const Object &obj) {
+    // The hash is not taken over, the copied nested objects are not linked to this one yet
+    storage = obj.storage;
+    switch (obj.storage) {
+        case HASHMAP:
+            data.elementsHashmap = Memory::create<HashmapStorage>(resource, resource);
+            data.elementsHashmap->reserve(obj.data.elementsHashmap->size());
+            for (auto &elem: *obj.data.elementsHashmap) {
+                data.elementsHashmap->emplace(std::piecewise_construct, std::forward_as_tuple(elem.first),
+                                              std::forward_as_tuple(elem.second, resource));
+            }
+            break;
+        case MAP:
+            data.elementsMap = Memory::create<MapStorage>(resource, resource);
+            for (auto &elem: *obj.data.elementsMap) {
+                data.elementsMap->emplace_hint(data.elementsMap->end(), std::piecewise_construct,
+                                               std::forward_as_tuple(elem.first),
+                                               std::forward_as_tuple(elem.second, resource));
+            }
+            break;
+        case VECTOR:
+            data.elementsVector = Memory::create<VectorStorage>(resource, resource);
+            data.elementsVector->reserve(obj.data.elementsVector->size());
+            for (auto &elem: *obj.data.elementsVector) {
+                data.elementsVector->emplace_back(std::piecewise_construct, std::forward_as_tuple(elem.first),
+                                                  std::forward_as_tuple(elem.second, resource));
+            }
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            data.elementsAdaptive = Memory::create<AdaptiveStorage>(resource, *obj.data.elementsAdaptive, resource);
+            break;
+        case FLAT_HASHMAP:
+            data.elementsFlatHashmap = Memory::create<FlatHashMap>(resource, *obj.data.elementsFlatHashmap, resource);
+            break;
+        case SHAPED:
+            data.elementsShaped = Memory::create<ShapedStorage>(resource, *obj.data.elementsShaped, resource);
+            break;
+    }
+}
+
+Object::Object(Object &&obj) noexcept : cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
+    move(std::move(obj));
+}
+
+
+Object::Object(const Object &obj)
+        : resource(defaultResource()), cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
+    copy(obj);
+}
+
+Object::Object(const Object &obj, MemoryResource *_resource)
+        : resource(_resource), cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
+    copy(obj);
+}
+
+Object& Object::operator=(const Object &obj) {
+    if (&obj != this) {
+        reset();
+        copy(obj);
+    }
+    return *this;
+}
+
+Object& Object::operator=(Object &&obj) noexcept {
+    if (&obj != this) {
+        reset();
+        move(std::move(obj));
+    }
+    return *this;
+}
+
+
+Element &Object::operator[](const std::string &member) {
+    markChanged();
+    Element *element = lookup(member);
+    if (element) {
+        return *element;
+    }
+    return insert(member);
+}
+
+Element &Object::operator[](const char *member) {
+    markChanged();
+    Element *element = lookup(member, std::char_traits<char>::length(member));
+    if (element) {
+        return *element;
+    }
+    return insert(member);
+}
+
+Element *Object::find(const std::string &key) {
+    markChanged();
+    Element *element = lookup(key);
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+const Element *Object::find(const std::string &key) const {
+    Element *element = lookup(key);
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+Element *Object::find(const char *key) {
+    markChanged();
+    Element *element = lookup(key, std::char_traits<char>::length(key));
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+const Element *Object::find(const char *key) const {
+    Element *element = lookup(key, std::char_traits<char>::length(key));
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+#if __cplusplus >= 201703L
+
+Element &Object::operator[](std::string_view member) {
+    markChanged();
+    Element *element = lookup(member.data(), member.size());
+    if (element) {
+        return *element;
+    }
+    return insert(std::string(member));
+}
+
+Element *Object::find(std::string_view key) {
+    markChanged();
+    Element *element = lookup(key.data(), key.size());
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+const Element *Object::find(std::string_view key) const {
+    Element *element = lookup(key.data(), key.size());
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+#endif
+
+Element *Object::lookup(const std::string &key) const {
+    if (storage == VECTOR) {
+        for (auto &elem: *data.elementsVector) {
+            if (elem.first == key) {
+                return &elem.second;
+            }
+        }
+    } else if (storage == MAP) {
+        auto itr = data.elementsMap->find(key);
+        if (itr != data.elementsMap->end()) {
+            return &itr->second;
+        }
+    } else if (storage == HASHMAP) {
+        auto itr = data.elementsHashmap->find(key);
+        if (itr != data.elementsHashmap->end()) {
+            return &itr->second;
+        }
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->lookup(key.data(), key.size());
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->lookup(key.data(), key.size());
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->lookup(key.data(), key.size());
+    }
+    return nullptr;
+}
+
+Element *Object::lookup(const char *key, size_t length) const {
+    if (storage == VECTOR) {
+        for (auto &elem: *data.elementsVector) {
+            if (elem.first.size() == length and elem.first.compare(0, length, key, length) == 0) {
+                return &elem.second;
+            }
+        }
+        return nullptr;
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->lookup(key, length);
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->lookup(key, length);
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->lookup(key, length);
+    }
+#if __cplusplus >= 201703L
+    if (storage == MAP) {
+        auto itr = data.elementsMap->find(std::string_view(key, length));
+        return itr != data.elementsMap->end() ? &itr->second : nullptr;
+    }
+#endif
+    // std::unordered_map has no heterogeneous lookup before C++20, short keys fit in the small string buffer
+    return lookup(std::string(key, length));
+}
+
+Element *Object::lookup(const std::string &key, uint64_t hash) const {
+    if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->lookup(key.data(), key.size(), hash);
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->lookup(key.data(), key.size(), hash);
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->lookup(key.data(), key.size(), hash);
+    }
+    return lookup(key);
+}
+
+Element &Object::insert(std::string key) {
+    markChanged();
+    if (storage == VECTOR) {
+        data.elementsVector->emplace_back(std::move(key), Element(resource));
+        return data.elementsVector->back().second;
+    } else if (storage == MAP) {
+        return data.elementsMap->emplace(std::move(key), Element(resource)).first->second;
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->insert(std::move(key));
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->insert(std::move(key));
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->insert(std::move(key));
+    } else {
+        return data.elementsHashmap->emplace(std::move(key), Element(resource)).first->second;
+    }
+}
+
+std::string Object::toString(unsigned int ind) const {
+    return toString(WriteOptions(false, ind));
+}
+
+std::string Object::toString(const WriteOptions &options) const {
+    StringOutput output;
+    // Cached fragments are measured without visiting the unchanged objects again
+    if (options.exactSize or options.cacheFragments) {
+        output.getString().reserve(Writer::serializedSize(*this, options));
+    }
+    Writer(output, options).write(*this);
+    return std::move(output.getString());
+}
+
+
+void Object::remove(const std::string &key) {
+    markChanged();
+    if (storage == VECTOR) {
+        for (auto itr = data.elementsVector->begin(); itr != data.elementsVector->end(); ++itr) {
+            if (itr->first == key) {
+                data.elementsVector->erase(itr);
+                break;
+            }
+        }
+    } else if (storage == MAP) {
+        data.elementsMap->erase(key);
+    } else if (storage == HASHMAP) {
+        data.elementsHashmap->erase(key);
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        data.elementsAdaptive->remove(key.data(), key.size());
+    } else if (storage == FLAT_HASHMAP) {
+        data.elementsFlatHashmap->remove(key.data(), key.size());
+    } else if (storage == SHAPED) {
+        data.elementsShaped->remove(key.data(), key.size());
+    }
+}
+
+
+std::vector<Pair> Object::pairs() const {
+    std::vector<Pair> pairs;
+    if (storage == VECTOR) {
+        for (auto &elem: *data.elementsVector) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == MAP) {
+        for (auto &elem: *data.elementsMap) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == HASHMAP) {
+        for (auto &elem: *data.elementsHashmap) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        for (auto &elem: *data.elementsAdaptive) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == FLAT_HASHMAP) {
+        for (auto &elem: *data.elementsFlatHashmap) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == SHAPED) {
+        for (auto &member: *this) {
+            pairs.emplace_back(member.getKey(), member.getValue());
+        }
+    }
+    return pairs;
+}
+
+ObjectIterator<Element> Object::begin() {
+    markChanged();
+    return ObjectIterator<Element>(*this, false);
+}
+
+ObjectIterator<Element> Object::end() {
+    return ObjectIterator<Element>(*this, true);
+}
+
+ObjectIterator<const Element> Object::begin() const {
+    return ObjectIterator<const Element>(*this, false);
+}
+
+ObjectIterator<const Element> Object::end() const {
+    return ObjectIterator<const Element>(*this, true);
+}
+
+ObjectRange<KeyIterator> Object::keys() const {
+    return ObjectRange<KeyIterator>(KeyIterator(begin()), KeyIterator(end()));
+}
+
+ObjectRange<ValueIterator<Element>> Object::values() {
+    return ObjectRange<ValueIterator<Element>>(ValueIterator<Element>(begin()), ValueIterator<Element>(end()));
+}
+
+ObjectRange<ValueIterator<const Element>> Object::values() const {
+    return ObjectRange<ValueIterator<const Element>>(ValueIterator<const Element>(begin()),
+                                                     ValueIterator<const Element>(end()));
+}
+
+size_t Object::size() const {
+    if (storage == VECTOR) {
+        return data.elementsVector->size();
+    } else if (storage == MAP) {
+        return data.elementsMap->size();
+    } else if (storage == HASHMAP) {
+        return data.elementsHashmap->size();
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->size();
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->size();
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->size();
+    }
+    return 0;
+}
+
+bool Object::exists(const std::string &key) const {
+    return find(key) != nullptr;
+}
+
+bool Object::empty() const {
+    if (storage == VECTOR) {
+        for (auto& element: *data.elementsVector) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == MAP) {
+        for (auto& element: *data.elementsMap) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == HASHMAP) {
+        for (auto& element: *data.elementsHashmap) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        for (auto& element: *data.elementsAdaptive) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == FLAT_HASHMAP) {
+        for (auto& element: *data.elementsFlatHashmap) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == SHAPED) {
+        return begin() == end();
+    }
+    return true;
+}
+
+void Object::clear() {
+    markChanged();
+    if (storage == VECTOR) {
+        data.elementsVector->clear();
+    } else if (storage == MAP) {
+        data.elementsMap->clear();
+    } else if (storage == HASHMAP) {
+        data.elementsHashmap->clear();
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        data.elementsAdaptive->clear();
+    } else if (storage == FLAT_HASHMAP) {
+        data.elementsFlatHashmap->clear();
+    } else if (storage == SHAPED) {
+        data.elementsShaped->clear();
+    }
+}
+
+void Object::reserve(size_t items) {
+    if (storage == VECTOR) {
+        data.elementsVector->reserve(items);
+    } else if (storage == HASHMAP) {
+        data.elementsHashmap->reserve(items);
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        data.elementsAdaptive->reserve(items);
+    } else if (storage == FLAT_HASHMAP) {
+        data.elementsFlatHashmap->reserve(items);
+    } else if (storage == SHAPED) {
+        data.elementsShaped->reserve(items);
+    }
+}
+
+MemoryResource *Object::getResource() const {
+    return resource;
+}
+
+FrozenObject Object::freeze(MemoryResource *frozenResource) const {
+    return FrozenObject(*this, frozenResource);
+}
+
+bool Object::operator==(const Object &other) const {
+    if (this == &other) {
+        return true;
+    }
+    uint64_t ours = freshHash();
+    uint64_t theirs = other.freshHash();
+    if (ours != 0 and theirs != 0 and ours != theirs) {
+        return false;
+    }
+
+    size_t count = 0;
+    for (const auto &member: *this) {
+        const std::string &key = member.getKey();
+        const Element *value = other.lookup(key.data(), key.size());
+        if (not value or value->getType() == UNINITIALIZED or *value != member.getValue()) {
+            return false;
+        }
+        count++;
+    }
+
+    // Every pair is present in the other object, which is equal if it has no other initialized pairs
+    if (count == other.size()) {
+        return true;
+    }
+    size_t otherCount = 0;
+    for (auto itr = other.begin(); itr != other.end(); ++itr) {
+        otherCount++;
+    }
+    return count == otherCount;
+}
+
+bool Object::operator!=(const Object &other) const {
+    return not (*this == other);
+}
+
+uint64_t Object::hash() const {
+    bool cacheable = true;
+    return hash(cacheable);
+}
+
+uint64_t Object::hash(bool &cacheable) const {
+    uint64_t cached = freshHash();
+    if (cached != 0) {
+        return cached;
+    }
+
+    // The sum of the pair hashes doesn't depend on the order of the keys
+    uint64_t current = epoch.load(std::memory_order_relaxed);
+    bool own = true;
+    uint64_t sum = 0;
+    size_t count = 0;
+    for (const auto &member: *this) {
+        const std::string &key = member.getKey();
+        sum += Utils::mix(Utils::hash(key.data(), key.size()) + Utils::mix(member.getValue().hash(own)));
+        count++;
+    }
+    uint64_t result = Utils::mix(sum ^ (count * 0x9e3779b97f4a7c15ull));
+    result = result == 0 ? 1 : result;
+    if (not own) {
+        // Exposed values can change without notice, so neither this hash nor those around it are kept
+        cacheable = false;
+        return result;
+    }
+    cacheFilled();
+    hashEpoch.store(current, std::memory_order_relaxed);
+    cachedHash.store(result, std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t Object::freshHash() const {
+    uint64_t cached = cachedHash.load(std::memory_order_relaxed);
+    if (cached == 0 or hashEpoch.load(std::memory_order_relaxed) != epoch.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    return cached;
+}
+
+void Object::markChanged() {
+    if (stale.load(std::memory_order_relaxed)) {
+        return;
+    }
+    clearCaches();
+    markParentsChanged();
+}
+
+void Object::detach() {
+    if (parent.load(std::memory_order_relaxed)) {
+        markParentsChanged();
+        parent.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void Object::markParentsChanged() {
+    // A stale parent has told its own parents already, nothing above it can have a cache since
+    Object *current = parent.load(std::memory_order_relaxed);
+    while (current and not current->stale.load(std::memory_order_relaxed)) {
+        current->clearCaches();
+        current = current->parent.load(std::memory_order_relaxed);
+    }
+}
+
+void Object::clearCaches() {
+    cachedHash.store(0, std::memory_order_relaxed);
+    if (jsonCache) {
+        jsonCache->valid = false;
+        // A slice of the parsed source is never valid again
+        jsonCache->source.reset();
+    }
+    // Changes to the elements are now seen by this object anyway
+    for (ObjectIterator<const Element> itr(*this, false, true), end(*this, true); itr != end; ++itr) {
+        itr->getValue().cached.store(false, std::memory_order_relaxed);
+    }
+    stale.store(true, std::memory_order_relaxed);
+}
+
+void Object::linkChildren() const {
+    for (const auto &member: *this) {
+        linkValue(member.getValue(), const_cast<Object *>(this));
+    }
+    linked.store(true, std::memory_order_relaxed);
+}
+
+void Object::cacheFilled() const {
+    linkChildren();
+    // Uninitialized elements as well, references to them can be kept to assign them later
+    for (ObjectIterator<const Element> itr(*this, false, true), end(*this, true); itr != end; ++itr) {
+        itr->getValue().cached.store(true, std::memory_order_relaxed);
+    }
+    stale.store(false, std::memory_order_relaxed);
+}
+
+void Object::linkValue(const Element &value, Object *parent) {
+    if (value.type == OBJECT) {
+        value.data.object->parent.store(parent, std::memory_order_relaxed);
+    } else if (value.type == ARRAY and not value.exposed) {
+        // Exposed arrays can leave through the references to them, the caches around them never include them
+        value.linked.store(true, std::memory_order_relaxed);
+        for (const Element &element: *value.data.array) {
+            linkValue(element, parent);
+        }
+    }
+}
+
+void Object::setAdaptiveThreshold(size_t threshold) {
+    AdaptiveStorage::setThreshold(threshold);
+}
+
+size_t Object::KeyHash::operator()(const std::string &key) const {
+    return static_cast<size_t>(Utils::hash(key.data(), key.size()));
+}
+
+
+namespace {
+
+    inline uint64_t rotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    /// One SipRound on the four words of the state
+    inline void sipRound(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3) {
+        v0 += v1; v1 = rotateLeft(v1, 13); v1 ^= v0; v0 = rotateLeft(v0, 32);
+        v2 += v3; v3 = rotateLeft(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotateLeft(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotateLeft(v1, 17); v1 ^= v2; v2 = rotateLeft(v2, 32);
+    }
+
+}
+
+uint64_t Utils::hash(const char *key, size_t length) {
+    return hash(key, length, hashKey());
+}
+
+uint64_t Utils::hash(const char *key, size_t length, const HashKey &secret) {
+    // SipHash-1-3, the key enters the state of every round, so differences can't be cancelled without knowing it
+    uint64_t v0 = secret.first ^ 0x736f6d6570736575ull;
+    uint64_t v1 = secret.second ^ 0x646f72616e646f6dull;
+    uint64_t v2 = secret.first ^ 0x6c7967656e657261ull;
+    uint64_t v3 = secret.second ^ 0x7465646279746573ull;
+    uint64_t last = static_cast<uint64_t>(length) << 56;
+
+    // Eight bytes at a time, the tail goes into the last word together with the length
+    for (; length >= 8; key += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, key, 8);
+        v3 ^= word;
+        sipRound(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, key, length);
+    last |= tail;
+    v3 ^= last;
+    sipRound(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+const Utils::HashKey &Utils::hashKey() {
+    // random_device may be deterministic on some platforms, so mix in the clock and an address as well
+    static const HashKey key = [] {
+        std::random_device device;
+        uint64_t first = (static_cast<uint64_t>(device()) << 32) ^ device();
+        uint64_t second = (static_cast<uint64_t>(device()) << 32) ^ device();
+        first ^= static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+        second ^= mix(reinterpret_cast<uintptr_t>(&device));
+        return HashKey(first, second);
+    }();
+    return key;
+}
+
+uint64_t Utils::mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    return value;
+}
+
+
+std::string toString(Type type) {
+    switch (type) {
+        case INTEGER:
+            return "INTEGER";
+        case BOOLEAN:
+            return "BOOLEAN";
+        case FRACTION:
+            return "FLOATING POINT";
+        case OBJECT:
+            return "JSON OBJECT";
+        case STRING:
+            return "STRING";
+        case ARRAY:
+            return "JSON ARRAY";
+        case JSON_NULL:
+            return "JSON NULL";
+        case UNINITIALIZED:
+            return "UNINITIALIZED";
+    }
+}
+
+
+ParseError::ParseError() : code(PARSE_SUCCESS), offset(0) {}
+
+ParseError::ParseError(ParseErrorCode _code, size_t _offset, std::string _excerpt)
+        : code(_code), offset(_offset), excerpt(std::move(_excerpt)) {}
+
+ParseError::operator bool() const {
+    return code != PARSE_SUCCESS;
+}
+
+ParseErrorCode ParseError::getCode() const {
+    return code;
+}
+
+size_t ParseError::getOffset() const {
+    return offset;
+}
+
+const char *ParseError::getMessage() const {
+    switch (code) {
+        case PARSE_SUCCESS:
+            return "No error";
+        case INVALID_VALUE:
+            return "Invalid Json, value is not valid.";
+        case NUMBER_OUT_OF_RANGE:
+            return "Cannot parse, number is out of range.";
+        case INVALID_STRING:
+            return "Invalid Json, string is invalid as per Json rules.";
+        case MISSING_KEY:
+            return "Invalid Json, missing key in object";
+        case UNTERMINATED_KEY:
+            return "Invalid Json, key in object has no ending";
+        case MISSING_COLON:
+            return "Invalid Json, no ':' between key and value";
+        case INVALID_OBJECT_START:
+            return "Invalid Json: object does not start with '{'";
+        case INVALID_OBJECT_END:
+            return "Invalid Json: object does not end with '}'";
+        case INVALID_ARRAY_START:
+            return "Invalid Json: array does not start with '['";
+        case INVALID_ARRAY_END:
+            return "Invalid Json: array does not end with ']'";
+    }
+    return "Unknown error";
+}
+
+const std::string &ParseError::getExcerpt() const {
+    return excerpt;
+}
+
+std::string ParseError::getDescription() const {
+    switch (code) {
+        case INVALID_VALUE:
+            return "Invalid Json, '" + excerpt + "' is not valid.";
+        case NUMBER_OUT_OF_RANGE:
+            return "Cannot parse, number '" + excerpt + "' is out of range.";
+        default:
+            if (code == PARSE_SUCCESS or excerpt.empty()) {
+                return getMessage();
+            }
+            return std::string(getMessage()) + " at '" + excerpt + "'";
+    }
+}
+
+size_t ParseError::getLine(const std::string &json) const {
+    size_t end = std::min(offset, json.size());
+    return 1 + static_cast<size_t>(std::count(json.begin(), json.begin() + end, '\n'));
+}
+
+size_t ParseError::getColumn(const std::string &json) const {
+    size_t end = std::min(offset, json.size());
+    size_t lineStart = end == 0 ? std::string::npos : json.rfind('\n', end - 1);
+    return lineStart == std::string::npos ? end + 1 : end - lineStart;
+}
+
+
+namespace {
+
+    /// Longest excerpt of the json that a ParseError keeps
+    const size_t maxExcerptLength = 32;
+
+}
+
+Element parse(const std::string &json, MemoryResource *resource, Storage storage) {
+    return Parser(json, resource, storage).parse();
+}
+
+ParseError parse(const std::string &json, Element &result, MemoryResource *resource, Storage storage) {
+    return Parser(json, resource, storage).parse(result);
+}
+
+Element parseFile(const std::string &fileName, MemoryResource *resource, Storage storage) {
+    std::string fileContent = Utils::fileToString(fileName);
+    return parse(fileContent, resource, storage);
+}
+
+Element parseWithSource(const std::string &json, MemoryResource *resource, Storage storage) {
+    // The copy itself comes from the resource, its characters don't, just like the strings of elements
+    std::shared_ptr<const std::string> source =
+            std::allocate_shared<std::string>(Allocator<std::string>(resource), json);
+    return Parser(*source, 0, source->size(), resource, nullptr, source, storage).parse();
+}
+
+Element Parser::parse() {
+    Element element = parseElement();
+    if (failed()) {
+        JSONMAX_THROW(ParseException(*error, json));
+    }
+    return element;
+}
+
+ParseError Parser::parse(Element &result) {
+    Element element = parseElement();
+    if (not failed()) {
+        result = std::move(element);
+    }
+    return *error;
+}
+
+Element Parser::parseElement() {
+    trim();
+    size_t size = remainingSize();
+
+    Element element(memoryResource);
+    if (size == 0) {
+        return element;
+    } else if (size == 4 and json.compare(index, size, "true") == 0) {
+        element = true;
+    } else if (size == 5 and json.compare(index, size, "false") == 0) {
+        element = false;
+    } else if (size == 4 and json.compare(index, size, "null") == 0) {
+        element = nullptr;
+    } else if (currentSymbol() == '{') {
+        return ObjectParser(json, index, endIndex, memoryResource, error, source, storage).parseElement();
+    } else if (currentSymbol() == '[') {
+        return ArrayParser(json, index, endIndex, memoryResource, error, source, storage).parseElement();
+    } else if (currentSymbol() == '"') {
+        return StringParser(json, index, endIndex, memoryResource, error).parseElement();
+    } else {
+        return NumberParser(json, index, endIndex, memoryResource, error).parseElement();
+    }
+    return element;
+}
+
+void Parser::moveToNonEmptyPosition() {
+    index = json.find_first_not_of(" \t\n", index);
+    if (index == std::string::npos) {
+        index = endIndex;
+    }
+}
+
+
+void Parser::trim() {
+    moveToNonEmptyPosition();
+    trimEndWhitespace();
+}
+
+
+bool Parser::endOfParsing() const {
+    return index == std::string::npos or index >= endIndex - 1;
+}
+
+void Parser::trimEndWhitespace() {
+    endIndex = getJson().find_last_not_of(" \t\n", lastPosition());
+    if (endIndex == std::string::npos) {
+        endIndex = index;
+    } else {
+        endIndex++;
+    }
+}
+
+size_t Parser::findIndexAfterElement(char symbol) {
+    bool skip = false;
+    bool inString = false;
+
+    int arrayCounter = 0;
+    int objectCounter = 0;
+    for (size_t i = index; i <= lastPosition(); i++) {
+        char current = json[i];
+
+        if (skip) {
+            skip = false;
+            continue;
+        } else if (inString) {
+            // An escaped quotation mark doesn't end the string
+            skip = current == '\\';
+            inString = current != '"';
+            continue;
+        }
+
+        if (current == symbol and objectCounter == 0 and arrayCounter == 0) {
+            return i;
+        }
+
+        if (current == '\\') {
+            skip = true;
+        } else if (current == '"') {
+            inString = true;
+        } else if (current == '{') {
+            objectCounter++;
+        } else if (current == '}') {
+            objectCounter--;
+        } else if (current == '[') {
+            arrayCounter++;
+        } else if (current == ']') {
+            arrayCounter--;
+        }
+    }
+
+    return std::string::npos;
+}
+
+size_t Parser::remainingSize() const {
+    return endIndex - index;
+}
+
+const std::string& Parser::getJson() const {
+    return json;
+}
+
+MemoryResource* Parser::getResource() const {
+    return memoryResource;
+}
+
+const std::shared_ptr<const std::string> &Parser::getSource() const {
+    return source;
+}
+
+Storage Parser::getStorage() const {
+    return storage;
+}
+
+size_t Parser::currentPosition() const {
+    return index;
+}
+
+size_t Parser::lastPosition() const {
+    return endIndex - 1;
+}
+
+void Parser::incrementPosition() {
+    index++;
+}
+
+void Parser::setPosition(size_t pos) {
+    index = pos;
+}
+
+char Parser::currentSymbol() const {
+    return getJson().at(currentPosition());
+}
+
+void Parser::fail(ParseErrorCode code) {
+    // Only the first error is kept, the parsers of the enclosing elements stop right after it
+    if (failed()) {
+        return;
+    }
+    // The rest of the element is the excerpt, long ones are cut without splitting a character
+    size_t remaining = index < endIndex ? endIndex - index : 0;
+    size_t length = std::min(remaining, maxExcerptLength);
+    while (length < remaining and length > 0 and (json[index + length] & 0xC0) == 0x80) {
+        length--;
+    }
+    std::string excerpt = json.substr(std::min(index, json.size()), length);
+    if (length < remaining) {
+        excerpt += "...";
+    }
+    *error = ParseError(code, currentPosition(), std::move(excerpt));
+}
+
+bool Parser::failed() const {
+    return error->getCode() != PARSE_SUCCESS;
+}
+
+ParseError *Parser::getError() const {
+    return error;
+}
+
+
+Element ArrayParser::parseElement() {
+    trim();
+    if (not checkArraySemantics()) {
+        return Element(getResource());
+    }
+    // Skip '['
+    incrementPosition();
+
+    ArrayBuilder builder(getResource());
+    while (not endOfParsing()) {
+        size_t endIndexOfElement = findIndexAfterElement(',');
+        if (endIndexOfElement == std::string::npos) {
+            endIndexOfElement = lastPosition();
+        }
+        builder.add(Parser(getJson(), currentPosition(), endIndexOfElement, getResource(), getError(), getSource(),
+                           getStorage()).parseElement());
+        if (failed()) {
+            return Element(getResource());
+        }
+        setPosition(endIndexOfElement + 1);
+    }
+    // Nothing outside the parser refers to the elements, so the array is not exposed
+    Element element(builder.build());
+    element.exposed = false;
+    return element;
+}
+
+bool ArrayParser::checkArraySemantics() {
+    if (currentSymbol() != '[') {
+        fail(INVALID_ARRAY_START);
+        return false;
+    }
+    if (getJson().at(lastPosition()) != ']') {
+        fail(INVALID_ARRAY_END);
+        return false;
+    }
+    return true;
+}
+
+
+Element NumberParser::parseElement() {
+    trim();
+    Element element(getResource());
+    double number;
+    if (not parseNumber(number)) {
+        return element;
+    }
+    if (std::memchr(getJson().data() + currentPosition(), '.', remainingSize()) == nullptr) {
+        element = (int) number;
+    } else {
+        element = number;
+    }
+    return element;
+}
+
+bool NumberParser::parseNumber(double &number) {
+    // strtod stops at the first character after the number, which must be the end of the element
+    const char *start = getJson().c_str() + currentPosition();
+    char *end = nullptr;
+    errno = 0;
+    number = std::strtod(start, &end);
+    if (end != start + remainingSize()) {
+        fail(INVALID_VALUE);
+        return false;
+    }
+    // Subnormal values are reported as a range error as well, only reject overflow and underflow to zero
+    if (errno == ERANGE and (number == 0 or std::isinf(number))) {
+        fail(NUMBER_OUT_OF_RANGE);
+        return false;
+    }
+    return true;
+}
+
+
+Element ObjectParser::parseElement() {
+    trim();
+    if (not checkObjectSemantics()) {
+        return Element(getResource());
+    }
+    size_t start = currentPosition();
+    incrementPosition();
+
+    ObjectBuilder builder(getStorage(), getResource());
+    while (not endOfParsing()) {
+        std::string key = extractKeyAndAdjustIndex();
+        if (failed() or not checkForDoublePointAndAdjustIndex()) {
+            return Element(getResource());
+        }
+        size_t endIndexOfElement = findIndexAfterElement(',');
+        if (endIndexOfElement == std::string::npos) {
+            endIndexOfElement = lastPosition();
+        }
+        builder.add(std::move(key),
+                    Parser(getJson(), currentPosition(), endIndexOfElement, getResource(), getError(), getSource(),
+                           getStorage()).parseElement());
+        if (failed()) {
+            return Element(getResource());
+        }
+        setPosition(endIndexOfElement + 1);
+    }
+    Element element(builder.build());
+    if (getSource()) {
+        // The slice counts as the cached json of the object until it is changed
+        Object &object = element.getObject();
+        object.jsonCache = Memory::create<Object::JsonCache>(object.resource, object.resource);
+        object.jsonCache->source = getSource();
+        object.jsonCache->offset = start;
+        object.jsonCache->size = lastPosition() + 1 - start;
+        object.jsonCache->epoch = Object::epoch.load(std::memory_order_relaxed);
+        object.jsonCache->valid = true;
+        object.cacheFilled();
+    }
+    return element;
+}
+
+
+
+std::string ObjectParser::extractKeyAndAdjustIndex() {
+    // First quotation mark
+    moveToNonEmptyPosition();
+    if (endOfParsing() or currentSymbol() != '"') {
+        fail(MISSING_KEY);
+        return std::string();
+    }
+    incrementPosition();
+
+    size_t keyStart = currentPosition();
+
+    // Second quotation mark, escaped characters are skipped
+    while (not endOfParsing() and currentSymbol() != '"') {
+        if (currentSymbol() == '\\') {
+            incrementPosition();
+        }
+        incrementPosition();
+    }
+    if (endOfParsing()) {
+        fail(UNTERMINATED_KEY);
+        return std::string();
+    }
+    size_t keyEnd = currentPosition();
+    incrementPosition();
+
+    std::string key;
+    if (not StringParser::unescape(getJson().data() + keyStart, getJson().data() + keyEnd, key)) {
+        setPosition(keyStart);
+        fail(INVALID_STRING);
+    }
+    return key;
+}
+
+
+
+bool ObjectParser::checkForDoublePointAndAdjustIndex() {
+    moveToNonEmptyPosition();
+    if (endOfParsing() or currentSymbol() != ':') {
+        fail(MISSING_COLON);
+        return false;
+    }
+    incrementPosition();
+    return true;
+}
+
+bool ObjectParser::checkObjectSemantics() {
+    if (currentSymbol() != '{') {
+        fail(INVALID_OBJECT_START);
+        return false;
+    }
+    if (getJson().at(lastPosition()) != '}') {
+        fail(INVALID_OBJECT_END);
+        return false;
+    }
+    return true;
+}
+
+
+namespace {
+
+    /// Reads 4 hexadecimal digits, moves the position past them
+    bool readCodeUnit(const char *&position, const char *end, uint32_t &unit) {
+        if (end - position < 4) {
+            return false;
+        }
+        unit = 0;
+        for (int i = 0; i < 4; i++) {
+            char digit = *position++;
+            unit <<= 4;
+            if (digit >= '0' and digit <= '9') {
+                unit |= static_cast<uint32_t>(digit - '0');
+            } else if (digit >= 'a' and digit <= 'f') {
+                unit |= static_cast<uint32_t>(digit - 'a' + 10);
+            } else if (digit >= 'A' and digit <= 'F') {
+                unit |= static_cast<uint32_t>(digit - 'A' + 10);
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void appendUtf8(std::string &result, uint32_t code) {
+        if (code < 0x80) {
+            result += static_cast<char>(code);
+        } else if (code < 0x800) {
+            result += static_cast<char>(0xc0 | (code >> 6));
+            result += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            result += static_cast<char>(0xe0 | (code >> 12));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            result += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            result += static_cast<char>(0xf0 | (code >> 18));
+            result += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            result += static_cast<char>(0x80 | (code & 0x3f));
+        }
+    }
+
+}
+
+Element StringParser::parseElement() {
+    trim();
+    std::string value;
+    if (remainingSize() < 2 or currentSymbol() != '"' or getJson().at(lastPosition()) != '"' or
+        not unescape(getJson().data() + currentPosition() + 1, getJson().data() + lastPosition(), value)) {
+        fail(INVALID_STRING);
+        return Element(getResource());
+    }
+    Element element(getResource());
+    element = value;
+    return element;
+}
+
+bool StringParser::unescape(const char *position, const char *end, std::string &result) {
+    result.clear();
+    result.reserve(static_cast<size_t>(end - position));
+    while (position != end) {
+        // Everything up to the next backslash is copied at once
+        auto backslash = static_cast<const char *>(std::memchr(position, '\\', static_cast<size_t>(end - position)));
+        const char *runEnd = backslash ? backslash : end;
+        if (std::memchr(position, '"', static_cast<size_t>(runEnd - position))) {
+            return false;
+        }
+        result.append(position, runEnd);
+        if (not backslash) {
+            return true;
+        }
+
+        position = backslash + 1;
+        if (position == end) {
+            return false;
+        }
+        switch (*position++) {
+            case '"': result += '"'; break;
+            case '\\': result += '\\'; break;
+            case '/': result += '/'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (not readCodeUnit(position, end, code)) {
+                    return false;
+                }
+                // A high surrogate followed by a low one encodes a code point above 0xffff
+                const char *next = position + 2;
+                uint32_t low;
+                if (code >= 0xd800 and code < 0xdc00 and end - position >= 6 and position[0] == '\\' and
+                    position[1] == 'u' and readCodeUnit(next, end, low) and low >= 0xdc00 and low < 0xe000) {
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    position = next;
+                }
+                appendUtf8(result, code);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+
+namespace {
+
+    /// Marks a missing start, end or step of a slice
+    const int64_t unsetBound = INT64_MIN;
+
+    /// Operand on the stack of a filter
+    struct Operand {
+        /// Value of a path or literal, nullptr if the path doesn't exist or the operand is a truth value
+        const Element *element;
+
+        /// Whether the operand counts as true in && || and !
+        bool truth;
+    };
+
+    bool isNumber(const Element *element) {
+        return element->isInt() or element->isDouble();
+    }
+
+    double toNumber(const Element *element) {
+        return element->isInt() ? element->getInt() : element->getDouble();
+    }
+
+    /// Equality of two operands, two missing values are equal
+    bool queryEqual(const Element *left, const Element *right) {
+        if (not left or not right) {
+            return left == right;
+        }
+        if (isNumber(left) and isNumber(right)) {
+            return toNumber(left) == toNumber(right);
+        }
+        if (left->getType() != right->getType()) {
+            return false;
+        }
+        switch (left->getType()) {
+            case STRING:
+                return left->getString() == right->getString();
+            case BOOLEAN:
+                return left->getBool() == right->getBool();
+            case JSON_NULL:
+                return true;
+            default:
+                // Objects and arrays only equal themselves
+                return left == right;
+        }
+    }
+
+    /// Strict ordering of two operands, only numbers and strings can be ordered
+    bool queryLess(const Element *left, const Element *right) {
+        if (not left or not right) {
+            return false;
+        }
+        if (isNumber(left) and isNumber(right)) {
+            return toNumber(left) < toNumber(right);
+        }
+        if (left->isString() and right->isString()) {
+            return left->getString() < right->getString();
+        }
+        return false;
+    }
 
-Element::Element(int num) {
-    setNumber(num);
 }
 
-Element::Element(double fract) {
-    setFraction(fract);
-}
+/// Compiles an expression into the program of a query, see compileQuery
+class QueryCompiler {
+public:
 
-Element::Element(bool boolean) {
-    setBoolean(boolean);
-}
+    QueryCompiler(const std::string &_expression, Query &_query)
+            : expression(_expression), query(_query), position(0), depth(0) {
+        query.expression = expression;
+    }
 
-Element::Element(const Object &obj) {
-    setObject(obj);
-}
+    void compile() {
+        skipSpaces();
+        expect('$');
+        while (true) {
+            skipSpaces();
+            if (position == expression.size()) {
+                return;
+            }
+            if (consume("..")) {
+                emit(Query::DESCEND);
+                if (peek('[')) {
+                    compileBracket();
+                } else if (consume("*")) {
+                    emit(Query::WILDCARD);
+                } else {
+                    emitChild(parseName());
+                }
+            } else if (consume(".")) {
+                if (consume("*")) {
+                    emit(Query::WILDCARD);
+                } else {
+                    emitChild(parseName());
+                }
+            } else if (peek('[')) {
+                compileBracket();
+            } else {
+                fail("expected '.' or '['");
+            }
+        }
+    }
 
-Element::Element(const std::vector<Element> &arr) {
-    setArray(arr);
-}
+private:
 
-Element &Element::operator=(std::nullptr_t pointer) {
-    reset();
-    if (pointer == nullptr) {
-        type = JSON_NULL;
+    using Instruction = Query::Instruction;
+
+    [[noreturn]] void fail(const std::string &message) const {
+        JSONMAX_THROW(QueryException(message, expression, position));
     }
-    return *this;
-}
 
-Element::Element(std::nullptr_t pointer) {
-    if (pointer == nullptr) {
-        type = JSON_NULL;
+    void skipSpaces() {
+        while (position < expression.size() and
+               (expression[position] == ' ' or expression[position] == '\t' or
+                expression[position] == '\n' or expression[position] == '\r')) {
+            position++;
+        }
+    }
+
+    bool peek(char c) const {
+        return position < expression.size() and expression[position] == c;
+    }
+
+    bool consume(const char *token) {
+        size_t length = std::char_traits<char>::length(token);
+        if (expression.compare(position, length, token) != 0) {
+            return false;
+        }
+        position += length;
+        return true;
+    }
+
+    void expect(char c) {
+        if (not peek(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+        position++;
+    }
+
+    static Instruction instruction(Query::Opcode opcode, uint32_t operand = 0, int64_t first = 0,
+                                   int64_t second = 0, int64_t third = 0) {
+        return Instruction{opcode, operand, first, second, third};
+    }
+
+    void emit(Query::Opcode opcode) {
+        query.program.push_back(instruction(opcode));
+    }
+
+    void emitChild(std::string key) {
+        query.program.push_back(childInstruction(std::move(key)));
+    }
+
+    Instruction childInstruction(std::string key) {
+        uint64_t hash = Utils::hash(key.data(), key.size());
+        query.names.push_back(Query::Name{std::move(key), hash});
+        return instruction(Query::CHILD, static_cast<uint32_t>(query.names.size() - 1));
+    }
+
+    /// Member name after a '.', letters, digits, '_', '-', '$' and any non ASCII character
+    std::string parseName() {
+        size_t start = position;
+        while (position < expression.size()) {
+            auto c = static_cast<unsigned char>(expression[position]);
+            if (not (std::isalnum(c) or c == '_' or c == '-' or c == '$' or c >= 0x80)) {
+                break;
+            }
+            position++;
+        }
+        if (start == position) {
+            fail("expected a member name");
+        }
+        return expression.substr(start, position - start);
+    }
+
+    /// String between single or double quotes
+    std::string parseString() {
+        char quote = expression[position++];
+        std::string result;
+        while (true) {
+            if (position == expression.size()) {
+                fail("unterminated string");
+            }
+            char c = expression[position++];
+            if (c == quote) {
+                return result;
+            }
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (position == expression.size()) {
+                fail("unterminated string");
+            }
+            c = expression[position++];
+            switch (c) {
+                case 'n':
+                    result += '\n';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'r':
+                    result += '\r';
+                    break;
+                case 'b':
+                    result += '\b';
+                    break;
+                case 'f':
+                    result += '\f';
+                    break;
+                case '\\':
+                case '/':
+                case '\'':
+                case '"':
+                    result += c;
+                    break;
+                default:
+                    position--;
+                    fail("invalid escape sequence");
+            }
+        }
+    }
+
+    bool peekInteger() const {
+        return position < expression.size() and
+               (expression[position] == '-' or (expression[position] >= '0' and expression[position] <= '9'));
+    }
+
+    int64_t parseInteger() {
+        bool negative = consume("-");
+        size_t start = position;
+        int64_t value = 0;
+        while (position < expression.size() and expression[position] >= '0' and expression[position] <= '9') {
+            if (position - start == 18) {
+                fail("index out of range");
+            }
+            value = value * 10 + (expression[position++] - '0');
+        }
+        if (start == position) {
+            fail("expected an integer");
+        }
+        return negative ? -value : value;
+    }
+
+    /// Selectors between '[' and ']'
+    void compileBracket() {
+        expect('[');
+        skipSpaces();
+        if (consume("*")) {
+            emit(Query::WILDCARD);
+        } else if (consume("?")) {
+            uint32_t start = compileFilter();
+            query.program.push_back(instruction(Query::FILTER, start));
+        } else {
+            std::vector<Instruction> selectors;
+            while (true) {
+                skipSpaces();
+                if (peek('\'') or peek('"')) {
+                    selectors.push_back(childInstruction(parseString()));
+                } else if (peekInteger() or peek(':')) {
+                    selectors.push_back(parseIndexOrSlice());
+                } else {
+                    fail("expected a name, index or slice");
+                }
+                skipSpaces();
+                if (not consume(",")) {
+                    break;
+                }
+            }
+
+            if (selectors.size() == 1) {
+                query.program.push_back(selectors[0]);
+            } else {
+                for (const Instruction &selector: selectors) {
+                    if (selector.opcode == Query::SLICE) {
+                        fail("slices can't be combined with other selectors");
+                    }
+                }
+                query.program.push_back(instruction(Query::UNION, 0, query.selectors.size(), selectors.size()));
+                query.selectors.insert(query.selectors.end(), selectors.begin(), selectors.end());
+            }
+        }
+        skipSpaces();
+        expect(']');
+    }
+
+    Instruction parseIndexOrSlice() {
+        int64_t start = peekInteger() ? parseInteger() : unsetBound;
+        skipSpaces();
+        if (not consume(":")) {
+            if (start == unsetBound) {
+                fail("expected an index");
+            }
+            return instruction(Query::INDEX, 0, start);
+        }
+        skipSpaces();
+        int64_t end = peekInteger() ? parseInteger() : unsetBound;
+        int64_t step = unsetBound;
+        skipSpaces();
+        if (consume(":")) {
+            skipSpaces();
+            step = peekInteger() ? parseInteger() : unsetBound;
+        }
+        return instruction(Query::SLICE, 0, start, end, step);
+    }
+
+    /// Compiles the filter expression after '?', returns the index of its first instruction
+    uint32_t compileFilter() {
+        auto start = static_cast<uint32_t>(query.filters.size());
+        depth = 0;
+        compileOr();
+        emitFilter(Query::RETURN);
+        return start;
+    }
+
+    void emitFilter(Query::FilterOpcode opcode, uint32_t operand = 0) {
+        query.filters.push_back(Query::FilterInstruction{opcode, operand});
+    }
+
+    /// Emits an instruction that pushes an operand
+    void emitPush(Query::FilterOpcode opcode, size_t operand) {
+        if (++depth > Query::maxStack) {
+            fail("filter expression is nested too deeply");
+        }
+        emitFilter(opcode, static_cast<uint32_t>(operand));
+    }
+
+    void compileOr() {
+        compileAnd();
+        skipSpaces();
+        while (consume("||")) {
+            size_t jump = query.filters.size();
+            emitFilter(Query::OR_JUMP);
+            depth--;
+            compileAnd();
+            query.filters[jump].operand = static_cast<uint32_t>(query.filters.size());
+            skipSpaces();
+        }
+    }
+
+    void compileAnd() {
+        compileUnary();
+        skipSpaces();
+        while (consume("&&")) {
+            size_t jump = query.filters.size();
+            emitFilter(Query::AND_JUMP);
+            depth--;
+            compileUnary();
+            query.filters[jump].operand = static_cast<uint32_t>(query.filters.size());
+            skipSpaces();
+        }
+    }
+
+    void compileUnary() {
+        skipSpaces();
+        if (consume("!")) {
+            compileUnary();
+            emitFilter(Query::NOT);
+            return;
+        }
+        if (consume("(")) {
+            compileOr();
+            skipSpaces();
+            expect(')');
+            return;
+        }
+
+        compileOperand();
+        skipSpaces();
+        Query::FilterOpcode comparison;
+        if (consume("==")) {
+            comparison = Query::EQUAL;
+        } else if (consume("!=")) {
+            comparison = Query::NOT_EQUAL;
+        } else if (consume("<=")) {
+            comparison = Query::LESS_EQUAL;
+        } else if (consume(">=")) {
+            comparison = Query::GREATER_EQUAL;
+        } else if (consume("<")) {
+            comparison = Query::LESS;
+        } else if (consume(">")) {
+            comparison = Query::GREATER;
+        } else {
+            return;
+        }
+        skipSpaces();
+        compileOperand();
+        emitFilter(comparison);
+        depth--;
+    }
+
+    /// A path starting with '@' or '$', or a literal
+    void compileOperand() {
+        if (consume("@")) {
+            emitPush(Query::PUSH_RELATIVE, compilePath());
+        } else if (consume("$")) {
+            emitPush(Query::PUSH_ROOT, compilePath());
+        } else if (peek('\'') or peek('"')) {
+            emitConstant(Element(parseString()));
+        } else if (peekInteger()) {
+            emitConstant(parseNumber());
+        } else if (consume("true")) {
+            emitConstant(Element(true));
+        } else if (consume("false")) {
+            emitConstant(Element(false));
+        } else if (consume("null")) {
+            emitConstant(Element(nullptr));
+        } else {
+            fail("expected a path or a literal");
+        }
+    }
+
+    void emitConstant(Element constant) {
+        query.constants.push_back(std::move(constant));
+        emitPush(Query::PUSH_CONSTANT, query.constants.size() - 1);
+    }
+
+    Element parseNumber() {
+        size_t start = position;
+        bool fraction = false;
+        while (position < expression.size()) {
+            char c = expression[position];
+            if (c == '.' or c == 'e' or c == 'E') {
+                fraction = true;
+            } else if (not ((c >= '0' and c <= '9') or c == '-' or c == '+')) {
+                break;
+            }
+            position++;
+        }
+        std::string number = expression.substr(start, position - start);
+        char *end = nullptr;
+        if (not fraction) {
+            long long value = std::strtoll(number.c_str(), &end, 10);
+            if (end == number.c_str() + number.size() and value >= INT_MIN and value <= INT_MAX) {
+                return Element(static_cast<int>(value));
+            }
+        }
+        double value = std::strtod(number.c_str(), &end);
+        if (end != number.c_str() + number.size()) {
+            position = start;
+            fail("invalid number");
+        }
+        return Element(value);
+    }
+
+    /// Member names and indexes after '@' or '$' in a filter, compiled into a Path
+    size_t compilePath() {
+        std::string pointer;
+        while (true) {
+            std::string key;
+            if (consume(".")) {
+                key = parseName();
+            } else if (peek('[')) {
+                position++;
+                skipSpaces();
+                if (peek('\'') or peek('"')) {
+                    key = parseString();
+                } else if (peekInteger()) {
+                    int64_t index = parseInteger();
+                    if (index < 0) {
+                        fail("negative indexes are not supported in filter paths");
+                    }
+                    key = std::to_string(index);
+                } else {
+                    fail("expected a name or index");
+                }
+                skipSpaces();
+                expect(']');
+            } else {
+                break;
+            }
+
+            pointer += '/';
+            for (char c: key) {
+                if (c == '~') {
+                    pointer += "~0";
+                } else if (c == '/') {
+                    pointer += "~1";
+                } else {
+                    pointer += c;
+                }
+            }
+        }
+        query.paths.emplace_back(pointer);
+        return query.paths.size() - 1;
     }
+
+    const std::string &expression;
+
+    Query &query;
+
+    /// Current position in the expression
+    size_t position;
+
+    /// Amount of operands on the stack of the filter being compiled
+    size_t depth;
+
+};
+
+Query compileQuery(const std::string &expression) {
+    Query query;
+    QueryCompiler(expression, query).compile();
+    return query;
 }
 
-Element::Element(const std::initializer_list<Element> &arr) {
-    setArray(arr);
+void Query::evaluate(const Element &root, const Callback &callback) const {
+    run(0, root, root, [&callback](const Element &match) {
+        callback(match);
+        return true;
+    });
 }
 
-Element &Element::operator=(const std::initializer_list<Element> &arr) {
-    reset();
-    setArray(arr);
-    return *this;
+std::vector<const Element *> Query::select(const Element &root) const {
+    std::vector<const Element *> matches;
+    run(0, root, root, [&matches](const Element &match) {
+        matches.push_back(&match);
+        return true;
+    });
+    return matches;
 }
 
-void Element::reset() {
-    switch (type) {
-        case INTEGER: delete data.number;
-            break;
-        case FRACTION: delete data.fraction;
-            break;
-        case OBJECT: delete data.object;
-            break;
-        case STRING: delete data.string;
-            break;
-        case ARRAY: delete data.array;
-            break;
-        default:
-            break;
-    }
-    type = UNINITIALIZED;
+const Element *Query::first(const Element &root) const {
+    const Element *result = nullptr;
+    run(0, root, root, [&result](const Element &match) {
+        result = &match;
+        return false;
+    });
+    return result;
 }
 
-Element::~Element() {
-    reset();
+size_t Query::count(const Element &root) const {
+    size_t amount = 0;
+    run(0, root, root, [&amount](const Element &) {
+        amount++;
+        return true;
+    });
+    return amount;
 }
 
+const std::string &Query::toString() const {
+    return expression;
+}
 
-void Element::copy(const Element &obj) {
-    type = obj.type;
-    switch (type) {
-        case INTEGER: data.number = new int(*obj.data.number);
-            break;
-        case FRACTION: data.fraction = new double(*obj.data.fraction);
-            break;
-        case STRING: data.string = new std::string(*obj.data.string);
-            break;
-        case OBJECT: data.object = new Object(*obj.data.object);
-            break;
-        case ARRAY: data.array = new Array(*obj.data.array);
-            break;
-        case BOOLEAN: data.boolean = obj.data.boolean;
-            break;
-        default:
-            break;
+bool Query::run(size_t pc, const Element &node, const Element &root, const Visitor &visit) const {
+    if (pc == program.size()) {
+        return visit(node);
     }
-}
 
-void Element::move(Element &&obj) {
-    type = obj.type;
-    switch (type) {
-        case INTEGER: data.number = obj.data.number;
-            obj.data.number = nullptr;
-            break;
-        case FRACTION: data.fraction = obj.data.fraction;
-            obj.data.fraction = nullptr;
-            break;
-        case STRING: data.string = obj.data.string;
-            obj.data.string = nullptr;
-            break;
-        case OBJECT: data.object = obj.data.object;
-            obj.data.object = nullptr;
-            break;
-        case ARRAY: data.array = obj.data.array;
-            obj.data.array = nullptr;
-            break;
-        case BOOLEAN: data.boolean = obj.data.boolean;
-            break;
-        default:
-            break;
+    const Instruction &instruction = program[pc];
+    switch (instruction.opcode) {
+        case CHILD:
+        case INDEX:
+            return runSelector(instruction, pc + 1, node, root, visit);
+        case WILDCARD:
+            return runChildren(pc + 1, node, root, visit);
+        case SLICE: {
+            if (not node.isArray()) {
+                return true;
+            }
+            const Array &array = node.getArray();
+            auto size = static_cast<int64_t>(array.size());
+            int64_t step = instruction.third == unsetBound ? 1 : instruction.third;
+            auto bound = [size](int64_t index, int64_t lowest, int64_t highest) {
+                index = index < 0 ? size + index : index;
+                return index < lowest ? lowest : (index > highest ? highest : index);
+            };
+            if (step > 0) {
+                int64_t lower = instruction.first == unsetBound ? 0 : bound(instruction.first, 0, size);
+                int64_t upper = instruction.second == unsetBound ? size : bound(instruction.second, 0, size);
+                for (int64_t i = lower; i < upper; i += step) {
+                    if (not run(pc + 1, array[i], root, visit)) {
+                        return false;
+                    }
+                }
+            } else if (step < 0) {
+                int64_t upper = instruction.first == unsetBound ? size - 1 : bound(instruction.first, -1, size - 1);
+                int64_t lower = instruction.second == unsetBound ? -1 : bound(instruction.second, -1, size - 1);
+                for (int64_t i = upper; i > lower; i += step) {
+                    if (not run(pc + 1, array[i], root, visit)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+        case UNION:
+            for (int64_t i = instruction.first; i < instruction.first + instruction.second; i++) {
+                if (not runSelector(selectors[i], pc + 1, node, root, visit)) {
+                    return false;
+                }
+            }
+            return true;
+        case DESCEND:
+            // The rest of the program runs on the node itself, then this instruction runs again on every child
+            if (not run(pc + 1, node, root, visit)) {
+                return false;
+            }
+            return runChildren(pc, node, root, visit);
+        case FILTER:
+            if (node.isObject()) {
+                for (const auto &member: static_cast<const Object &>(node.getObject())) {
+                    if (matches(instruction.operand, member.getValue(), root) and
+                        not run(pc + 1, member.getValue(), root, visit)) {
+                        return false;
+                    }
+                }
+            } else if (node.isArray()) {
+                for (const Element &element: node.getArray()) {
+                    if (matches(instruction.operand, element, root) and not run(pc + 1, element, root, visit)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
     }
+    return true;
 }
 
-
-Element::Element(const Element &obj) {
-    copy(obj);
+bool Query::runChildren(size_t pc, const Element &node, const Element &root, const Visitor &visit) const {
+    if (node.isObject()) {
+        for (const auto &member: static_cast<const Object &>(node.getObject())) {
+            if (not run(pc, member.getValue(), root, visit)) {
+                return false;
+            }
+        }
+    } else if (node.isArray()) {
+        for (const Element &element: node.getArray()) {
+            if (not run(pc, element, root, visit)) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
-Element::Element(Element &&obj) noexcept {
-    move(std::move(obj));
+bool Query::runSelector(const Instruction &selector, size_t pc, const Element &node, const Element &root,
+                        const Visitor &visit) const {
+    if (selector.opcode == CHILD) {
+        if (not node.isObject()) {
+            return true;
+        }
+        const Name &name = names[selector.operand];
+        const Element *child = node.getObject().lookup(name.key, name.hash);
+        if (not child or child->getType() == UNINITIALIZED) {
+            return true;
+        }
+        return run(pc, *child, root, visit);
+    }
+
+    if (not node.isArray()) {
+        return true;
+    }
+    const Array &array = node.getArray();
+    int64_t index = selector.first < 0 ? static_cast<int64_t>(array.size()) + selector.first : selector.first;
+    if (index < 0 or index >= static_cast<int64_t>(array.size())) {
+        return true;
+    }
+    return run(pc, array[index], root, visit);
 }
 
-Element& Element::operator=(Element &&obj) noexcept {
-    if (this != &obj) {
-        reset();
-        move(std::move(obj));
+bool Query::matches(uint32_t start, const Element &node, const Element &root) const {
+    Operand stack[maxStack];
+    size_t top = 0;
+    for (uint32_t pc = start;; pc++) {
+        const FilterInstruction &instruction = filters[pc];
+        switch (instruction.opcode) {
+            case PUSH_RELATIVE:
+            case PUSH_ROOT: {
+                const Element *element = paths[instruction.operand].resolve(
+                        instruction.opcode == PUSH_RELATIVE ? node : root);
+                stack[top++] = Operand{element, element != nullptr};
+                break;
+            }
+            case PUSH_CONSTANT: {
+                const Element &constant = constants[instruction.operand];
+                stack[top++] = Operand{&constant, not constant.isNull() and not (constant.isBool() and
+                                                                                   not constant.getBool())};
+                break;
+            }
+            case EQUAL:
+            case NOT_EQUAL:
+            case LESS:
+            case LESS_EQUAL:
+            case GREATER:
+            case GREATER_EQUAL: {
+                const Element *left = stack[top - 2].element;
+                const Element *right = stack[top - 1].element;
+                bool result;
+                switch (instruction.opcode) {
+                    case EQUAL:
+                        result = queryEqual(left, right);
+                        break;
+                    case NOT_EQUAL:
+                        result = not queryEqual(left, right);
+                        break;
+                    case LESS:
+                        result = queryLess(left, right);
+                        break;
+                    case LESS_EQUAL:
+                        result = queryLess(left, right) or (left and right and queryEqual(left, right));
+                        break;
+                    case GREATER:
+                        result = queryLess(right, left);
+                        break;
+                    default:
+                        result = queryLess(right, left) or (left and right and queryEqual(left, right));
+                        break;
+                }
+                top--;
+                stack[top - 1] = Operand{nullptr, result};
+                break;
+            }
+            case NOT:
+                stack[top - 1] = Operand{nullptr, not stack[top - 1].truth};
+                break;
+            case AND_JUMP:
+                if (not stack[top - 1].truth) {
+                    pc = instruction.operand - 1;
+                } else {
+                    top--;
+                }
+                break;
+            case OR_JUMP:
+                if (stack[top - 1].truth) {
+                    pc = instruction.operand - 1;
+                } else {
+                    top--;
+                }
+                break;
+            case RETURN:
+                return stack[top - 1].truth;
+        }
     }
-    return *this;
 }
 
-Element& Element::operator=(const Element &obj) {
-    if (this != &obj) {
-        reset();
-        copy(obj);
+
+namespace {
+
+    /// Floating point number f * 2^e with a 64 bit significand, the working type of Grisu
+    struct DiyFp {
+
+        DiyFp(uint64_t _f, int _e) : f(_f), e(_e) {}
+
+        DiyFp operator-(const DiyFp &other) const {
+            return DiyFp(f - other.f, e);
+        }
+
+        /// Upper 64 bits of the product, rounded
+        DiyFp operator*(const DiyFp &other) const {
+            const uint64_t mask = 0xffffffffull;
+            uint64_t a = f >> 32, b = f & mask, c = other.f >> 32, d = other.f & mask;
+            uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+            uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1ull << 31);
+            return DiyFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), e + other.e + 64);
+        }
+
+        /// Shifts the significand until its highest bit is set
+        DiyFp normalize() const {
+            DiyFp result = *this;
+            while (not (result.f & (1ull << 63))) {
+                result.f <<= 1;
+                result.e--;
+            }
+            return result;
+        }
+
+        uint64_t f;
+        int e;
+
+    };
+
+    const uint64_t hiddenBit = 1ull << 52;
+
+    /**
+     * Normalized powers of ten from 10^-348 to 10^340 in steps of 8, rounded to 64 bits
+     * Every Grisu multiplication uses one of them, so the product lands in a fixed binary exponent range.
+     */
+    const uint64_t cachedSignificands[] = {
+            0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+            0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+            0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+            0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+            0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+            0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+            0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+            0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+            0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+            0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+            0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+            0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+            0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+            0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+            0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+            0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+            0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+            0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+            0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+            0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+            0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+            0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+            0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+            0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+            0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+            0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+            0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+            0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+            0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+    };
+
+    const int16_t cachedExponents[] = {
+            -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+            -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+            -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+            -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+            56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+            375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+            694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+            1013, 1039, 1066
+    };
+
+    const uint64_t powersOfTen[] = {
+            1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+            1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+            100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+            1000000000000000000ull, 10000000000000000000ull
+    };
+
+    DiyFp diyFromDouble(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(double));
+        int biased = static_cast<int>((bits >> 52) & 0x7ff);
+        uint64_t significand = bits & (hiddenBit - 1);
+        if (biased) {
+            return DiyFp(significand + hiddenBit, biased - 1075);
+        }
+        return DiyFp(significand, -1074);
     }
-    return *this;
-}
 
-bool Element::isInt() const {
-    return type == INTEGER;
-}
+    /// Boundaries halfway to the neighbouring doubles, both with the exponent of the normalized upper one
+    void boundaries(const DiyFp &value, DiyFp &minus, DiyFp &plus) {
+        plus = DiyFp((value.f << 1) + 1, value.e - 1).normalize();
+        minus = value.f == hiddenBit ? DiyFp((value.f << 2) - 1, value.e - 2) : DiyFp((value.f << 1) - 1, value.e - 1);
+        minus.f <<= minus.e - plus.e;
+        minus.e = plus.e;
+    }
 
-bool Element::isDouble() const {
-    return type == FRACTION;
-}
+    /// @return the cached power of ten 10^-k that brings the binary exponent e into range
+    DiyFp cachedPower(int e, int &k) {
+        double estimate = (-61 - e) * 0.30102999566398114 + 347;
+        int ceiling = static_cast<int>(estimate);
+        if (estimate - ceiling > 0.0) {
+            ceiling++;
+        }
+        unsigned int index = static_cast<unsigned int>((ceiling >> 3) + 1);
+        k = -(-348 + static_cast<int>(index << 3));
+        return DiyFp(cachedSignificands[index], cachedExponents[index]);
+    }
 
-bool Element::isBool() const {
-    return type == BOOLEAN;
-}
+    /// Moves the last digit closer to the exact value while it stays within the boundaries
+    void grisuRound(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance) {
+        while (rest < distance and delta - rest >= tenKappa and
+               (rest + tenKappa < distance or distance - rest > rest + tenKappa - distance)) {
+            digits[length - 1]--;
+            rest += tenKappa;
+        }
+    }
 
-bool Element::isObject() const {
-    return type == OBJECT;
-}
+    /// Generates the shortest digits within the boundaries, the value is then digits * 10^k
+    void grisuDigits(const DiyFp &value, const DiyFp &upper, uint64_t delta, char *digits, int &length, int &k) {
+        const DiyFp one(1ull << -upper.e, upper.e);
+        const DiyFp distance = upper - value;
+        uint32_t integral = static_cast<uint32_t>(upper.f >> -one.e);
+        uint64_t fractional = upper.f & (one.f - 1);
 
-bool Element::isArray() const {
-    return type == ARRAY;
-}
+        int kappa = 1;
+        while (kappa < 10 and integral >= powersOfTen[kappa]) {
+            kappa++;
+        }
+        length = 0;
+
+        while (kappa > 0) {
+            uint32_t power = static_cast<uint32_t>(powersOfTen[kappa - 1]);
+            uint32_t digit = integral / power;
+            integral %= power;
+            if (digit or length) {
+                digits[length++] = static_cast<char>('0' + digit);
+            }
+            kappa--;
+            uint64_t rest = (static_cast<uint64_t>(integral) << -one.e) + fractional;
+            if (rest <= delta) {
+                k += kappa;
+                grisuRound(digits, length, delta, rest, powersOfTen[kappa] << -one.e, distance.f);
+                return;
+            }
+        }
 
-bool Element::isString() const {
-    return type == STRING;
-}
+        while (true) {
+            fractional *= 10;
+            delta *= 10;
+            char digit = static_cast<char>(fractional >> -one.e);
+            if (digit or length) {
+                digits[length++] = static_cast<char>('0' + digit);
+            }
+            fractional &= one.f - 1;
+            kappa--;
+            if (fractional < delta) {
+                k += kappa;
+                int index = -kappa;
+                grisuRound(digits, length, delta, fractional, one.f, distance.f * (index < 20 ? powersOfTen[index] : 0));
+                return;
+            }
+        }
+    }
 
-bool Element::isNull() const {
-    return type == JSON_NULL;
-}
+    /// Writes the digits of a positive, finite and non zero value, returns the decimal exponent
+    void grisu2(double value, char *digits, int &length, int &k) {
+        const DiyFp exact = diyFromDouble(value);
+        DiyFp minus(0, 0), plus(0, 0);
+        boundaries(exact, minus, plus);
+
+        const DiyFp power = cachedPower(plus.e, k);
+        const DiyFp scaled = exact.normalize() * power;
+        DiyFp upper = plus * power;
+        DiyFp lower = minus * power;
+        // The products are rounded, so stay on the safe side of both boundaries
+        lower.f++;
+        upper.f--;
+        grisuDigits(scaled, upper, upper.f - lower.f, digits, length, k);
+    }
 
+    /// Places the decimal point, digits * 10^k becomes for example 12.5, 0.001 or 1.5e+300
+    size_t placePoint(char *buffer, int length, int k) {
+        const int point = length + k;
 
-Pair::Pair(std::string str, Element ele): key(std::move(str)), value(std::move(ele)) {}
+        if (length <= point and point <= 21) {
+            // Whole number, pad with zeros
+            std::memset(buffer + length, '0', static_cast<size_t>(point - length));
+            buffer[point] = '.';
+            buffer[point + 1] = '0';
+            return static_cast<size_t>(point + 2);
+        }
+        if (0 < point and point <= 21) {
+            std::memmove(buffer + point + 1, buffer + point, static_cast<size_t>(length - point));
+            buffer[point] = '.';
+            return static_cast<size_t>(length + 1);
+        }
+        if (-6 < point and point <= 0) {
+            const int zeros = 2 - point;
+            std::memmove(buffer + zeros, buffer, static_cast<size_t>(length));
+            buffer[0] = '0';
+            buffer[1] = '.';
+            std::memset(buffer + 2, '0', static_cast<size_t>(-point));
+            return static_cast<size_t>(length + zeros);
+        }
 
-const std::string& Pair::getKey() const {
-    return key;
-}
+        // Exponent notation, the first digit followed by the others or by a zero
+        size_t size;
+        if (length == 1) {
+            buffer[1] = '.';
+            buffer[2] = '0';
+            size = 3;
+        } else {
+            std::memmove(buffer + 2, buffer + 1, static_cast<size_t>(length - 1));
+            buffer[1] = '.';
+            size = static_cast<size_t>(length + 1);
+        }
+        int exponent = point - 1;
+        buffer[size++] = 'e';
+        buffer[size++] = exponent < 0 ? '-' : '+';
+        if (exponent < 0) {
+            exponent = -exponent;
+        }
+        if (exponent >= 100) {
+            buffer[size++] = static_cast<char>('0' + exponent / 100);
+            exponent %= 100;
+            buffer[size++] = static_cast<char>('0' + exponent / 10);
+        } else if (exponent >= 10) {
+            buffer[size++] = static_cast<char>('0' + exponent / 10);
+        }
+        buffer[size++] = static_cast<char>('0' + exponent % 10);
+        return size;
+    }
 
-const Element& Pair::getValue() const {
-    return value;
 }
 
+size_t Utils::formatDouble(double value, char *buffer) {
+    if (value != value or value - value != 0) {
+        // NaN or infinity
+        std::memcpy(buffer, "null", 4);
+        return 4;
+    }
 
-Object::Object(Storage _storage): storage(_storage) {
-    switch (storage) {
-        case HASHMAP: 
-            data.elementsHashmap = new std::unordered_map<std::string, Element>();
-            break;
-        case MAP:
-            data.elementsMap = new std::map<std::string, Element>();
-            break;
-        case VECTOR:
-            data.elementsVector = new std::vector<std::pair<std::string, Element>>();
-            break;
+    size_t sign = 0;
+    if (std::signbit(value)) {
+        buffer[sign++] = '-';
+        value = -value;
+    }
+    if (value == 0) {
+        std::memcpy(buffer + sign, "0.0", 3);
+        return sign + 3;
     }
-}
 
-Object::~Object() {
-    reset();
+    int length;
+    int k;
+    grisu2(value, buffer + sign, length, k);
+    return sign + placePoint(buffer + sign, length, k);
 }
 
-
-void Object::reset() {
-    switch (storage) {
-        case HASHMAP:
-            delete data.elementsHashmap;
-            break;
-        case MAP:
-            delete data.elementsMap;
-            break;
-        case VECTOR:
-            delete data.elementsVector;
-            break;
+size_t Utils::formatInteger(int value, char *buffer) {
+    // Digits are written back to front, unsigned so the lowest int can be negated
+    char digits[maxIntegerLength];
+    char *position = digits + maxIntegerLength;
+    unsigned int number = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+    do {
+        *--position = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number);
+    if (value < 0) {
+        *--position = '-';
     }
+    size_t size = static_cast<size_t>(digits + maxIntegerLength - position);
+    std::memcpy(buffer, position, size);
+    return size;
 }
 
 
-void Object::move(Object &&obj) {
-    storage = obj.storage;
-    switch (obj.storage) {
-        case HASHMAP:
-            data.elementsHashmap = obj.data.elementsHashmap;
-            obj.data.elementsHashmap = nullptr;
-            break;
-        case MAP:
-            data.elementsMap = obj.data.elementsMap;
-            obj.data.elementsMap = nullptr;
-            break;
-        case VECTOR:
-            data.elementsVector = obj.data.elementsVector;
-            obj.data.elementsVector = nullptr;
-            break;
+void Output::writeBlocks(const Block *blocks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        write(blocks[i].data, blocks[i].size);
     }
 }
 
-void Object::copy(const Object &obj) {
-    storage = obj.storage;
-    switch (obj.storage) {
-        case HASHMAP:
-            data.elementsHashmap = new std::unordered_map<std::string, Element>(*obj.data.elementsHashmap);
-            break;
-        case MAP:
-            data.elementsMap = new std::map<std::string, Element>(*obj.data.elementsMap);
-            break;
-        case VECTOR:
-            data.elementsVector = new std::vector<std::pair<std::string, Element>>(*obj.data.elementsVector);
-            break;
-    }
+StringOutput::StringOutput() : target(&own) {}
+
+StringOutput::StringOutput(std::string &_target) : target(&_target) {}
+
+void StringOutput::write(const char *data, size_t size) {
+    target->append(data, size);
 }
 
-Object::Object(Object &&obj) noexcept {
-    move(std::move(obj));
+std::string &StringOutput::getString() {
+    return *target;
 }
 
+StreamOutput::StreamOutput(std::ostream &_stream) : stream(_stream) {}
 
-Object::Object(const Object &obj) {
-    copy(obj);
+void StreamOutput::write(const char *data, size_t size) {
+    stream.write(data, static_cast<std::streamsize>(size));
 }
 
-Object& Object::operator=(const Object &obj) {
-    if (&obj != this) {
-        reset();
-        copy(obj);
-    }
-    return *this;
-}
+FileOutput::FileOutput(std::FILE *_file) : file(_file) {}
 
-Object& Object::operator=(Object &&obj) noexcept {
-    if (&obj != this) {
-        reset();
-        move(std::move(obj));
+void FileOutput::write(const char *data, size_t size) {
+    if (std::fwrite(data, 1, size, file) != size) {
+        JSONMAX_THROW(WriteException("Couldn't write the json to the file"));
     }
-    return *this;
 }
 
+#ifdef JSONMAX_POSIX
 
-Element &Object::operator[](const std::string &member) {
-    if (storage == VECTOR) {
-        for (auto &elem: *data.elementsVector) {
-            if (elem.first == member) {
-                return elem.second;
-            }
-        }
-        data.elementsVector->emplace_back(member, Element());
-        return data.elementsVector->back().second;
-    } else if (storage == MAP) {
-        for (auto &elem: *data.elementsMap) {
-            if (elem.first == member) {
-                return elem.second;
-            }
-        }
-        data.elementsMap->emplace(member, Element());
-        return data.elementsMap->operator[](member);
-    } else if (storage == HASHMAP) {
-        for (auto &elem: *data.elementsHashmap) {
-            if (elem.first == member) {
-                return elem.second;
+DescriptorOutput::DescriptorOutput(int _descriptor) : descriptor(_descriptor) {}
+
+void DescriptorOutput::write(const char *data, size_t size) {
+    while (size) {
+        ssize_t written = ::write(descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
             }
+            JSONMAX_THROW(WriteException("Couldn't write the json to the file descriptor"));
         }
-        data.elementsHashmap->emplace(member, Element());
-        return data.elementsHashmap->operator[](member);
+        data += written;
+        size -= static_cast<size_t>(written);
     }
 }
 
-std::string Object::toString(unsigned int ind) const {
-    std::string output = "{";
-    if (storage == VECTOR) {
-        for (auto &elem: *data.elementsVector) {
-            if (elem.second.getType() == Type::UNINITIALIZED) {
-                continue;
-            }
-            output += "\"" + elem.first + "\": " + elem.second.toString(0) + ", ";
+void DescriptorOutput::writeBlocks(const Block *blocks, size_t count) {
+    std::vector<iovec> vectors;
+    vectors.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (blocks[i].size) {
+            vectors.push_back(iovec{const_cast<char *>(blocks[i].data), blocks[i].size});
         }
-    } else if (storage == MAP) {
-        for (auto &elem: *data.elementsMap) {
-            if (elem.second.getType() == Type::UNINITIALIZED) {
+    }
+
+    size_t first = 0;
+    while (first < vectors.size()) {
+        int amount = static_cast<int>(std::min<size_t>(vectors.size() - first, IOV_MAX));
+        ssize_t written = ::writev(descriptor, &vectors[first], amount);
+        if (written < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-            output += "\"" + elem.first + "\": " + elem.second.toString(0) + ", ";
+            JSONMAX_THROW(WriteException("Couldn't write the json to the file descriptor"));
         }
-    } else if (storage == HASHMAP) {
-        for (auto &elem: *data.elementsHashmap) {
-            if (elem.second.getType() == Type::UNINITIALIZED) {
-                continue;
-            }
-            output += "\"" + elem.first + "\": " + elem.second.toString(0) + ", ";
+        // Skip the blocks that were written completely, continue in the middle of a partially written one
+        auto remaining = static_cast<size_t>(written);
+        while (first < vectors.size() and remaining >= vectors[first].iov_len) {
+            remaining -= vectors[first].iov_len;
+            first++;
+        }
+        if (remaining) {
+            vectors[first].iov_base = static_cast<char *>(vectors[first].iov_base) + remaining;
+            vectors[first].iov_len -= remaining;
         }
     }
-    if (output.size() > 2) {
-        output.pop_back();
-        output.pop_back();
-    }
-    output += "}";
+}
 
-    if (ind) {
-        return Utils::indent(output, ind);
-    }
+#endif
 
-    return output;
-}
 
+namespace {
 
-void Object::remove(const std::string &key) {
-    if (storage == VECTOR) {
-        for (auto itr = data.elementsVector->begin(); itr != data.elementsVector->end(); ++itr) {
-            if (itr->first == key) {
-                data.elementsVector->erase(itr);
-                break;
-            }
-        }
-    } else if (storage == MAP) {
-        data.elementsMap->erase(key);
-    } else if (storage == HASHMAP) {
-        data.elementsHashmap->erase(key);
+    /// @return true if the character can't be written as is in a json string
+    inline bool needsEscape(unsigned char symbol) {
+        return symbol == '"' or symbol == '\\' or symbol < 0x20;
     }
-}
-
 
-std::vector<Pair> Object::pairs() const {
-    std::vector<Pair> pairs;
-    if (storage == VECTOR) {
-        for (auto &elem: *data.elementsVector) {
-            if (elem.second.getType() != Type::UNINITIALIZED) {
-                pairs.emplace_back(elem.first, elem.second);
-            }
-        }
-    } else if (storage == MAP) {
-        for (auto &elem: *data.elementsMap) {
-            if (elem.second.getType() != Type::UNINITIALIZED) {
-                pairs.emplace_back(elem.first, elem.second);
+    /**
+     * @return the first character in the range that needs escaping, end if there is none
+     * With SSE2 16 characters are checked at once, so strings without escapes are scanned at memcpy speed.
+     */
+    const char *findEscape(const char *position, const char *end) {
+#ifdef JSONMAX_SSE2
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1f);
+        while (end - position >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+            // Unsigned minimum with 0x1f equals the character for every control character
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                           _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+            if (mask) {
+                return position + Utils::lowestBit(mask);
             }
+            position += 16;
         }
-    } else if (storage == HASHMAP) {
-        for (auto &elem: *data.elementsHashmap) {
-            if (elem.second.getType() != Type::UNINITIALIZED) {
-                pairs.emplace_back(elem.first, elem.second);
-            }
+#endif
+        while (position != end and not needsEscape(static_cast<unsigned char>(*position))) {
+            position++;
         }
+        return position;
     }
-    return pairs;
-}
-
-size_t Object::size() const {
-    if (storage == VECTOR) {
-        return data.elementsVector->size();
-    } else if (storage == MAP) {
-        return data.elementsMap->size();
-    } else if (storage == HASHMAP) {
-        return data.elementsHashmap->size();
-    }
-    return 0;
-}
 
-bool Object::exists(const std::string &key) const {
-    if (storage == VECTOR) {
-        for (auto& element: *data.elementsVector) {
-            if (element.first == key && element.second.getType() != UNINITIALIZED) {
-                return true;
-            }
+    /// Writes the escape sequence of the character, returns its length
+    size_t escapeSequence(unsigned char symbol, char *sequence) {
+        const char *hexadecimal = "0123456789abcdef";
+        sequence[0] = '\\';
+        switch (symbol) {
+            case '"': sequence[1] = '"'; return 2;
+            case '\\': sequence[1] = '\\'; return 2;
+            case '\b': sequence[1] = 'b'; return 2;
+            case '\f': sequence[1] = 'f'; return 2;
+            case '\n': sequence[1] = 'n'; return 2;
+            case '\r': sequence[1] = 'r'; return 2;
+            case '\t': sequence[1] = 't'; return 2;
+            default:
+                std::memcpy(sequence + 1, "u00", 3);
+                sequence[4] = hexadecimal[symbol >> 4];
+                sequence[5] = hexadecimal[symbol & 0xf];
+                return 6;
         }
-        return false;
-    } else if (storage == MAP) {
-        return data.elementsMap->count(key) && data.elementsMap->operator[](key).getType() != UNINITIALIZED;
-    } else if (storage == HASHMAP) {
-        return data.elementsHashmap->count(key) && data.elementsHashmap->operator[](key).getType() != UNINITIALIZED;
     }
-    return false;
-}
 
-bool Object::empty() const {
-    if (storage == VECTOR) {
-        for (auto& element: *data.elementsVector) {
-            if (element.second.getType() != UNINITIALIZED) {
-                return false;
-            }
-        }
-        return true;
-    } else if (storage == MAP) {
-        for (auto& element: *data.elementsMap) {
-            if (element.second.getType() != UNINITIALIZED) {
-                return false;
-            }
-        }
-        return true;
-    } else if (storage == HASHMAP) {
-        for (auto& element: *data.elementsHashmap) {
-            if (element.second.getType() != UNINITIALIZED) {
-                return false;
-            }
+    /// Output that appends to the text of a cached json
+    class CacheOutput : public Output {
+    public:
+
+        explicit CacheOutput(std::vector<char, Allocator<char>> &_text) : text(_text) {}
+
+        void write(const char *data, size_t size) override {
+            text.insert(text.end(), data, data + size);
         }
-        return true;
-    }
-    return true;
-}
 
-void Object::clear() {
-    if (storage == VECTOR) {
-        data.elementsVector->clear();
-    } else if (storage == MAP) {
-        data.elementsMap->clear();
-    } else if (storage == HASHMAP) {
-        data.elementsHashmap->clear();
-    }
+    private:
+
+        std::vector<char, Allocator<char>> &text;
+
+    };
+
 }
 
+const size_t Writer::bufferSize;
 
-std::string Utils::indent(const std::string &json, int indentation) {
-    std::string output;
-    unsigned int spaces = 0;
-    bool escape = false;
-    bool inString = false;
+const size_t Writer::parallelThreshold;
+
+WriteOptions::WriteOptions(bool _compact, unsigned int _indent, unsigned int _threads, bool _exactSize)
+        : compact(_compact), indent(_indent), threads(_threads), exactSize(_exactSize), cacheFragments(false) {}
+
+Writer::Writer(Output &_output, WriteOptions _options)
+        : output(_output), options(_options), lineBreak("\n"), depth(0), used(0), recording(nullptr) {}
+
+void Writer::write(const Element &element) {
+    writeValue(element);
+    flush();
+}
+
+void Writer::write(const Object &object) {
+    writeObject(object);
+    flush();
+}
 
-    for (size_t i = 0; i < json.size(); i++) {
-        char symbol = json[i];
+void Writer::write(const FrozenObject &object) {
+    writeFrozenObject(object);
+    flush();
+}
 
-        // Two special cases, escaped symbol or in string
-        if (escape) {
-            output += symbol;
-            escape = false;
-            continue;
-        } else if (inString) {
-            inString = '"' != symbol;
-            output += symbol;
-            continue;
-        }
+void Writer::write(const Array &array) {
+    writeArray(array);
+    flush();
+}
 
-        // Non empty object or array started
-        if ((symbol == '{' and json[i + 1] != '}') or (symbol == '[' and json[i + 1] != ']')) {
-            spaces += indentation;
-            output += std::string(1, symbol) + "\n" + std::string(spaces, ' ');
-        }
-        // Non empty object or array ended
-        else if ((symbol == '}' and json[i - 1] != '{') or (symbol == ']' and json[i - 1] != '[')) {
-            spaces -= indentation;
-            output += "\n" + std::string(spaces, ' ') + std::string(1, symbol);
-        }
-        // Comma so new line and indent
-        else if (symbol == ',') {
-            output += ",\n" + std::string(spaces - 1, ' ');
-        }
-        // Other symbols
-        else {
-            // Check if escape or string started
-            if (symbol == '\\') {
-                escape = true;
-            } else if (symbol == '"') {
-                inString = true;
-            }
-            output += symbol;
-        }
+void Writer::flush() {
+    if (used) {
+        output.write(buffer, used);
+        used = 0;
     }
+}
 
-    return output;
+size_t Writer::serializedSize(const Element &element, const WriteOptions &options) {
+    return measureValue(element, options, 0);
 }
 
-std::string Utils::doubleToString(const double &dou) {
-    std::string str = std::to_string(dou);
-    if (str.find('.') != std::string::npos) {
-        while (str.back() == '0' and str[str.length() - 2] != '.') {
-            str.pop_back();
-        }
-    }
-    return str;
+size_t Writer::serializedSize(const Object &object, const WriteOptions &options) {
+    return measureObject(object, options, 0);
+}
+
+size_t Writer::serializedSize(const FrozenObject &object, const WriteOptions &options) {
+    return measureFrozenObject(object, options, 0);
 }
 
+size_t Writer::serializedSize(const Array &array, const WriteOptions &options) {
+    return measureArray(array, options, 0);
+}
 
-std::string toString(Type type) {
-    switch (type) {
-        case INTEGER:
-            return "INTEGER";
+void Writer::writeValue(const Element &element) {
+    if (recording and element.exposed) {
+        recordElement(element);
+        return;
+    }
+    switch (element.getType()) {
+        case INTEGER: {
+            char digits[Utils::maxIntegerLength];
+            append(digits, Utils::formatInteger(element.getInt(), digits));
+            break;
+        }
         case BOOLEAN:
-            return "BOOLEAN";
-        case FRACTION:
-            return "FLOATING POINT";
+            if (element.getBool()) append("true", 4);
+            else append("false", 5);
+            break;
+        case FRACTION: {
+            char digits[Utils::maxDoubleLength];
+            append(digits, Utils::formatDouble(element.getDouble(), digits));
+            break;
+        }
         case OBJECT:
-            return "JSON OBJECT";
+            writeObject(element.getObject());
+            break;
         case STRING:
-            return "STRING";
+            writeString(element.getString());
+            break;
         case ARRAY:
-            return "JSON ARRAY";
+            writeArray(element.getArray());
+            break;
         case JSON_NULL:
-            return "JSON NULL";
+            append("null", 4);
+            break;
         case UNINITIALIZED:
-            return "UNINITIALIZED";
+            append("UNINITIALIZED", 13);
+            break;
     }
 }
 
-
-Element parse(const std::string &json) {
-    return Parser(json).parse();
+void Writer::writeObject(const Object &object) {
+    if (recording) {
+        recordNested(object);
+    } else if (usesSource(object, options)) {
+        const Object::JsonCache *cache = object.jsonCache;
+        append(cache->source->data() + cache->offset, cache->size);
+    } else if (options.cacheFragments and not options.indent) {
+        writeCachedObject(object);
+    } else {
+        writeMembers(object);
+    }
 }
 
-Element parseFile(const std::string &fileName) {
-    std::string fileContent = Utils::fileToString(fileName);
-    return parse(fileContent);
+bool Writer::usesSource(const Object &object, const WriteOptions &options) {
+    const Object::JsonCache *cache = object.jsonCache;
+    return cache and cache->valid and cache->source and not options.compact and not options.indent
+           and cache->epoch == Object::epoch.load(std::memory_order_relaxed);
 }
 
-Element Parser::parse() {
-    trim();
-    size_t size = remainingSize();
+bool Writer::usesCache(const Object &object, const WriteOptions &options) {
+    const Object::JsonCache *cache = object.jsonCache;
+    return cache and cache->valid and not cache->source and cache->compact == options.compact
+           and cache->epoch == Object::epoch.load(std::memory_order_relaxed);
+}
 
-    if (size == 0) {
-        return Element();
-    } else if (size == 4 and json.substr(index, size) == "true") {
-        return Element(true);
-    } else if (size == 5 and json.substr(index, size) == "false") {
-        return Element(false);
-    } else if (size == 4 and json.substr(index, size) == "null") {
-        return Element(nullptr);
-    } else if (currentSymbol() == '{') {
-        return ObjectParser(json, index, endIndex).parse();
-    } else if (currentSymbol() == '[') {
-        return ArrayParser(json, index, endIndex).parse();
-    } else if (currentSymbol() == '"') {
-        return StringParser(json, index, endIndex).parse();
-    } else {
-        return NumberParser(json, index, endIndex).parse();
+void Writer::writeCachedObject(const Object &object) {
+    if (not usesCache(object, options)) {
+        fillCache(object);
+    }
+    const Object::JsonCache *cache = object.jsonCache;
+    size_t position = 0;
+    for (const Object::JsonCache::Nested &nested: cache->nested) {
+        append(cache->text.data() + position, nested.position - position);
+        if (nested.object) {
+            writeObject(*nested.object);
+        } else {
+            writeValue(*nested.element);
+        }
+        position = nested.position;
     }
+    append(cache->text.data() + position, cache->text.size() - position);
 }
 
-void Parser::moveToNonEmptyPosition() {
-    index = json.find_first_not_of(" \t\n", index);
-    if (index == std::string::npos) {
-        index = endIndex;
+void Writer::fillCache(const Object &object) {
+    Object::JsonCache *cache = object.jsonCache;
+    if (not cache) {
+        cache = object.jsonCache = Memory::create<Object::JsonCache>(object.resource, object.resource);
     }
+    cache->valid = false;
+    cache->text.clear();
+    cache->nested.clear();
+    cache->source.reset();
+    cache->flat = true;
+    // Changes during the recording must leave the cache outdated
+    cache->epoch = Object::epoch.load(std::memory_order_relaxed);
+
+    // Positions in the text are only known when a single writer records it
+    WriteOptions cacheOptions = options;
+    cacheOptions.threads = 1;
+    CacheOutput fragment(cache->text);
+    Writer writer(fragment, cacheOptions);
+    writer.recording = cache;
+    writer.writeMembers(object);
+    writer.flush();
+    cache->compact = options.compact;
+    cache->valid = true;
+    object.cacheFilled();
 }
 
-
-void Parser::trim() {
-    moveToNonEmptyPosition();
-    trimEndWhitespace();
+void Writer::recordNested(const Object &object) {
+    recording->flat = false;
+    if (usesSource(object, options)) {
+        flush();
+        recording->nested.push_back(Object::JsonCache::Nested{recording->text.size(), &object, nullptr});
+        return;
+    }
+    if (not usesCache(object, options)) {
+        fillCache(object);
+    }
+    const Object::JsonCache *cache = object.jsonCache;
+    if (cache->flat) {
+        // Objects without nested objects are copied, so every character is stored twice at most
+        append(cache->text.data(), cache->text.size());
+    } else {
+        flush();
+        recording->nested.push_back(Object::JsonCache::Nested{recording->text.size(), &object, nullptr});
+    }
 }
 
-
-bool Parser::endOfParsing() const {
-    return index == std::string::npos or index >= endIndex - 1;
+void Writer::recordElement(const Element &element) {
+    recording->flat = false;
+    flush();
+    recording->nested.push_back(Object::JsonCache::Nested{recording->text.size(), nullptr, &element});
 }
 
-void Parser::trimEndWhitespace() {
-    endIndex = getJson().find_last_not_of(" \t\n", lastPosition());
-    if (endIndex == std::string::npos) {
-        endIndex = index;
-    } else {
-        endIndex++;
+void Writer::writeMembers(const Object &object) {
+    append('{');
+    if (parallel(object.size())) {
+        std::vector<Item> items;
+        items.reserve(object.size());
+        for (const auto &member: object) {
+            items.push_back(Item{&member.getKey(), &member.getValue()});
+        }
+        if (not items.empty()) {
+            openNesting();
+            writeParallel(items);
+            closeNesting();
+        }
+        append('}');
+        return;
+    }
+    bool first = true;
+    for (const auto &member: object) {
+        if (first) {
+            openNesting();
+        } else {
+            writeSeparator();
+        }
+        first = false;
+        writeKey(member.getKey());
+        writeValue(member.getValue());
+    }
+    if (not first) {
+        closeNesting();
     }
+    append('}');
 }
 
-size_t Parser::findIndexAfterElement(char symbol) {
-    bool skip = false;
-    bool inString = false;
-
-    int arrayCounter = 0;
-    int objectCounter = 0;
-    for (size_t i = index; i <= lastPosition(); i++) {
-        char current = json[i];
+void Writer::writeFrozenObject(const FrozenObject &object) {
+    bool caching = options.cacheFragments;
+    options.cacheFragments = false;
+    writeFrozenMembers(object);
+    options.cacheFragments = caching;
+}
 
-        if (skip) {
-            skip = false;
-            continue;
-        } else if (inString) {
-            inString = current != '"';
-            continue;
+void Writer::writeFrozenMembers(const FrozenObject &object) {
+    append('{');
+    if (parallel(object.size())) {
+        std::vector<Item> items;
+        items.reserve(object.size());
+        for (const FrozenObject::Entry &entry: object) {
+            items.push_back(Item{&entry.first, &entry.second});
         }
-
-        if (current == symbol and objectCounter == 0 and arrayCounter == 0) {
-            return i;
+        openNesting();
+        writeParallel(items);
+        closeNesting();
+        append('}');
+        return;
+    }
+    for (const FrozenObject::Entry &entry: object) {
+        if (&entry == object.begin()) {
+            openNesting();
+        } else {
+            writeSeparator();
         }
+        writeKey(entry.first);
+        writeValue(entry.second);
+    }
+    if (not object.empty()) {
+        closeNesting();
+    }
+    append('}');
+}
 
-        if (current == '\\') {
-            skip = true;
-        } else if (current == '"') {
-            inString = true;
-        } else if (current == '{') {
-            objectCounter++;
-        } else if (current == '}') {
-            objectCounter--;
-        } else if (current == '[') {
-            arrayCounter++;
-        } else if (current == ']') {
-            arrayCounter--;
+void Writer::writeArray(const Array &array) {
+    append('[');
+    if (parallel(array.size())) {
+        std::vector<Item> items;
+        items.reserve(array.size());
+        for (const Element &value: array) {
+            items.push_back(Item{nullptr, &value});
         }
+        openNesting();
+        writeParallel(items);
+        closeNesting();
+        append(']');
+        return;
     }
-
-    return std::string::npos;
+    for (size_t i = 0; i < array.size(); i++) {
+        if (i) {
+            writeSeparator();
+        } else {
+            openNesting();
+        }
+        writeValue(array[i]);
+    }
+    if (not array.empty()) {
+        closeNesting();
+    }
+    append(']');
 }
 
-size_t Parser::remainingSize() const {
-    return endIndex - index;
+void Writer::writeKey(const std::string &key) {
+    writeString(key);
+    if (options.compact) append(':');
+    else append(": ", 2);
 }
 
-const std::string& Parser::getJson() const {
-    return json;
+void Writer::writeString(const std::string &string) {
+    append('"');
+    const char *position = string.data();
+    const char *end = position + string.size();
+    while (true) {
+        // Clean runs are copied at once
+        const char *special = findEscape(position, end);
+        append(position, static_cast<size_t>(special - position));
+        if (special == end) {
+            break;
+        }
+        char sequence[6];
+        append(sequence, escapeSequence(static_cast<unsigned char>(*special), sequence));
+        position = special + 1;
+    }
+    append('"');
 }
 
-size_t Parser::currentPosition() const {
-    return index;
+bool Writer::parallel(size_t values) const {
+    // Caches are filled from the memory resources of the objects, which need not be thread safe
+    bool caching = options.cacheFragments and not options.indent;
+    return workers(options.threads) > 1 and values >= parallelThreshold and not caching;
 }
 
-size_t Parser::lastPosition() const {
-    return endIndex - 1;
+size_t Writer::workers(unsigned int threads) {
+    // hardware_concurrency is zero when it is not known, the threads asked for are used then
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware and hardware < threads ? hardware : threads;
 }
 
-void Parser::incrementPosition() {
-    index++;
+void Writer::writeParallel(const std::vector<Item> &items) {
+    const size_t chunks = workers(options.threads);
+    std::vector<std::string> parts(chunks);
+
+    // Every chunk gets its own writer and buffer, nested containers are written by that thread alone,
+    // so a single object or array is split at a time and no more threads run than the hardware has
+    WriteOptions chunkOptions = options;
+    chunkOptions.threads = 1;
+    auto writeChunk = [&](size_t chunk) {
+        StringOutput partOutput(parts[chunk]);
+        Writer writer(partOutput, chunkOptions);
+        writer.depth = depth;
+        writer.writeItems(items, items.size() * chunk / chunks, items.size() * (chunk + 1) / chunks);
+        writer.flush();
+    };
+    std::vector<std::future<void>> tasks;
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        tasks.push_back(std::async(std::launch::async, writeChunk, chunk));
+    }
+    writeChunk(0);
+    for (auto &task: tasks) {
+        task.get();
+    }
+
+    // What was buffered before goes first, all of it is handed over at once so file descriptors can use writev
+    std::vector<Output::Block> blocks;
+    blocks.reserve(chunks + 1);
+    blocks.push_back(Output::Block{buffer, used});
+    for (const std::string &part: parts) {
+        blocks.push_back(Output::Block{part.data(), part.size()});
+    }
+    output.writeBlocks(blocks.data(), blocks.size());
+    used = 0;
 }
 
-void Parser::setPosition(size_t pos) {
-    index = pos;
+void Writer::writeItems(const std::vector<Item> &items, size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+        if (i) {
+            writeSeparator();
+        }
+        if (items[i].key) {
+            writeKey(*items[i].key);
+        }
+        writeValue(*items[i].value);
+    }
 }
 
-char Parser::currentSymbol() const {
-    return getJson().at(currentPosition());
+size_t Writer::measureValue(const Element &element, const WriteOptions &options, size_t depth) {
+    switch (element.getType()) {
+        case INTEGER: {
+            char digits[Utils::maxIntegerLength];
+            return Utils::formatInteger(element.getInt(), digits);
+        }
+        case BOOLEAN:
+            return element.getBool() ? 4 : 5;
+        case FRACTION: {
+            char digits[Utils::maxDoubleLength];
+            return Utils::formatDouble(element.getDouble(), digits);
+        }
+        case OBJECT:
+            return measureObject(element.getObject(), options, depth);
+        case STRING:
+            return measureString(element.getString());
+        case ARRAY:
+            return measureArray(element.getArray(), options, depth);
+        case JSON_NULL:
+            return 4;
+        case UNINITIALIZED:
+            return 13;
+    }
+    return 0;
 }
 
-void Parser::throwException(const std::string &msg) const {
-    throw ParseException(msg, getJson(), currentPosition());
+size_t Writer::measureObject(const Object &object, const WriteOptions &options, size_t depth) {
+    const Object::JsonCache *cache = object.jsonCache;
+    if (usesSource(object, options)) {
+        return cache->size;
+    }
+    if (options.cacheFragments and not options.indent and usesCache(object, options)) {
+        size_t size = cache->text.size();
+        for (const Object::JsonCache::Nested &nested: cache->nested) {
+            if (nested.object) {
+                size += measureObject(*nested.object, options, depth + 1);
+            } else {
+                size += measureValue(*nested.element, options, depth + 1);
+            }
+        }
+        return size;
+    }
+    size_t size = 0;
+    size_t values = 0;
+    for (const auto &member: object) {
+        size += measureString(member.getKey()) + measureKeySeparator(options);
+        size += measureValue(member.getValue(), options, depth + 1);
+        values++;
+    }
+    return size + measureLayout(values, options, depth);
 }
 
+size_t Writer::measureFrozenObject(const FrozenObject &object, const WriteOptions &options, size_t depth) {
+    size_t size = 0;
+    for (const FrozenObject::Entry &entry: object) {
+        size += measureString(entry.first) + measureKeySeparator(options);
+        size += measureValue(entry.second, options, depth + 1);
+    }
+    return size + measureLayout(object.size(), options, depth);
+}
 
-Element ArrayParser::parse() {
-    trim();
-    checkArraySemantics();
-    // Skip '['
-    incrementPosition();
+size_t Writer::measureArray(const Array &array, const WriteOptions &options, size_t depth) {
+    size_t size = 0;
+    for (const Element &value: array) {
+        size += measureValue(value, options, depth + 1);
+    }
+    return size + measureLayout(array.size(), options, depth);
+}
 
-    Array array;
-    while (not endOfParsing()) {
-        size_t endIndexOfElement = findIndexAfterElement(',');
-        if (endIndexOfElement == std::string::npos) {
-            endIndexOfElement = lastPosition();
-        }
-        array.push_back(Parser(getJson(), currentPosition(), endIndexOfElement).parse());
-        setPosition(endIndexOfElement + 1);
+size_t Writer::measureString(const std::string &string) {
+    size_t size = string.size() + 2;
+    const char *position = string.data();
+    const char *end = position + string.size();
+    while ((position = findEscape(position, end)) != end) {
+        char sequence[6];
+        size += escapeSequence(static_cast<unsigned char>(*position), sequence) - 1;
+        position++;
     }
-    return array;
+    return size;
 }
 
-void ArrayParser::checkArraySemantics() {
-    if (currentSymbol() != '[') {
-        throwException("Array does not start with '{'");
+size_t Writer::measureLayout(size_t values, const WriteOptions &options, size_t depth) {
+    if (values == 0) {
+        return 2;
     }
-    if (getJson().at(lastPosition()) != ']') {
-        throwException("Array does not end with ']'");
+    if (options.indent) {
+        // A line break before every value and one before the closing bracket
+        size_t inner = values * (1 + (depth + 1) * options.indent);
+        return 2 + (values - 1) + inner + 1 + depth * options.indent;
     }
+    return 2 + (values - 1) * (options.compact ? 1 : 2);
 }
 
+size_t Writer::measureKeySeparator(const WriteOptions &options) {
+    return options.compact ? 1 : 2;
+}
 
-Element NumberParser::parse() {
-    trim();
-    std::string str = getJson().substr(currentPosition(), remainingSize());
-    double number = parseNumber(str);
-    if (str.find('.') == std::string::npos) {
-        return Element((int) number);
+void Writer::writeSeparator() {
+    if (options.indent) {
+        append(',');
+        writeLineBreak();
+    } else if (options.compact) {
+        append(',');
     } else {
-        return Element(number);
+        append(", ", 2);
     }
 }
 
-double NumberParser::parseNumber(const std::string& str) {
-    try {
-        return std::stod(str);
-    } catch (std::out_of_range &e) {
-        throwException("Cannot parse, number '" + str + "' is out of range.");
-    } catch (std::invalid_argument &e) {
-        throwException("Invalid Json, '" + str + "' is not valid.");
+void Writer::openNesting() {
+    depth++;
+    if (options.indent) {
+        writeLineBreak();
     }
 }
 
+void Writer::closeNesting() {
+    depth--;
+    if (options.indent) {
+        writeLineBreak();
+    }
+}
 
-Element ObjectParser::parse() {
-    trim();
-    checkObjectSemantics();
-    incrementPosition();
+void Writer::writeLineBreak() {
+    size_t size = 1 + depth * options.indent;
+    if (lineBreak.size() < size) {
+        lineBreak.resize(size, ' ');
+    }
+    append(lineBreak.data(), size);
+}
 
-    Object obj = Object();
-    while (not endOfParsing()) {
-        std::string key = extractKeyAndAdjustIndex();
-        checkForDoublePointAndAdjustIndex();
-        size_t endIndexOfElement = findIndexAfterElement(',');
-        if (endIndexOfElement == std::string::npos) {
-            endIndexOfElement = lastPosition();
+void Writer::append(const char *data, size_t size) {
+    if (used + size > bufferSize) {
+        flush();
+        if (size > bufferSize) {
+            // Too large to buffer, hand it over as is
+            output.write(data, size);
+            return;
         }
-        obj[key] = Parser(getJson(), currentPosition(), endIndexOfElement).parse();
-        setPosition(endIndexOfElement + 1);
     }
-    return obj;
+    std::memcpy(buffer + used, data, size);
+    used += size;
 }
 
-
-
-std::string ObjectParser::extractKeyAndAdjustIndex() {
-    // First quotation mark
-    moveToNonEmptyPosition();
-    if (endOfParsing() or currentSymbol() != '"') {
-        throwException("Invalid Json, missing key in object");
+void Writer::append(char symbol) {
+    if (used == bufferSize) {
+        flush();
     }
-    incrementPosition();
+    buffer[used++] = symbol;
+}
 
-    int keyStart = currentPosition();
 
-    // Second quotation mark
-    setPosition(findIndexAfterElement('"'));
-    if (endOfParsing()) {
-        throwException("Invalid Json, key in object has no ending");
-    }
-    incrementPosition();
+StreamWriter::StreamWriter(Output &output, WriteOptions options) : writer(output, options), afterKey(false) {}
 
-    return getJson().substr(keyStart, currentPosition() - keyStart - 1);
+StreamWriter &StreamWriter::startObject() {
+    beforeValue();
+    writer.append('{');
+    levels.push_back(Level{true, true});
+    return *this;
 }
 
+StreamWriter &StreamWriter::endObject() {
+    end(true, '}');
+    return *this;
+}
 
+StreamWriter &StreamWriter::startArray() {
+    beforeValue();
+    writer.append('[');
+    levels.push_back(Level{false, true});
+    return *this;
+}
 
-void ObjectParser::checkForDoublePointAndAdjustIndex() {
-    moveToNonEmptyPosition();
-    if (endOfParsing() or currentSymbol() != ':') {
-        throwException("Invalid Json, no ':' between key and value");
-    }
-    incrementPosition();
+StreamWriter &StreamWriter::endArray() {
+    end(false, ']');
+    return *this;
 }
 
-void ObjectParser::checkObjectSemantics() {
-    if (currentSymbol() != '{') {
-        throwException("Invalid Json: object does not start with '{'");
+StreamWriter &StreamWriter::key(const std::string &key) {
+    beforeKey();
+    writer.writeKey(key);
+    afterKey = true;
+    return *this;
+}
 
-    }
-    if (getJson().at(lastPosition()) != '}') {
-        throwException("Invalid Json: object does not end with '}'");
-    }
+StreamWriter &StreamWriter::value(const std::string &string) {
+    beforeValue();
+    writer.writeString(string);
+    afterValue();
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(const char *string) {
+    return value(std::string(string));
 }
 
+StreamWriter &StreamWriter::value(int number) {
+    beforeValue();
+    char digits[Utils::maxIntegerLength];
+    writer.append(digits, Utils::formatInteger(number, digits));
+    afterValue();
+    return *this;
+}
 
+StreamWriter &StreamWriter::value(double fraction) {
+    beforeValue();
+    char digits[Utils::maxDoubleLength];
+    writer.append(digits, Utils::formatDouble(fraction, digits));
+    afterValue();
+    return *this;
+}
 
+StreamWriter &StreamWriter::value(bool boolean) {
+    beforeValue();
+    if (boolean) writer.append("true", 4);
+    else writer.append("false", 5);
+    afterValue();
+    return *this;
+}
 
+StreamWriter &StreamWriter::value(std::nullptr_t) {
+    beforeValue();
+    writer.append("null", 4);
+    afterValue();
+    return *this;
+}
 
-Element StringParser::parse() {
-    trim();
-    if (not isValidString()) {
-        throwException("Invalid Json, string is invalid as per Json rules.");
-    }
-    // pos + 1 and size - 2 to erase quotation
-    return getJson().substr(currentPosition() + 1, remainingSize() - 2);
+StreamWriter &StreamWriter::value(const Element &element) {
+    beforeValue();
+    writer.writeValue(element);
+    afterValue();
+    return *this;
 }
 
-bool StringParser::isValidString() {
-    size_t startPosition = currentPosition();
+void StreamWriter::flush() {
+    writer.flush();
+}
 
-    if (remainingSize() < 2 or currentSymbol() != '"' or getJson().at(lastPosition()) != '"') {
-        return false;
+void StreamWriter::beforeValue() {
+    if (afterKey) {
+        afterKey = false;
+        return;
     }
-    incrementPosition();
-
-    bool escape = false;
-    while (not endOfParsing()) {
-        if (escape) {
-            if (not isEscapedPartCorrect()) {
-                return false;
-            }
-            escape = false;
-        } else if (currentSymbol() == '\\') {
-            escape = true;
-        } else if (currentSymbol() == '\"' and currentPosition() != lastPosition()) {
-            return false;
-        }
-        incrementPosition();
+    if (levels.empty()) {
+        return;
+    }
+#ifndef NDEBUG
+    if (levels.back().object) {
+        JSONMAX_THROW(WriteException("StreamWriter: a value in an object needs a key first."));
+    }
+#endif
+    if (levels.back().empty) {
+        levels.back().empty = false;
+        writer.openNesting();
+    } else {
+        writer.writeSeparator();
     }
-    setPosition(startPosition);
-    return true;
 }
 
-
-bool StringParser::isHexadecimalCorrect() {
-    if (currentPosition() + 4 > lastPosition()) {
-        return false;
+void StreamWriter::beforeKey() {
+#ifndef NDEBUG
+    if (levels.empty() or not levels.back().object) {
+        JSONMAX_THROW(WriteException("StreamWriter: keys can only be written in an object."));
+    }
+    if (afterKey) {
+        JSONMAX_THROW(WriteException("StreamWriter: the previous key has no value yet."));
+    }
+#endif
+    if (levels.back().empty) {
+        levels.back().empty = false;
+        writer.openNesting();
+    } else {
+        writer.writeSeparator();
     }
-    incrementPosition();
-    const static std::string hexa = "0123456789abcdefABCDEF";
-    size_t result = getJson().find_first_not_of(hexa.c_str(), currentPosition(), 4);
-    return result != std::string::npos;
 }
 
+void StreamWriter::end(bool object, char bracket) {
+#ifndef NDEBUG
+    if (levels.empty() or levels.back().object != object) {
+        JSONMAX_THROW(WriteException(object ? "StreamWriter: endObject without a matching startObject."
+                                            : "StreamWriter: endArray without a matching startArray."));
+    }
+    if (afterKey) {
+        JSONMAX_THROW(WriteException("StreamWriter: the last key has no value."));
+    }
+#else
+    (void) object;
+#endif
+    if (not levels.back().empty) {
+        writer.closeNesting();
+    }
+    levels.pop_back();
+    writer.append(bracket);
+    afterValue();
+}
 
-bool StringParser::isEscapedPartCorrect() {
-    // Allowed chars after escape
-    const static std::string allowed = "\"\\/bfnrtu";
-    if (allowed.find(currentSymbol()) == std::string::npos) {
-        return false;
+void StreamWriter::afterValue() {
+    if (levels.empty()) {
+        writer.flush();
     }
-    // u has to be followed by 4 hexadecimal units
-    return currentSymbol() != 'u' or isHexadecimalCorrect();
 }
 } // namespace JsonMax
 #endif //JSONMAX_H
@@ -71,15 +71,64 @@ int main() {
            "#include <vector>\n"
            "#include <map>\n"
            "#include <unordered_map>\n"
+           "#include <memory>\n"
            "#include <sstream>\n"
-           "#include <fstream>\n\n";
+           "#include <ostream>\n"
+           "#include <fstream>\n"
+           "#include <cstddef>\n"
+           "#include <new>\n"
+           "#include <tuple>\n"
+           "#include <utility>\n"
+           "#include <atomic>\n"
+           "#include <cstdint>\n"
+           "#include <cstring>\n"
+           "#include <chrono>\n"
+           "#include <random>\n"
+           "#include <iterator>\n"
+           "#include <algorithm>\n"
+           "#include <mutex>\n"
+           "#include <future>\n"
+           "#include <functional>\n"
+           "#include <cstdlib>\n"
+           "#include <climits>\n"
+           "#include <cctype>\n"
+           "#include <cstdio>\n"
+           "#include <cerrno>\n"
+           "#include <cmath>\n"
+           "#include <exception>\n"
+           "#include <stdexcept>\n"
+           "#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)\n"
+           "#include <emmintrin.h>\n"
+           "#endif\n"
+           "#if defined(__unix__) || defined(__APPLE__)\n"
+           "#include <unistd.h>\n"
+           "#include <sys/uio.h>\n"
+           "#endif\n"
+           "#if __cplusplus >= 201703L\n"
+           "#include <memory_resource>\n"
+           "#include <string_view>\n"
+           "#endif\n\n";
 
     out << "namespace JsonMax {" << std::endl;
+    out << fromHeader(root + "src/json_max/model/Config.h");
+    out << fromHeader(root + "src/json_max/writer/WriteOptions.h");
+    out << fromHeader(root + "src/json_max/model/Memory.h");
     out << fromHeader(root + "src/json_max/model/Object.h");
     out << fromHeader(root + "src/json_max/model/Type.h");
     out << fromHeader(root + "src/json_max/model/Element.h");
+    out << fromHeader(root + "src/json_max/model/AdaptiveStorage.h");
+    out << fromHeader(root + "src/json_max/model/FlatHashMap.h");
+    out << fromHeader(root + "src/json_max/model/Shape.h");
+    out << fromHeader(root + "src/json_max/model/ShapedStorage.h");
+    out << fromHeader(root + "src/json_max/model/ObjectIterator.h");
+    out << fromHeader(root + "src/json_max/model/FrozenObject.h");
+    out << fromHeader(root + "src/json_max/model/ObjectBuilder.h");
+    out << fromHeader(root + "src/json_max/model/ArrayBuilder.h");
+    out << fromHeader(root + "src/json_max/model/Path.h");
+    out << fromHeader(root + "src/json_max/model/ArrayIndex.h");
     out << fromHeader(root + "src/json_max/model/Pair.h");
     out << fromHeader(root + "src/json_max/model/Utils.h");
+    out << fromHeader(root + "src/json_max/parser/ParseError.h");
     out << fromHeader(root + "src/json_max/parser/ParseException.h");
     out << fromHeader(root + "src/json_max/parser/Utils.h");
     out << fromHeader(root + "src/json_max/parser/Parser.h");
@@ -87,16 +136,38 @@ int main() {
     out << fromHeader(root + "src/json_max/parser/NumberParser.h");
     out << fromHeader(root + "src/json_max/parser/ObjectParser.h");
     out << fromHeader(root + "src/json_max/parser/StringParser.h");
+    out << fromHeader(root + "src/json_max/query/Query.h");
+    out << fromHeader(root + "src/json_max/writer/NumberFormat.h");
+    out << fromHeader(root + "src/json_max/writer/Output.h");
+    out << fromHeader(root + "src/json_max/writer/Writer.h");
+    out << fromHeader(root + "src/json_max/writer/StreamWriter.h");
+    out << fromCpp(root + "src/json_max/model/Memory.cpp");
     out << fromCpp(root + "src/json_max/model/Element.cpp");
     out << fromCpp(root + "src/json_max/model/Pair.cpp");
+    out << fromCpp(root + "src/json_max/model/AdaptiveStorage.cpp");
+    out << fromCpp(root + "src/json_max/model/FlatHashMap.cpp");
+    out << fromCpp(root + "src/json_max/model/Shape.cpp");
+    out << fromCpp(root + "src/json_max/model/ShapedStorage.cpp");
+    out << fromCpp(root + "src/json_max/model/ObjectIterator.cpp");
+    out << fromCpp(root + "src/json_max/model/FrozenObject.cpp");
+    out << fromCpp(root + "src/json_max/model/ObjectBuilder.cpp");
+    out << fromCpp(root + "src/json_max/model/ArrayBuilder.cpp");
+    out << fromCpp(root + "src/json_max/model/Path.cpp");
+    out << fromCpp(root + "src/json_max/model/ArrayIndex.cpp");
     out << fromCpp(root + "src/json_max/model/Object.cpp");
     out << fromCpp(root + "src/json_max/model/Utils.cpp");
     out << fromCpp(root + "src/json_max/model/Type.cpp");
+    out << fromCpp(root + "src/json_max/parser/ParseError.cpp");
     out << fromCpp(root + "src/json_max/parser/Parser.cpp");
     out << fromCpp(root + "src/json_max/parser/ArrayParser.cpp");
     out << fromCpp(root + "src/json_max/parser/NumberParser.cpp");
     out << fromCpp(root + "src/json_max/parser/ObjectParser.cpp");
     out << fromCpp(root + "src/json_max/parser/StringParser.cpp");
+    out << fromCpp(root + "src/json_max/query/Query.cpp");
+    out << fromCpp(root + "src/json_max/writer/NumberFormat.cpp");
+    out << fromCpp(root + "src/json_max/writer/Output.cpp");
+    out << fromCpp(root + "src/json_max/writer/Writer.cpp");
+    out << fromCpp(root + "src/json_max/writer/StreamWriter.cpp");
     out << "} // namespace JsonMax" << std::endl;
     out << "#endif //JSONMAX_H" << std::endl;
 
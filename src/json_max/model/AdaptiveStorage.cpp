@@ -0,0 +1,209 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "AdaptiveStorage.h"
+#include "Utils.h"
+#include "Config.h"
+
+#include <tuple>
+
+using namespace JsonMax;
+
+std::atomic<size_t> AdaptiveStorage::threshold(8);
+
+AdaptiveStorage::AdaptiveStorage(MemoryResource *_resource, bool _indexed)
+        : entries(reinterpret_cast<Entry *>(inlineEntries)), count(0), capacity(inlineCapacity),
+          index(nullptr), indexMask(0), resource(_resource), indexed(_indexed) {}
+
+AdaptiveStorage::AdaptiveStorage(const AdaptiveStorage &other, MemoryResource *_resource)
+        : AdaptiveStorage(_resource, other.indexed) {
+    if (other.count > capacity) {
+        grow(other.count);
+    }
+    JSONMAX_TRY {
+        for (const Entry &entry: other) {
+            new(entries + count) Entry(std::piecewise_construct, std::forward_as_tuple(entry.first),
+                                       std::forward_as_tuple(entry.second, resource));
+            count++;
+        }
+        if (other.index) {
+            buildIndex(other.indexMask + 1);
+        }
+    } JSONMAX_CATCH_ALL {
+        destroy();
+        JSONMAX_RETHROW;
+    }
+}
+
+AdaptiveStorage::~AdaptiveStorage() {
+    destroy();
+}
+
+Element *AdaptiveStorage::lookup(const char *key, size_t length) const {
+    uint32_t found = position(key, length);
+    return found == count ? nullptr : &entries[found].second;
+}
+
+Element *AdaptiveStorage::lookup(const char *key, size_t length, uint64_t hash) const {
+    uint32_t found = index ? probe(key, length, hash) : scan(key, length);
+    return found == count ? nullptr : &entries[found].second;
+}
+
+uint32_t AdaptiveStorage::position(const char *key, size_t length) const {
+    return index ? probe(key, length, Utils::hash(key, length)) : scan(key, length);
+}
+
+uint32_t AdaptiveStorage::probe(const char *key, size_t length, uint64_t hash) const {
+    uint32_t fragment = static_cast<uint32_t>(hash >> 32);
+    for (uint32_t i = static_cast<uint32_t>(hash) & indexMask;; i = (i + 1) & indexMask) {
+        const Slot &slot = index[i];
+        if (slot.position == 0) {
+            return count;
+        }
+        const std::string &candidate = entries[slot.position - 1].first;
+        if (slot.hash == fragment and candidate.size() == length and
+            candidate.compare(0, length, key, length) == 0) {
+            return slot.position - 1;
+        }
+    }
+}
+
+uint32_t AdaptiveStorage::scan(const char *key, size_t length) const {
+    for (uint32_t i = 0; i < count; i++) {
+        const std::string &candidate = entries[i].first;
+        if (candidate.size() == length and candidate.compare(0, length, key, length) == 0) {
+            return i;
+        }
+    }
+    return count;
+}
+
+Element &AdaptiveStorage::insert(std::string key) {
+    if (count == capacity) {
+        grow(capacity * 2);
+    }
+    // Keep the index at most half full, grow it before anything changes
+    if (index and (count + 1) * 2 > indexMask + 1) {
+        buildIndex((indexMask + 1) * 2);
+    }
+
+    new(entries + count) Entry(std::move(key), Element(resource));
+    count++;
+
+    if (index) {
+        const std::string &added = entries[count - 1].first;
+        addToIndex(count - 1, Utils::hash(added.data(), added.size()));
+    } else if (indexed or count > threshold.load(std::memory_order_relaxed)) {
+        uint32_t slots = 16;
+        while (slots < count * 2) {
+            slots *= 2;
+        }
+        buildIndex(slots);
+    }
+    return entries[count - 1].second;
+}
+
+void AdaptiveStorage::remove(const char *key, size_t length) {
+    uint32_t found = position(key, length);
+    if (found == count) {
+        return;
+    }
+
+    // Shift the pairs after the removed one to keep the order
+    for (uint32_t i = found; i + 1 < count; i++) {
+        entries[i].first = std::move(entries[i + 1].first);
+        entries[i].second = std::move(entries[i + 1].second);
+    }
+    entries[count - 1].~Entry();
+    count--;
+
+    if (index) {
+        buildIndex(indexMask + 1);
+    }
+}
+
+void AdaptiveStorage::clear() {
+    for (Entry &entry: *this) {
+        entry.~Entry();
+    }
+    count = 0;
+    if (index) {
+        resource->deallocate(index, (indexMask + 1) * sizeof(Slot), alignof(Slot));
+        index = nullptr;
+        indexMask = 0;
+    }
+}
+
+void AdaptiveStorage::reserve(size_t pairs) {
+    grow(static_cast<uint32_t>(pairs));
+}
+
+size_t AdaptiveStorage::size() const {
+    return count;
+}
+
+AdaptiveStorage::Entry *AdaptiveStorage::begin() const {
+    return entries;
+}
+
+AdaptiveStorage::Entry *AdaptiveStorage::end() const {
+    return entries + count;
+}
+
+size_t AdaptiveStorage::getThreshold() {
+    return threshold.load(std::memory_order_relaxed);
+}
+
+void AdaptiveStorage::setThreshold(size_t newThreshold) {
+    threshold.store(newThreshold, std::memory_order_relaxed);
+}
+
+void AdaptiveStorage::grow(uint32_t wanted) {
+    if (wanted <= capacity) {
+        return;
+    }
+    auto *grown = static_cast<Entry *>(resource->allocate(wanted * sizeof(Entry), alignof(Entry)));
+    for (uint32_t i = 0; i < count; i++) {
+        new(grown + i) Entry(std::move(entries[i]));
+        entries[i].~Entry();
+    }
+    if (entries != reinterpret_cast<Entry *>(inlineEntries)) {
+        resource->deallocate(entries, capacity * sizeof(Entry), alignof(Entry));
+    }
+    entries = grown;
+    capacity = wanted;
+}
+
+void AdaptiveStorage::buildIndex(uint32_t slots) {
+    auto *built = static_cast<Slot *>(resource->allocate(slots * sizeof(Slot), alignof(Slot)));
+    if (index) {
+        resource->deallocate(index, (indexMask + 1) * sizeof(Slot), alignof(Slot));
+    }
+    index = built;
+    indexMask = slots - 1;
+    for (uint32_t i = 0; i < slots; i++) {
+        index[i].position = 0;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        addToIndex(i, Utils::hash(entries[i].first.data(), entries[i].first.size()));
+    }
+}
+
+void AdaptiveStorage::addToIndex(uint32_t entry, uint64_t hash) {
+    uint32_t i = static_cast<uint32_t>(hash) & indexMask;
+    while (index[i].position != 0) {
+        i = (i + 1) & indexMask;
+    }
+    index[i].hash = static_cast<uint32_t>(hash >> 32);
+    index[i].position = entry + 1;
+}
+
+void AdaptiveStorage::destroy() {
+    clear();
+    if (entries != reinterpret_cast<Entry *>(inlineEntries)) {
+        resource->deallocate(entries, capacity * sizeof(Entry), alignof(Entry));
+        entries = reinterpret_cast<Entry *>(inlineEntries);
+        capacity = inlineCapacity;
+    }
+}
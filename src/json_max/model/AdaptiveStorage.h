@@ -0,0 +1,139 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_ADAPTIVESTORAGE_H
+#define JSONMAX_ADAPTIVESTORAGE_H
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include "Element.h"
+#include "Memory.h"
+
+namespace JsonMax {
+
+    /**
+     * Storage behind ADAPTIVE objects
+     * Keeps the pairs in insertion order in a small vector, the first few live inline without any allocation.
+     * Once the object grows past the threshold, a compact hash index over the vector is built for O(1) lookups.
+     * INDEXED objects use the same storage, but keep the index from the first pair on.
+     */
+    class AdaptiveStorage {
+    public:
+
+        /// Key/value pair as stored in the vector
+        using Entry = std::pair<std::string, Element>;
+
+        /// Amount of pairs stored inline
+        static const uint32_t inlineCapacity = 4;
+
+        /**
+         * Constructor, allocates from the given resource once the inline pairs are used up
+         * @param indexed true to always keep the hash index, regardless of the threshold
+         */
+        explicit AdaptiveStorage(MemoryResource *resource, bool indexed = false);
+
+        /// Deep copies the given storage into the given resource
+        AdaptiveStorage(const AdaptiveStorage &other, MemoryResource *resource);
+
+        AdaptiveStorage(const AdaptiveStorage &) = delete;
+
+        AdaptiveStorage &operator=(const AdaptiveStorage &) = delete;
+
+        /// Destructor, cleans up the pairs and the index
+        ~AdaptiveStorage();
+
+        /// @return the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const char *key, size_t length) const;
+
+        /// Same as above, with the precomputed Utils::hash of the key
+        Element *lookup(const char *key, size_t length, uint64_t hash) const;
+
+        /// Appends a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
+
+        /// Makes room for at least the given amount of pairs
+        void reserve(size_t pairs);
+
+        /// Removes the pair with the given key, keeps the order of the others
+        void remove(const char *key, size_t length);
+
+        /// Removes all pairs
+        void clear();
+
+        /// @return amount of pairs
+        size_t size() const;
+
+        /// Iteration over the pairs, in insertion order
+        Entry *begin() const;
+
+        Entry *end() const;
+
+        /// Amount of pairs above which objects build a hash index
+        static size_t getThreshold();
+
+        /// Setter for the threshold, only affects objects that grow afterwards
+        static void setThreshold(size_t threshold);
+
+    private:
+
+        /// Slot in the hash index, position is one based so zero marks an empty slot
+        struct Slot {
+            uint32_t hash;
+            uint32_t position;
+        };
+
+        /// @return position of the pair with the given key, count if not present
+        uint32_t position(const char *key, size_t length) const;
+
+        /// Position lookup through the hash index, which must exist
+        uint32_t probe(const char *key, size_t length, uint64_t hash) const;
+
+        /// Position lookup by comparing every key
+        uint32_t scan(const char *key, size_t length) const;
+
+        /// Makes room for at least the given amount of pairs
+        void grow(uint32_t wanted);
+
+        /// (Re)builds the hash index with the given amount of slots, a power of two
+        void buildIndex(uint32_t slots);
+
+        /// Adds the pair at the given position to the index
+        void addToIndex(uint32_t entry, uint64_t hash);
+
+        /// Destroys all pairs and releases the index
+        void destroy();
+
+        /// Pairs in insertion order, either the inline ones or allocated from the resource
+        Entry *entries;
+
+        /// Amount of pairs
+        uint32_t count;
+
+        /// Amount of pairs that fit in entries
+        uint32_t capacity;
+
+        /// Hash index, nullptr as long as the object is small
+        Slot *index;
+
+        /// Amount of slots in the index minus one
+        uint32_t indexMask;
+
+        /// Memory resource for the pairs and the index
+        MemoryResource *resource;
+
+        /// True if the index is kept regardless of the threshold
+        bool indexed;
+
+        /// Storage for the inline pairs
+        alignas(Entry) unsigned char inlineEntries[inlineCapacity * sizeof(Entry)];
+
+        /// Global threshold
+        static std::atomic<size_t> threshold;
+
+    };
+
+}
+
+#endif //JSONMAX_ADAPTIVESTORAGE_H
@@ -0,0 +1,31 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "ArrayBuilder.h"
+
+using namespace JsonMax;
+
+ArrayBuilder::ArrayBuilder(MemoryResource *resource) : array(resource) {}
+
+void ArrayBuilder::reserve(size_t elements) {
+    array.reserve(elements);
+}
+
+void ArrayBuilder::add(Element element) {
+    if (element.getResource() == array.get_allocator().resource()) {
+        array.push_back(std::move(element));
+    } else {
+        array.emplace_back(element, array.get_allocator().resource());
+    }
+}
+
+size_t ArrayBuilder::size() const {
+    return array.size();
+}
+
+Array ArrayBuilder::build() {
+    Array built(std::move(array));
+    array = Array(built.get_allocator().resource());
+    return built;
+}
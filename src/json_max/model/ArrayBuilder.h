@@ -0,0 +1,41 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_ARRAYBUILDER_H
+#define JSONMAX_ARRAYBUILDER_H
+
+#include "Element.h"
+#include "Memory.h"
+
+namespace JsonMax {
+
+    /// Collects the elements of an Array and hands it over in one go, the counterpart of the ObjectBuilder
+    class ArrayBuilder {
+    public:
+
+        /// Constructor, the built array and every element added to it use the given resource
+        explicit ArrayBuilder(MemoryResource *resource = defaultResource());
+
+        /// Makes room for the given amount of elements
+        void reserve(size_t elements);
+
+        /// Appends an element, moved if it uses the resource of the builder and copied otherwise
+        void add(Element element);
+
+        /// @return amount of elements added since the last build
+        size_t size() const;
+
+        /// Hands over the array with all added elements, the builder is empty afterwards
+        Array build();
+
+    private:
+
+        /// Elements in the order they were added
+        Array array;
+
+    };
+
+}
+
+#endif //JSONMAX_ARRAYBUILDER_H
@@ -0,0 +1,171 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "ArrayIndex.h"
+#include "Utils.h"
+
+#include <cstring>
+
+using namespace JsonMax;
+
+namespace {
+
+    /**
+     * Encodes a value with its type, returns false if the value can't be indexed
+     * Integers are encoded as doubles so they match fractions with the same value
+     */
+    bool indexKey(const Element &value, std::string &key) {
+        switch (value.getType()) {
+            case STRING:
+                key.assign(1, 's');
+                key += value.getString();
+                return true;
+            case INTEGER:
+            case FRACTION: {
+                double number = value.isInt() ? value.getInt() : value.getDouble();
+                if (number == 0) {
+                    number = 0;  // -0.0 equals 0.0
+                }
+                key.assign(1 + sizeof(double), 'n');
+                std::memcpy(&key[1], &number, sizeof(double));
+                return true;
+            }
+            case BOOLEAN:
+                key.assign(value.getBool() ? "t" : "f");
+                return true;
+            case JSON_NULL:
+                key.assign("z");
+                return true;
+            default:
+                return false;
+        }
+    }
+
+}
+
+const uint32_t ArrayIndex::none;
+
+ArrayIndex::Iterator::Iterator(const ArrayIndex *_index, uint32_t _position) : index(_index), position(_position) {}
+
+ArrayIndex::Iterator::reference ArrayIndex::Iterator::operator*() const {
+    return (*index->array)[position];
+}
+
+ArrayIndex::Iterator::pointer ArrayIndex::Iterator::operator->() const {
+    return &(*index->array)[position];
+}
+
+ArrayIndex::Iterator &ArrayIndex::Iterator::operator++() {
+    position = index->next[position];
+    return *this;
+}
+
+ArrayIndex::Iterator ArrayIndex::Iterator::operator++(int) {
+    Iterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+bool ArrayIndex::Iterator::operator==(const Iterator &other) const {
+    return position == other.position;
+}
+
+bool ArrayIndex::Iterator::operator!=(const Iterator &other) const {
+    return position != other.position;
+}
+
+ArrayIndex::Range::Range(const ArrayIndex *_index, uint32_t _first) : index(_index), first(_first) {}
+
+ArrayIndex::Iterator ArrayIndex::Range::begin() const {
+    return Iterator(index, first);
+}
+
+ArrayIndex::Iterator ArrayIndex::Range::end() const {
+    return Iterator(index, none);
+}
+
+bool ArrayIndex::Range::empty() const {
+    return first == none;
+}
+
+ArrayIndex::ArrayIndex(const Array &_array, const std::string &pointer) : ArrayIndex(_array, Path(pointer)) {}
+
+ArrayIndex::ArrayIndex(const Array &_array, Path _path) : array(&_array), path(std::move(_path)) {
+    update();
+}
+
+const Element *ArrayIndex::find(const Element &value) {
+    const Chain *chain = lookup(value);
+    return chain ? &(*array)[chain->first] : nullptr;
+}
+
+ArrayIndex::Range ArrayIndex::findAll(const Element &value) {
+    const Chain *chain = lookup(value);
+    if (not chain) {
+        return Range(this, none);
+    }
+    return Range(this, chain->first);
+}
+
+size_t ArrayIndex::count(const Element &value) {
+    const Chain *chain = lookup(value);
+    if (not chain) {
+        return 0;
+    }
+    size_t amount = 1;
+    for (uint32_t position = chain->first; next[position] != none; position = next[position]) {
+        amount++;
+    }
+    return amount;
+}
+
+void ArrayIndex::update() {
+    if (array->size() < next.size()) {
+        // Elements were removed, the positions in the chains are no longer valid
+        rebuild();
+        return;
+    }
+
+    std::string key;
+    for (auto position = static_cast<uint32_t>(next.size()); position < array->size(); position++) {
+        next.push_back(none);
+        const Element *field = path.resolve((*array)[position]);
+        if (not field or not indexKey(*field, key)) {
+            continue;
+        }
+        auto inserted = chains.emplace(key, Chain{position, position});
+        if (not inserted.second) {
+            next[inserted.first->second.last] = position;
+            inserted.first->second.last = position;
+        }
+    }
+}
+
+void ArrayIndex::rebuild() {
+    chains.clear();
+    next.clear();
+    update();
+}
+
+const Path &ArrayIndex::getPath() const {
+    return path;
+}
+
+const ArrayIndex::Chain *ArrayIndex::lookup(const Element &value) {
+    update();
+    std::string key;
+    if (not indexKey(value, key)) {
+        return nullptr;
+    }
+    auto itr = chains.find(key);
+    return itr == chains.end() ? nullptr : &itr->second;
+}
+
+size_t ArrayIndex::KeyHash::operator()(const std::string &key) const {
+    return static_cast<size_t>(Utils::hash(key.data(), key.size()));
+}
+
+ArrayIndex JsonMax::buildIndex(const Array &array, const std::string &pointer) {
+    return ArrayIndex(array, pointer);
+}
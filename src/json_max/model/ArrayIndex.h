@@ -0,0 +1,141 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_ARRAYINDEX_H
+#define JSONMAX_ARRAYINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <iterator>
+#include <cstdint>
+#include "Element.h"
+#include "Path.h"
+
+namespace JsonMax {
+
+    /**
+     * Hash index over an Array, from the value of a field of its elements to the elements that have that value
+     * The field is given as a JSON Pointer relative to every element, such as "/customer/id".
+     * Strings, numbers, booleans and null are indexed; numbers compare by value, so 3 finds 3.0 as well.
+     * Elements appended to the array are indexed by the next lookup, other changes to the array need a rebuild.
+     * The array must outlive the index, any amount of indexes can refer to the same array.
+     */
+    class ArrayIndex {
+    public:
+
+        /// Iterates the elements with the same value, in the order of the array
+        class Iterator {
+        public:
+
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = const Element;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Element *;
+            using reference = const Element &;
+
+            Iterator(const ArrayIndex *index, uint32_t position);
+
+            reference operator*() const;
+
+            pointer operator->() const;
+
+            Iterator &operator++();
+
+            Iterator operator++(int);
+
+            bool operator==(const Iterator &other) const;
+
+            bool operator!=(const Iterator &other) const;
+
+        private:
+
+            const ArrayIndex *index;
+
+            uint32_t position;
+
+        };
+
+        /// Elements with the same value, see findAll
+        class Range {
+        public:
+
+            Range(const ArrayIndex *index, uint32_t first);
+
+            Iterator begin() const;
+
+            Iterator end() const;
+
+            bool empty() const;
+
+        private:
+
+            const ArrayIndex *index;
+
+            uint32_t first;
+
+        };
+
+        /// Constructor, indexes the array on the field with the given JSON Pointer
+        ArrayIndex(const Array &array, const std::string &pointer);
+
+        /// Constructor, indexes the array on the field the given path refers to
+        ArrayIndex(const Array &array, Path path);
+
+        /// @return the first element whose field has the given value, nullptr if there is none
+        const Element *find(const Element &value);
+
+        /// @return all elements whose field has the given value
+        Range findAll(const Element &value);
+
+        /// @return amount of elements whose field has the given value
+        size_t count(const Element &value);
+
+        /// Indexes the elements appended to the array since the last lookup
+        void update();
+
+        /// Indexes the whole array again, needed after elements were changed, inserted or removed
+        void rebuild();
+
+        /// @return the path of the indexed field
+        const Path &getPath() const;
+
+    private:
+
+        /// Position that marks the end of a chain
+        static const uint32_t none = UINT32_MAX;
+
+        /// First and last position of the elements with the same value
+        struct Chain {
+            uint32_t first;
+            uint32_t last;
+        };
+
+        struct KeyHash {
+            size_t operator()(const std::string &key) const;
+        };
+
+        /// @return the chain of the given value, nullptr if no element has it
+        const Chain *lookup(const Element &value);
+
+        /// The indexed array
+        const Array *array;
+
+        /// Path of the indexed field
+        Path path;
+
+        /// Chains of positions per value, the value is encoded together with its type
+        std::unordered_map<std::string, Chain, KeyHash> chains;
+
+        /// Next position with the same value for every indexed position
+        std::vector<uint32_t> next;
+
+    };
+
+    /// @return an index over the array on the field with the given JSON Pointer, see ArrayIndex
+    ArrayIndex buildIndex(const Array &array, const std::string &pointer);
+
+}
+
+#endif //JSONMAX_ARRAYINDEX_H
@@ -0,0 +1,59 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_CONFIG_H
+#define JSONMAX_CONFIG_H
+
+#include <exception>
+#include <cstdio>
+#include <cstdlib>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+namespace JsonMax {
+
+/// Defined when SSE2 instructions can be used, the FlatHashMap groups and the Writer's string escaping use them
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define JSONMAX_SSE2
+#endif
+
+/// Defined when POSIX file descriptors are available, see DescriptorOutput
+#if defined(__unix__) || defined(__APPLE__)
+#define JSONMAX_POSIX
+#endif
+
+/**
+ * The library can be built with -fno-exceptions
+ * Every throw then prints the message of the exception and aborts, use the non throwing functions
+ * (parse with a ParseError, find, tryGet, getOr) to handle errors in that case.
+ */
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS) || defined(_CPPUNWIND)
+#define JSONMAX_THROW(exception) throw exception
+#define JSONMAX_TRY try
+#define JSONMAX_CATCH_ALL catch (...)
+#define JSONMAX_RETHROW throw
+#else
+#define JSONMAX_THROW(exception) JsonMax::abortWith(exception)
+#define JSONMAX_TRY if (true)
+#define JSONMAX_CATCH_ALL else
+#define JSONMAX_RETHROW (void) 0
+#endif
+
+    /// Replaces throwing the given exception when exceptions are disabled
+    [[noreturn]] inline void abortWith(const std::exception &exception) {
+        std::fputs(exception.what(), stderr);
+        std::fputc('\n', stderr);
+        std::abort();
+    }
+
+}
+
+#endif //JSONMAX_CONFIG_H
@@ -4,41 +4,62 @@
 
 #include "Element.h"
 #include "Object.h"
+#include "Path.h"
 #include "Utils.h"
+#include "Config.h"
+#include "../writer/Writer.h"
 
 #include <math.h>
+#include <cstring>
+#include <algorithm>
 
 using namespace JsonMax;
 
-Element::Element() : type(UNINITIALIZED) {}
+Element::Element() : type(UNINITIALIZED), resource(defaultResource()) {}
+
+Element::Element(MemoryResource *memoryResource) : type(UNINITIALIZED), resource(memoryResource) {}
 
 std::string Element::toString(unsigned int ind) const {
-    switch (type) {
-        case INTEGER:
-            return std::to_string(*data.number);
-        case BOOLEAN:
-            if (data.boolean) return "true";
-            else return "false";
-        case FRACTION:
-            return Utils::doubleToString(*data.fraction);
-        case OBJECT:
-            return data.object->toString(ind);
-        case STRING:
-            return "\"" + *data.string + "\"";
-        case ARRAY: {
-            std::string arrayElements = "[";
-            for (size_t i = 0; i < data.array->size(); i++) {
-                arrayElements += data.array->at(i).toString();
-                if (i != data.array->size() - 1) arrayElements += ", ";
-            }
-            arrayElements += "]";
-            if (ind) return Utils::indent(arrayElements, ind);
-            return arrayElements;
-        }
-        case JSON_NULL:
-            return "null";
-        case UNINITIALIZED:
-            return "UNINITIALIZED";
+    return toString(WriteOptions(false, ind));
+}
+
+std::string Element::toString(const WriteOptions &options) const {
+    StringOutput output;
+    // Cached fragments are measured without visiting the unchanged objects again
+    if (options.exactSize or options.cacheFragments) {
+        output.getString().reserve(Writer::serializedSize(*this, options));
+    }
+    Writer(output, options).write(*this);
+    return std::move(output.getString());
+}
+
+size_t Element::serializedSize(const WriteOptions &options) const {
+    return Writer::serializedSize(*this, options);
+}
+
+void Element::write(std::ostream &stream, const WriteOptions &options) const {
+    StreamOutput output(stream);
+    Writer(output, options).write(*this);
+}
+
+void Element::write(std::FILE *file, const WriteOptions &options) const {
+    FileOutput output(file);
+    Writer(output, options).write(*this);
+}
+
+void Element::writeFile(const std::string &fileName, const WriteOptions &options) const {
+    std::FILE *file = std::fopen(fileName.c_str(), "wb");
+    if (not file) {
+        JSONMAX_THROW(WriteException("Couldn't open " + fileName));
+    }
+    JSONMAX_TRY {
+        write(file, options);
+    } JSONMAX_CATCH_ALL {
+        std::fclose(file);
+        JSONMAX_RETHROW;
+    }
+    if (std::fclose(file) != 0) {
+        JSONMAX_THROW(WriteException("Couldn't write " + fileName));
     }
 }
 
@@ -61,18 +82,30 @@ Element &Element::operator=(const Object &obj) {
     return *this;
 }
 
+Element &Element::operator=(Object &&obj) {
+    reset();
+    setObject(std::move(obj));
+    return *this;
+}
+
 Element &Element::operator=(const std::string &string) {
     reset();
     setString(string);
     return *this;
 }
 
-Element &Element::operator=(const std::vector<Element> &arr) {
+Element &Element::operator=(const Array &arr) {
     reset();
     setArray(arr);
     return *this;
 }
 
+Element &Element::operator=(Array &&arr) {
+    reset();
+    setArray(std::move(arr));
+    return *this;
+}
+
 Element &Element::operator=(bool boolean) {
     reset();
     setBoolean(boolean);
@@ -89,11 +122,77 @@ Element& Element::operator[](const std::string &str) {
     if (type == OBJECT) {
         return data.object->operator[](str);
     }
-    throw TypeException("Invalid use of operator[](const char*), element is not a json object.");
+    JSONMAX_THROW(TypeException("Invalid use of operator[](const std::string&), element is not a json object."));
 }
 
+Element& Element::operator[](const char *str) {
+    if (type == OBJECT) {
+        return data.object->operator[](str);
+    }
+    JSONMAX_THROW(TypeException("Invalid use of operator[](const char*), element is not a json object."));
+}
+
+Element *Element::find(const std::string &key) {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+const Element *Element::find(const std::string &key) const {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+Element *Element::find(const Path &path) {
+    return path.resolve(*this);
+}
+
+const Element *Element::find(const Path &path) const {
+    return path.resolve(*this);
+}
+
+Element &Element::at(const Path &path) {
+    Element *element = path.resolve(*this);
+    if (not element) {
+        JSONMAX_THROW(PathException("JSON Pointer '" + path.toString() + "' does not exist in the element."));
+    }
+    return *element;
+}
+
+const Element &Element::at(const Path &path) const {
+    const Element *element = path.resolve(*this);
+    if (not element) {
+        JSONMAX_THROW(PathException("JSON Pointer '" + path.toString() + "' does not exist in the element."));
+    }
+    return *element;
+}
+
+Element *Element::find(const char *key) {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+const Element *Element::find(const char *key) const {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+#if __cplusplus >= 201703L
+
+Element& Element::operator[](std::string_view str) {
+    if (type == OBJECT) {
+        return data.object->operator[](str);
+    }
+    JSONMAX_THROW(TypeException("Invalid use of operator[](std::string_view), element is not a json object."));
+}
+
+Element *Element::find(std::string_view key) {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+const Element *Element::find(std::string_view key) const {
+    return type == OBJECT ? data.object->find(key) : nullptr;
+}
+
+#endif
+
 void Element::setNumber(int number) {
-    Element::data.number = new int(number);
+    Element::data.number = number;
     type = INTEGER;
 }
 
@@ -103,36 +202,73 @@ void Element::setBoolean(bool boolean) {
 }
 
 void Element::setFraction(double fraction) {
-    Element::data.fraction = new double(fraction);
+    Element::data.fraction = fraction;
     type = FRACTION;
 }
 
 void Element::setObject(const Object& object) {
-    Element::data.object = new Object(object);
+    Element::data.object = Memory::create<Object>(resource, object, resource);
+    type = OBJECT;
+}
+
+void Element::setObject(Object &&object) {
+    if (not sharesResource(object.getResource())) {
+        return setObject(object);
+    }
+    Element::data.object = Memory::create<Object>(resource, std::move(object));
     type = OBJECT;
 }
 
 void Element::setString(const std::string &string) {
-    Element::data.string = new std::string(string);
+    Element::data.string = Memory::create<std::string>(resource, string);
     type = STRING;
 }
 
-void Element::setArray(const std::vector<Element> &array) {
-    Element::data.array = new std::vector<Element>(array);
+void Element::setArray(const Array &array) {
+    Element::data.array = Memory::create<Array>(resource, resource);
+    type = ARRAY;
+    data.array->reserve(array.size());
+    for (const Element &element: array) {
+        data.array->emplace_back(element, resource);
+    }
+}
+
+void Element::setArray(Array &&array) {
+    if (not sharesResource(array.get_allocator().resource())) {
+        return setArray(array);
+    }
+    Element::data.array = Memory::create<Array>(resource, std::move(array));
+    type = ARRAY;
+    // The elements keep their place, references to them may still be around
+    exposed = true;
+}
+
+void Element::setArray(const std::initializer_list<Element> &list) {
+    Element::data.array = Memory::create<Array>(resource, resource);
     type = ARRAY;
+    data.array->reserve(list.size());
+    for (const Element &element: list) {
+        data.array->emplace_back(element, resource);
+    }
 }
 
 int Element::getInt() const {
     checkType(INTEGER);
-    return *data.number;
+    return data.number;
 }
 
 double Element::getDouble() const {
     checkType(FRACTION);
-    return *data.fraction;
+    return data.fraction;
 }
 
-std::string& Element::getString() const {
+std::string& Element::getString() {
+    checkType(STRING);
+    expose();
+    return *data.string;
+}
+
+const std::string& Element::getString() const {
     checkType(STRING);
     return *data.string;
 }
@@ -143,53 +279,257 @@ bool Element::getBool() const {
 }
 
 Object& Element::getObject() const {
+    // Changes through the object reach the objects whose caches include it, see Object::markChanged
     checkType(OBJECT);
     return *data.object;
 }
 
-Array& Element::getArray() const {
+Array& Element::getArray() {
     checkType(ARRAY);
+    expose();
     return *data.array;
 }
 
+const Array& Element::getArray() const {
+    checkType(ARRAY);
+    return *data.array;
+}
+
+bool Element::operator==(const Element &other) const {
+    if (this == &other) {
+        return true;
+    }
+    bool number = type == INTEGER or type == FRACTION;
+    bool otherNumber = other.type == INTEGER or other.type == FRACTION;
+    if (number and otherNumber) {
+        if (type == INTEGER and other.type == INTEGER) {
+            return data.number == other.data.number;
+        }
+        double value = type == INTEGER ? data.number : data.fraction;
+        double otherValue = other.type == INTEGER ? other.data.number : other.data.fraction;
+        return value == otherValue;
+    }
+    if (type != other.type) {
+        return false;
+    }
+    switch (type) {
+        case BOOLEAN:
+            return data.boolean == other.data.boolean;
+        case STRING:
+            return *data.string == *other.data.string;
+        case OBJECT:
+            return *data.object == *other.data.object;
+        case ARRAY:
+            return data.array->size() == other.data.array->size() and
+                   std::equal(data.array->begin(), data.array->end(), other.data.array->begin());
+        default:
+            // Null and uninitialized
+            return true;
+    }
+}
+
+bool Element::operator!=(const Element &other) const {
+    return not (*this == other);
+}
+
+uint64_t Element::hash() const {
+    bool cacheable = true;
+    return hash(cacheable);
+}
+
+uint64_t Element::hash(bool &cacheable) const {
+    if (exposed) {
+        cacheable = false;
+    }
+    // Every type gets its own constant, so values of different types don't collide by construction
+    switch (type) {
+        case INTEGER:
+        case FRACTION: {
+            // Integers are hashed as doubles, so they match the fractions they are equal to
+            double value = type == INTEGER ? data.number : data.fraction;
+            value = value == 0 ? 0 : value;
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return Utils::mix(bits ^ 0x1f83d9abfb41bd6bull);
+        }
+        case BOOLEAN:
+            return Utils::mix(data.boolean ? 0x5be0cd19137e2179ull : 0x9b05688c2b3e6c1full);
+        case STRING:
+            return Utils::mix(Utils::hash(data.string->data(), data.string->size()) ^ 0x510e527fade682d1ull);
+        case OBJECT:
+            return data.object->hash(cacheable);
+        case ARRAY:
+            return hash(*data.array, cacheable);
+        case JSON_NULL:
+            return Utils::mix(0x3c6ef372fe94f82bull);
+        default:
+            return Utils::mix(0xa54ff53a5f1d36f1ull);
+    }
+}
+
+uint64_t Element::hash(const Array &array) {
+    bool cacheable = true;
+    return hash(array, cacheable);
+}
+
+uint64_t Element::hash(const Array &array, bool &cacheable) {
+    uint64_t result = Utils::mix(array.size() ^ 0x6a09e667f3bcc908ull);
+    for (const Element &element: array) {
+        result = Utils::mix(result + element.hash(cacheable));
+    }
+    return result;
+}
+
+int *Element::tryGetInt() {
+    if (type != INTEGER) {
+        return nullptr;
+    }
+    expose();
+    return &data.number;
+}
+
+const int *Element::tryGetInt() const {
+    return type == INTEGER ? &data.number : nullptr;
+}
+
+bool *Element::tryGetBool() {
+    if (type != BOOLEAN) {
+        return nullptr;
+    }
+    expose();
+    return &data.boolean;
+}
+
+const bool *Element::tryGetBool() const {
+    return type == BOOLEAN ? &data.boolean : nullptr;
+}
+
+double *Element::tryGetDouble() {
+    if (type != FRACTION) {
+        return nullptr;
+    }
+    expose();
+    return &data.fraction;
+}
+
+const double *Element::tryGetDouble() const {
+    return type == FRACTION ? &data.fraction : nullptr;
+}
+
+std::string *Element::tryGetString() {
+    if (type != STRING) {
+        return nullptr;
+    }
+    expose();
+    return data.string;
+}
+
+const std::string *Element::tryGetString() const {
+    return type == STRING ? data.string : nullptr;
+}
+
+Object *Element::tryGetObject() {
+    return type == OBJECT ? data.object : nullptr;
+}
+
+const Object *Element::tryGetObject() const {
+    return type == OBJECT ? data.object : nullptr;
+}
+
+Array *Element::tryGetArray() {
+    if (type != ARRAY) {
+        return nullptr;
+    }
+    expose();
+    return data.array;
+}
+
+const Array *Element::tryGetArray() const {
+    return type == ARRAY ? data.array : nullptr;
+}
+
+int Element::getOr(int defaultValue) const {
+    return type == INTEGER ? data.number : defaultValue;
+}
+
+bool Element::getOr(bool defaultValue) const {
+    return type == BOOLEAN ? data.boolean : defaultValue;
+}
+
+double Element::getOr(double defaultValue) const {
+    return type == FRACTION ? data.fraction : defaultValue;
+}
+
+std::string Element::getOr(const std::string &defaultValue) const {
+    return type == STRING ? *data.string : defaultValue;
+}
+
+const char *Element::getOr(const char *defaultValue) const {
+    return type == STRING ? data.string->c_str() : defaultValue;
+}
+
+#if __cplusplus >= 201703L
+
+std::string_view Element::getOr(std::string_view defaultValue) const {
+    return type == STRING ? std::string_view(*data.string) : defaultValue;
+}
+
+#endif
+
 Type Element::getType() const {
     return type;
 }
 
+MemoryResource *Element::getResource() const {
+    return resource;
+}
+
+bool Element::sharesResource(MemoryResource *other) const {
+    return resource == other or resource->is_equal(*other);
+}
+
 void Element::checkType(Type castType) const {
     if (type != castType) {
-        throw TypeException(type, castType);
+        JSONMAX_THROW(TypeException(type, castType));
     }
 }
 
-Element::Element(const std::string &string) {
+Element::Element(const std::string &string) : resource(defaultResource()) {
     setString(string);
 }
 
-Element::Element(const char *c_string) {
+Element::Element(const char *c_string) : resource(defaultResource()) {
     setString(c_string);
 }
 
-Element::Element(int num) {
+Element::Element(int num) : resource(defaultResource()) {
     setNumber(num);
 }
 
-Element::Element(double fract) {
+Element::Element(double fract) : resource(defaultResource()) {
     setFraction(fract);
 }
 
-Element::Element(bool boolean) {
+Element::Element(bool boolean) : resource(defaultResource()) {
     setBoolean(boolean);
 }
 
-Element::Element(const Object &obj) {
+Element::Element(const Object &obj) : resource(defaultResource()) {
     setObject(obj);
 }
 
-Element::Element(const std::vector<Element> &arr) {
+Element::Element(Object &&obj) : resource(obj.getResource()) {
+    setObject(std::move(obj));
+}
+
+Element::Element(const Array &arr) : resource(defaultResource()) {
     setArray(arr);
 }
 
+Element::Element(Array &&arr) : resource(arr.get_allocator().resource()) {
+    setArray(std::move(arr));
+}
+
 Element &Element::operator=(std::nullptr_t pointer) {
     reset();
     if (pointer == nullptr) {
@@ -198,13 +538,9 @@ Element &Element::operator=(std::nullptr_t pointer) {
     return *this;
 }
 
-Element::Element(std::nullptr_t pointer) {
-    if (pointer == nullptr) {
-        type = JSON_NULL;
-    }
-}
+Element::Element(std::nullptr_t) : type(JSON_NULL), resource(defaultResource()) {}
 
-Element::Element(const std::initializer_list<Element> &arr) {
+Element::Element(const std::initializer_list<Element> &arr) : resource(defaultResource()) {
     setArray(arr);
 }
 
@@ -215,16 +551,13 @@ Element &Element::operator=(const std::initializer_list<Element> &arr) {
 }
 
 void Element::reset() {
+    change();
     switch (type) {
-        case INTEGER: delete data.number;
-            break;
-        case FRACTION: delete data.fraction;
+        case OBJECT: Memory::destroy(resource, data.object);
             break;
-        case OBJECT: delete data.object;
+        case STRING: Memory::destroy(resource, data.string);
             break;
-        case STRING: delete data.string;
-            break;
-        case ARRAY: delete data.array;
+        case ARRAY: Memory::destroy(resource, data.array);
             break;
         default:
             break;
@@ -238,52 +571,70 @@ Element::~Element() {
 
 
 void Element::copy(const JsonMax::Element &obj) {
-    type = obj.type;
-    switch (type) {
-        case INTEGER: data.number = new int(*obj.data.number);
+    switch (obj.type) {
+        case INTEGER: setNumber(obj.data.number);
             break;
-        case FRACTION: data.fraction = new double(*obj.data.fraction);
+        case FRACTION: setFraction(obj.data.fraction);
             break;
-        case STRING: data.string = new std::string(*obj.data.string);
+        case STRING: setString(*obj.data.string);
             break;
-        case OBJECT: data.object = new Object(*obj.data.object);
+        case OBJECT: setObject(*obj.data.object);
             break;
-        case ARRAY: data.array = new Array(*obj.data.array);
+        case ARRAY: setArray(*obj.data.array);
             break;
-        case BOOLEAN: data.boolean = obj.data.boolean;
+        case BOOLEAN: setBoolean(obj.data.boolean);
             break;
-        default:
+        default: type = obj.type;
             break;
     }
 }
 
 void Element::move(JsonMax::Element &&obj) {
+    // The value leaves its place, the objects that cached it have to know
+    obj.change();
+    obj.detach();
     type = obj.type;
-    switch (type) {
-        case INTEGER: data.number = obj.data.number;
-            obj.data.number = nullptr;
-            break;
-        case FRACTION: data.fraction = obj.data.fraction;
-            obj.data.fraction = nullptr;
-            break;
-        case STRING: data.string = obj.data.string;
-            obj.data.string = nullptr;
-            break;
-        case OBJECT: data.object = obj.data.object;
-            obj.data.object = nullptr;
-            break;
-        case ARRAY: data.array = obj.data.array;
-            obj.data.array = nullptr;
-            break;
-        case BOOLEAN: data.boolean = obj.data.boolean;
-            break;
-        default:
-            break;
+    data = obj.data;
+    resource = obj.resource;
+    // References into the value move along with it
+    exposed = exposed or obj.exposed;
+    obj.type = UNINITIALIZED;
+}
+
+void Element::change() {
+    if (cached.load(std::memory_order_relaxed)) {
+        cached.store(false, std::memory_order_relaxed);
+        Object::epoch.fetch_add(1, std::memory_order_relaxed);
     }
 }
 
+void Element::expose() {
+    change();
+    if (type == ARRAY) {
+        // The array can leave through the reference, its objects must not point to the enclosing object anymore
+        detach();
+    }
+    exposed = true;
+}
+
+
+void Element::detach() {
+    if (type == OBJECT) {
+        data.object->detach();
+    } else if (type == ARRAY and linked.load(std::memory_order_relaxed)) {
+        linked.store(false, std::memory_order_relaxed);
+        for (Element &element: *data.array) {
+            element.detach();
+        }
+    }
+}
+
+Element::Element(const JsonMax::Element &obj) : type(UNINITIALIZED), resource(defaultResource()) {
+    copy(obj);
+}
 
-Element::Element(const JsonMax::Element &obj) {
+Element::Element(const JsonMax::Element &obj, MemoryResource *memoryResource)
+        : type(UNINITIALIZED), resource(memoryResource) {
     copy(obj);
 }
 
@@ -294,7 +645,17 @@ Element::Element(JsonMax::Element &&obj) noexcept {
 Element& Element::operator=(JsonMax::Element &&obj) noexcept {
     if (this != &obj) {
         reset();
-        move(std::move(obj));
+        if (sharesResource(obj.resource)) {
+            move(std::move(obj));
+            return *this;
+        }
+        // Containers rely on this not throwing, so a copy that runs out of memory takes over the value instead
+        JSONMAX_TRY {
+            copy(obj);
+        } JSONMAX_CATCH_ALL {
+            reset();
+            move(std::move(obj));
+        }
     }
     return *this;
 }
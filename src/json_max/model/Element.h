@@ -7,16 +7,25 @@
 
 #include <string>
 #include <vector>
+#include <ostream>
+#include <cstdio>
+#include <atomic>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 #include "Type.h"
+#include "Memory.h"
+#include "../writer/WriteOptions.h"
 
 namespace JsonMax {
 
     /// Forward declarations
     class Object;
     class Element;
+    class Path;
 
-    /// Name alias for a Json Array
-    using Array = std::vector<Element>;
+    /// Name alias for a Json Array, its elements come from the memory resource of the array
+    using Array = std::vector<Element, Allocator<Element>>;
 
     /**
      * Representation of an Element in a JSON Object
@@ -27,10 +36,25 @@ namespace JsonMax {
         /// Default constructor, sets type to uninitialized
         Element();
 
-        /// Copy constructor
+        /**
+         * Constructor, sets type to uninitialized
+         * Every value assigned afterwards is allocated from the given resource
+         */
+        explicit Element(MemoryResource *resource);
+
+        /**
+         * Copy constructor
+         * Deep copies the element into the default resource
+         */
         Element(const Element&);
 
-        /// Move constructor
+        /// Deep copies the element into the given resource
+        Element(const Element&, MemoryResource *resource);
+
+        /**
+         * Move constructor
+         * The element keeps using the memory resource of the temp element
+         */
         Element(Element&&) noexcept;
 
         /// Constructor for string
@@ -51,9 +75,15 @@ namespace JsonMax {
         /// Constructor for a JSON Object
         Element(const Object &obj);
 
+        /// Constructor for a JSON Object, takes over the memory resource of the object
+        Element(Object &&obj);
+
         /// Constructor for a JSON Array
         Element(const Array &arr);
 
+        /// Constructor for a JSON Array, takes over the memory resource of the array
+        Element(Array &&arr);
+
         /// Constructor for a JSON Array (initializer list)
         Element(const std::initializer_list<Element> &arr);
 
@@ -63,10 +93,14 @@ namespace JsonMax {
         /// Destructor, cleans up resources
         ~Element();
 
-        /// Copy assignment
+        /// Copy assignment, keeps using the current memory resource
         Element& operator=(const Element&);
 
-        /// Move assignment
+        /**
+         * Move assignment, keeps using the current memory resource
+         * Steals the value when both elements share a resource, copies it otherwise.
+         * Never throws: if the copy fails, the value is stolen together with its resource.
+         */
         Element& operator=(Element&&) noexcept;
 
         /// String assignment
@@ -87,27 +121,105 @@ namespace JsonMax {
         /// JSON Object assignment
         Element &operator=(const Object &obj);
 
+        /// JSON Object assignment, moves the storage of the temp object if it shares the memory resource
+        Element &operator=(Object &&obj);
+
         /// JSON Array assignment
         Element &operator=(const Array &arr);
 
+        /// JSON Array assignment, moves the elements of the temp array if it shares the memory resource
+        Element &operator=(Array &&arr);
+
         /// JSON Array (initializer list) assignment
         Element &operator=(const std::initializer_list<Element> &arr);
 
         /// JSON null assignment
         Element &operator=(std::nullptr_t pointer);
 
+        /**
+         * Deep equality, objects ignore the order of their keys and numbers compare by value (1 equals 1.0)
+         * Nested objects with different cached hashes are rejected without comparing them
+         */
+        bool operator==(const Element &other) const;
+
+        bool operator!=(const Element &other) const;
+
+        /// Hash of the value, consistent with operator==, nested objects cache theirs (see Object::hash)
+        uint64_t hash() const;
+
+        /// Hash of the elements of an array, in order (arrays compare with the operator== of std::vector)
+        static uint64_t hash(const Array &array);
+
         /// Getter for the current type
         Type getType() const;
 
+        /// Getter for the memory resource used for strings, objects and arrays
+        MemoryResource *getResource() const;
+
         /// Returns the operator[] of the Object, throws exception if not an Object
         Element &operator[](const std::string&);
 
+        /// Returns the operator[] of the Object, throws exception if not an Object
+        Element &operator[](const char*);
+
+        /// Returns the find of the Object, nullptr if not an Object or if the key is not present
+        Element *find(const std::string&);
+
+        /// Same as above, const version
+        const Element *find(const std::string&) const;
+
+        /// Returns the find of the Object, nullptr if not an Object or if the key is not present
+        Element *find(const char*);
+
+        /// Same as above, const version
+        const Element *find(const char*) const;
+
+        /// Resolves the compiled JSON Pointer, nullptr if it does not exist (include Path.h)
+        Element *find(const Path&);
+
+        /// Same as above, const version
+        const Element *find(const Path&) const;
+
+        /// Resolves the compiled JSON Pointer, throws a PathException if it does not exist
+        Element &at(const Path&);
+
+        /// Same as above, const version
+        const Element &at(const Path&) const;
+
+#if __cplusplus >= 201703L
+
+        /// Returns the operator[] of the Object, throws exception if not an Object (C++17 only)
+        Element &operator[](std::string_view);
+
+        /// Returns the find of the Object, nullptr if not an Object or if the key is not present (C++17 only)
+        Element *find(std::string_view);
+
+        /// Same as above, const version
+        const Element *find(std::string_view) const;
+
+#endif
+
         /**
          * @param indent the wanted indentation (in spaces)
          * @return string representation of the object
          */
         std::string toString(unsigned int indent = 0) const;
 
+        /// @return json with the given layout, see Writer
+        std::string toString(const WriteOptions &options) const;
+
+        /// @return exact amount of characters of the json with the given layout, without writing it
+        size_t serializedSize(const WriteOptions &options = WriteOptions()) const;
+
+        /// Writes the json to the stream through a fixed size buffer, the document is never held in memory as a whole
+        void write(std::ostream &stream, const WriteOptions &options = WriteOptions()) const;
+
+        /// Same as above, writes to a C file, throws a WriteException if writing fails
+        void write(std::FILE *file, const WriteOptions &options = WriteOptions()) const;
+
+        /// Same as above, creates or overwrites the file with the given name
+        void writeFile(const std::string &fileName, const WriteOptions &options = WriteOptions()) const;
+
         /// Int getter, throws type exception if wrong type
         int getInt() const;
 
@@ -117,14 +229,92 @@ namespace JsonMax {
         /// Double getter, throws type exception if wrong type
         double getDouble() const;
 
-        /// String getter, throws type exception if wrong type
-        std::string& getString() const;
+        /**
+         * String getter, throws type exception if wrong type
+         * The string can be changed through the reference, so it is hashed and written again every time afterwards
+         */
+        std::string& getString();
+
+        /// Same as above, const version
+        const std::string& getString() const;
 
         /// Object getter, throws type exception if wrong type
         Object& getObject() const;
 
-        /// Array getter, throws type exception if wrong type
-        Array& getArray() const;
+        /**
+         * Array getter, throws type exception if wrong type
+         * The array can be changed through the reference, so it is hashed and written again every time afterwards
+         */
+        Array& getArray();
+
+        /// Same as above, const version
+        const Array& getArray() const;
+
+        /// Int getter, nullptr if wrong type
+        int *tryGetInt();
+
+        /// Same as above, const version
+        const int *tryGetInt() const;
+
+        /// Boolean getter, nullptr if wrong type
+        bool *tryGetBool();
+
+        /// Same as above, const version
+        const bool *tryGetBool() const;
+
+        /// Double getter, nullptr if wrong type
+        double *tryGetDouble();
+
+        /// Same as above, const version
+        const double *tryGetDouble() const;
+
+        /// String getter, nullptr if wrong type
+        std::string *tryGetString();
+
+        /// Same as above, const version
+        const std::string *tryGetString() const;
+
+        /// Object getter, nullptr if wrong type
+        Object *tryGetObject();
+
+        /// Same as above, const version
+        const Object *tryGetObject() const;
+
+        /// Array getter, nullptr if wrong type
+        Array *tryGetArray();
+
+        /// Same as above, const version
+        const Array *tryGetArray() const;
+
+        /// @return the int, or the given default if wrong type
+        int getOr(int defaultValue) const;
+
+        /// @return the boolean, or the given default if wrong type
+        bool getOr(bool defaultValue) const;
+
+        /// @return the double, or the given default if wrong type (integers are not converted)
+        double getOr(double defaultValue) const;
+
+        /// @return a copy of the string, or the given default if wrong type
+        std::string getOr(const std::string &defaultValue) const;
+
+        /// @return the characters of the string, or the given default if wrong type, without copying
+        const char *getOr(const char *defaultValue) const;
+
+#if __cplusplus >= 201703L
+
+        /// @return a view on the string, or the given default if wrong type, without copying (C++17 only)
+        std::string_view getOr(std::string_view defaultValue) const;
+
+#endif
+
+        /**
+         * Calls the visitor once with the value of the element, dispatched on its type
+         * The visitor is called with an int, bool, double, const std::string&, const Object& or const Array&,
+         * and with nullptr for null (and uninitialized) elements. All calls must return the same type.
+         */
+        template <typename Visitor>
+        auto visit(Visitor &&visitor) const -> decltype(visitor(nullptr));
         
         /// Check if type is int
         bool isInt() const;
@@ -149,15 +339,43 @@ namespace JsonMax {
 
     private:
 
-        /// Moves the given temp object to this
+        friend class Object;
+
+        friend class Writer;
+
+        friend class ArrayParser;
+
+        /// Moves the given temp object to this, including its memory resource
         void move(Element&&);
 
-        /// Deep copies the given object to this
+        /**
+         * Called before the value changes
+         * If the element is a pair of an object with a filled cache, that object can't know about the change,
+         * so every cache filled so far is dropped, see Object::epoch
+         */
+        void change();
+
+        /// Called before a reference into the value is handed out, which can change it without the element knowing
+        void expose();
+
+        /// Hash of the value, cacheable is set to false if it includes exposed values
+        uint64_t hash(bool &cacheable) const;
+
+        /// Hash of the elements of an array, cacheable is set to false if it includes exposed values
+        static uint64_t hash(const Array &array, bool &cacheable);
+
+        /// Unlinks the objects held by this element from the objects whose caches include them, see Object::hash
+        void detach();
+
+        /// Deep copies the given object to this, using the current memory resource
         void copy(const Element&);
 
         /// Cleans up resources
         void reset();
 
+        /// @return true if memory of the given resource can be used by this element
+        bool sharesResource(MemoryResource* other) const;
+
         /// Throws a TypeException if the given type is not equal to the current one
         void checkType(Type castType) const;
 
@@ -173,17 +391,29 @@ namespace JsonMax {
         /// Makes the element an object
         void setObject(const Object& object);
 
+        /// Makes the element an object by moving the given one, copies it if it uses another resource
+        void setObject(Object&& object);
+
         /// Makes the element a string
         void setString(const std::string& string);
 
         /// Makes the element an array
         void setArray(const Array& array);
 
-        /// Union with pointers to the different kinds of types
+        /// Makes the element an array by moving the given one, copies it if it uses another resource
+        void setArray(Array&& array);
+
+        /// Makes the element an array from an initializer list
+        void setArray(const std::initializer_list<Element>& list);
+
+        /**
+         * Union with the different kinds of types
+         * Numbers and booleans are stored inline, the others point into the memory resource
+         */
         union Data {
-            int* number;
+            int number;
             bool boolean;
-            double* fraction;
+            double fraction;
             Object* object;
             std::string* string;
             Array* array;
@@ -195,8 +425,43 @@ namespace JsonMax {
         /// Element type
         Type type;
 
+        /// True while the element is a pair of an object with a filled cache, the flags fit in the padding
+        mutable std::atomic<bool> cached{false};
+
+        /// True if the element is an array whose objects may be linked to an enclosing object
+        mutable std::atomic<bool> linked{false};
+
+        /**
+         * True once a reference into the value was handed out (getString, getArray, tryGetInt, ...)
+         * The value can then change at any time, so it is hashed and written again instead of cached
+         */
+        bool exposed = false;
+
+        /// Memory resource for strings, objects and arrays
+        MemoryResource* resource;
+
     };
 
+    template <typename Visitor>
+    auto Element::visit(Visitor &&visitor) const -> decltype(visitor(nullptr)) {
+        switch (type) {
+            case INTEGER:
+                return visitor(data.number);
+            case BOOLEAN:
+                return visitor(data.boolean);
+            case FRACTION:
+                return visitor(data.fraction);
+            case STRING:
+                return visitor(static_cast<const std::string &>(*data.string));
+            case OBJECT:
+                return visitor(static_cast<const Object &>(*data.object));
+            case ARRAY:
+                return visitor(static_cast<const Array &>(*data.array));
+            default:
+                return visitor(nullptr);
+        }
+    }
+
 }
 
 #endif //JSONMAX_JSONELEMENT_H
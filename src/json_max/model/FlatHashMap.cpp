@@ -0,0 +1,329 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "FlatHashMap.h"
+#include "Utils.h"
+#include "Config.h"
+
+#include <tuple>
+#include <cstring>
+
+using namespace JsonMax;
+
+namespace {
+
+#ifdef JSONMAX_SSE2
+
+    /// Amount of control bytes that are compared at once
+    const size_t groupWidth = 16;
+
+    /// Group of control bytes, compared with SSE2
+    class Group {
+    public:
+
+        explicit Group(const int8_t *position)
+                : control(_mm_load_si128(reinterpret_cast<const __m128i *>(position))) {}
+
+        /// @return bit set of the slots with the given control byte
+        uint32_t match(int8_t byte) const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), control)));
+        }
+
+        /// @return bit set of the empty and deleted slots, both have the sign bit set
+        uint32_t matchFree() const {
+            return static_cast<uint32_t>(_mm_movemask_epi8(control));
+        }
+
+    private:
+
+        __m128i control;
+
+    };
+
+#else
+
+    /// Amount of control bytes that are compared at once
+    const size_t groupWidth = 8;
+
+    /// Group of control bytes, compared one by one (compilers vectorize this where they can)
+    class Group {
+    public:
+
+        explicit Group(const int8_t *position) {
+            std::memcpy(control, position, groupWidth);
+        }
+
+        /// @return bit set of the slots with the given control byte
+        uint32_t match(int8_t byte) const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < groupWidth; i++) {
+                mask |= static_cast<uint32_t>(control[i] == byte) << i;
+            }
+            return mask;
+        }
+
+        /// @return bit set of the empty and deleted slots, both are negative
+        uint32_t matchFree() const {
+            uint32_t mask = 0;
+            for (size_t i = 0; i < groupWidth; i++) {
+                mask |= static_cast<uint32_t>(control[i] < 0) << i;
+            }
+            return mask;
+        }
+
+    private:
+
+        int8_t control[groupWidth];
+
+    };
+
+#endif
+
+    /// The lowest 7 bits of the hash are stored in the control byte
+    inline int8_t controlHash(uint64_t hash) {
+        return static_cast<int8_t>(hash & 0x7f);
+    }
+
+    /// The other bits pick the first group to probe
+    inline size_t groupHash(uint64_t hash) {
+        return static_cast<size_t>(hash >> 7);
+    }
+
+    /// Alignment of a table, groups are loaded with aligned loads
+    inline size_t tableAlignment() {
+        return alignof(FlatHashMap::Entry) > groupWidth ? alignof(FlatHashMap::Entry) : groupWidth;
+    }
+
+}
+
+FlatHashMap::Iterator::Iterator(const int8_t *_control, Entry *_slot, const int8_t *_end)
+        : control(_control), slot(_slot), end(_end) {
+    skipEmpty();
+}
+
+FlatHashMap::Entry &FlatHashMap::Iterator::operator*() const {
+    return *slot;
+}
+
+FlatHashMap::Entry *FlatHashMap::Iterator::operator->() const {
+    return slot;
+}
+
+FlatHashMap::Iterator &FlatHashMap::Iterator::operator++() {
+    ++control;
+    ++slot;
+    skipEmpty();
+    return *this;
+}
+
+bool FlatHashMap::Iterator::operator==(const Iterator &other) const {
+    return control == other.control;
+}
+
+bool FlatHashMap::Iterator::operator!=(const Iterator &other) const {
+    return control != other.control;
+}
+
+void FlatHashMap::Iterator::skipEmpty() {
+    while (control != end and *control < 0) {
+        ++control;
+        ++slot;
+    }
+}
+
+FlatHashMap::FlatHashMap(MemoryResource *_resource)
+        : control(nullptr), slots(nullptr), capacity(0), count(0), growthLeft(0), resource(_resource) {}
+
+FlatHashMap::FlatHashMap(const FlatHashMap &other, MemoryResource *_resource) : FlatHashMap(_resource) {
+    if (other.count == 0) {
+        return;
+    }
+    rehash(other.capacity);
+    JSONMAX_TRY {
+        for (const Entry &entry: other) {
+            uint64_t hash = Utils::hash(entry.first.data(), entry.first.size());
+            size_t slot = findFreeSlot(hash);
+            new(slots + slot) Entry(std::piecewise_construct, std::forward_as_tuple(entry.first),
+                                    std::forward_as_tuple(entry.second, resource));
+            control[slot] = controlHash(hash);
+            count++;
+            growthLeft--;
+        }
+    } JSONMAX_CATCH_ALL {
+        destroy();
+        JSONMAX_RETHROW;
+    }
+}
+
+FlatHashMap::~FlatHashMap() {
+    destroy();
+}
+
+Element *FlatHashMap::lookup(const char *key, size_t length) const {
+    return lookup(key, length, Utils::hash(key, length));
+}
+
+Element *FlatHashMap::lookup(const char *key, size_t length, uint64_t hash) const {
+    Entry *entry = findSlot(key, length, hash);
+    return entry ? &entry->second : nullptr;
+}
+
+Element &FlatHashMap::insert(std::string key) {
+    if (growthLeft == 0) {
+        if (capacity == 0) {
+            rehash(groupWidth);
+        } else if (count >= capacity * 7 / 16) {
+            rehash(capacity * 2);
+        } else {
+            // Mostly deleted slots, cleaning them up is enough
+            rehash(capacity);
+        }
+    }
+
+    uint64_t hash = Utils::hash(key.data(), key.size());
+    size_t slot = findFreeSlot(hash);
+    new(slots + slot) Entry(std::move(key), Element(resource));
+    if (control[slot] == empty) {
+        growthLeft--;
+    }
+    control[slot] = controlHash(hash);
+    count++;
+    return slots[slot].second;
+}
+
+void FlatHashMap::reserve(size_t pairs) {
+    size_t wanted = groupWidth;
+    while (wanted * 7 / 8 < pairs) {
+        wanted *= 2;
+    }
+    if (wanted > capacity) {
+        rehash(wanted);
+    }
+}
+
+void FlatHashMap::remove(const char *key, size_t length) {
+    Entry *entry = findSlot(key, length, Utils::hash(key, length));
+    if (not entry) {
+        return;
+    }
+    size_t slot = static_cast<size_t>(entry - slots);
+    entry->~Entry();
+    count--;
+
+    // Lookups stop at groups with an empty slot, so such a group was never passed by another probe
+    Group group(control + slot - slot % groupWidth);
+    if (group.match(empty)) {
+        control[slot] = empty;
+        growthLeft++;
+    } else {
+        control[slot] = deleted;
+    }
+}
+
+void FlatHashMap::clear() {
+    for (Entry &entry: *this) {
+        entry.~Entry();
+    }
+    if (capacity) {
+        std::memset(control, empty, capacity);
+    }
+    count = 0;
+    growthLeft = capacity * 7 / 8;
+}
+
+size_t FlatHashMap::size() const {
+    return count;
+}
+
+FlatHashMap::Iterator FlatHashMap::begin() const {
+    return Iterator(control, slots, control + capacity);
+}
+
+FlatHashMap::Iterator FlatHashMap::end() const {
+    return Iterator(control + capacity, slots + capacity, control + capacity);
+}
+
+void FlatHashMap::rehash(size_t wanted) {
+    size_t bytes = controlBytes(wanted) + wanted * sizeof(Entry);
+    auto *table = static_cast<char *>(resource->allocate(bytes, tableAlignment()));
+
+    int8_t *oldControl = control;
+    Entry *oldSlots = slots;
+    size_t oldCapacity = capacity;
+
+    control = reinterpret_cast<int8_t *>(table);
+    slots = reinterpret_cast<Entry *>(table + controlBytes(wanted));
+    capacity = wanted;
+    growthLeft = wanted * 7 / 8 - count;
+    std::memset(control, empty, wanted);
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldControl[i] >= 0) {
+            Entry &entry = oldSlots[i];
+            uint64_t hash = Utils::hash(entry.first.data(), entry.first.size());
+            size_t slot = findFreeSlot(hash);
+            new(slots + slot) Entry(std::move(entry));
+            control[slot] = controlHash(hash);
+            entry.~Entry();
+        }
+    }
+
+    if (oldCapacity) {
+        resource->deallocate(oldControl, controlBytes(oldCapacity) + oldCapacity * sizeof(Entry),
+                             tableAlignment());
+    }
+}
+
+FlatHashMap::Entry *FlatHashMap::findSlot(const char *key, size_t length, uint64_t hash) const {
+    if (capacity == 0) {
+        return nullptr;
+    }
+    size_t groupMask = capacity / groupWidth - 1;
+    size_t group = groupHash(hash) & groupMask;
+    int8_t byte = controlHash(hash);
+
+    // Triangular probing over the groups visits every group once
+    for (size_t step = 1;; step++) {
+        size_t first = group * groupWidth;
+        Group current(control + first);
+        for (uint32_t mask = current.match(byte); mask; mask &= mask - 1) {
+            Entry &entry = slots[first + Utils::lowestBit(mask)];
+            if (entry.first.size() == length and entry.first.compare(0, length, key, length) == 0) {
+                return &entry;
+            }
+        }
+        if (current.match(empty)) {
+            return nullptr;
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+size_t FlatHashMap::findFreeSlot(uint64_t hash) const {
+    size_t groupMask = capacity / groupWidth - 1;
+    size_t group = groupHash(hash) & groupMask;
+    for (size_t step = 1;; step++) {
+        uint32_t mask = Group(control + group * groupWidth).matchFree();
+        if (mask) {
+            return group * groupWidth + Utils::lowestBit(mask);
+        }
+        group = (group + step) & groupMask;
+    }
+}
+
+size_t FlatHashMap::controlBytes(size_t slots) {
+    size_t alignment = alignof(Entry);
+    return (slots + alignment - 1) / alignment * alignment;
+}
+
+void FlatHashMap::destroy() {
+    clear();
+    if (capacity) {
+        resource->deallocate(control, controlBytes(capacity) + capacity * sizeof(Entry), tableAlignment());
+        control = nullptr;
+        slots = nullptr;
+        capacity = 0;
+        growthLeft = 0;
+    }
+}
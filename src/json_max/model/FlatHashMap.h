@@ -0,0 +1,139 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_FLATHASHMAP_H
+#define JSONMAX_FLATHASHMAP_H
+
+#include <string>
+#include <cstdint>
+#include "Element.h"
+#include "Memory.h"
+#include "Config.h"
+
+namespace JsonMax {
+
+    /**
+     * Storage behind FLAT_HASHMAP objects
+     * Open addressing hash table in the style of SwissTable: keys and values are stored inline in one array,
+     * next to an array of control bytes holding 7 bits of the hash of every slot.
+     * Lookups compare a whole group of control bytes at once (16 with SSE2, 8 otherwise) and only touch the
+     * pairs whose control byte matches.
+     */
+    class FlatHashMap {
+    public:
+
+        /// Key/value pair as stored in the table
+        using Entry = std::pair<std::string, Element>;
+
+        /// Forward iterator over the pairs, in no particular order
+        class Iterator {
+        public:
+
+            Iterator(const int8_t *control, Entry *slot, const int8_t *end);
+
+            Entry &operator*() const;
+
+            Entry *operator->() const;
+
+            Iterator &operator++();
+
+            bool operator==(const Iterator &other) const;
+
+            bool operator!=(const Iterator &other) const;
+
+        private:
+
+            /// Skips slots that don't hold a pair
+            void skipEmpty();
+
+            const int8_t *control;
+            Entry *slot;
+            const int8_t *end;
+
+        };
+
+        /// Constructor, the table is allocated from the given resource on the first insert
+        explicit FlatHashMap(MemoryResource *resource);
+
+        /// Deep copies the given table into the given resource
+        FlatHashMap(const FlatHashMap &other, MemoryResource *resource);
+
+        FlatHashMap(const FlatHashMap &) = delete;
+
+        FlatHashMap &operator=(const FlatHashMap &) = delete;
+
+        /// Destructor, cleans up the pairs and the table
+        ~FlatHashMap();
+
+        /// @return the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const char *key, size_t length) const;
+
+        /// Same as above, with the precomputed Utils::hash of the key
+        Element *lookup(const char *key, size_t length, uint64_t hash) const;
+
+        /// Inserts a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
+
+        /// Makes room for at least the given amount of pairs without growing
+        void reserve(size_t pairs);
+
+        /// Removes the pair with the given key
+        void remove(const char *key, size_t length);
+
+        /// Removes all pairs, keeps the table
+        void clear();
+
+        /// @return amount of pairs
+        size_t size() const;
+
+        Iterator begin() const;
+
+        Iterator end() const;
+
+    private:
+
+        /// Control byte of an empty slot
+        static const int8_t empty = -128;
+
+        /// Control byte of a slot whose pair was removed
+        static const int8_t deleted = -2;
+
+        /// Allocates a table with the given amount of slots (a multiple of the group width) and moves all pairs to it
+        void rehash(size_t slots);
+
+        /// @return slot of the pair with the given key and hash, nullptr if not present
+        Entry *findSlot(const char *key, size_t length, uint64_t hash) const;
+
+        /// @return index of a free slot for the given hash
+        size_t findFreeSlot(uint64_t hash) const;
+
+        /// Size in bytes of the control bytes of a table with the given amount of slots
+        static size_t controlBytes(size_t slots);
+
+        /// Destroys all pairs and releases the table
+        void destroy();
+
+        /// Control bytes, one per slot
+        int8_t *control;
+
+        /// The pairs, only those with a non negative control byte are constructed
+        Entry *slots;
+
+        /// Amount of slots, zero or a multiple of the group width
+        size_t capacity;
+
+        /// Amount of pairs
+        size_t count;
+
+        /// Amount of pairs that can be added before the table has to grow, deleted slots count as used
+        size_t growthLeft;
+
+        /// Memory resource for the table
+        MemoryResource *resource;
+
+    };
+
+}
+
+#endif //JSONMAX_FLATHASHMAP_H
@@ -0,0 +1,292 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "FrozenObject.h"
+#include "ObjectIterator.h"
+#include "Utils.h"
+#include "Config.h"
+#include "../writer/Writer.h"
+
+#include <vector>
+#include <tuple>
+#include <algorithm>
+
+using namespace JsonMax;
+
+namespace {
+
+    /// Maximum displacement tried for a bucket, before starting over with another seed
+    const int32_t maxDisplacement = 1 << 20;
+
+    /// Maximum amount of seeds tried, before the pairs are kept in their order and scanned
+    const uint64_t maxSeeds = 64;
+
+    /// Hash of the key for the given seed, every seed hashes the keys independently of the others
+    inline uint64_t frozenHash(const char *key, size_t length, uint64_t seed) {
+        if (seed == 0) {
+            return Utils::hash(key, length);
+        }
+        const Utils::HashKey &secret = Utils::hashKey();
+        return Utils::hash(key, length, Utils::HashKey(secret.first ^ seed, secret.second));
+    }
+
+    /// @return true if two keys have the same hash, no displacement can tell them apart
+    bool sameHashes(std::vector<uint64_t> hashes) {
+        std::sort(hashes.begin(), hashes.end());
+        return std::adjacent_find(hashes.begin(), hashes.end()) != hashes.end();
+    }
+
+    /// Finalizer of splitmix64, spreads the bits of the given value
+    inline uint64_t mixHash(uint64_t value) {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ull;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebull;
+        value ^= value >> 31;
+        return value;
+    }
+
+    /// Bucket of the key with the given hash
+    inline uint32_t frozenBucket(uint64_t hash, uint64_t seed, uint32_t count) {
+        return static_cast<uint32_t>(mixHash(hash ^ seed) % count);
+    }
+
+    /// Slot of the key with the given hash, in a bucket with the given (positive) displacement
+    inline uint32_t frozenSlot(uint64_t hash, int32_t displacement, uint32_t count) {
+        return static_cast<uint32_t>(mixHash(hash + static_cast<uint64_t>(displacement) * 0x9e3779b97f4a7c15ull) % count);
+    }
+
+    /**
+     * Hash and displace: distributes the keys over as many buckets as there are keys,
+     * then finds a displacement for every bucket that moves all its keys to free slots, largest buckets first.
+     * Buckets with a single key simply take a free slot.
+     * @return false if some bucket has no displacement, another seed has to be tried
+     */
+    bool placeKeys(const std::vector<uint64_t> &hashes, uint64_t seed,
+                   std::vector<int32_t> &displacements, std::vector<uint32_t> &slots) {
+        auto count = static_cast<uint32_t>(hashes.size());
+
+        // Sort the keys on their bucket
+        std::vector<uint32_t> bucketStart(count + 1, 0);
+        for (uint64_t hash: hashes) {
+            bucketStart[frozenBucket(hash, seed, count) + 1]++;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            bucketStart[i + 1] += bucketStart[i];
+        }
+        std::vector<uint32_t> keys(count);
+        std::vector<uint32_t> cursor(bucketStart.begin(), bucketStart.end() - 1);
+        for (uint32_t i = 0; i < count; i++) {
+            keys[cursor[frozenBucket(hashes[i], seed, count)]++] = i;
+        }
+
+        std::vector<uint32_t> order(count);
+        for (uint32_t i = 0; i < count; i++) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&bucketStart](uint32_t first, uint32_t second) {
+            return bucketStart[first + 1] - bucketStart[first] > bucketStart[second + 1] - bucketStart[second];
+        });
+
+        std::vector<bool> taken(count, false);
+        std::vector<uint32_t> candidates;
+        uint32_t free = 0;
+        for (uint32_t bucket: order) {
+            uint32_t first = bucketStart[bucket];
+            uint32_t size = bucketStart[bucket + 1] - first;
+
+            if (size == 0) {
+                displacements[bucket] = 0;
+            } else if (size == 1) {
+                while (taken[free]) {
+                    free++;
+                }
+                taken[free] = true;
+                slots[keys[first]] = free;
+                displacements[bucket] = -static_cast<int32_t>(free) - 1;
+            } else {
+                int32_t displacement = 1;
+                for (;; displacement++) {
+                    if (displacement > maxDisplacement) {
+                        return false;
+                    }
+                    candidates.clear();
+                    for (uint32_t i = first; i < first + size; i++) {
+                        uint32_t slot = frozenSlot(hashes[keys[i]], displacement, count);
+                        if (taken[slot] or std::find(candidates.begin(), candidates.end(), slot) != candidates.end()) {
+                            break;
+                        }
+                        candidates.push_back(slot);
+                    }
+                    if (candidates.size() == size) {
+                        break;
+                    }
+                }
+                for (uint32_t i = 0; i < size; i++) {
+                    taken[candidates[i]] = true;
+                    slots[keys[first + i]] = candidates[i];
+                }
+                displacements[bucket] = displacement;
+            }
+        }
+        return true;
+    }
+
+}
+
+FrozenObject::FrozenObject(const Object &object, MemoryResource *_resource)
+        : entries(nullptr), displacements(nullptr), count(0), seed(0), resource(_resource) {
+    std::vector<const std::string *> keys;
+    std::vector<const Element *> values;
+    for (const auto &member: object) {
+        keys.push_back(&member.getKey());
+        values.push_back(&member.getValue());
+    }
+    if (keys.empty()) {
+        return;
+    }
+
+    // Every seed hashes the keys again, so keys with the same hash for one seed are apart for the next
+    auto total = static_cast<uint32_t>(keys.size());
+    std::vector<uint64_t> hashes(total);
+    std::vector<int32_t> placedDisplacements(total);
+    std::vector<uint32_t> slots(total);
+    bool placed = false;
+    while (not placed and seed < maxSeeds) {
+        for (uint32_t i = 0; i < total; i++) {
+            hashes[i] = frozenHash(keys[i]->data(), keys[i]->size(), seed);
+        }
+        placed = not sameHashes(hashes) and placeKeys(hashes, seed, placedDisplacements, slots);
+        if (not placed) {
+            seed++;
+        }
+    }
+
+    std::vector<uint32_t> keyAt(total);
+    for (uint32_t i = 0; i < total; i++) {
+        keyAt[placed ? slots[i] : i] = i;
+    }
+
+    if (placed) {
+        displacements = static_cast<int32_t *>(resource->allocate(total * sizeof(int32_t), alignof(int32_t)));
+        std::copy(placedDisplacements.begin(), placedDisplacements.end(), displacements);
+    }
+    entries = static_cast<Entry *>(resource->allocate(total * sizeof(Entry), alignof(Entry)));
+    JSONMAX_TRY {
+        for (; count < total; count++) {
+            new(entries + count) Entry(std::piecewise_construct, std::forward_as_tuple(*keys[keyAt[count]]),
+                                       std::forward_as_tuple(*values[keyAt[count]], resource));
+        }
+    } JSONMAX_CATCH_ALL {
+        for (uint32_t i = 0; i < count; i++) {
+            entries[i].~Entry();
+        }
+        resource->deallocate(entries, total * sizeof(Entry), alignof(Entry));
+        if (displacements) {
+            resource->deallocate(displacements, total * sizeof(int32_t), alignof(int32_t));
+        }
+        JSONMAX_RETHROW;
+    }
+}
+
+FrozenObject::FrozenObject(FrozenObject &&other) noexcept
+        : entries(other.entries), displacements(other.displacements), count(other.count), seed(other.seed),
+          resource(other.resource) {
+    other.entries = nullptr;
+    other.displacements = nullptr;
+    other.count = 0;
+}
+
+FrozenObject::~FrozenObject() {
+    if (count == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i].~Entry();
+    }
+    resource->deallocate(entries, count * sizeof(Entry), alignof(Entry));
+    if (displacements) {
+        resource->deallocate(displacements, count * sizeof(int32_t), alignof(int32_t));
+    }
+}
+
+const Element *FrozenObject::find(const std::string &key) const {
+    return lookup(key.data(), key.size());
+}
+
+const Element *FrozenObject::find(const char *key) const {
+    return lookup(key, std::char_traits<char>::length(key));
+}
+
+#if __cplusplus >= 201703L
+
+const Element *FrozenObject::find(std::string_view key) const {
+    return lookup(key.data(), key.size());
+}
+
+#endif
+
+bool FrozenObject::exists(const std::string &key) const {
+    return find(key) != nullptr;
+}
+
+size_t FrozenObject::size() const {
+    return count;
+}
+
+bool FrozenObject::empty() const {
+    return count == 0;
+}
+
+const FrozenObject::Entry *FrozenObject::begin() const {
+    return entries;
+}
+
+const FrozenObject::Entry *FrozenObject::end() const {
+    return entries + count;
+}
+
+std::string FrozenObject::toString(unsigned int ind) const {
+    return toString(WriteOptions(false, ind));
+}
+
+std::string FrozenObject::toString(const WriteOptions &options) const {
+    StringOutput output;
+    if (options.exactSize) {
+        output.getString().reserve(Writer::serializedSize(*this, options));
+    }
+    Writer(output, options).write(*this);
+    return std::move(output.getString());
+}
+
+MemoryResource *FrozenObject::getResource() const {
+    return resource;
+}
+
+const Element *FrozenObject::lookup(const char *key, size_t length) const {
+    if (count == 0) {
+        return nullptr;
+    }
+    if (not displacements) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (entries[i].first.size() == length and entries[i].first.compare(0, length, key, length) == 0) {
+                return &entries[i].second;
+            }
+        }
+        return nullptr;
+    }
+    const Entry &entry = entries[slot(frozenHash(key, length, seed))];
+    if (entry.first.size() == length and entry.first.compare(0, length, key, length) == 0) {
+        return &entry.second;
+    }
+    return nullptr;
+}
+
+uint32_t FrozenObject::slot(uint64_t hash) const {
+    int32_t displacement = displacements[frozenBucket(hash, seed, count)];
+    if (displacement < 0) {
+        return static_cast<uint32_t>(-(displacement + 1));
+    }
+    return frozenSlot(hash, displacement, count);
+}
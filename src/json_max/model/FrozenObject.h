@@ -0,0 +1,124 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_FROZENOBJECT_H
+#define JSONMAX_FROZENOBJECT_H
+
+#include <string>
+#include <cstdint>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include "Element.h"
+#include "Object.h"
+#include "Memory.h"
+
+namespace JsonMax {
+
+    /**
+     * Read only snapshot of an Object, see Object::freeze
+     * The pairs are stored in one contiguous array, placed by a minimal perfect hash that is built when freezing.
+     * Every lookup is a single probe: one displacement, one slot and one key comparison.
+     * The pairs can't be changed afterwards, so lookups, iteration and writing the frozen object itself can be done
+     * from multiple threads without locking. Writing it never fills the caches of WriteOptions::cacheFragments.
+     * Nested objects are only reachable as const, but still cache their json when written on their own with
+     * cacheFragments, so do that from one thread at a time. Hashing them from multiple threads is safe.
+     */
+    class FrozenObject {
+    public:
+
+        /// Key/value pair as stored in the array
+        using Entry = std::pair<std::string, Element>;
+
+        /**
+         * Constructor
+         * Deep copies all initialized pairs of the object into the given resource
+         * Building the hash takes linear time on average
+         */
+        explicit FrozenObject(const Object &object, MemoryResource *resource = defaultResource());
+
+        /// Move constructor, the temp object is left empty
+        FrozenObject(FrozenObject &&) noexcept;
+
+        FrozenObject(const FrozenObject &) = delete;
+
+        FrozenObject &operator=(const FrozenObject &) = delete;
+
+        FrozenObject &operator=(FrozenObject &&) = delete;
+
+        /// Destructor, cleans up the pairs and the tables
+        ~FrozenObject();
+
+        /// @return pointer to the element with the given key, nullptr if not present
+        const Element *find(const std::string &key) const;
+
+        /// Same as above, but takes a c string
+        const Element *find(const char *key) const;
+
+#if __cplusplus >= 201703L
+
+        /// Same as above, but takes a string view (C++17 only)
+        const Element *find(std::string_view key) const;
+
+#endif
+
+        /// @return true if the pair with the given key exists
+        bool exists(const std::string &key) const;
+
+        /// @return amount of pairs
+        size_t size() const;
+
+        /// @return true if there are no pairs
+        bool empty() const;
+
+        /// Iteration over the pairs, in the order of the hash
+        const Entry *begin() const;
+
+        const Entry *end() const;
+
+        /**
+         * @param indent the wanted indentation (in spaces)
+         * @return string representation of the object
+         */
+        std::string toString(unsigned int indent = 0) const;
+
+        /// @return json with the given layout, see Writer
+        std::string toString(const WriteOptions &options) const;
+
+        /// Getter for the memory resource of the pairs and the tables
+        MemoryResource *getResource() const;
+
+    private:
+
+        /// @return the element with the given characters as key, nullptr if not present
+        const Element *lookup(const char *key, size_t length) const;
+
+        /// Slot of the key with the given hash
+        uint32_t slot(uint64_t hash) const;
+
+        /// Pairs, placed at the slot the hash gives them
+        Entry *entries;
+
+        /**
+         * One displacement per bucket of keys
+         * Positive values are mixed into the hash of the keys of the bucket to get their slot,
+         * negative values directly hold the slot (minus one) of a bucket with a single key
+         * nullptr if no seed placed the keys, the pairs are then kept in their order and scanned
+         */
+        int32_t *displacements;
+
+        /// Amount of pairs, slots and buckets
+        uint32_t count;
+
+        /// Seed for hashing the keys and picking the bucket, changed when no displacements are found
+        uint64_t seed;
+
+        /// Memory resource for the pairs and the tables
+        MemoryResource *resource;
+
+    };
+
+}
+
+#endif //JSONMAX_FROZENOBJECT_H
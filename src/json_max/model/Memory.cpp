@@ -0,0 +1,44 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "Memory.h"
+
+using namespace JsonMax;
+
+#if __cplusplus >= 201703L
+
+MemoryResource *JsonMax::defaultResource() {
+    return std::pmr::get_default_resource();
+}
+
+#else
+
+namespace {
+
+    /// Resource that simply forwards to the global new and delete
+    class NewDeleteResource : public MemoryResource {
+    protected:
+
+        void *do_allocate(size_t bytes, size_t) override {
+            return ::operator new(bytes);
+        }
+
+        void do_deallocate(void *pointer, size_t, size_t) override {
+            ::operator delete(pointer);
+        }
+
+        bool do_is_equal(const MemoryResource &other) const noexcept override {
+            return this == &other;
+        }
+
+    };
+
+}
+
+MemoryResource *JsonMax::defaultResource() {
+    static NewDeleteResource resource;
+    return &resource;
+}
+
+#endif
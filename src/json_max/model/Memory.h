@@ -0,0 +1,154 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_MEMORY_H
+#define JSONMAX_MEMORY_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "Config.h"
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+namespace JsonMax {
+
+#if __cplusplus >= 201703L
+
+    /// In C++17 builds every std::pmr resource (pools, monotonic buffers,...) can be used directly
+    using MemoryResource = std::pmr::memory_resource;
+
+    /// Allocator that hands out memory from a MemoryResource
+    template<typename T>
+    using Allocator = std::pmr::polymorphic_allocator<T>;
+
+#else
+
+    /**
+     * Source of memory for Elements, Objects and Arrays
+     * Mirrors the interface of std::pmr::memory_resource, so resources written for C++11
+     * keep working unchanged when the library is built as C++17
+     */
+    class MemoryResource {
+    public:
+
+        virtual ~MemoryResource() = default;
+
+        /// Allocates at least the given amount of bytes with the given alignment
+        void *allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+            return do_allocate(bytes, alignment);
+        }
+
+        /// Returns memory that was previously allocated by this resource
+        void deallocate(void *pointer, size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+            do_deallocate(pointer, bytes, alignment);
+        }
+
+        /// @return true if memory allocated by one resource can be deallocated by the other
+        bool is_equal(const MemoryResource &other) const noexcept {
+            return do_is_equal(other);
+        }
+
+    protected:
+
+        virtual void *do_allocate(size_t bytes, size_t alignment) = 0;
+
+        virtual void do_deallocate(void *pointer, size_t bytes, size_t alignment) = 0;
+
+        virtual bool do_is_equal(const MemoryResource &other) const noexcept = 0;
+
+    };
+
+#endif
+
+    /**
+     * The resource used when none is given
+     * Uses new/delete, or std::pmr::get_default_resource() in C++17 builds
+     */
+    MemoryResource *defaultResource();
+
+#if __cplusplus < 201703L
+
+    /// Allocator that hands out memory from a MemoryResource, a C++11 take on std::pmr::polymorphic_allocator
+    template<typename T>
+    class Allocator {
+    public:
+
+        using value_type = T;
+
+        /// Constructor, uses the default resource
+        Allocator() noexcept : memoryResource(defaultResource()) {}
+
+        /// Constructor, uses the given resource
+        Allocator(MemoryResource *resource) noexcept : memoryResource(resource) {}
+
+        /// Rebinding constructor
+        template<typename U>
+        Allocator(const Allocator<U> &other) noexcept : memoryResource(other.resource()) {}
+
+        T *allocate(size_t amount) {
+            return static_cast<T *>(memoryResource->allocate(amount * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T *pointer, size_t amount) {
+            memoryResource->deallocate(pointer, amount * sizeof(T), alignof(T));
+        }
+
+        /// Copies of containers use the default resource, just like std::pmr
+        Allocator select_on_container_copy_construction() const {
+            return Allocator();
+        }
+
+        /// Getter for the resource
+        MemoryResource *resource() const noexcept {
+            return memoryResource;
+        }
+
+    private:
+
+        MemoryResource *memoryResource;
+
+    };
+
+    template<typename T, typename U>
+    bool operator==(const Allocator<T> &first, const Allocator<U> &second) noexcept {
+        return first.resource() == second.resource() or first.resource()->is_equal(*second.resource());
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const Allocator<T> &first, const Allocator<U> &second) noexcept {
+        return not(first == second);
+    }
+
+#endif
+
+    namespace Memory {
+
+        /// Allocates a T from the given resource and constructs it with the given arguments
+        template<typename T, typename... Args>
+        T *create(MemoryResource *resource, Args &&... args) {
+            void *memory = resource->allocate(sizeof(T), alignof(T));
+            JSONMAX_TRY {
+                return new(memory) T(std::forward<Args>(args)...);
+            } JSONMAX_CATCH_ALL {
+                resource->deallocate(memory, sizeof(T), alignof(T));
+                JSONMAX_RETHROW;
+            }
+        }
+
+        /// Destroys a T that was made with create and gives its memory back to the resource
+        template<typename T>
+        void destroy(MemoryResource *resource, T *pointer) {
+            if (pointer) {
+                pointer->~T();
+                resource->deallocate(pointer, sizeof(T), alignof(T));
+            }
+        }
+
+    }
+
+}
+
+#endif //JSONMAX_MEMORY_H
@@ -6,19 +6,43 @@
 #include "Element.h"
 #include "Utils.h"
 #include "Pair.h"
+#include "AdaptiveStorage.h"
+#include "FlatHashMap.h"
+#include "ShapedStorage.h"
+#include "ObjectIterator.h"
+#include "FrozenObject.h"
+#include "../writer/Writer.h"
+
+#include <tuple>
 
 using namespace JsonMax;
 
-Object::Object(JsonMax::Storage _storage): storage(_storage) {
+std::atomic<uint64_t> Object::epoch(0);
+
+Object::Object(JsonMax::Storage _storage, MemoryResource *_resource)
+        : storage(_storage), resource(_resource), cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
     switch (storage) {
         case HASHMAP: 
-            data.elementsHashmap = new std::unordered_map<std::string, Element>();
+            data.elementsHashmap = Memory::create<HashmapStorage>(resource, resource);
             break;
         case MAP:
-            data.elementsMap = new std::map<std::string, Element>();
+            data.elementsMap = Memory::create<MapStorage>(resource, resource);
             break;
         case VECTOR:
-            data.elementsVector = new std::vector<std::pair<std::string, Element>>();
+            data.elementsVector = Memory::create<VectorStorage>(resource, resource);
+            break;
+        case ADAPTIVE:
+            data.elementsAdaptive = Memory::create<AdaptiveStorage>(resource, resource);
+            break;
+        case INDEXED:
+            data.elementsAdaptive = Memory::create<AdaptiveStorage>(resource, resource, true);
+            break;
+        case FLAT_HASHMAP:
+            data.elementsFlatHashmap = Memory::create<FlatHashMap>(resource, resource);
+            break;
+        case SHAPED:
+            data.elementsShaped = Memory::create<ShapedStorage>(resource, resource);
             break;
     }
 }
@@ -29,22 +53,47 @@ Object::~Object() {
 
 
 void Object::reset() {
+    markChanged();
+    Memory::destroy(resource, jsonCache);
+    jsonCache = nullptr;
     switch (storage) {
         case HASHMAP:
-            delete data.elementsHashmap;
+            Memory::destroy(resource, data.elementsHashmap);
             break;
         case MAP:
-            delete data.elementsMap;
+            Memory::destroy(resource, data.elementsMap);
             break;
         case VECTOR:
-            delete data.elementsVector;
+            Memory::destroy(resource, data.elementsVector);
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            Memory::destroy(resource, data.elementsAdaptive);
+            break;
+        case FLAT_HASHMAP:
+            Memory::destroy(resource, data.elementsFlatHashmap);
+            break;
+        case SHAPED:
+            Memory::destroy(resource, data.elementsShaped);
             break;
     }
 }
 
 
 void Object::move(JsonMax::Object &&obj) {
+    // The pairs leave the temp object, its parents change
+    obj.detach();
     storage = obj.storage;
+    resource = obj.resource;
+    cachedHash.store(obj.cachedHash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    hashEpoch.store(obj.hashEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    jsonCache = obj.jsonCache;
+    obj.jsonCache = nullptr;
+    stale.store(obj.stale.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    linked.store(obj.linked.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    obj.cachedHash.store(0, std::memory_order_relaxed);
+    obj.stale.store(true, std::memory_order_relaxed);
+    obj.linked.store(false, std::memory_order_relaxed);
     switch (obj.storage) {
         case HASHMAP:
             data.elementsHashmap = obj.data.elementsHashmap;
@@ -58,30 +107,82 @@ void Object::move(JsonMax::Object &&obj) {
             data.elementsVector = obj.data.elementsVector;
             obj.data.elementsVector = nullptr;
             break;
+        case ADAPTIVE:
+        case INDEXED:
+            data.elementsAdaptive = obj.data.elementsAdaptive;
+            obj.data.elementsAdaptive = nullptr;
+            break;
+        case FLAT_HASHMAP:
+            data.elementsFlatHashmap = obj.data.elementsFlatHashmap;
+            obj.data.elementsFlatHashmap = nullptr;
+            break;
+        case SHAPED:
+            data.elementsShaped = obj.data.elementsShaped;
+            obj.data.elementsShaped = nullptr;
+            break;
+    }
+    if (linked.load(std::memory_order_relaxed)) {
+        // The nested objects still point to the temp object
+        linkChildren();
     }
 }
 
 void Object::copy(const JsonMax::Object &obj) {
+    // The hash is not taken over, the copied nested objects are not linked to this one yet
     storage = obj.storage;
     switch (obj.storage) {
         case HASHMAP:
-            data.elementsHashmap = new std::unordered_map<std::string, Element>(*obj.data.elementsHashmap);
+            data.elementsHashmap = Memory::create<HashmapStorage>(resource, resource);
+            data.elementsHashmap->reserve(obj.data.elementsHashmap->size());
+            for (auto &elem: *obj.data.elementsHashmap) {
+                data.elementsHashmap->emplace(std::piecewise_construct, std::forward_as_tuple(elem.first),
+                                              std::forward_as_tuple(elem.second, resource));
+            }
             break;
         case MAP:
-            data.elementsMap = new std::map<std::string, Element>(*obj.data.elementsMap);
+            data.elementsMap = Memory::create<MapStorage>(resource, resource);
+            for (auto &elem: *obj.data.elementsMap) {
+                data.elementsMap->emplace_hint(data.elementsMap->end(), std::piecewise_construct,
+                                               std::forward_as_tuple(elem.first),
+                                               std::forward_as_tuple(elem.second, resource));
+            }
             break;
         case VECTOR:
-            data.elementsVector = new std::vector<std::pair<std::string, Element>>(*obj.data.elementsVector);
+            data.elementsVector = Memory::create<VectorStorage>(resource, resource);
+            data.elementsVector->reserve(obj.data.elementsVector->size());
+            for (auto &elem: *obj.data.elementsVector) {
+                data.elementsVector->emplace_back(std::piecewise_construct, std::forward_as_tuple(elem.first),
+                                                  std::forward_as_tuple(elem.second, resource));
+            }
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            data.elementsAdaptive = Memory::create<AdaptiveStorage>(resource, *obj.data.elementsAdaptive, resource);
+            break;
+        case FLAT_HASHMAP:
+            data.elementsFlatHashmap = Memory::create<FlatHashMap>(resource, *obj.data.elementsFlatHashmap, resource);
+            break;
+        case SHAPED:
+            data.elementsShaped = Memory::create<ShapedStorage>(resource, *obj.data.elementsShaped, resource);
             break;
     }
 }
 
-Object::Object(JsonMax::Object &&obj) noexcept {
+Object::Object(JsonMax::Object &&obj) noexcept : cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
     move(std::move(obj));
 }
 
 
-Object::Object(const JsonMax::Object &obj) {
+Object::Object(const JsonMax::Object &obj)
+        : resource(defaultResource()), cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
+    copy(obj);
+}
+
+Object::Object(const JsonMax::Object &obj, MemoryResource *_resource)
+        : resource(_resource), cachedHash(0), hashEpoch(0), jsonCache(nullptr), parent(nullptr),
+          stale(true), linked(false) {
     copy(obj);
 }
 
@@ -103,72 +204,167 @@ Object& Object::operator=(JsonMax::Object &&obj) noexcept {
 
 
 Element &Object::operator[](const std::string &member) {
+    markChanged();
+    Element *element = lookup(member);
+    if (element) {
+        return *element;
+    }
+    return insert(member);
+}
+
+Element &Object::operator[](const char *member) {
+    markChanged();
+    Element *element = lookup(member, std::char_traits<char>::length(member));
+    if (element) {
+        return *element;
+    }
+    return insert(member);
+}
+
+Element *Object::find(const std::string &key) {
+    markChanged();
+    Element *element = lookup(key);
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+const Element *Object::find(const std::string &key) const {
+    Element *element = lookup(key);
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+Element *Object::find(const char *key) {
+    markChanged();
+    Element *element = lookup(key, std::char_traits<char>::length(key));
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+const Element *Object::find(const char *key) const {
+    Element *element = lookup(key, std::char_traits<char>::length(key));
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+#if __cplusplus >= 201703L
+
+Element &Object::operator[](std::string_view member) {
+    markChanged();
+    Element *element = lookup(member.data(), member.size());
+    if (element) {
+        return *element;
+    }
+    return insert(std::string(member));
+}
+
+Element *Object::find(std::string_view key) {
+    markChanged();
+    Element *element = lookup(key.data(), key.size());
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+const Element *Object::find(std::string_view key) const {
+    Element *element = lookup(key.data(), key.size());
+    return element and element->getType() != UNINITIALIZED ? element : nullptr;
+}
+
+#endif
+
+Element *Object::lookup(const std::string &key) const {
     if (storage == VECTOR) {
         for (auto &elem: *data.elementsVector) {
-            if (elem.first == member) {
-                return elem.second;
+            if (elem.first == key) {
+                return &elem.second;
             }
         }
-        data.elementsVector->emplace_back(member, Element());
-        return data.elementsVector->back().second;
     } else if (storage == MAP) {
-        for (auto &elem: *data.elementsMap) {
-            if (elem.first == member) {
-                return elem.second;
-            }
+        auto itr = data.elementsMap->find(key);
+        if (itr != data.elementsMap->end()) {
+            return &itr->second;
         }
-        data.elementsMap->emplace(member, Element());
-        return data.elementsMap->operator[](member);
     } else if (storage == HASHMAP) {
-        for (auto &elem: *data.elementsHashmap) {
-            if (elem.first == member) {
-                return elem.second;
-            }
+        auto itr = data.elementsHashmap->find(key);
+        if (itr != data.elementsHashmap->end()) {
+            return &itr->second;
         }
-        data.elementsHashmap->emplace(member, Element());
-        return data.elementsHashmap->operator[](member);
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->lookup(key.data(), key.size());
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->lookup(key.data(), key.size());
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->lookup(key.data(), key.size());
     }
+    return nullptr;
 }
 
-std::string Object::toString(unsigned int ind) const {
-    std::string output = "{";
+Element *Object::lookup(const char *key, size_t length) const {
     if (storage == VECTOR) {
         for (auto &elem: *data.elementsVector) {
-            if (elem.second.getType() == Type::UNINITIALIZED) {
-                continue;
-            }
-            output += "\"" + elem.first + "\": " + elem.second.toString(0) + ", ";
-        }
-    } else if (storage == MAP) {
-        for (auto &elem: *data.elementsMap) {
-            if (elem.second.getType() == Type::UNINITIALIZED) {
-                continue;
+            if (elem.first.size() == length and elem.first.compare(0, length, key, length) == 0) {
+                return &elem.second;
             }
-            output += "\"" + elem.first + "\": " + elem.second.toString(0) + ", ";
-        }
-    } else if (storage == HASHMAP) {
-        for (auto &elem: *data.elementsHashmap) {
-            if (elem.second.getType() == Type::UNINITIALIZED) {
-                continue;
-            }
-            output += "\"" + elem.first + "\": " + elem.second.toString(0) + ", ";
         }
+        return nullptr;
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->lookup(key, length);
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->lookup(key, length);
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->lookup(key, length);
     }
-    if (output.size() > 2) {
-        output.pop_back();
-        output.pop_back();
+#if __cplusplus >= 201703L
+    if (storage == MAP) {
+        auto itr = data.elementsMap->find(std::string_view(key, length));
+        return itr != data.elementsMap->end() ? &itr->second : nullptr;
     }
-    output += "}";
+#endif
+    // std::unordered_map has no heterogeneous lookup before C++20, short keys fit in the small string buffer
+    return lookup(std::string(key, length));
+}
 
-    if (ind) {
-        return Utils::indent(output, ind);
+Element *Object::lookup(const std::string &key, uint64_t hash) const {
+    if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->lookup(key.data(), key.size(), hash);
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->lookup(key.data(), key.size(), hash);
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->lookup(key.data(), key.size(), hash);
     }
+    return lookup(key);
+}
 
-    return output;
+Element &Object::insert(std::string key) {
+    markChanged();
+    if (storage == VECTOR) {
+        data.elementsVector->emplace_back(std::move(key), Element(resource));
+        return data.elementsVector->back().second;
+    } else if (storage == MAP) {
+        return data.elementsMap->emplace(std::move(key), Element(resource)).first->second;
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->insert(std::move(key));
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->insert(std::move(key));
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->insert(std::move(key));
+    } else {
+        return data.elementsHashmap->emplace(std::move(key), Element(resource)).first->second;
+    }
+}
+
+std::string Object::toString(unsigned int ind) const {
+    return toString(WriteOptions(false, ind));
+}
+
+std::string Object::toString(const WriteOptions &options) const {
+    StringOutput output;
+    // Cached fragments are measured without visiting the unchanged objects again
+    if (options.exactSize or options.cacheFragments) {
+        output.getString().reserve(Writer::serializedSize(*this, options));
+    }
+    Writer(output, options).write(*this);
+    return std::move(output.getString());
 }
 
 
 void Object::remove(const std::string &key) {
+    markChanged();
     if (storage == VECTOR) {
         for (auto itr = data.elementsVector->begin(); itr != data.elementsVector->end(); ++itr) {
             if (itr->first == key) {
@@ -180,6 +376,12 @@ void Object::remove(const std::string &key) {
         data.elementsMap->erase(key);
     } else if (storage == HASHMAP) {
         data.elementsHashmap->erase(key);
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        data.elementsAdaptive->remove(key.data(), key.size());
+    } else if (storage == FLAT_HASHMAP) {
+        data.elementsFlatHashmap->remove(key.data(), key.size());
+    } else if (storage == SHAPED) {
+        data.elementsShaped->remove(key.data(), key.size());
     }
 }
 
@@ -204,10 +406,56 @@ std::vector<Pair> Object::pairs() const {
                 pairs.emplace_back(elem.first, elem.second);
             }
         }
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        for (auto &elem: *data.elementsAdaptive) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == FLAT_HASHMAP) {
+        for (auto &elem: *data.elementsFlatHashmap) {
+            if (elem.second.getType() != Type::UNINITIALIZED) {
+                pairs.emplace_back(elem.first, elem.second);
+            }
+        }
+    } else if (storage == SHAPED) {
+        for (auto &member: *this) {
+            pairs.emplace_back(member.getKey(), member.getValue());
+        }
     }
     return pairs;
 }
 
+ObjectIterator<Element> Object::begin() {
+    markChanged();
+    return ObjectIterator<Element>(*this, false);
+}
+
+ObjectIterator<Element> Object::end() {
+    return ObjectIterator<Element>(*this, true);
+}
+
+ObjectIterator<const Element> Object::begin() const {
+    return ObjectIterator<const Element>(*this, false);
+}
+
+ObjectIterator<const Element> Object::end() const {
+    return ObjectIterator<const Element>(*this, true);
+}
+
+ObjectRange<KeyIterator> Object::keys() const {
+    return ObjectRange<KeyIterator>(KeyIterator(begin()), KeyIterator(end()));
+}
+
+ObjectRange<ValueIterator<Element>> Object::values() {
+    return ObjectRange<ValueIterator<Element>>(ValueIterator<Element>(begin()), ValueIterator<Element>(end()));
+}
+
+ObjectRange<ValueIterator<const Element>> Object::values() const {
+    return ObjectRange<ValueIterator<const Element>>(ValueIterator<const Element>(begin()),
+                                                     ValueIterator<const Element>(end()));
+}
+
 size_t Object::size() const {
     if (storage == VECTOR) {
         return data.elementsVector->size();
@@ -215,24 +463,18 @@ size_t Object::size() const {
         return data.elementsMap->size();
     } else if (storage == HASHMAP) {
         return data.elementsHashmap->size();
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        return data.elementsAdaptive->size();
+    } else if (storage == FLAT_HASHMAP) {
+        return data.elementsFlatHashmap->size();
+    } else if (storage == SHAPED) {
+        return data.elementsShaped->size();
     }
     return 0;
 }
 
 bool Object::exists(const std::string &key) const {
-    if (storage == VECTOR) {
-        for (auto& element: *data.elementsVector) {
-            if (element.first == key && element.second.getType() != UNINITIALIZED) {
-                return true;
-            }
-        }
-        return false;
-    } else if (storage == MAP) {
-        return data.elementsMap->count(key) && data.elementsMap->operator[](key).getType() != UNINITIALIZED;
-    } else if (storage == HASHMAP) {
-        return data.elementsHashmap->count(key) && data.elementsHashmap->operator[](key).getType() != UNINITIALIZED;
-    }
-    return false;
+    return find(key) != nullptr;
 }
 
 bool Object::empty() const {
@@ -257,16 +499,212 @@ bool Object::empty() const {
             }
         }
         return true;
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        for (auto& element: *data.elementsAdaptive) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == FLAT_HASHMAP) {
+        for (auto& element: *data.elementsFlatHashmap) {
+            if (element.second.getType() != UNINITIALIZED) {
+                return false;
+            }
+        }
+        return true;
+    } else if (storage == SHAPED) {
+        return begin() == end();
     }
     return true;
 }
 
 void Object::clear() {
+    markChanged();
     if (storage == VECTOR) {
         data.elementsVector->clear();
     } else if (storage == MAP) {
         data.elementsMap->clear();
     } else if (storage == HASHMAP) {
         data.elementsHashmap->clear();
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        data.elementsAdaptive->clear();
+    } else if (storage == FLAT_HASHMAP) {
+        data.elementsFlatHashmap->clear();
+    } else if (storage == SHAPED) {
+        data.elementsShaped->clear();
+    }
+}
+
+void Object::reserve(size_t items) {
+    if (storage == VECTOR) {
+        data.elementsVector->reserve(items);
+    } else if (storage == HASHMAP) {
+        data.elementsHashmap->reserve(items);
+    } else if (storage == ADAPTIVE or storage == INDEXED) {
+        data.elementsAdaptive->reserve(items);
+    } else if (storage == FLAT_HASHMAP) {
+        data.elementsFlatHashmap->reserve(items);
+    } else if (storage == SHAPED) {
+        data.elementsShaped->reserve(items);
+    }
+}
+
+MemoryResource *Object::getResource() const {
+    return resource;
+}
+
+FrozenObject Object::freeze(MemoryResource *frozenResource) const {
+    return FrozenObject(*this, frozenResource);
+}
+
+bool Object::operator==(const Object &other) const {
+    if (this == &other) {
+        return true;
     }
+    uint64_t ours = freshHash();
+    uint64_t theirs = other.freshHash();
+    if (ours != 0 and theirs != 0 and ours != theirs) {
+        return false;
+    }
+
+    size_t count = 0;
+    for (const auto &member: *this) {
+        const std::string &key = member.getKey();
+        const Element *value = other.lookup(key.data(), key.size());
+        if (not value or value->getType() == UNINITIALIZED or *value != member.getValue()) {
+            return false;
+        }
+        count++;
+    }
+
+    // Every pair is present in the other object, which is equal if it has no other initialized pairs
+    if (count == other.size()) {
+        return true;
+    }
+    size_t otherCount = 0;
+    for (auto itr = other.begin(); itr != other.end(); ++itr) {
+        otherCount++;
+    }
+    return count == otherCount;
+}
+
+bool Object::operator!=(const Object &other) const {
+    return not (*this == other);
+}
+
+uint64_t Object::hash() const {
+    bool cacheable = true;
+    return hash(cacheable);
+}
+
+uint64_t Object::hash(bool &cacheable) const {
+    uint64_t cached = freshHash();
+    if (cached != 0) {
+        return cached;
+    }
+
+    // The sum of the pair hashes doesn't depend on the order of the keys
+    uint64_t current = epoch.load(std::memory_order_relaxed);
+    bool own = true;
+    uint64_t sum = 0;
+    size_t count = 0;
+    for (const auto &member: *this) {
+        const std::string &key = member.getKey();
+        sum += Utils::mix(Utils::hash(key.data(), key.size()) + Utils::mix(member.getValue().hash(own)));
+        count++;
+    }
+    uint64_t result = Utils::mix(sum ^ (count * 0x9e3779b97f4a7c15ull));
+    result = result == 0 ? 1 : result;
+    if (not own) {
+        // Exposed values can change without notice, so neither this hash nor those around it are kept
+        cacheable = false;
+        return result;
+    }
+    cacheFilled();
+    hashEpoch.store(current, std::memory_order_relaxed);
+    cachedHash.store(result, std::memory_order_relaxed);
+    return result;
+}
+
+uint64_t Object::freshHash() const {
+    uint64_t cached = cachedHash.load(std::memory_order_relaxed);
+    if (cached == 0 or hashEpoch.load(std::memory_order_relaxed) != epoch.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    return cached;
+}
+
+void Object::markChanged() {
+    if (stale.load(std::memory_order_relaxed)) {
+        return;
+    }
+    clearCaches();
+    markParentsChanged();
+}
+
+void Object::detach() {
+    if (parent.load(std::memory_order_relaxed)) {
+        markParentsChanged();
+        parent.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void Object::markParentsChanged() {
+    // A stale parent has told its own parents already, nothing above it can have a cache since
+    Object *current = parent.load(std::memory_order_relaxed);
+    while (current and not current->stale.load(std::memory_order_relaxed)) {
+        current->clearCaches();
+        current = current->parent.load(std::memory_order_relaxed);
+    }
+}
+
+void Object::clearCaches() {
+    cachedHash.store(0, std::memory_order_relaxed);
+    if (jsonCache) {
+        jsonCache->valid = false;
+        // A slice of the parsed source is never valid again
+        jsonCache->source.reset();
+    }
+    // Changes to the elements are now seen by this object anyway
+    for (ObjectIterator<const Element> itr(*this, false, true), end(*this, true); itr != end; ++itr) {
+        itr->getValue().cached.store(false, std::memory_order_relaxed);
+    }
+    stale.store(true, std::memory_order_relaxed);
+}
+
+void Object::linkChildren() const {
+    for (const auto &member: *this) {
+        linkValue(member.getValue(), const_cast<Object *>(this));
+    }
+    linked.store(true, std::memory_order_relaxed);
+}
+
+void Object::cacheFilled() const {
+    linkChildren();
+    // Uninitialized elements as well, references to them can be kept to assign them later
+    for (ObjectIterator<const Element> itr(*this, false, true), end(*this, true); itr != end; ++itr) {
+        itr->getValue().cached.store(true, std::memory_order_relaxed);
+    }
+    stale.store(false, std::memory_order_relaxed);
+}
+
+void Object::linkValue(const Element &value, Object *parent) {
+    if (value.type == OBJECT) {
+        value.data.object->parent.store(parent, std::memory_order_relaxed);
+    } else if (value.type == ARRAY and not value.exposed) {
+        // Exposed arrays can leave through the references to them, the caches around them never include them
+        value.linked.store(true, std::memory_order_relaxed);
+        for (const Element &element: *value.data.array) {
+            linkValue(element, parent);
+        }
+    }
+}
+
+void Object::setAdaptiveThreshold(size_t threshold) {
+    AdaptiveStorage::setThreshold(threshold);
+}
+
+size_t Object::KeyHash::operator()(const std::string &key) const {
+    return static_cast<size_t>(Utils::hash(key.data(), key.size()));
 }
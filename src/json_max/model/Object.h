@@ -9,6 +9,13 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include "Memory.h"
 
 
 namespace JsonMax {
@@ -16,12 +23,26 @@ namespace JsonMax {
     /// Forward declarations
     class Element;
     class Pair;
+    class AdaptiveStorage;
+    class FlatHashMap;
+    class FrozenObject;
+    class ShapedStorage;
+    class Path;
+    struct WriteOptions;
+    class KeyIterator;
+    template <typename Value> class ObjectIterator;
+    template <typename Value> class ValueIterator;
+    template <typename Iterator> class ObjectRange;
 
     /// Storage options for the Object
     enum Storage {
         HASHMAP,
         MAP,
-        VECTOR
+        VECTOR,
+        ADAPTIVE,
+        FLAT_HASHMAP,
+        INDEXED,
+        SHAPED
     };
 
     /// JSON Object representation
@@ -32,32 +53,39 @@ namespace JsonMax {
          * Constructor
          * Pick the storage type most suitable to your situation (see readme for more info)
          * @param storage the wanted storage type
+         * @param resource the memory resource used for the storage and every element added to it
          */
-        explicit Object(Storage storage = HASHMAP);
+        explicit Object(Storage storage = HASHMAP, MemoryResource *resource = defaultResource());
 
         /**
          * Copy constructor
-         * Deep copies all elements and uses the same storage type
+         * Deep copies all elements into the default resource and uses the same storage type
          */
         Object(const Object&);
 
+        /**
+         * Copy constructor with memory resource
+         * Deep copies all elements into the given resource and uses the same storage type
+         */
+        Object(const Object&, MemoryResource *resource);
+
         /**
          * Move constructor
-         * Moves the complete storage from the temp object
+         * Moves the complete storage and its memory resource from the temp object
          */
         Object(Object&&) noexcept;
 
         /**
          * Copy assignment
          * Resets the current object
-         * Deep copies all elements and uses the same storage type
+         * Deep copies all elements, keeps the current memory resource and uses the same storage type
          */
         Object& operator=(const Object&);
 
         /**
          * Move assignment
          * Resets the current object
-         * Moves the complete storage from the temp object
+         * Moves the complete storage and its memory resource from the temp object
          */
         Object& operator=(Object&&) noexcept;
 
@@ -75,12 +103,47 @@ namespace JsonMax {
          */
         Element &operator[](const std::string &key);
 
+        /// Same as above, but doesn't construct a string for keys that are already present
+        Element &operator[](const char *key);
+
+        /**
+         * Looks up the Element with the given key, never inserts anything
+         * @param key str key of the object
+         * @return pointer to the element, nullptr if the key is not present
+         */
+        Element *find(const std::string &key);
+
+        /// Same as above, const version
+        const Element *find(const std::string &key) const;
+
+        /// Same as above, but takes a c string
+        Element *find(const char *key);
+
+        /// Same as above, const version
+        const Element *find(const char *key) const;
+
+#if __cplusplus >= 201703L
+
+        /// Same as above, but takes a string view (C++17 only)
+        Element &operator[](std::string_view key);
+
+        /// Same as find(const std::string&), but takes a string view (C++17 only)
+        Element *find(std::string_view key);
+
+        /// Same as above, const version
+        const Element *find(std::string_view key) const;
+
+#endif
+
         /**
          * @param indent the wanted indentation (in spaces)
          * @return string representation of the object
          */
         std::string toString(unsigned int indent = 0) const;
 
+        /// @return json with the given layout, see Writer
+        std::string toString(const WriteOptions &options) const;
+
         /**
          * Removes an item from the object
          * Does nothing when the object does not exist
@@ -89,11 +152,36 @@ namespace JsonMax {
 
         /**
          * Fetches all pairs in the object
+         * Copies every key and value, prefer iterating the object itself
          * @return vector of pairs, easy to loop over
          */
         std::vector<Pair> pairs() const;
 
-        /// @return amount of items in the object
+        /**
+         * Iteration over the pairs without copying them (include ObjectIterator.h)
+         * Yields a Member with references to the key and value, uninitialized elements are skipped
+         */
+        ObjectIterator<Element> begin();
+
+        ObjectIterator<Element> end();
+
+        ObjectIterator<const Element> begin() const;
+
+        ObjectIterator<const Element> end() const;
+
+        /// Range over the keys of the object, without copying them
+        ObjectRange<KeyIterator> keys() const;
+
+        /// Range over the values of the object, without copying them
+        ObjectRange<ValueIterator<Element>> values();
+
+        /// Same as above, const version
+        ObjectRange<ValueIterator<const Element>> values() const;
+
+        /**
+         * Keys created by operator[] but never assigned are counted as well
+         * @return amount of items in the object
+         */
         size_t size() const;
 
         /// @return true if the item with the given key exists
@@ -105,22 +193,179 @@ namespace JsonMax {
         /// Clears all items from the object
         void clear();
 
+        /// Makes room for the given amount of items, so adding them doesn't reallocate the storage
+        void reserve(size_t items);
+
+        /// Getter for the memory resource used by the storage and its elements
+        MemoryResource *getResource() const;
+
+        /**
+         * Copies the object into a read only FrozenObject with a perfect hash (include FrozenObject.h)
+         * @param resource the memory resource for the frozen pairs
+         */
+        FrozenObject freeze(MemoryResource *resource = defaultResource()) const;
+
+        /**
+         * Deep equality, the order of the keys doesn't matter and numbers compare by value (1 equals 1.0)
+         * Returns false right away when both objects have a cached hash that is still valid and the hashes differ
+         */
+        bool operator==(const Object &other) const;
+
+        bool operator!=(const Object &other) const;
+
+        /**
+         * Hash of the pairs and all nested elements, independent of the order of the keys
+         * The hash is cached until the object is accessed in a way that can change it (operator[], non const find
+         * or iteration, remove, clear), so unchanged nested objects are not hashed again.
+         * A change to a nested object also clears the hashes of the objects around it. A value assigned through
+         * an element reference obtained before hashing clears every cached hash, as the element doesn't know its
+         * object. Values handed out by reference (getString, getArray, tryGetInt, ...) are hashed every time, and
+         * so are the objects that contain them.
+         * Hashes are seeded per process, so don't store them.
+         */
+        uint64_t hash() const;
+
+        /**
+         * ADAPTIVE objects scan their pairs until they hold more than the threshold, then they build a hash index
+         * Only affects objects that grow afterwards, defaults to 8
+         */
+        static void setAdaptiveThreshold(size_t threshold);
+
     private:
 
+        template <typename> friend class ObjectIterator;
+
+        friend class ObjectBuilder;
+
+        friend class Path;
+
+        friend class Query;
+
+        friend class Writer;
+
+        friend class ObjectParser;
+
+        friend class Element;
+
+        /**
+         * Json of the object as written by a Writer with WriteOptions::cacheFragments, allocated from its resource
+         * Nested objects are not copied into the text, they are written from their own caches at their positions.
+         * Objects parsed with parseWithSource start with their slice of the source instead
+         */
+        struct JsonCache {
+
+            /// Nested object, or exposed element when object is nullptr, that is written at the given position
+            struct Nested {
+                size_t position;
+                const Object *object;
+                const Element *element;
+            };
+
+            explicit JsonCache(MemoryResource *resource)
+                    : text(resource), nested(resource), offset(0), size(0), epoch(0), compact(false), flat(true),
+                      valid(false) {}
+
+            std::vector<char, Allocator<char>> text;
+            std::vector<Nested, Allocator<Nested>> nested;
+            std::shared_ptr<const std::string> source;
+            size_t offset;
+            size_t size;
+            /// Object::epoch when the cache was filled, the cache is outdated once it moves on
+            uint64_t epoch;
+            bool compact;
+            /// True if the object has no nested objects, so the text is all of its json
+            bool flat;
+            bool valid;
+        };
+
         /// Cleans up resources
         void reset();
 
         /// Moves the given temp object to this
         void move(Object&&);
 
-        /// Deep copies the given object to this
+        /// Deep copies the given object to this, using the current memory resource
         void copy(const Object&);
 
+        /// Returns the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const std::string &key) const;
+
+        /// Same as above, but takes the characters of the key
+        Element *lookup(const char *key, size_t length) const;
+
+        /**
+         * Same as the first one, with the precomputed Utils::hash of the key for the storages that use it
+         * (ADAPTIVE, INDEXED, FLAT_HASHMAP and SHAPED). HASHMAP hashes the key itself, MAP and VECTOR compare it
+         */
+        Element *lookup(const std::string &key, uint64_t hash) const;
+
+        /// Inserts a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
+
+        /// Same as above, cacheable is set to false if the hash includes exposed values and can't be cached
+        uint64_t hash(bool &cacheable) const;
+
+        /// @return the cached hash if it is still valid, zero otherwise
+        uint64_t freshHash() const;
+
+        /// Clears the values cached for the current pairs and those of the enclosing objects, see linkChildren
+        void markChanged();
+
+        /// Clears the cached values of the enclosing objects, which no longer contain this one, and forgets them
+        void detach();
+
+        /// Clears the cached values of the enclosing objects, stops at the first one that is already stale
+        void markParentsChanged();
+
+        /// Clears the values cached for the current pairs, the elements no longer count as cached
+        void clearCaches();
+
+        /**
+         * Makes the nested objects, including those in arrays that are not exposed, point to this one as their parent
+         * Called whenever a cache of this object is filled, so a change below it can clear that cache
+         */
+        void linkChildren() const;
+
+        /**
+         * Called after a cache was filled, links the nested objects and marks the elements as cached,
+         * so the next change clears the caches again
+         */
+        void cacheFilled() const;
+
+        /// Links the objects in the given value to the given parent
+        static void linkValue(const Element &value, Object *parent);
+
+        /**
+         * Counts the changes that can't be traced to the objects they affect: values assigned through element
+         * references kept from before a cache was filled. Caches filled before the last one of them are not used.
+         */
+        static std::atomic<uint64_t> epoch;
+
+        /// Storage types, all of them allocate from the memory resource
+        using VectorStorage = std::vector<std::pair<std::string, Element>, Allocator<std::pair<std::string, Element>>>;
+#if __cplusplus >= 201703L
+        using MapStorage = std::map<std::string, Element, std::less<>,
+                Allocator<std::pair<const std::string, Element>>>;
+#else
+        using MapStorage = std::map<std::string, Element, std::less<std::string>,
+                Allocator<std::pair<const std::string, Element>>>;
+#endif
+        /// Keyed Utils::hash for the HASHMAP storage, protects against keys crafted to collide
+        struct KeyHash {
+            size_t operator()(const std::string &key) const;
+        };
+
+        using HashmapStorage = std::unordered_map<std::string, Element, KeyHash,
+                std::equal_to<std::string>, Allocator<std::pair<const std::string, Element>>>;
+
         /// Union with pointer to the different kinds of storage types
         union Data {
-            std::vector<std::pair<std::string, Element>>* elementsVector;
-            std::map<std::string, Element>* elementsMap;
-            std::unordered_map<std::string, Element>* elementsHashmap;
+            VectorStorage* elementsVector;
+            MapStorage* elementsMap;
+            HashmapStorage* elementsHashmap;
+            AdaptiveStorage* elementsAdaptive;
+            FlatHashMap* elementsFlatHashmap;
+            ShapedStorage* elementsShaped;
         };
 
         /// Actual data
@@ -129,6 +374,33 @@ namespace JsonMax {
         /// Storage type
         Storage storage;
 
+        /// Memory resource for the storage and its elements
+        MemoryResource* resource;
+
+        /**
+         * Cached hash of the pairs, zero if it has to be computed again
+         * Atomic because const objects, such as the values of a FrozenObject, can be hashed from multiple threads
+         */
+        mutable std::atomic<uint64_t> cachedHash;
+
+        /// Epoch in which the cached hash was computed
+        mutable std::atomic<uint64_t> hashEpoch;
+
+        /// Cached json, nullptr until the object is written with WriteOptions::cacheFragments or parsed with its source
+        mutable JsonCache *jsonCache;
+
+        /**
+         * Object whose cached values include this one, nullptr if there is none
+         * Set when the parent fills a cache, cleared when this object is moved out of it
+         */
+        mutable std::atomic<Object *> parent;
+
+        /// True if the caches are empty and the parents know, so further changes don't have to tell them again
+        mutable std::atomic<bool> stale;
+
+        /// True if nested objects may point to this one as their parent
+        mutable std::atomic<bool> linked;
+
     };
 
 }
@@ -0,0 +1,107 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "ObjectBuilder.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+using namespace JsonMax;
+
+namespace {
+
+    /// Objects up to this size compare every pair of keys to find duplicates, larger ones sort on the hashes
+    const size_t duplicateScanLimit = 16;
+
+}
+
+ObjectBuilder::ObjectBuilder(Storage _storage, MemoryResource *_resource) : storage(_storage), resource(_resource) {}
+
+void ObjectBuilder::reserve(size_t count) {
+    pairs.reserve(count);
+}
+
+void ObjectBuilder::add(std::string key, Element value) {
+    pairs.emplace_back(std::move(key), Element(resource));
+    pairs.back().second = std::move(value);
+}
+
+size_t ObjectBuilder::size() const {
+    return pairs.size();
+}
+
+Object ObjectBuilder::build() {
+    removeDuplicates();
+
+    Object object(storage, resource);
+    object.reserve(pairs.size());
+    for (auto &pair: pairs) {
+        object.insert(std::move(pair.first)) = std::move(pair.second);
+    }
+    pairs.clear();
+    return object;
+}
+
+void ObjectBuilder::removeDuplicates() {
+    size_t count = pairs.size();
+    std::vector<bool> dropped;
+
+    auto merge = [this, &dropped](size_t first, size_t later) {
+        if (dropped.empty()) {
+            dropped.resize(pairs.size(), false);
+        }
+        pairs[first].second = std::move(pairs[later].second);
+        dropped[later] = true;
+    };
+
+    if (count <= duplicateScanLimit) {
+        for (size_t later = 1; later < count; later++) {
+            for (size_t first = 0; first < later; first++) {
+                if (pairs[first].first == pairs[later].first) {
+                    merge(first, later);
+                    break;
+                }
+            }
+        }
+    } else {
+        // Equal keys end up next to each other, in the order they were added
+        std::vector<std::pair<uint64_t, size_t>> hashes(count);
+        for (size_t i = 0; i < count; i++) {
+            hashes[i] = std::make_pair(Utils::hash(pairs[i].first.data(), pairs[i].first.size()), i);
+        }
+        std::sort(hashes.begin(), hashes.end());
+        for (size_t start = 0; start < count;) {
+            size_t end = start + 1;
+            while (end < count and hashes[end].first == hashes[start].first) {
+                end++;
+            }
+            // Pairs with the same hash, almost always just one
+            for (size_t later = start + 1; later < end; later++) {
+                for (size_t first = start; first < later; first++) {
+                    size_t firstIndex = hashes[first].second;
+                    size_t laterIndex = hashes[later].second;
+                    if ((dropped.empty() or not dropped[firstIndex]) and pairs[firstIndex].first == pairs[laterIndex].first) {
+                        merge(firstIndex, laterIndex);
+                        break;
+                    }
+                }
+            }
+            start = end;
+        }
+    }
+
+    if (dropped.empty()) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (not dropped[i]) {
+            if (kept != i) {
+                pairs[kept] = std::move(pairs[i]);
+            }
+            kept++;
+        }
+    }
+    pairs.erase(pairs.begin() + kept, pairs.end());
+}
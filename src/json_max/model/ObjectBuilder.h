@@ -0,0 +1,64 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_OBJECTBUILDER_H
+#define JSONMAX_OBJECTBUILDER_H
+
+#include <string>
+#include <vector>
+#include "Element.h"
+#include "Object.h"
+#include "Memory.h"
+
+namespace JsonMax {
+
+    /**
+     * Collects the pairs of an Object and creates it in one go
+     * Adding a pair is a plain append, without any lookup. The object is only built once all pairs are known,
+     * so its storage is allocated with the right size right away.
+     */
+    class ObjectBuilder {
+    public:
+
+        /**
+         * Constructor
+         * @param storage the storage type of the built object
+         * @param resource the memory resource of the built object and every value added to it
+         */
+        explicit ObjectBuilder(Storage storage = HASHMAP, MemoryResource *resource = defaultResource());
+
+        /// Makes room for the given amount of pairs
+        void reserve(size_t pairs);
+
+        /**
+         * Appends a pair, the value is moved if it uses the resource of the builder and copied otherwise
+         * If a key is added more than once, the object gets the last value at the position of the first key
+         */
+        void add(std::string key, Element value);
+
+        /// @return amount of pairs added since the last build
+        size_t size() const;
+
+        /// Creates the object with all added pairs, the builder is empty afterwards
+        Object build();
+
+    private:
+
+        /// Merges pairs with the same key into the first one of them
+        void removeDuplicates();
+
+        /// Pairs in the order they were added
+        std::vector<std::pair<std::string, Element>> pairs;
+
+        /// Storage type of the built object
+        Storage storage;
+
+        /// Memory resource for the values and the built object
+        MemoryResource *resource;
+
+    };
+
+}
+
+#endif //JSONMAX_OBJECTBUILDER_H
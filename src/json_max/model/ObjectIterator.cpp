@@ -0,0 +1,239 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "ObjectIterator.h"
+#include "AdaptiveStorage.h"
+
+using namespace JsonMax;
+
+template <typename Value>
+Member<Value>::Member(const std::string *_key, Value *_value): key(_key), value(_value) {}
+
+template <typename Value>
+const std::string &Member<Value>::getKey() const {
+    return *key;
+}
+
+template <typename Value>
+Value &Member<Value>::getValue() const {
+    return *value;
+}
+
+template <typename Value>
+ObjectIterator<Value>::ObjectIterator(const Object &_object, bool end, bool _uninitialized)
+        : object(&_object), member(nullptr, nullptr), uninitialized(_uninitialized), entry(nullptr), entryEnd(nullptr),
+          flatPosition(nullptr, nullptr, nullptr), shapedPosition(0) {
+    if (end) {
+        return;
+    }
+    switch (object->storage) {
+        case VECTOR:
+            entry = object->data.elementsVector->data();
+            entryEnd = entry + object->data.elementsVector->size();
+            break;
+        case MAP:
+            mapPosition = object->data.elementsMap->begin();
+            break;
+        case HASHMAP:
+            hashmapPosition = object->data.elementsHashmap->begin();
+            break;
+        case ADAPTIVE:
+        case INDEXED:
+            entry = object->data.elementsAdaptive->begin();
+            entryEnd = object->data.elementsAdaptive->end();
+            break;
+        case FLAT_HASHMAP:
+            flatPosition = object->data.elementsFlatHashmap->begin();
+            break;
+        case SHAPED:
+            if (object->data.elementsShaped->getDictionary()) {
+                entry = object->data.elementsShaped->getDictionary()->begin();
+                entryEnd = object->data.elementsShaped->getDictionary()->end();
+            }
+            break;
+    }
+    load();
+}
+
+template <typename Value>
+typename ObjectIterator<Value>::reference ObjectIterator<Value>::operator*() const {
+    return member;
+}
+
+template <typename Value>
+typename ObjectIterator<Value>::pointer ObjectIterator<Value>::operator->() const {
+    return &member;
+}
+
+template <typename Value>
+ObjectIterator<Value> &ObjectIterator<Value>::operator++() {
+    advance();
+    load();
+    return *this;
+}
+
+template <typename Value>
+ObjectIterator<Value> ObjectIterator<Value>::operator++(int) {
+    ObjectIterator<Value> previous = *this;
+    ++*this;
+    return previous;
+}
+
+template <typename Value>
+bool ObjectIterator<Value>::operator==(const ObjectIterator &other) const {
+    // Every pair has its own element, the end points to no element at all
+    return member.value == other.member.value;
+}
+
+template <typename Value>
+bool ObjectIterator<Value>::operator!=(const ObjectIterator &other) const {
+    return member.value != other.member.value;
+}
+
+template <typename Value>
+void ObjectIterator<Value>::load() {
+    while (true) {
+        std::pair<const std::string *, Element *> current(nullptr, nullptr);
+        switch (object->storage) {
+            case VECTOR:
+            case ADAPTIVE:
+            case INDEXED:
+                if (entry != entryEnd) {
+                    current = std::make_pair(&entry->first, &entry->second);
+                }
+                break;
+            case MAP:
+                if (mapPosition != object->data.elementsMap->end()) {
+                    current = std::make_pair(&mapPosition->first, &mapPosition->second);
+                }
+                break;
+            case HASHMAP:
+                if (hashmapPosition != object->data.elementsHashmap->end()) {
+                    current = std::make_pair(&hashmapPosition->first, &hashmapPosition->second);
+                }
+                break;
+            case FLAT_HASHMAP:
+                if (flatPosition != object->data.elementsFlatHashmap->end()) {
+                    current = std::make_pair(&flatPosition->first, &flatPosition->second);
+                }
+                break;
+            case SHAPED: {
+                const ShapedStorage *shaped = object->data.elementsShaped;
+                if (shaped->getDictionary()) {
+                    if (entry != entryEnd) {
+                        current = std::make_pair(&entry->first, &entry->second);
+                    }
+                } else if (shapedPosition < shaped->getShape()->size()) {
+                    current = std::make_pair(&shaped->getShape()->getKey(shapedPosition),
+                                             shaped->getValues() + shapedPosition);
+                }
+                break;
+            }
+        }
+
+        if (not current.second or uninitialized or current.second->getType() != UNINITIALIZED) {
+            member = Member<Value>(current.first, current.second);
+            return;
+        }
+        advance();
+    }
+}
+
+template <typename Value>
+void ObjectIterator<Value>::advance() {
+    switch (object->storage) {
+        case VECTOR:
+        case ADAPTIVE:
+        case INDEXED:
+            ++entry;
+            break;
+        case MAP:
+            ++mapPosition;
+            break;
+        case HASHMAP:
+            ++hashmapPosition;
+            break;
+        case FLAT_HASHMAP:
+            ++flatPosition;
+            break;
+        case SHAPED:
+            if (object->data.elementsShaped->getDictionary()) {
+                ++entry;
+            } else {
+                ++shapedPosition;
+            }
+            break;
+    }
+}
+
+KeyIterator::KeyIterator(ObjectIterator<const Element> _position): position(_position) {}
+
+KeyIterator::reference KeyIterator::operator*() const {
+    return position->getKey();
+}
+
+KeyIterator &KeyIterator::operator++() {
+    ++position;
+    return *this;
+}
+
+bool KeyIterator::operator==(const KeyIterator &other) const {
+    return position == other.position;
+}
+
+bool KeyIterator::operator!=(const KeyIterator &other) const {
+    return position != other.position;
+}
+
+template <typename Value>
+ValueIterator<Value>::ValueIterator(ObjectIterator<Value> _position): position(_position) {}
+
+template <typename Value>
+typename ValueIterator<Value>::reference ValueIterator<Value>::operator*() const {
+    return position->getValue();
+}
+
+template <typename Value>
+typename ValueIterator<Value>::pointer ValueIterator<Value>::operator->() const {
+    return &position->getValue();
+}
+
+template <typename Value>
+ValueIterator<Value> &ValueIterator<Value>::operator++() {
+    ++position;
+    return *this;
+}
+
+template <typename Value>
+bool ValueIterator<Value>::operator==(const ValueIterator &other) const {
+    return position == other.position;
+}
+
+template <typename Value>
+bool ValueIterator<Value>::operator!=(const ValueIterator &other) const {
+    return position != other.position;
+}
+
+template <typename Iterator>
+ObjectRange<Iterator>::ObjectRange(Iterator _first, Iterator _last): first(_first), last(_last) {}
+
+template <typename Iterator>
+Iterator ObjectRange<Iterator>::begin() const {
+    return first;
+}
+
+template <typename Iterator>
+Iterator ObjectRange<Iterator>::end() const {
+    return last;
+}
+
+template class JsonMax::Member<JsonMax::Element>;
+template class JsonMax::Member<const JsonMax::Element>;
+template class JsonMax::ObjectIterator<JsonMax::Element>;
+template class JsonMax::ObjectIterator<const JsonMax::Element>;
+template class JsonMax::ValueIterator<JsonMax::Element>;
+template class JsonMax::ValueIterator<const JsonMax::Element>;
+template class JsonMax::ObjectRange<JsonMax::KeyIterator>;
+template class JsonMax::ObjectRange<JsonMax::ValueIterator<JsonMax::Element>>;
+template class JsonMax::ObjectRange<JsonMax::ValueIterator<const JsonMax::Element>>;
@@ -0,0 +1,183 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_OBJECTITERATOR_H
+#define JSONMAX_OBJECTITERATOR_H
+
+#include <string>
+#include <iterator>
+#include "Element.h"
+#include "Object.h"
+#include "FlatHashMap.h"
+#include "ShapedStorage.h"
+
+namespace JsonMax {
+
+    /// References to the key and value of a pair in an Object, nothing is copied
+    template <typename Value>
+    class Member {
+    public:
+
+        /// Constructor with key and value
+        Member(const std::string *key, Value *value);
+
+        /// Getter for key
+        const std::string &getKey() const;
+
+        /// Getter for value, mutable when iterating a non const object
+        Value &getValue() const;
+
+    private:
+
+        template <typename> friend class ObjectIterator;
+
+        const std::string *key;
+        Value *value;
+
+    };
+
+    /**
+     * Forward iterator over the pairs of an Object, for every storage type
+     * Skips uninitialized elements, the order is the order of the storage
+     * Adding or removing pairs invalidates the iterators
+     */
+    template <typename Value>
+    class ObjectIterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Member<Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Member<Value> *;
+        using reference = const Member<Value> &;
+
+        /**
+         * Constructor, points to the first pair of the object or past the last one
+         * @param uninitialized true to yield the uninitialized elements as well
+         */
+        ObjectIterator(const Object &object, bool end, bool uninitialized = false);
+
+        reference operator*() const;
+
+        pointer operator->() const;
+
+        ObjectIterator &operator++();
+
+        ObjectIterator operator++(int);
+
+        bool operator==(const ObjectIterator &other) const;
+
+        bool operator!=(const ObjectIterator &other) const;
+
+    private:
+
+        /// Points the member to the current position, or to nothing once the end is reached
+        void load();
+
+        /// Moves to the next position of the storage
+        void advance();
+
+        /// Object that is iterated
+        const Object *object;
+
+        /// Current pair
+        Member<Value> member;
+
+        /// True if uninitialized elements are not skipped
+        bool uninitialized;
+
+        /// Position in VECTOR, ADAPTIVE and INDEXED objects, and in SHAPED objects that use a dictionary
+        std::pair<std::string, Element> *entry;
+        std::pair<std::string, Element> *entryEnd;
+
+        /// Position in MAP objects
+        Object::MapStorage::iterator mapPosition;
+
+        /// Position in HASHMAP objects
+        Object::HashmapStorage::iterator hashmapPosition;
+
+        /// Position in FLAT_HASHMAP objects
+        FlatHashMap::Iterator flatPosition;
+
+        /// Position in SHAPED objects that share a shape
+        uint32_t shapedPosition;
+
+    };
+
+    /// Iterator over the keys of an Object
+    class KeyIterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string *;
+        using reference = const std::string &;
+
+        explicit KeyIterator(ObjectIterator<const Element> position);
+
+        reference operator*() const;
+
+        KeyIterator &operator++();
+
+        bool operator==(const KeyIterator &other) const;
+
+        bool operator!=(const KeyIterator &other) const;
+
+    private:
+
+        ObjectIterator<const Element> position;
+
+    };
+
+    /// Iterator over the values of an Object
+    template <typename Value>
+    class ValueIterator {
+    public:
+
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Element;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value *;
+        using reference = Value &;
+
+        explicit ValueIterator(ObjectIterator<Value> position);
+
+        reference operator*() const;
+
+        pointer operator->() const;
+
+        ValueIterator &operator++();
+
+        bool operator==(const ValueIterator &other) const;
+
+        bool operator!=(const ValueIterator &other) const;
+
+    private:
+
+        ObjectIterator<Value> position;
+
+    };
+
+    /// Pair of iterators that can be used in a range based for loop
+    template <typename Iterator>
+    class ObjectRange {
+    public:
+
+        ObjectRange(Iterator first, Iterator last);
+
+        Iterator begin() const;
+
+        Iterator end() const;
+
+    private:
+
+        Iterator first;
+        Iterator last;
+
+    };
+
+}
+
+#endif //JSONMAX_OBJECTITERATOR_H
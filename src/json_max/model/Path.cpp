@@ -0,0 +1,105 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "Path.h"
+#include "Element.h"
+#include "Object.h"
+#include "Utils.h"
+#include "Config.h"
+
+using namespace JsonMax;
+
+Path::Path(const std::string &_pointer) : pointer(_pointer) {
+    if (pointer.empty()) {
+        return;
+    }
+    if (pointer[0] != '/') {
+        JSONMAX_THROW(PathException("Invalid JSON Pointer '" + pointer + "': it does not start with '/'"));
+    }
+
+    size_t start = 1;
+    while (true) {
+        size_t end = pointer.find('/', start);
+        if (end == std::string::npos) {
+            end = pointer.size();
+        }
+
+        Token token;
+        for (size_t i = start; i < end; i++) {
+            if (pointer[i] != '~') {
+                token.key += pointer[i];
+            } else if (i + 1 < end and pointer[i + 1] == '0') {
+                token.key += '~';
+                i++;
+            } else if (i + 1 < end and pointer[i + 1] == '1') {
+                token.key += '/';
+                i++;
+            } else {
+                JSONMAX_THROW(PathException("Invalid JSON Pointer '" + pointer +
+                                            "': '~' is not followed by '0' or '1'"));
+            }
+        }
+        token.hash = Utils::hash(token.key.data(), token.key.size());
+
+        // Array indexes are digits without leading zeros
+        token.index = std::string::npos;
+        bool digits = not token.key.empty() and token.key.size() < 19 and
+                      (token.key[0] != '0' or token.key.size() == 1);
+        for (char c: token.key) {
+            digits = digits and c >= '0' and c <= '9';
+        }
+        if (digits) {
+            token.index = static_cast<size_t>(std::stoull(token.key));
+        }
+
+        tokens.push_back(std::move(token));
+        if (end == pointer.size()) {
+            break;
+        }
+        start = end + 1;
+    }
+}
+
+Element *Path::resolve(Element &root) const {
+    return walk(root, true);
+}
+
+const Element *Path::resolve(const Element &root) const {
+    return walk(root, false);
+}
+
+Element *Path::walk(const Element &root, bool changing) const {
+    auto *current = const_cast<Element *>(&root);
+    for (const Token &token: tokens) {
+        if (current->isObject()) {
+            Object &object = current->getObject();
+            if (changing) {
+                // The result can be used to change the object
+                object.markChanged();
+            }
+            current = object.lookup(token.key, token.hash);
+            if (not current or current->getType() == UNINITIALIZED) {
+                return nullptr;
+            }
+        } else if (current->isArray()) {
+            // The result can be used to change the array, so it is exposed like through getArray
+            const Array &array = changing ? current->getArray() : static_cast<const Element *>(current)->getArray();
+            if (token.index >= array.size()) {
+                return nullptr;
+            }
+            current = const_cast<Element *>(&array[token.index]);
+        } else {
+            return nullptr;
+        }
+    }
+    return current;
+}
+
+size_t Path::size() const {
+    return tokens.size();
+}
+
+const std::string &Path::toString() const {
+    return pointer;
+}
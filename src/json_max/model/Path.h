@@ -0,0 +1,81 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_PATH_H
+#define JSONMAX_PATH_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+
+namespace JsonMax {
+
+    /// Forward declaration
+    class Element;
+
+    /// Invalid JSON Pointer, or a pointer that doesn't resolve
+    class PathException : public std::runtime_error {
+    public:
+
+        explicit PathException(const std::string &message) : std::runtime_error(message) {}
+
+    };
+
+    /**
+     * Compiled JSON Pointer (RFC 6901), such as "/users/3/name"
+     * The pointer is parsed once: every key is unescaped and hashed up front, and every array index is converted.
+     * Resolving it walks the elements with a single lookup per level and never allocates. ADAPTIVE, INDEXED,
+     * FLAT_HASHMAP and SHAPED objects use the hash of the key from the path, HASHMAP objects hash it again.
+     */
+    class Path {
+    public:
+
+        /**
+         * Constructor, compiles the given pointer
+         * The empty pointer refers to the whole document, any other pointer starts with '/'
+         * Throws a PathException if the pointer is malformed
+         */
+        explicit Path(const std::string &pointer);
+
+        /// @return the element the path refers to, nullptr if it does not exist
+        Element *resolve(Element &root) const;
+
+        /// Same as above, const version
+        const Element *resolve(const Element &root) const;
+
+        /// @return amount of reference tokens
+        size_t size() const;
+
+        /// @return the pointer the path was compiled from
+        const std::string &toString() const;
+
+    private:
+
+        /// Reference token of the pointer
+        struct Token {
+            /// Unescaped key, used when the token is applied to an object
+            std::string key;
+
+            /// Hash of the key
+            uint64_t hash;
+
+            /// Index, used when the token is applied to an array; npos if the token is not a valid index
+            size_t index;
+        };
+
+        /// Resolves the path, marks the objects on the way as changed if the result may be changed
+        Element *walk(const Element &root, bool changing) const;
+
+        /// The original pointer
+        std::string pointer;
+
+        /// Tokens of the pointer, in order
+        std::vector<Token> tokens;
+
+    };
+
+}
+
+#endif //JSONMAX_PATH_H
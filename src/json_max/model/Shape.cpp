@@ -0,0 +1,295 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "Shape.h"
+#include "Utils.h"
+#include "Config.h"
+
+#include <thread>
+#include <type_traits>
+
+using namespace JsonMax;
+
+namespace {
+
+    /// Shapes with more keys than this get a table with a hash index
+    const uint32_t shapeScanLimit = 8;
+
+    /// Slots of the first transitions of a shape
+    const uint32_t firstTransitions = 8;
+
+}
+
+Shape *Shape::root() {
+    // Never destroyed, objects may still refer to it while static objects are destroyed
+    static std::aligned_storage<sizeof(Shape), alignof(Shape)>::type storage;
+    static Shape *empty = new(&storage) Shape();
+    return empty;
+}
+
+Shape::Shape() : hash(0), count(0), parent(nullptr), resource(defaultResource()), table(nullptr),
+                 transitions(nullptr), readerPhase(0), references(1) {
+    readers[0].store(0, std::memory_order_relaxed);
+    readers[1].store(0, std::memory_order_relaxed);
+}
+
+Shape::Shape(Shape *_parent, std::string _key, uint64_t _hash, MemoryResource *_resource)
+        : key(std::move(_key)), hash(_hash), count(_parent->count + 1), parent(_parent), resource(_resource),
+          table(nullptr), transitions(nullptr), readerPhase(0), references(1) {
+    readers[0].store(0, std::memory_order_relaxed);
+    readers[1].store(0, std::memory_order_relaxed);
+    parent->acquire();
+}
+
+Shape::~Shape() {
+    Memory::destroy(resource, const_cast<Table *>(table.load(std::memory_order_acquire)));
+    Memory::destroy(resource, transitions.load(std::memory_order_acquire));
+}
+
+void Shape::destroy(Shape *shape) {
+    MemoryResource *memory = shape->resource;
+    shape->~Shape();
+    memory->deallocate(shape, sizeof(Shape), alignof(Shape));
+}
+
+Shape *Shape::extend(const std::string &newKey, MemoryResource *memory) {
+    uint64_t keyHash = Utils::hash(newKey.data(), newKey.size());
+    Shape *existing = acquireTransition(newKey, keyHash, memory);
+    if (existing) {
+        return existing;
+    }
+    std::lock_guard<std::mutex> lock(transitionsMutex);
+    existing = acquireTransition(newKey, keyHash, memory);
+    return existing ? existing : addTransition(std::string(newKey), keyHash, memory);
+}
+
+Shape *Shape::extend(std::string &&newKey, MemoryResource *memory) {
+    uint64_t keyHash = Utils::hash(newKey.data(), newKey.size());
+    Shape *existing = acquireTransition(newKey, keyHash, memory);
+    if (existing) {
+        return existing;
+    }
+    std::lock_guard<std::mutex> lock(transitionsMutex);
+    existing = acquireTransition(newKey, keyHash, memory);
+    return existing ? existing : addTransition(std::move(newKey), keyHash, memory);
+}
+
+uint32_t Shape::find(const char *candidate, size_t length) const {
+    return find(candidate, length, count > shapeScanLimit ? Utils::hash(candidate, length) : 0);
+}
+
+uint32_t Shape::find(const char *candidate, size_t length, uint64_t candidateHash) const {
+    if (count <= shapeScanLimit) {
+        for (const Shape *shape = this; shape->parent; shape = shape->parent) {
+            if (shape->key.size() == length and shape->key.compare(0, length, candidate, length) == 0) {
+                return shape->count - 1;
+            }
+        }
+        return count;
+    }
+
+    const Table &lookup = getTable();
+    auto fragment = static_cast<uint32_t>(candidateHash >> 32);
+    auto mask = static_cast<uint32_t>(lookup.index.size() - 1);
+    for (uint32_t i = static_cast<uint32_t>(candidateHash) & mask;; i = (i + 1) & mask) {
+        const Slot &slot = lookup.index[i];
+        if (slot.position == 0) {
+            return count;
+        }
+        const std::string &stored = *lookup.keys[slot.position - 1];
+        if (slot.hash == fragment and stored.size() == length and stored.compare(0, length, candidate, length) == 0) {
+            return slot.position - 1;
+        }
+    }
+}
+
+const std::string &Shape::getKey(uint32_t position) const {
+    if (count > shapeScanLimit) {
+        return *getTable().keys[position];
+    }
+    const Shape *shape = this;
+    while (shape->count != position + 1) {
+        shape = shape->parent;
+    }
+    return shape->key;
+}
+
+uint32_t Shape::size() const {
+    return count;
+}
+
+MemoryResource *Shape::getResource() const {
+    return resource;
+}
+
+void Shape::acquire() {
+    references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Shape::release() {
+    size_t current = references.load(std::memory_order_relaxed);
+    while (current > 1) {
+        if (references.compare_exchange_weak(current, current - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    // Possibly the last reference: searches may hand out this shape again until it is removed from its parent
+    Shape *ancestor = parent;
+    bool last;
+    {
+        std::lock_guard<std::mutex> lock(ancestor->transitionsMutex);
+        last = references.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        if (last) {
+            ancestor->removeTransition(this);
+        }
+    }
+    if (last) {
+        destroy(this);
+        ancestor->release();
+    }
+}
+
+bool Shape::tryAcquire() {
+    size_t current = references.load(std::memory_order_relaxed);
+    while (current != 0) {
+        if (references.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Shape *Shape::acquireTransition(const std::string &newKey, uint64_t keyHash, MemoryResource *memory) {
+    // Counting the search keeps the shapes it may see alive, see waitForReaders
+    uint32_t phase = readerPhase.load(std::memory_order_seq_cst);
+    readers[phase].fetch_add(1, std::memory_order_seq_cst);
+    Shape *found = nullptr;
+    const Transitions *current = transitions.load(std::memory_order_seq_cst);
+    if (current) {
+        auto mask = static_cast<uint32_t>(current->slots.size() - 1);
+        for (auto i = static_cast<uint32_t>(keyHash) & mask;; i = (i + 1) & mask) {
+            Shape *child = current->slots[i].load(std::memory_order_seq_cst);
+            if (not child) {
+                break;
+            }
+            // A child whose last reference is being released is not handed out, the caller retries under the lock
+            if (child != this and child->hash == keyHash and child->resource == memory and child->key == newKey) {
+                found = child->tryAcquire() ? child : nullptr;
+                break;
+            }
+        }
+    }
+    readers[phase].fetch_sub(1, std::memory_order_seq_cst);
+    return found;
+}
+
+Shape *Shape::addTransition(std::string &&newKey, uint64_t keyHash, MemoryResource *memory) {
+    Transitions *current = transitions.load(std::memory_order_relaxed);
+    if (not current or (current->used + 1) * 2 > current->slots.size()) {
+        // Removed slots are left out, so the new table is sized for the shapes that are still there
+        uint32_t live = 0;
+        if (current) {
+            for (const std::atomic<Shape *> &slot: current->slots) {
+                Shape *child = slot.load(std::memory_order_relaxed);
+                live += child and child != this;
+            }
+        }
+        uint32_t capacity = firstTransitions;
+        while (capacity < (live + 1) * 4) {
+            capacity *= 2;
+        }
+        auto *grown = Memory::create<Transitions>(resource, capacity, resource);
+        for (uint32_t i = 0; current and i < current->slots.size(); i++) {
+            Shape *child = current->slots[i].load(std::memory_order_relaxed);
+            if (child and child != this) {
+                auto mask = capacity - 1;
+                auto slot = static_cast<uint32_t>(child->hash) & mask;
+                while (grown->slots[slot].load(std::memory_order_relaxed)) {
+                    slot = (slot + 1) & mask;
+                }
+                grown->slots[slot].store(child, std::memory_order_relaxed);
+                grown->used++;
+            }
+        }
+        transitions.store(grown, std::memory_order_seq_cst);
+        if (current) {
+            waitForReaders();
+            Memory::destroy(resource, current);
+        }
+        current = grown;
+    }
+
+    void *memoryOfChild = memory->allocate(sizeof(Shape), alignof(Shape));
+    auto *child = new(memoryOfChild) Shape(this, std::move(newKey), keyHash, memory);
+    auto mask = static_cast<uint32_t>(current->slots.size() - 1);
+    auto slot = static_cast<uint32_t>(keyHash) & mask;
+    while (current->slots[slot].load(std::memory_order_relaxed)) {
+        slot = (slot + 1) & mask;
+    }
+    current->used++;
+    current->slots[slot].store(child, std::memory_order_seq_cst);
+    return child;
+}
+
+void Shape::removeTransition(Shape *child) {
+    Transitions *current = transitions.load(std::memory_order_relaxed);
+    auto mask = static_cast<uint32_t>(current->slots.size() - 1);
+    auto slot = static_cast<uint32_t>(child->hash) & mask;
+    while (current->slots[slot].load(std::memory_order_relaxed) != child) {
+        slot = (slot + 1) & mask;
+    }
+    current->slots[slot].store(this, std::memory_order_seq_cst);
+    waitForReaders();
+}
+
+void Shape::waitForReaders() {
+    // Searches that start from now on count in the other phase and can't see what was removed before.
+    // Those that are still counted in the previous phase only take a few probes
+    uint32_t previous = readerPhase.load(std::memory_order_relaxed);
+    readerPhase.store(previous ^ 1, std::memory_order_seq_cst);
+    while (readers[previous].load(std::memory_order_seq_cst) != 0) {
+        std::this_thread::yield();
+    }
+}
+
+const Shape::Table &Shape::getTable() const {
+    const Table *current = table.load(std::memory_order_acquire);
+    if (current) {
+        return *current;
+    }
+
+    auto *built = Memory::create<Table>(resource, resource);
+    JSONMAX_TRY {
+        built->keys.resize(count);
+        for (const Shape *shape = this; shape->parent; shape = shape->parent) {
+            built->keys[shape->count - 1] = &shape->key;
+        }
+        size_t slots = 16;
+        while (slots < count * 2) {
+            slots *= 2;
+        }
+        built->index.assign(slots, Slot{0, 0});
+    } JSONMAX_CATCH_ALL {
+        Memory::destroy(resource, built);
+        JSONMAX_RETHROW;
+    }
+    auto mask = static_cast<uint32_t>(built->index.size() - 1);
+    for (uint32_t position = 0; position < count; position++) {
+        uint64_t keyHash = Utils::hash(built->keys[position]->data(), built->keys[position]->size());
+        uint32_t i = static_cast<uint32_t>(keyHash) & mask;
+        while (built->index[i].position != 0) {
+            i = (i + 1) & mask;
+        }
+        built->index[i].hash = static_cast<uint32_t>(keyHash >> 32);
+        built->index[i].position = position + 1;
+    }
+
+    // Threads that search the shape at the same time may build it twice, the first one is kept
+    if (not table.compare_exchange_strong(current, built, std::memory_order_acq_rel)) {
+        Memory::destroy(resource, built);
+        return *current;
+    }
+    return *built;
+}
@@ -0,0 +1,163 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_SHAPE_H
+#define JSONMAX_SHAPE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include "Memory.h"
+
+namespace JsonMax {
+
+    /**
+     * Key sequence shared by all SHAPED objects that have the same keys in the same order
+     * A shape never changes: adding a key moves the object to the next shape, found through the transitions.
+     * Every shape stores only the key it adds and points to its parent for the others, the objects only store their
+     * values. The table of all keys and the lookup index are built when the shape is first searched.
+     * Shapes are allocated from the memory resource of the objects that use them, and only shared between objects
+     * of the same resource. They are reference counted and can be used from multiple threads: existing transitions
+     * are found without locking, each shape has a mutex for adding and removing its own transitions.
+     */
+    class Shape {
+    public:
+
+        /// @return the shape without any keys, which is never destroyed
+        static Shape *root();
+
+        /**
+         * @return the shape with the keys of this one followed by the given key, which must not be present yet
+         * A shape that has to be created is allocated from the given resource. The caller owns a reference to it
+         */
+        Shape *extend(const std::string &key, MemoryResource *resource);
+
+        /// Same as above, moves the key into the shape if it has to be created
+        Shape *extend(std::string &&key, MemoryResource *resource);
+
+        /// @return position of the given key, size() if not present
+        uint32_t find(const char *key, size_t length) const;
+
+        /// Same as above, with the precomputed Utils::hash of the key
+        uint32_t find(const char *key, size_t length, uint64_t hash) const;
+
+        /// @return key at the given position
+        const std::string &getKey(uint32_t position) const;
+
+        /// @return amount of keys
+        uint32_t size() const;
+
+        /// @return memory resource of the shape, the default one for the root
+        MemoryResource *getResource() const;
+
+        /// Adds a reference to the shape
+        void acquire();
+
+        /// Removes a reference, the shape is destroyed once the last one is gone
+        void release();
+
+    private:
+
+        /// Slot in the hash index, position is one based so zero marks an empty slot
+        struct Slot {
+            uint32_t hash;
+            uint32_t position;
+        };
+
+        /// All keys in order and the hash index over them
+        struct Table {
+            explicit Table(MemoryResource *resource) : keys(resource), index(resource) {}
+
+            std::vector<const std::string *, Allocator<const std::string *>> keys;
+            std::vector<Slot, Allocator<Slot>> index;
+        };
+
+        /// Open addressing table of the shapes with one more key, replaced by a larger one when half full
+        struct Transitions {
+            Transitions(uint32_t capacity, MemoryResource *resource) : slots(capacity, resource), used(0) {}
+
+            /// Child shapes, nullptr for a free slot and the owning shape itself for a removed one
+            std::vector<std::atomic<Shape *>, Allocator<std::atomic<Shape *>>> slots;
+
+            /// Slots that are not free, removed ones included
+            uint32_t used;
+        };
+
+        /// Constructor for the root shape
+        Shape();
+
+        /// Constructor for a shape that adds one key, with the given Utils::hash, to its parent
+        Shape(Shape *parent, std::string key, uint64_t hash, MemoryResource *resource);
+
+        Shape(const Shape &) = delete;
+
+        Shape &operator=(const Shape &) = delete;
+
+        /// Destructor, only called once the last reference is gone
+        ~Shape();
+
+        /// Destroys the given shape and gives its memory back to its resource
+        static void destroy(Shape *shape);
+
+        /**
+         * @return the shape in the transitions with the given key and resource with a reference for the caller,
+         * nullptr if none. Doesn't need the transitions mutex
+         */
+        Shape *acquireTransition(const std::string &key, uint64_t hash, MemoryResource *resource);
+
+        /// @return a new shape in the transitions with the given key, the caller holds the mutex and owns the reference
+        Shape *addTransition(std::string &&key, uint64_t hash, MemoryResource *resource);
+
+        /// Removes the given child from the transitions, the caller holds the mutex
+        void removeTransition(Shape *child);
+
+        /// Waits until every search of the transitions that may have seen a removed slot is done
+        void waitForReaders();
+
+        /// Adds a reference unless the last one is already gone, @return true if it was added
+        bool tryAcquire();
+
+        /// @return the table of this large shape, built by the first caller
+        const Table &getTable() const;
+
+        /// The key added by this shape, empty for the root
+        std::string key;
+
+        /// Utils::hash of the key
+        uint64_t hash;
+
+        /// Amount of keys, the position of the own key plus one
+        uint32_t count;
+
+        /// Shape without the last key, holds a reference
+        Shape *parent;
+
+        /// Memory resource of the shape, its table and its transitions
+        MemoryResource *resource;
+
+        /// Table for shapes with more keys than can be scanned, nullptr until it is needed
+        mutable std::atomic<const Table *> table;
+
+        /// Shapes with one more key, nullptr until the first one is added. Replaced and changed under the mutex
+        std::atomic<Transitions *> transitions;
+
+        /// Guards changes to the transitions and the last release of the shapes in them
+        std::mutex transitionsMutex;
+
+        /// Searches of the transitions in progress, per phase, see waitForReaders
+        std::atomic<uint32_t> readers[2];
+
+        /// Phase that new searches count themselves in
+        std::atomic<uint32_t> readerPhase;
+
+        /// Amount of objects and shapes that refer to this one
+        std::atomic<size_t> references;
+
+    };
+
+}
+
+#endif //JSONMAX_SHAPE_H
@@ -0,0 +1,216 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "ShapedStorage.h"
+#include "Config.h"
+
+using namespace JsonMax;
+
+ShapedStorage::ShapedStorage(MemoryResource *_resource)
+        : shape(Shape::root()), values(nullptr), capacity(0), dictionary(nullptr), resource(_resource) {
+    shape->acquire();
+}
+
+ShapedStorage::ShapedStorage(const ShapedStorage &other, MemoryResource *_resource)
+        : ShapedStorage(_resource) {
+    // Delegated constructor, the destructor cleans up if a copy fails
+    if (other.dictionary) {
+        dictionary = Memory::create<AdaptiveStorage>(resource, *other.dictionary, resource);
+        return;
+    }
+    // Shapes come from the resource of their objects, so only objects of the same resource share them
+    uint32_t count = other.shape->size();
+    Shape *copied = other.shape;
+    if (copied->getResource() == resource or copied == Shape::root()) {
+        copied->acquire();
+    } else {
+        copied = buildShape(*other.shape, count);
+    }
+
+    // The values are copied while the object still has the empty shape, so a failed copy only destroys those done
+    JSONMAX_TRY {
+        grow(count);
+        for (uint32_t i = 0; i < count; i++) {
+            new(values + i) Element(resource);
+            JSONMAX_TRY {
+                values[i] = other.values[i];
+            } JSONMAX_CATCH_ALL {
+                for (uint32_t j = 0; j <= i; j++) {
+                    values[j].~Element();
+                }
+                JSONMAX_RETHROW;
+            }
+        }
+    } JSONMAX_CATCH_ALL {
+        copied->release();
+        JSONMAX_RETHROW;
+    }
+    shape->release();
+    shape = copied;
+}
+
+ShapedStorage::~ShapedStorage() {
+    destroy();
+    shape->release();
+}
+
+Element *ShapedStorage::lookup(const char *key, size_t length) const {
+    if (dictionary) {
+        return dictionary->lookup(key, length);
+    }
+    uint32_t position = shape->find(key, length);
+    return position == shape->size() ? nullptr : values + position;
+}
+
+Element *ShapedStorage::lookup(const char *key, size_t length, uint64_t hash) const {
+    if (dictionary) {
+        return dictionary->lookup(key, length, hash);
+    }
+    uint32_t position = shape->find(key, length, hash);
+    return position == shape->size() ? nullptr : values + position;
+}
+
+Element &ShapedStorage::insert(std::string key) {
+    if (dictionary) {
+        return dictionary->insert(std::move(key));
+    }
+    uint32_t count = shape->size();
+    if (count == maxShapeKeys) {
+        toDictionary();
+        return dictionary->insert(std::move(key));
+    }
+    if (count == capacity) {
+        grow(capacity ? capacity * 2 : 4);
+    }
+
+    new(values + count) Element(resource);
+    Shape *next;
+    JSONMAX_TRY {
+        next = shape->extend(std::move(key), resource);
+    } JSONMAX_CATCH_ALL {
+        values[count].~Element();
+        JSONMAX_RETHROW;
+    }
+    shape->release();
+    shape = next;
+    return values[count];
+}
+
+void ShapedStorage::reserve(size_t pairs) {
+    if (dictionary) {
+        dictionary->reserve(pairs);
+    } else {
+        grow(static_cast<uint32_t>(pairs < maxShapeKeys ? pairs : maxShapeKeys));
+    }
+}
+
+void ShapedStorage::remove(const char *key, size_t length) {
+    if (dictionary) {
+        dictionary->remove(key, length);
+        return;
+    }
+    uint32_t count = shape->size();
+    uint32_t found = shape->find(key, length);
+    if (found == count) {
+        return;
+    }
+
+    // Rebuild the shape from the root without the removed key, then close the gap in the values
+    Shape *rebuilt = buildShape(*shape, found);
+    for (uint32_t i = found; i + 1 < count; i++) {
+        values[i] = std::move(values[i + 1]);
+    }
+    values[count - 1].~Element();
+    shape->release();
+    shape = rebuilt;
+}
+
+void ShapedStorage::clear() {
+    destroy();
+    if (shape != Shape::root()) {
+        shape->release();
+        shape = Shape::root();
+        shape->acquire();
+    }
+}
+
+size_t ShapedStorage::size() const {
+    return dictionary ? dictionary->size() : shape->size();
+}
+
+const Shape *ShapedStorage::getShape() const {
+    return dictionary ? nullptr : shape;
+}
+
+Element *ShapedStorage::getValues() const {
+    return values;
+}
+
+AdaptiveStorage *ShapedStorage::getDictionary() const {
+    return dictionary;
+}
+
+void ShapedStorage::grow(uint32_t wanted) {
+    if (wanted <= capacity) {
+        return;
+    }
+    auto *grown = static_cast<Element *>(resource->allocate(wanted * sizeof(Element), alignof(Element)));
+    for (uint32_t i = 0; i < shape->size(); i++) {
+        new(grown + i) Element(std::move(values[i]));
+        values[i].~Element();
+    }
+    if (values) {
+        resource->deallocate(values, capacity * sizeof(Element), alignof(Element));
+    }
+    values = grown;
+    capacity = wanted;
+}
+
+void ShapedStorage::toDictionary() {
+    auto *created = Memory::create<AdaptiveStorage>(resource, resource, true);
+    JSONMAX_TRY {
+        for (uint32_t i = 0; i < shape->size(); i++) {
+            created->insert(shape->getKey(i)) = std::move(values[i]);
+        }
+    } JSONMAX_CATCH_ALL {
+        Memory::destroy(resource, created);
+        JSONMAX_RETHROW;
+    }
+    destroy();
+    dictionary = created;
+    shape->release();
+    shape = Shape::root();
+    shape->acquire();
+}
+
+Shape *ShapedStorage::buildShape(const Shape &keys, uint32_t skipped) const {
+    Shape *built = Shape::root();
+    built->acquire();
+    JSONMAX_TRY {
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            if (i != skipped) {
+                Shape *next = built->extend(keys.getKey(i), resource);
+                built->release();
+                built = next;
+            }
+        }
+    } JSONMAX_CATCH_ALL {
+        built->release();
+        JSONMAX_RETHROW;
+    }
+    return built;
+}
+
+void ShapedStorage::destroy() {
+    if (values) {
+        for (uint32_t i = 0; i < shape->size(); i++) {
+            values[i].~Element();
+        }
+        resource->deallocate(values, capacity * sizeof(Element), alignof(Element));
+        values = nullptr;
+        capacity = 0;
+    }
+    Memory::destroy(resource, dictionary);
+    dictionary = nullptr;
+}
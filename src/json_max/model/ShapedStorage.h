@@ -0,0 +1,104 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_SHAPEDSTORAGE_H
+#define JSONMAX_SHAPEDSTORAGE_H
+
+#include <string>
+#include <cstdint>
+#include "Element.h"
+#include "Memory.h"
+#include "Shape.h"
+#include "AdaptiveStorage.h"
+
+namespace JsonMax {
+
+    /**
+     * Storage behind SHAPED objects
+     * Refers to a Shape for the keys and their index and only stores the values, in the order of the keys.
+     * Objects that grow past maxShapeKeys switch to a dictionary: an indexed AdaptiveStorage of their own.
+     */
+    class ShapedStorage {
+    public:
+
+        /// Objects with more keys than this stop sharing shapes
+        static const uint32_t maxShapeKeys = 64;
+
+        /// Constructor, allocates the values from the given resource
+        explicit ShapedStorage(MemoryResource *resource);
+
+        /// Deep copies the given storage into the given resource, the shape is shared within the same resource
+        ShapedStorage(const ShapedStorage &other, MemoryResource *resource);
+
+        ShapedStorage(const ShapedStorage &) = delete;
+
+        ShapedStorage &operator=(const ShapedStorage &) = delete;
+
+        /// Destructor, cleans up the values and releases the shape
+        ~ShapedStorage();
+
+        /// @return the element with the given key (even if uninitialized), nullptr if not present
+        Element *lookup(const char *key, size_t length) const;
+
+        /// Same as above, with the precomputed Utils::hash of the key
+        Element *lookup(const char *key, size_t length, uint64_t hash) const;
+
+        /// Appends a new uninitialized element with the given key, which must not be present yet
+        Element &insert(std::string key);
+
+        /// Makes room for at least the given amount of values
+        void reserve(size_t pairs);
+
+        /// Removes the pair with the given key, keeps the order of the others
+        void remove(const char *key, size_t length);
+
+        /// Removes all pairs, a dictionary object goes back to sharing shapes
+        void clear();
+
+        /// @return amount of pairs
+        size_t size() const;
+
+        /// @return the shared shape, nullptr once the object uses a dictionary
+        const Shape *getShape() const;
+
+        /// @return the values in the order of the keys of the shape
+        Element *getValues() const;
+
+        /// @return the dictionary, nullptr as long as the object shares shapes
+        AdaptiveStorage *getDictionary() const;
+
+    private:
+
+        /// Makes room for at least the given amount of values
+        void grow(uint32_t wanted);
+
+        /// Moves all pairs to a dictionary
+        void toDictionary();
+
+        /// Destroys the values and the dictionary
+        void destroy();
+
+        /// @return shape for this resource with the keys of the given one, except the skipped position, with a reference
+        Shape *buildShape(const Shape &keys, uint32_t skipped) const;
+
+        /// Shape of the object, holds a reference
+        Shape *shape;
+
+        /// Values, as many as the shape has keys
+        Element *values;
+
+        /// Amount of values that fit in the values
+        uint32_t capacity;
+
+        /// Storage for objects with too many keys
+        AdaptiveStorage *dictionary;
+
+        /// Memory resource for the values and the dictionary
+        MemoryResource *resource;
+
+    };
+
+}
+
+#endif //JSONMAX_SHAPEDSTORAGE_H
@@ -4,63 +4,80 @@
 
 #include "Utils.h"
 
-using namespace JsonMax;
+#include <cstring>
+#include <chrono>
+#include <random>
 
-std::string Utils::indent(const std::string &json, int indentation) {
-    std::string output;
-    unsigned int spaces = 0;
-    bool escape = false;
-    bool inString = false;
+using namespace JsonMax;
 
-    for (size_t i = 0; i < json.size(); i++) {
-        char symbol = json[i];
+namespace {
 
-        // Two special cases, escaped symbol or in string
-        if (escape) {
-            output += symbol;
-            escape = false;
-            continue;
-        } else if (inString) {
-            inString = '"' != symbol;
-            output += symbol;
-            continue;
-        }
+    inline uint64_t rotateLeft(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
 
-        // Non empty object or array started
-        if ((symbol == '{' and json[i + 1] != '}') or (symbol == '[' and json[i + 1] != ']')) {
-            spaces += indentation;
-            output += std::string(1, symbol) + "\n" + std::string(spaces, ' ');
-        }
-        // Non empty object or array ended
-        else if ((symbol == '}' and json[i - 1] != '{') or (symbol == ']' and json[i - 1] != '[')) {
-            spaces -= indentation;
-            output += "\n" + std::string(spaces, ' ') + std::string(1, symbol);
-        }
-        // Comma so new line and indent
-        else if (symbol == ',') {
-            output += ",\n" + std::string(spaces - 1, ' ');
-        }
-        // Other symbols
-        else {
-            // Check if escape or string started
-            if (symbol == '\\') {
-                escape = true;
-            } else if (symbol == '"') {
-                inString = true;
-            }
-            output += symbol;
-        }
+    /// One SipRound on the four words of the state
+    inline void sipRound(uint64_t &v0, uint64_t &v1, uint64_t &v2, uint64_t &v3) {
+        v0 += v1; v1 = rotateLeft(v1, 13); v1 ^= v0; v0 = rotateLeft(v0, 32);
+        v2 += v3; v3 = rotateLeft(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotateLeft(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotateLeft(v1, 17); v1 ^= v2; v2 = rotateLeft(v2, 32);
     }
 
-    return output;
 }
 
-std::string Utils::doubleToString(const double &dou) {
-    std::string str = std::to_string(dou);
-    if (str.find('.') != std::string::npos) {
-        while (str.back() == '0' and str[str.length() - 2] != '.') {
-            str.pop_back();
-        }
+uint64_t Utils::hash(const char *key, size_t length) {
+    return hash(key, length, hashKey());
+}
+
+uint64_t Utils::hash(const char *key, size_t length, const HashKey &secret) {
+    // SipHash-1-3, the key enters the state of every round, so differences can't be cancelled without knowing it
+    uint64_t v0 = secret.first ^ 0x736f6d6570736575ull;
+    uint64_t v1 = secret.second ^ 0x646f72616e646f6dull;
+    uint64_t v2 = secret.first ^ 0x6c7967656e657261ull;
+    uint64_t v3 = secret.second ^ 0x7465646279746573ull;
+    uint64_t last = static_cast<uint64_t>(length) << 56;
+
+    // Eight bytes at a time, the tail goes into the last word together with the length
+    for (; length >= 8; key += 8, length -= 8) {
+        uint64_t word;
+        std::memcpy(&word, key, 8);
+        v3 ^= word;
+        sipRound(v0, v1, v2, v3);
+        v0 ^= word;
     }
-    return str;
+    uint64_t tail = 0;
+    std::memcpy(&tail, key, length);
+    last |= tail;
+    v3 ^= last;
+    sipRound(v0, v1, v2, v3);
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+const Utils::HashKey &Utils::hashKey() {
+    // random_device may be deterministic on some platforms, so mix in the clock and an address as well
+    static const HashKey key = [] {
+        std::random_device device;
+        uint64_t first = (static_cast<uint64_t>(device()) << 32) ^ device();
+        uint64_t second = (static_cast<uint64_t>(device()) << 32) ^ device();
+        first ^= static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count());
+        second ^= mix(reinterpret_cast<uintptr_t>(&device));
+        return HashKey(first, second);
+    }();
+    return key;
+}
+
+uint64_t Utils::mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    value ^= value >> 31;
+    return value;
 }
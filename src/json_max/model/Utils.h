@@ -7,16 +7,41 @@
 
 
 #include <string>
+#include <cstdint>
+#include <utility>
 
 namespace JsonMax {
 
     namespace Utils {
 
-        /// Indents the given string with the given indentation (in spaces)
-        std::string indent(const std::string &json, int indentation);
-
-        /// Returns the string representation of a double, without any trailing zeroes after the comma
-        std::string doubleToString(const double&);
+        /// Secret key of the hash, two 64 bit words
+        typedef std::pair<uint64_t, uint64_t> HashKey;
+
+        /**
+         * Hashes the given characters with SipHash-1-3, used for the hash indexes of the Object storages
+         * Keyed with a random secret per process, so keys can't be crafted to collide without knowing it
+         */
+        uint64_t hash(const char *key, size_t length);
+
+        /// Same as above, with the given secret instead of the one of the process
+        uint64_t hash(const char *key, size_t length, const HashKey &secret);
+
+        /// Random key of the hash, picked once per process
+        const HashKey &hashKey();
+
+        /// Scrambles the bits of the given value, used to combine hashes
+        uint64_t mix(uint64_t value);
+
+        /// @return index of the lowest set bit, the mask can't be zero
+        inline size_t lowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return index;
+#else
+            return static_cast<size_t>(__builtin_ctz(mask));
+#endif
+        }
 
     }
 
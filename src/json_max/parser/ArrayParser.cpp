@@ -5,32 +5,45 @@
 #include <iostream>
 #include "ArrayParser.h"
 #include "ParseException.h"
+#include "../model/ArrayBuilder.h"
 
 using namespace JsonMax;
 
-Element ArrayParser::parse() {
+Element ArrayParser::parseElement() {
     trim();
-    checkArraySemantics();
+    if (not checkArraySemantics()) {
+        return Element(getResource());
+    }
     // Skip '['
     incrementPosition();
 
-    Array array;
+    ArrayBuilder builder(getResource());
     while (not endOfParsing()) {
         size_t endIndexOfElement = findIndexAfterElement(',');
         if (endIndexOfElement == std::string::npos) {
             endIndexOfElement = lastPosition();
         }
-        array.push_back(Parser(getJson(), currentPosition(), endIndexOfElement).parse());
+        builder.add(Parser(getJson(), currentPosition(), endIndexOfElement, getResource(), getError(), getSource(),
+                           getStorage()).parseElement());
+        if (failed()) {
+            return Element(getResource());
+        }
         setPosition(endIndexOfElement + 1);
     }
-    return array;
+    // Nothing outside the parser refers to the elements, so the array is not exposed
+    Element element(builder.build());
+    element.exposed = false;
+    return element;
 }
 
-void ArrayParser::checkArraySemantics() {
+bool ArrayParser::checkArraySemantics() {
     if (currentSymbol() != '[') {
-        throwException("Array does not start with '{'");
+        fail(INVALID_ARRAY_START);
+        return false;
     }
     if (getJson().at(lastPosition()) != ']') {
-        throwException("Array does not end with ']'");
+        fail(INVALID_ARRAY_END);
+        return false;
     }
+    return true;
 }
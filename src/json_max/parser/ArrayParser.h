@@ -16,13 +16,15 @@ namespace JsonMax {
     class ArrayParser: public Parser {
     public:
 
-        ArrayParser(const std::string& str, size_t start, size_t end) : Parser(str, start, end) {}
+        ArrayParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error,
+                const std::shared_ptr<const std::string>& source = nullptr, Storage storage = ADAPTIVE)
+                : Parser(str, start, end, resource, error, source, storage) {}
 
-        Element parse() override;
+        Element parseElement() override;
 
     protected:
 
-        void checkArraySemantics();
+        bool checkArraySemantics();
 
     };
 
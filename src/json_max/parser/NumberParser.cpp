@@ -5,25 +5,42 @@
 #include "NumberParser.h"
 #include "ParseException.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+
 using namespace JsonMax;
 
-Element NumberParser::parse() {
+Element NumberParser::parseElement() {
     trim();
-    std::string str = getJson().substr(currentPosition(), remainingSize());
-    double number = parseNumber(str);
-    if (str.find('.') == std::string::npos) {
-        return Element((int) number);
+    Element element(getResource());
+    double number;
+    if (not parseNumber(number)) {
+        return element;
+    }
+    if (std::memchr(getJson().data() + currentPosition(), '.', remainingSize()) == nullptr) {
+        element = (int) number;
     } else {
-        return Element(number);
+        element = number;
     }
+    return element;
 }
 
-double NumberParser::parseNumber(const std::string& str) {
-    try {
-        return std::stod(str);
-    } catch (std::out_of_range &e) {
-        throwException("Cannot parse, number '" + str + "' is out of range.");
-    } catch (std::invalid_argument &e) {
-        throwException("Invalid Json, '" + str + "' is not valid.");
+bool NumberParser::parseNumber(double &number) {
+    // strtod stops at the first character after the number, which must be the end of the element
+    const char *start = getJson().c_str() + currentPosition();
+    char *end = nullptr;
+    errno = 0;
+    number = std::strtod(start, &end);
+    if (end != start + remainingSize()) {
+        fail(INVALID_VALUE);
+        return false;
+    }
+    // Subnormal values are reported as a range error as well, only reject overflow and underflow to zero
+    if (errno == ERANGE and (number == 0 or std::isinf(number))) {
+        fail(NUMBER_OUT_OF_RANGE);
+        return false;
     }
+    return true;
 }
@@ -14,13 +14,15 @@ namespace JsonMax {
     class NumberParser : public Parser {
     public:
 
-        NumberParser(const std::string &str, size_t start, size_t end) : Parser(str, start, end) {}
+        NumberParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error)
+                : Parser(str, start, end, resource, error) {}
 
-        Element parse() override;
+        Element parseElement() override;
 
-    public:
+    protected:
 
-        double parseNumber(const std::string& str);
+        /// Converts the element to a double, returns false and reports the error if it is not a valid number
+        bool parseNumber(double& number);
 
     };
 
@@ -4,27 +4,51 @@
 
 #include <iostream>
 #include "ObjectParser.h"
+#include "StringParser.h"
 #include "ParseException.h"
+#include "../model/ObjectBuilder.h"
 
 using namespace JsonMax;
 
-Element ObjectParser::parse() {
+Element ObjectParser::parseElement() {
     trim();
-    checkObjectSemantics();
+    if (not checkObjectSemantics()) {
+        return Element(getResource());
+    }
+    size_t start = currentPosition();
     incrementPosition();
 
-    Object obj = Object();
+    ObjectBuilder builder(getStorage(), getResource());
     while (not endOfParsing()) {
         std::string key = extractKeyAndAdjustIndex();
-        checkForDoublePointAndAdjustIndex();
+        if (failed() or not checkForDoublePointAndAdjustIndex()) {
+            return Element(getResource());
+        }
         size_t endIndexOfElement = findIndexAfterElement(',');
         if (endIndexOfElement == std::string::npos) {
             endIndexOfElement = lastPosition();
         }
-        obj[key] = Parser(getJson(), currentPosition(), endIndexOfElement).parse();
+        builder.add(std::move(key),
+                    Parser(getJson(), currentPosition(), endIndexOfElement, getResource(), getError(), getSource(),
+                           getStorage()).parseElement());
+        if (failed()) {
+            return Element(getResource());
+        }
         setPosition(endIndexOfElement + 1);
     }
-    return obj;
+    Element element(builder.build());
+    if (getSource()) {
+        // The slice counts as the cached json of the object until it is changed
+        Object &object = element.getObject();
+        object.jsonCache = Memory::create<Object::JsonCache>(object.resource, object.resource);
+        object.jsonCache->source = getSource();
+        object.jsonCache->offset = start;
+        object.jsonCache->size = lastPosition() + 1 - start;
+        object.jsonCache->epoch = Object::epoch.load(std::memory_order_relaxed);
+        object.jsonCache->valid = true;
+        object.cacheFilled();
+    }
+    return element;
 }
 
 
@@ -33,41 +57,55 @@ std::string ObjectParser::extractKeyAndAdjustIndex() {
     // First quotation mark
     moveToNonEmptyPosition();
     if (endOfParsing() or currentSymbol() != '"') {
-        throwException("Invalid Json, missing key in object");
+        fail(MISSING_KEY);
+        return std::string();
     }
     incrementPosition();
 
-    int keyStart = currentPosition();
+    size_t keyStart = currentPosition();
 
-    // Second quotation mark
-    setPosition(findIndexAfterElement('"'));
+    // Second quotation mark, escaped characters are skipped
+    while (not endOfParsing() and currentSymbol() != '"') {
+        if (currentSymbol() == '\\') {
+            incrementPosition();
+        }
+        incrementPosition();
+    }
     if (endOfParsing()) {
-        throwException("Invalid Json, key in object has no ending");
+        fail(UNTERMINATED_KEY);
+        return std::string();
     }
+    size_t keyEnd = currentPosition();
     incrementPosition();
 
-    return getJson().substr(keyStart, currentPosition() - keyStart - 1);
+    std::string key;
+    if (not StringParser::unescape(getJson().data() + keyStart, getJson().data() + keyEnd, key)) {
+        setPosition(keyStart);
+        fail(INVALID_STRING);
+    }
+    return key;
 }
 
 
 
-void ObjectParser::checkForDoublePointAndAdjustIndex() {
+bool ObjectParser::checkForDoublePointAndAdjustIndex() {
     moveToNonEmptyPosition();
     if (endOfParsing() or currentSymbol() != ':') {
-        throwException("Invalid Json, no ':' between key and value");
+        fail(MISSING_COLON);
+        return false;
     }
     incrementPosition();
+    return true;
 }
 
-void ObjectParser::checkObjectSemantics() {
+bool ObjectParser::checkObjectSemantics() {
     if (currentSymbol() != '{') {
-        throwException("Invalid Json: object does not start with '{'");
-
+        fail(INVALID_OBJECT_START);
+        return false;
     }
     if (getJson().at(lastPosition()) != '}') {
-        throwException("Invalid Json: object does not end with '}'");
+        fail(INVALID_OBJECT_END);
+        return false;
     }
+    return true;
 }
-
-
-
@@ -16,17 +16,19 @@ namespace JsonMax {
     class ObjectParser: public Parser {
     public:
 
-        ObjectParser(const std::string& str, size_t start, size_t end) : Parser(str, start, end) {}
+        ObjectParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error,
+                const std::shared_ptr<const std::string>& source = nullptr, Storage storage = ADAPTIVE)
+                : Parser(str, start, end, resource, error, source, storage) {}
 
-        Element parse() override;
+        Element parseElement() override;
 
     protected:
 
         std::string extractKeyAndAdjustIndex();
 
-        void checkForDoublePointAndAdjustIndex();
+        bool checkForDoublePointAndAdjustIndex();
 
-        void checkObjectSemantics();
+        bool checkObjectSemantics();
 
     };
 
@@ -0,0 +1,83 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "ParseError.h"
+
+#include <algorithm>
+
+using namespace JsonMax;
+
+ParseError::ParseError() : code(PARSE_SUCCESS), offset(0) {}
+
+ParseError::ParseError(ParseErrorCode _code, size_t _offset, std::string _excerpt)
+        : code(_code), offset(_offset), excerpt(std::move(_excerpt)) {}
+
+ParseError::operator bool() const {
+    return code != PARSE_SUCCESS;
+}
+
+ParseErrorCode ParseError::getCode() const {
+    return code;
+}
+
+size_t ParseError::getOffset() const {
+    return offset;
+}
+
+const char *ParseError::getMessage() const {
+    switch (code) {
+        case PARSE_SUCCESS:
+            return "No error";
+        case INVALID_VALUE:
+            return "Invalid Json, value is not valid.";
+        case NUMBER_OUT_OF_RANGE:
+            return "Cannot parse, number is out of range.";
+        case INVALID_STRING:
+            return "Invalid Json, string is invalid as per Json rules.";
+        case MISSING_KEY:
+            return "Invalid Json, missing key in object";
+        case UNTERMINATED_KEY:
+            return "Invalid Json, key in object has no ending";
+        case MISSING_COLON:
+            return "Invalid Json, no ':' between key and value";
+        case INVALID_OBJECT_START:
+            return "Invalid Json: object does not start with '{'";
+        case INVALID_OBJECT_END:
+            return "Invalid Json: object does not end with '}'";
+        case INVALID_ARRAY_START:
+            return "Invalid Json: array does not start with '['";
+        case INVALID_ARRAY_END:
+            return "Invalid Json: array does not end with ']'";
+    }
+    return "Unknown error";
+}
+
+const std::string &ParseError::getExcerpt() const {
+    return excerpt;
+}
+
+std::string ParseError::getDescription() const {
+    switch (code) {
+        case INVALID_VALUE:
+            return "Invalid Json, '" + excerpt + "' is not valid.";
+        case NUMBER_OUT_OF_RANGE:
+            return "Cannot parse, number '" + excerpt + "' is out of range.";
+        default:
+            if (code == PARSE_SUCCESS or excerpt.empty()) {
+                return getMessage();
+            }
+            return std::string(getMessage()) + " at '" + excerpt + "'";
+    }
+}
+
+size_t ParseError::getLine(const std::string &json) const {
+    size_t end = std::min(offset, json.size());
+    return 1 + static_cast<size_t>(std::count(json.begin(), json.begin() + end, '\n'));
+}
+
+size_t ParseError::getColumn(const std::string &json) const {
+    size_t end = std::min(offset, json.size());
+    size_t lineStart = end == 0 ? std::string::npos : json.rfind('\n', end - 1);
+    return lineStart == std::string::npos ? end + 1 : end - lineStart;
+}
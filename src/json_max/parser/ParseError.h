@@ -0,0 +1,77 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_PARSEERROR_H
+#define JSONMAX_PARSEERROR_H
+
+#include <string>
+
+namespace JsonMax {
+
+    /// Reasons why a JSON string is rejected
+    enum ParseErrorCode {
+        PARSE_SUCCESS,
+        INVALID_VALUE,
+        NUMBER_OUT_OF_RANGE,
+        INVALID_STRING,
+        MISSING_KEY,
+        UNTERMINATED_KEY,
+        MISSING_COLON,
+        INVALID_OBJECT_START,
+        INVALID_OBJECT_END,
+        INVALID_ARRAY_START,
+        INVALID_ARRAY_END
+    };
+
+    /**
+     * Result of parsing without exceptions, see parse(const std::string&, Element&)
+     * Stores the code, the byte offset and an excerpt of the json there, the line and column are computed when they
+     * are asked for.
+     */
+    class ParseError {
+    public:
+
+        /// Constructor, no error
+        ParseError();
+
+        /// Constructor, error with the given code at the given byte offset in the json, where it reads the excerpt
+        ParseError(ParseErrorCode code, size_t offset, std::string excerpt = std::string());
+
+        /// @return true if parsing failed
+        explicit operator bool() const;
+
+        /// @return the reason of the error, PARSE_SUCCESS if there is none
+        ParseErrorCode getCode() const;
+
+        /// @return byte offset in the json where the error was found
+        size_t getOffset() const;
+
+        /// @return description of the error code
+        const char *getMessage() const;
+
+        /// @return the json at the error, the offending value for INVALID_VALUE and NUMBER_OUT_OF_RANGE
+        const std::string &getExcerpt() const;
+
+        /// @return description of the error with its excerpt, as in the message of a ParseException
+        std::string getDescription() const;
+
+        /// @return line of the error (one based), the given json must be the parsed one
+        size_t getLine(const std::string &json) const;
+
+        /// @return column of the error in bytes (one based), the given json must be the parsed one
+        size_t getColumn(const std::string &json) const;
+
+    private:
+
+        ParseErrorCode code;
+
+        size_t offset;
+
+        std::string excerpt;
+
+    };
+
+}
+
+#endif //JSONMAX_PARSEERROR_H
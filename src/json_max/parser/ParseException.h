@@ -6,6 +6,8 @@
 #define JSONMAX_PARSEEXCEPTION_H
 
 #include <exception>
+#include <stdexcept>
+#include "ParseError.h"
 
 namespace JsonMax {
 
@@ -16,6 +18,10 @@ namespace JsonMax {
         explicit ParseException(const std::string &message, const std::string &json, size_t pos)
                 : std::runtime_error(craftMessage(message, json, pos)) {}
 
+        /// Constructor, from the error found while parsing the given json
+        ParseException(const ParseError &error, const std::string &json)
+                : std::runtime_error(craftMessage(error.getDescription(), json, error.getOffset())) {}
+
         static std::string craftMessage(const std::string &message, const std::string &json, size_t pos) {
             int line = 1;
             int lineStart = 0;
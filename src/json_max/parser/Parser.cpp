@@ -3,6 +3,7 @@
  */
 
 #include <iostream>
+#include <algorithm>
 
 #include "Parser.h"
 #include "ObjectParser.h"
@@ -11,39 +12,77 @@
 #include "NumberParser.h"
 
 #include "Utils.h"
+#include "ParseException.h"
+#include "../model/Config.h"
 
 using namespace JsonMax;
 
-Element JsonMax::parse(const std::string &json) {
-    return Parser(json).parse();
+namespace {
+
+    /// Longest excerpt of the json that a ParseError keeps
+    const size_t maxExcerptLength = 32;
+
+}
+
+Element JsonMax::parse(const std::string &json, MemoryResource *resource, Storage storage) {
+    return Parser(json, resource, storage).parse();
 }
 
-Element JsonMax::parseFile(const std::string &fileName) {
+ParseError JsonMax::parse(const std::string &json, Element &result, MemoryResource *resource, Storage storage) {
+    return Parser(json, resource, storage).parse(result);
+}
+
+Element JsonMax::parseFile(const std::string &fileName, MemoryResource *resource, Storage storage) {
     std::string fileContent = Utils::fileToString(fileName);
-    return parse(fileContent);
+    return parse(fileContent, resource, storage);
+}
+
+Element JsonMax::parseWithSource(const std::string &json, MemoryResource *resource, Storage storage) {
+    // The copy itself comes from the resource, its characters don't, just like the strings of elements
+    std::shared_ptr<const std::string> source =
+            std::allocate_shared<std::string>(Allocator<std::string>(resource), json);
+    return Parser(*source, 0, source->size(), resource, nullptr, source, storage).parse();
 }
 
 Element Parser::parse() {
+    Element element = parseElement();
+    if (failed()) {
+        JSONMAX_THROW(ParseException(*error, json));
+    }
+    return element;
+}
+
+ParseError Parser::parse(Element &result) {
+    Element element = parseElement();
+    if (not failed()) {
+        result = std::move(element);
+    }
+    return *error;
+}
+
+Element Parser::parseElement() {
     trim();
     size_t size = remainingSize();
 
+    Element element(memoryResource);
     if (size == 0) {
-        return Element();
-    } else if (size == 4 and json.substr(index, size) == "true") {
-        return Element(true);
-    } else if (size == 5 and json.substr(index, size) == "false") {
-        return Element(false);
-    } else if (size == 4 and json.substr(index, size) == "null") {
-        return Element(nullptr);
+        return element;
+    } else if (size == 4 and json.compare(index, size, "true") == 0) {
+        element = true;
+    } else if (size == 5 and json.compare(index, size, "false") == 0) {
+        element = false;
+    } else if (size == 4 and json.compare(index, size, "null") == 0) {
+        element = nullptr;
     } else if (currentSymbol() == '{') {
-        return ObjectParser(json, index, endIndex).parse();
+        return ObjectParser(json, index, endIndex, memoryResource, error, source, storage).parseElement();
     } else if (currentSymbol() == '[') {
-        return ArrayParser(json, index, endIndex).parse();
+        return ArrayParser(json, index, endIndex, memoryResource, error, source, storage).parseElement();
     } else if (currentSymbol() == '"') {
-        return StringParser(json, index, endIndex).parse();
+        return StringParser(json, index, endIndex, memoryResource, error).parseElement();
     } else {
-        return NumberParser(json, index, endIndex).parse();
+        return NumberParser(json, index, endIndex, memoryResource, error).parseElement();
     }
+    return element;
 }
 
 void Parser::moveToNonEmptyPosition() {
@@ -86,6 +125,8 @@ size_t Parser::findIndexAfterElement(char symbol) {
             skip = false;
             continue;
         } else if (inString) {
+            // An escaped quotation mark doesn't end the string
+            skip = current == '\\';
             inString = current != '"';
             continue;
         }
@@ -120,6 +161,18 @@ const std::string& Parser::getJson() const {
     return json;
 }
 
+MemoryResource* Parser::getResource() const {
+    return memoryResource;
+}
+
+const std::shared_ptr<const std::string> &Parser::getSource() const {
+    return source;
+}
+
+Storage Parser::getStorage() const {
+    return storage;
+}
+
 size_t Parser::currentPosition() const {
     return index;
 }
@@ -140,6 +193,28 @@ char Parser::currentSymbol() const {
     return getJson().at(currentPosition());
 }
 
-void Parser::throwException(const std::string &msg) const {
-    throw ParseException(msg, getJson(), currentPosition());
+void Parser::fail(ParseErrorCode code) {
+    // Only the first error is kept, the parsers of the enclosing elements stop right after it
+    if (failed()) {
+        return;
+    }
+    // The rest of the element is the excerpt, long ones are cut without splitting a character
+    size_t remaining = index < endIndex ? endIndex - index : 0;
+    size_t length = std::min(remaining, maxExcerptLength);
+    while (length < remaining and length > 0 and (json[index + length] & 0xC0) == 0x80) {
+        length--;
+    }
+    std::string excerpt = json.substr(std::min(index, json.size()), length);
+    if (length < remaining) {
+        excerpt += "...";
+    }
+    *error = ParseError(code, currentPosition(), std::move(excerpt));
+}
+
+bool Parser::failed() const {
+    return error->getCode() != PARSE_SUCCESS;
+}
+
+ParseError *Parser::getError() const {
+    return error;
 }
@@ -5,23 +5,54 @@
 #ifndef JSONMAX_JSONPARSER_H
 #define JSONMAX_JSONPARSER_H
 
+#include <memory>
 #include "../model/Element.h"
 #include "../model/Object.h"
+#include "ParseError.h"
 
 namespace JsonMax {
 
     /**
      * Parses a given string into a json element (object, array, int,...)
      * @param json string
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result, SHAPED shares the keys of objects that have the same ones
      * @return JSON Element, use appropriate getter to get the value
      */
-    Element parse(const std::string& json);
+    Element parse(const std::string& json, MemoryResource* resource = defaultResource(), Storage storage = ADAPTIVE);
+
+    /**
+     * Parses a given string into a json element without throwing
+     * @param json string
+     * @param result receives the parsed element, it is left untouched if the json is invalid
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result
+     * @return the error, evaluates to false if the json is valid
+     */
+    ParseError parse(const std::string& json, Element& result, MemoryResource* resource = defaultResource(),
+                     Storage storage = ADAPTIVE);
 
     /**
      * @param fileName the name of the file
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result
      * @return JSON Element parsed from file
      */
-    Element parseFile(const std::string& fileName);
+    Element parseFile(const std::string& fileName, MemoryResource* resource = defaultResource(),
+                      Storage storage = ADAPTIVE);
+
+    /**
+     * Parses a given string and keeps a copy of it, every object remembers its slice of the text
+     * Objects that are not changed afterwards are written as that slice, see Writer. Only objects keep a slice:
+     * arrays and values are written from their enclosing object's slice, a top level array or value is always
+     * written afresh. An object lets go of the copy when it is changed, the copy is freed with the last one.
+     * @param json string
+     * @param resource memory resource used for every string, object and array in the result
+     * @param storage storage of every object in the result
+     * @return JSON Element parsed from the string
+     */
+    Element parseWithSource(const std::string& json, MemoryResource* resource = defaultResource(),
+                            Storage storage = ADAPTIVE);
 
 
     /**
@@ -33,13 +64,32 @@ namespace JsonMax {
     public:
 
         /// Constructor, stores the reference of a JSON string
-        explicit Parser(const std::string& str) : Parser(str, 0, str.size()) {}
+        explicit Parser(const std::string& str, MemoryResource* resource = defaultResource(),
+                        Storage storage = ADAPTIVE)
+                : Parser(str, 0, str.size(), resource, nullptr, nullptr, storage) {}
+
+        /**
+         * Constructor, takes JSON but also the start and end positions (end position is not including)
+         * Errors are reported to the given ParseError, which is shared by the parsers of nested elements
+         * If a source is given, it holds the json and the parsed objects keep their slice of it
+         * The parsed objects get the given storage
+         */
+        Parser(const std::string& str, size_t start, size_t end, MemoryResource* resource = defaultResource(),
+               ParseError* parseError = nullptr, const std::shared_ptr<const std::string>& _source = nullptr,
+               Storage _storage = ADAPTIVE)
+                : json(str), index(start), endIndex(end), memoryResource(resource),
+                  error(parseError ? parseError : &ownError), source(_source), storage(_storage) {}
+
+        virtual ~Parser() = default;
 
-        /// Constructor, takes JSON but also the start and end positions (end position is not including)
-        Parser(const std::string& str, size_t start, size_t end) : json(str), index(start), endIndex(end) {}
+        /// Parses the stored json, throws a ParseException if it is not valid
+        Element parse();
 
-        /// Parses the stored json
-        virtual Element parse();
+        /// Parses the stored json into the given element, returns the error instead of throwing
+        ParseError parse(Element& result);
+
+        /// Parses the stored json, stops at the first error and reports it without throwing
+        virtual Element parseElement();
 
     protected:
 
@@ -56,12 +106,27 @@ namespace JsonMax {
          */
         size_t findIndexAfterElement(char symbol);
 
-        /// Throws a parsing exception with a given message
-        void throwException(const std::string& msg) const;
+        /// Reports an error at the current position, the caller stops parsing
+        void fail(ParseErrorCode code);
+
+        /// @return true if an error was reported
+        bool failed() const;
+
+        /// Returns the error reported to this parser
+        ParseError* getError() const;
 
         /// Returns the stored json
         const std::string& getJson() const;
 
+        /// Returns the memory resource for the parsed elements
+        MemoryResource* getResource() const;
+
+        /// Returns the source kept by the parsed objects, empty if they don't keep one
+        const std::shared_ptr<const std::string>& getSource() const;
+
+        /// Returns the storage of the parsed objects
+        Storage getStorage() const;
+
         /// Remaining characters in the json, includes the current position
         size_t remainingSize() const;
 
@@ -100,6 +165,21 @@ namespace JsonMax {
         /// One after the last index of the json
         size_t endIndex;
 
+        /// Memory resource for the parsed elements
+        MemoryResource* memoryResource;
+
+        /// Error of the whole parse, shared with the parsers of nested elements
+        ParseError* error;
+
+        /// Error used when no shared one is given
+        ParseError ownError;
+
+        /// Shared copy of the json for parseWithSource, empty otherwise
+        std::shared_ptr<const std::string> source;
+
+        /// Storage of the parsed objects
+        Storage storage;
+
     };
 
 }
@@ -5,61 +5,115 @@
 #include "StringParser.h"
 #include "ParseException.h"
 
-using namespace JsonMax;
+#include <cstring>
+#include <cstdint>
 
-Element StringParser::parse() {
-    trim();
-    if (not isValidString()) {
-        throwException("Invalid Json, string is invalid as per Json rules.");
-    }
-    // pos + 1 and size - 2 to erase quotation
-    return getJson().substr(currentPosition() + 1, remainingSize() - 2);
-}
-
-bool StringParser::isValidString() {
-    size_t startPosition = currentPosition();
+using namespace JsonMax;
 
-    if (remainingSize() < 2 or currentSymbol() != '"' or getJson().at(lastPosition()) != '"') {
-        return false;
-    }
-    incrementPosition();
+namespace {
 
-    bool escape = false;
-    while (not endOfParsing()) {
-        if (escape) {
-            if (not isEscapedPartCorrect()) {
+    /// Reads 4 hexadecimal digits, moves the position past them
+    bool readCodeUnit(const char *&position, const char *end, uint32_t &unit) {
+        if (end - position < 4) {
+            return false;
+        }
+        unit = 0;
+        for (int i = 0; i < 4; i++) {
+            char digit = *position++;
+            unit <<= 4;
+            if (digit >= '0' and digit <= '9') {
+                unit |= static_cast<uint32_t>(digit - '0');
+            } else if (digit >= 'a' and digit <= 'f') {
+                unit |= static_cast<uint32_t>(digit - 'a' + 10);
+            } else if (digit >= 'A' and digit <= 'F') {
+                unit |= static_cast<uint32_t>(digit - 'A' + 10);
+            } else {
                 return false;
             }
-            escape = false;
-        } else if (currentSymbol() == '\\') {
-            escape = true;
-        } else if (currentSymbol() == '\"' and currentPosition() != lastPosition()) {
-            return false;
         }
-        incrementPosition();
+        return true;
+    }
+
+    void appendUtf8(std::string &result, uint32_t code) {
+        if (code < 0x80) {
+            result += static_cast<char>(code);
+        } else if (code < 0x800) {
+            result += static_cast<char>(0xc0 | (code >> 6));
+            result += static_cast<char>(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            result += static_cast<char>(0xe0 | (code >> 12));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            result += static_cast<char>(0x80 | (code & 0x3f));
+        } else {
+            result += static_cast<char>(0xf0 | (code >> 18));
+            result += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+            result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            result += static_cast<char>(0x80 | (code & 0x3f));
+        }
     }
-    setPosition(startPosition);
-    return true;
-}
 
+}
 
-bool StringParser::isHexadecimalCorrect() {
-    if (currentPosition() + 4 > lastPosition()) {
-        return false;
+Element StringParser::parseElement() {
+    trim();
+    std::string value;
+    if (remainingSize() < 2 or currentSymbol() != '"' or getJson().at(lastPosition()) != '"' or
+        not unescape(getJson().data() + currentPosition() + 1, getJson().data() + lastPosition(), value)) {
+        fail(INVALID_STRING);
+        return Element(getResource());
     }
-    incrementPosition();
-    const static std::string hexa = "0123456789abcdefABCDEF";
-    size_t result = getJson().find_first_not_of(hexa.c_str(), currentPosition(), 4);
-    return result != std::string::npos;
+    Element element(getResource());
+    element = value;
+    return element;
 }
 
+bool StringParser::unescape(const char *position, const char *end, std::string &result) {
+    result.clear();
+    result.reserve(static_cast<size_t>(end - position));
+    while (position != end) {
+        // Everything up to the next backslash is copied at once
+        auto backslash = static_cast<const char *>(std::memchr(position, '\\', static_cast<size_t>(end - position)));
+        const char *runEnd = backslash ? backslash : end;
+        if (std::memchr(position, '"', static_cast<size_t>(runEnd - position))) {
+            return false;
+        }
+        result.append(position, runEnd);
+        if (not backslash) {
+            return true;
+        }
 
-bool StringParser::isEscapedPartCorrect() {
-    // Allowed chars after escape
-    const static std::string allowed = "\"\\/bfnrtu";
-    if (allowed.find(currentSymbol()) == std::string::npos) {
-        return false;
+        position = backslash + 1;
+        if (position == end) {
+            return false;
+        }
+        switch (*position++) {
+            case '"': result += '"'; break;
+            case '\\': result += '\\'; break;
+            case '/': result += '/'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'n': result += '\n'; break;
+            case 'r': result += '\r'; break;
+            case 't': result += '\t'; break;
+            case 'u': {
+                uint32_t code;
+                if (not readCodeUnit(position, end, code)) {
+                    return false;
+                }
+                // A high surrogate followed by a low one encodes a code point above 0xffff
+                const char *next = position + 2;
+                uint32_t low;
+                if (code >= 0xd800 and code < 0xdc00 and end - position >= 6 and position[0] == '\\' and
+                    position[1] == 'u' and readCodeUnit(next, end, low) and low >= 0xdc00 and low < 0xe000) {
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    position = next;
+                }
+                appendUtf8(result, code);
+                break;
+            }
+            default:
+                return false;
+        }
     }
-    // u has to be followed by 4 hexadecimal units
-    return currentSymbol() != 'u' or isHexadecimalCorrect();
+    return true;
 }
@@ -14,22 +14,21 @@ namespace JsonMax {
 
     /**
      * Parses JSON strings
-     * Mainly checks if they adhere to the standard
+     * Checks if they adhere to the standard and decodes the escape sequences, unicode escapes become UTF-8
      */
     class StringParser : public Parser {
     public:
 
-        StringParser(const std::string &str, size_t start, size_t end) : Parser(str, start, end) {}
+        StringParser(const std::string& str, size_t start, size_t end, MemoryResource* resource, ParseError* error)
+                : Parser(str, start, end, resource, error) {}
 
-        Element parse() override;
+        Element parseElement() override;
 
-    protected:
-
-        bool isValidString();
-
-        bool isHexadecimalCorrect();
-
-        bool isEscapedPartCorrect();
+        /**
+         * Decodes the characters between the quotation marks of a json string
+         * @return false if an escape sequence is invalid or an unescaped quotation mark is found
+         */
+        static bool unescape(const char *begin, const char *end, std::string &result);
 
     };
 
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <sstream>
 #include "ParseException.h"
+#include "../model/Config.h"
 
 namespace JsonMax {
 
@@ -17,7 +18,7 @@ namespace JsonMax {
         std::string fileToString(const std::string &fileName) {
             std::ifstream in(fileName);
             if (not in.good()) {
-                throw ParseException("Couldn't open " + fileName, "", 0);
+                JSONMAX_THROW(ParseException("Couldn't open " + fileName, "", 0));
             }
             std::ostringstream stream;
             stream << in.rdbuf();
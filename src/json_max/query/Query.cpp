@@ -0,0 +1,749 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "Query.h"
+#include "../model/Object.h"
+#include "../model/ObjectIterator.h"
+#include "../model/Utils.h"
+#include "../model/Config.h"
+
+#include <cstdlib>
+#include <climits>
+#include <cctype>
+
+using namespace JsonMax;
+
+namespace {
+
+    /// Marks a missing start, end or step of a slice
+    const int64_t unsetBound = INT64_MIN;
+
+    /// Operand on the stack of a filter
+    struct Operand {
+        /// Value of a path or literal, nullptr if the path doesn't exist or the operand is a truth value
+        const Element *element;
+
+        /// Whether the operand counts as true in && || and !
+        bool truth;
+    };
+
+    bool isNumber(const Element *element) {
+        return element->isInt() or element->isDouble();
+    }
+
+    double toNumber(const Element *element) {
+        return element->isInt() ? element->getInt() : element->getDouble();
+    }
+
+    /// Equality of two operands, two missing values are equal
+    bool queryEqual(const Element *left, const Element *right) {
+        if (not left or not right) {
+            return left == right;
+        }
+        if (isNumber(left) and isNumber(right)) {
+            return toNumber(left) == toNumber(right);
+        }
+        if (left->getType() != right->getType()) {
+            return false;
+        }
+        switch (left->getType()) {
+            case STRING:
+                return left->getString() == right->getString();
+            case BOOLEAN:
+                return left->getBool() == right->getBool();
+            case JSON_NULL:
+                return true;
+            default:
+                // Objects and arrays only equal themselves
+                return left == right;
+        }
+    }
+
+    /// Strict ordering of two operands, only numbers and strings can be ordered
+    bool queryLess(const Element *left, const Element *right) {
+        if (not left or not right) {
+            return false;
+        }
+        if (isNumber(left) and isNumber(right)) {
+            return toNumber(left) < toNumber(right);
+        }
+        if (left->isString() and right->isString()) {
+            return left->getString() < right->getString();
+        }
+        return false;
+    }
+
+}
+
+/// Compiles an expression into the program of a query, see compileQuery
+class JsonMax::QueryCompiler {
+public:
+
+    QueryCompiler(const std::string &_expression, Query &_query)
+            : expression(_expression), query(_query), position(0), depth(0) {
+        query.expression = expression;
+    }
+
+    void compile() {
+        skipSpaces();
+        expect('$');
+        while (true) {
+            skipSpaces();
+            if (position == expression.size()) {
+                return;
+            }
+            if (consume("..")) {
+                emit(Query::DESCEND);
+                if (peek('[')) {
+                    compileBracket();
+                } else if (consume("*")) {
+                    emit(Query::WILDCARD);
+                } else {
+                    emitChild(parseName());
+                }
+            } else if (consume(".")) {
+                if (consume("*")) {
+                    emit(Query::WILDCARD);
+                } else {
+                    emitChild(parseName());
+                }
+            } else if (peek('[')) {
+                compileBracket();
+            } else {
+                fail("expected '.' or '['");
+            }
+        }
+    }
+
+private:
+
+    using Instruction = Query::Instruction;
+
+    [[noreturn]] void fail(const std::string &message) const {
+        JSONMAX_THROW(QueryException(message, expression, position));
+    }
+
+    void skipSpaces() {
+        while (position < expression.size() and
+               (expression[position] == ' ' or expression[position] == '\t' or
+                expression[position] == '\n' or expression[position] == '\r')) {
+            position++;
+        }
+    }
+
+    bool peek(char c) const {
+        return position < expression.size() and expression[position] == c;
+    }
+
+    bool consume(const char *token) {
+        size_t length = std::char_traits<char>::length(token);
+        if (expression.compare(position, length, token) != 0) {
+            return false;
+        }
+        position += length;
+        return true;
+    }
+
+    void expect(char c) {
+        if (not peek(c)) {
+            fail(std::string("expected '") + c + "'");
+        }
+        position++;
+    }
+
+    static Instruction instruction(Query::Opcode opcode, uint32_t operand = 0, int64_t first = 0,
+                                   int64_t second = 0, int64_t third = 0) {
+        return Instruction{opcode, operand, first, second, third};
+    }
+
+    void emit(Query::Opcode opcode) {
+        query.program.push_back(instruction(opcode));
+    }
+
+    void emitChild(std::string key) {
+        query.program.push_back(childInstruction(std::move(key)));
+    }
+
+    Instruction childInstruction(std::string key) {
+        uint64_t hash = Utils::hash(key.data(), key.size());
+        query.names.push_back(Query::Name{std::move(key), hash});
+        return instruction(Query::CHILD, static_cast<uint32_t>(query.names.size() - 1));
+    }
+
+    /// Member name after a '.', letters, digits, '_', '-', '$' and any non ASCII character
+    std::string parseName() {
+        size_t start = position;
+        while (position < expression.size()) {
+            auto c = static_cast<unsigned char>(expression[position]);
+            if (not (std::isalnum(c) or c == '_' or c == '-' or c == '$' or c >= 0x80)) {
+                break;
+            }
+            position++;
+        }
+        if (start == position) {
+            fail("expected a member name");
+        }
+        return expression.substr(start, position - start);
+    }
+
+    /// String between single or double quotes
+    std::string parseString() {
+        char quote = expression[position++];
+        std::string result;
+        while (true) {
+            if (position == expression.size()) {
+                fail("unterminated string");
+            }
+            char c = expression[position++];
+            if (c == quote) {
+                return result;
+            }
+            if (c != '\\') {
+                result += c;
+                continue;
+            }
+            if (position == expression.size()) {
+                fail("unterminated string");
+            }
+            c = expression[position++];
+            switch (c) {
+                case 'n':
+                    result += '\n';
+                    break;
+                case 't':
+                    result += '\t';
+                    break;
+                case 'r':
+                    result += '\r';
+                    break;
+                case 'b':
+                    result += '\b';
+                    break;
+                case 'f':
+                    result += '\f';
+                    break;
+                case '\\':
+                case '/':
+                case '\'':
+                case '"':
+                    result += c;
+                    break;
+                default:
+                    position--;
+                    fail("invalid escape sequence");
+            }
+        }
+    }
+
+    bool peekInteger() const {
+        return position < expression.size() and
+               (expression[position] == '-' or (expression[position] >= '0' and expression[position] <= '9'));
+    }
+
+    int64_t parseInteger() {
+        bool negative = consume("-");
+        size_t start = position;
+        int64_t value = 0;
+        while (position < expression.size() and expression[position] >= '0' and expression[position] <= '9') {
+            if (position - start == 18) {
+                fail("index out of range");
+            }
+            value = value * 10 + (expression[position++] - '0');
+        }
+        if (start == position) {
+            fail("expected an integer");
+        }
+        return negative ? -value : value;
+    }
+
+    /// Selectors between '[' and ']'
+    void compileBracket() {
+        expect('[');
+        skipSpaces();
+        if (consume("*")) {
+            emit(Query::WILDCARD);
+        } else if (consume("?")) {
+            uint32_t start = compileFilter();
+            query.program.push_back(instruction(Query::FILTER, start));
+        } else {
+            std::vector<Instruction> selectors;
+            while (true) {
+                skipSpaces();
+                if (peek('\'') or peek('"')) {
+                    selectors.push_back(childInstruction(parseString()));
+                } else if (peekInteger() or peek(':')) {
+                    selectors.push_back(parseIndexOrSlice());
+                } else {
+                    fail("expected a name, index or slice");
+                }
+                skipSpaces();
+                if (not consume(",")) {
+                    break;
+                }
+            }
+
+            if (selectors.size() == 1) {
+                query.program.push_back(selectors[0]);
+            } else {
+                for (const Instruction &selector: selectors) {
+                    if (selector.opcode == Query::SLICE) {
+                        fail("slices can't be combined with other selectors");
+                    }
+                }
+                query.program.push_back(instruction(Query::UNION, 0, query.selectors.size(), selectors.size()));
+                query.selectors.insert(query.selectors.end(), selectors.begin(), selectors.end());
+            }
+        }
+        skipSpaces();
+        expect(']');
+    }
+
+    Instruction parseIndexOrSlice() {
+        int64_t start = peekInteger() ? parseInteger() : unsetBound;
+        skipSpaces();
+        if (not consume(":")) {
+            if (start == unsetBound) {
+                fail("expected an index");
+            }
+            return instruction(Query::INDEX, 0, start);
+        }
+        skipSpaces();
+        int64_t end = peekInteger() ? parseInteger() : unsetBound;
+        int64_t step = unsetBound;
+        skipSpaces();
+        if (consume(":")) {
+            skipSpaces();
+            step = peekInteger() ? parseInteger() : unsetBound;
+        }
+        return instruction(Query::SLICE, 0, start, end, step);
+    }
+
+    /// Compiles the filter expression after '?', returns the index of its first instruction
+    uint32_t compileFilter() {
+        auto start = static_cast<uint32_t>(query.filters.size());
+        depth = 0;
+        compileOr();
+        emitFilter(Query::RETURN);
+        return start;
+    }
+
+    void emitFilter(Query::FilterOpcode opcode, uint32_t operand = 0) {
+        query.filters.push_back(Query::FilterInstruction{opcode, operand});
+    }
+
+    /// Emits an instruction that pushes an operand
+    void emitPush(Query::FilterOpcode opcode, size_t operand) {
+        if (++depth > Query::maxStack) {
+            fail("filter expression is nested too deeply");
+        }
+        emitFilter(opcode, static_cast<uint32_t>(operand));
+    }
+
+    void compileOr() {
+        compileAnd();
+        skipSpaces();
+        while (consume("||")) {
+            size_t jump = query.filters.size();
+            emitFilter(Query::OR_JUMP);
+            depth--;
+            compileAnd();
+            query.filters[jump].operand = static_cast<uint32_t>(query.filters.size());
+            skipSpaces();
+        }
+    }
+
+    void compileAnd() {
+        compileUnary();
+        skipSpaces();
+        while (consume("&&")) {
+            size_t jump = query.filters.size();
+            emitFilter(Query::AND_JUMP);
+            depth--;
+            compileUnary();
+            query.filters[jump].operand = static_cast<uint32_t>(query.filters.size());
+            skipSpaces();
+        }
+    }
+
+    void compileUnary() {
+        skipSpaces();
+        if (consume("!")) {
+            compileUnary();
+            emitFilter(Query::NOT);
+            return;
+        }
+        if (consume("(")) {
+            compileOr();
+            skipSpaces();
+            expect(')');
+            return;
+        }
+
+        compileOperand();
+        skipSpaces();
+        Query::FilterOpcode comparison;
+        if (consume("==")) {
+            comparison = Query::EQUAL;
+        } else if (consume("!=")) {
+            comparison = Query::NOT_EQUAL;
+        } else if (consume("<=")) {
+            comparison = Query::LESS_EQUAL;
+        } else if (consume(">=")) {
+            comparison = Query::GREATER_EQUAL;
+        } else if (consume("<")) {
+            comparison = Query::LESS;
+        } else if (consume(">")) {
+            comparison = Query::GREATER;
+        } else {
+            return;
+        }
+        skipSpaces();
+        compileOperand();
+        emitFilter(comparison);
+        depth--;
+    }
+
+    /// A path starting with '@' or '$', or a literal
+    void compileOperand() {
+        if (consume("@")) {
+            emitPush(Query::PUSH_RELATIVE, compilePath());
+        } else if (consume("$")) {
+            emitPush(Query::PUSH_ROOT, compilePath());
+        } else if (peek('\'') or peek('"')) {
+            emitConstant(Element(parseString()));
+        } else if (peekInteger()) {
+            emitConstant(parseNumber());
+        } else if (consume("true")) {
+            emitConstant(Element(true));
+        } else if (consume("false")) {
+            emitConstant(Element(false));
+        } else if (consume("null")) {
+            emitConstant(Element(nullptr));
+        } else {
+            fail("expected a path or a literal");
+        }
+    }
+
+    void emitConstant(Element constant) {
+        query.constants.push_back(std::move(constant));
+        emitPush(Query::PUSH_CONSTANT, query.constants.size() - 1);
+    }
+
+    Element parseNumber() {
+        size_t start = position;
+        bool fraction = false;
+        while (position < expression.size()) {
+            char c = expression[position];
+            if (c == '.' or c == 'e' or c == 'E') {
+                fraction = true;
+            } else if (not ((c >= '0' and c <= '9') or c == '-' or c == '+')) {
+                break;
+            }
+            position++;
+        }
+        std::string number = expression.substr(start, position - start);
+        char *end = nullptr;
+        if (not fraction) {
+            long long value = std::strtoll(number.c_str(), &end, 10);
+            if (end == number.c_str() + number.size() and value >= INT_MIN and value <= INT_MAX) {
+                return Element(static_cast<int>(value));
+            }
+        }
+        double value = std::strtod(number.c_str(), &end);
+        if (end != number.c_str() + number.size()) {
+            position = start;
+            fail("invalid number");
+        }
+        return Element(value);
+    }
+
+    /// Member names and indexes after '@' or '$' in a filter, compiled into a Path
+    size_t compilePath() {
+        std::string pointer;
+        while (true) {
+            std::string key;
+            if (consume(".")) {
+                key = parseName();
+            } else if (peek('[')) {
+                position++;
+                skipSpaces();
+                if (peek('\'') or peek('"')) {
+                    key = parseString();
+                } else if (peekInteger()) {
+                    int64_t index = parseInteger();
+                    if (index < 0) {
+                        fail("negative indexes are not supported in filter paths");
+                    }
+                    key = std::to_string(index);
+                } else {
+                    fail("expected a name or index");
+                }
+                skipSpaces();
+                expect(']');
+            } else {
+                break;
+            }
+
+            pointer += '/';
+            for (char c: key) {
+                if (c == '~') {
+                    pointer += "~0";
+                } else if (c == '/') {
+                    pointer += "~1";
+                } else {
+                    pointer += c;
+                }
+            }
+        }
+        query.paths.emplace_back(pointer);
+        return query.paths.size() - 1;
+    }
+
+    const std::string &expression;
+
+    Query &query;
+
+    /// Current position in the expression
+    size_t position;
+
+    /// Amount of operands on the stack of the filter being compiled
+    size_t depth;
+
+};
+
+Query JsonMax::compileQuery(const std::string &expression) {
+    Query query;
+    QueryCompiler(expression, query).compile();
+    return query;
+}
+
+void Query::evaluate(const Element &root, const Callback &callback) const {
+    run(0, root, root, [&callback](const Element &match) {
+        callback(match);
+        return true;
+    });
+}
+
+std::vector<const Element *> Query::select(const Element &root) const {
+    std::vector<const Element *> matches;
+    run(0, root, root, [&matches](const Element &match) {
+        matches.push_back(&match);
+        return true;
+    });
+    return matches;
+}
+
+const Element *Query::first(const Element &root) const {
+    const Element *result = nullptr;
+    run(0, root, root, [&result](const Element &match) {
+        result = &match;
+        return false;
+    });
+    return result;
+}
+
+size_t Query::count(const Element &root) const {
+    size_t amount = 0;
+    run(0, root, root, [&amount](const Element &) {
+        amount++;
+        return true;
+    });
+    return amount;
+}
+
+const std::string &Query::toString() const {
+    return expression;
+}
+
+bool Query::run(size_t pc, const Element &node, const Element &root, const Visitor &visit) const {
+    if (pc == program.size()) {
+        return visit(node);
+    }
+
+    const Instruction &instruction = program[pc];
+    switch (instruction.opcode) {
+        case CHILD:
+        case INDEX:
+            return runSelector(instruction, pc + 1, node, root, visit);
+        case WILDCARD:
+            return runChildren(pc + 1, node, root, visit);
+        case SLICE: {
+            if (not node.isArray()) {
+                return true;
+            }
+            const Array &array = node.getArray();
+            auto size = static_cast<int64_t>(array.size());
+            int64_t step = instruction.third == unsetBound ? 1 : instruction.third;
+            auto bound = [size](int64_t index, int64_t lowest, int64_t highest) {
+                index = index < 0 ? size + index : index;
+                return index < lowest ? lowest : (index > highest ? highest : index);
+            };
+            if (step > 0) {
+                int64_t lower = instruction.first == unsetBound ? 0 : bound(instruction.first, 0, size);
+                int64_t upper = instruction.second == unsetBound ? size : bound(instruction.second, 0, size);
+                for (int64_t i = lower; i < upper; i += step) {
+                    if (not run(pc + 1, array[i], root, visit)) {
+                        return false;
+                    }
+                }
+            } else if (step < 0) {
+                int64_t upper = instruction.first == unsetBound ? size - 1 : bound(instruction.first, -1, size - 1);
+                int64_t lower = instruction.second == unsetBound ? -1 : bound(instruction.second, -1, size - 1);
+                for (int64_t i = upper; i > lower; i += step) {
+                    if (not run(pc + 1, array[i], root, visit)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+        case UNION:
+            for (int64_t i = instruction.first; i < instruction.first + instruction.second; i++) {
+                if (not runSelector(selectors[i], pc + 1, node, root, visit)) {
+                    return false;
+                }
+            }
+            return true;
+        case DESCEND:
+            // The rest of the program runs on the node itself, then this instruction runs again on every child
+            if (not run(pc + 1, node, root, visit)) {
+                return false;
+            }
+            return runChildren(pc, node, root, visit);
+        case FILTER:
+            if (node.isObject()) {
+                for (const auto &member: static_cast<const Object &>(node.getObject())) {
+                    if (matches(instruction.operand, member.getValue(), root) and
+                        not run(pc + 1, member.getValue(), root, visit)) {
+                        return false;
+                    }
+                }
+            } else if (node.isArray()) {
+                for (const Element &element: node.getArray()) {
+                    if (matches(instruction.operand, element, root) and not run(pc + 1, element, root, visit)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+    }
+    return true;
+}
+
+bool Query::runChildren(size_t pc, const Element &node, const Element &root, const Visitor &visit) const {
+    if (node.isObject()) {
+        for (const auto &member: static_cast<const Object &>(node.getObject())) {
+            if (not run(pc, member.getValue(), root, visit)) {
+                return false;
+            }
+        }
+    } else if (node.isArray()) {
+        for (const Element &element: node.getArray()) {
+            if (not run(pc, element, root, visit)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Query::runSelector(const Instruction &selector, size_t pc, const Element &node, const Element &root,
+                        const Visitor &visit) const {
+    if (selector.opcode == CHILD) {
+        if (not node.isObject()) {
+            return true;
+        }
+        const Name &name = names[selector.operand];
+        const Element *child = node.getObject().lookup(name.key, name.hash);
+        if (not child or child->getType() == UNINITIALIZED) {
+            return true;
+        }
+        return run(pc, *child, root, visit);
+    }
+
+    if (not node.isArray()) {
+        return true;
+    }
+    const Array &array = node.getArray();
+    int64_t index = selector.first < 0 ? static_cast<int64_t>(array.size()) + selector.first : selector.first;
+    if (index < 0 or index >= static_cast<int64_t>(array.size())) {
+        return true;
+    }
+    return run(pc, array[index], root, visit);
+}
+
+bool Query::matches(uint32_t start, const Element &node, const Element &root) const {
+    Operand stack[maxStack];
+    size_t top = 0;
+    for (uint32_t pc = start;; pc++) {
+        const FilterInstruction &instruction = filters[pc];
+        switch (instruction.opcode) {
+            case PUSH_RELATIVE:
+            case PUSH_ROOT: {
+                const Element *element = paths[instruction.operand].resolve(
+                        instruction.opcode == PUSH_RELATIVE ? node : root);
+                stack[top++] = Operand{element, element != nullptr};
+                break;
+            }
+            case PUSH_CONSTANT: {
+                const Element &constant = constants[instruction.operand];
+                stack[top++] = Operand{&constant, not constant.isNull() and not (constant.isBool() and
+                                                                                   not constant.getBool())};
+                break;
+            }
+            case EQUAL:
+            case NOT_EQUAL:
+            case LESS:
+            case LESS_EQUAL:
+            case GREATER:
+            case GREATER_EQUAL: {
+                const Element *left = stack[top - 2].element;
+                const Element *right = stack[top - 1].element;
+                bool result;
+                switch (instruction.opcode) {
+                    case EQUAL:
+                        result = queryEqual(left, right);
+                        break;
+                    case NOT_EQUAL:
+                        result = not queryEqual(left, right);
+                        break;
+                    case LESS:
+                        result = queryLess(left, right);
+                        break;
+                    case LESS_EQUAL:
+                        result = queryLess(left, right) or (left and right and queryEqual(left, right));
+                        break;
+                    case GREATER:
+                        result = queryLess(right, left);
+                        break;
+                    default:
+                        result = queryLess(right, left) or (left and right and queryEqual(left, right));
+                        break;
+                }
+                top--;
+                stack[top - 1] = Operand{nullptr, result};
+                break;
+            }
+            case NOT:
+                stack[top - 1] = Operand{nullptr, not stack[top - 1].truth};
+                break;
+            case AND_JUMP:
+                if (not stack[top - 1].truth) {
+                    pc = instruction.operand - 1;
+                } else {
+                    top--;
+                }
+                break;
+            case OR_JUMP:
+                if (stack[top - 1].truth) {
+                    pc = instruction.operand - 1;
+                } else {
+                    top--;
+                }
+                break;
+            case RETURN:
+                return stack[top - 1].truth;
+        }
+    }
+}
@@ -0,0 +1,162 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_QUERY_H
+#define JSONMAX_QUERY_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include "../model/Element.h"
+#include "../model/Path.h"
+
+namespace JsonMax {
+
+    /// Forward declaration
+    class QueryCompiler;
+
+    /// Invalid JSONPath expression
+    class QueryException : public std::runtime_error {
+    public:
+
+        QueryException(const std::string &message, const std::string &expression, size_t position)
+                : std::runtime_error("Invalid JSONPath '" + expression + "' at position " +
+                                     std::to_string(position) + ": " + message) {}
+
+    };
+
+    /**
+     * Compiled JSONPath expression, see compileQuery
+     * The expression is compiled into a small program: one instruction per step of the path,
+     * and a stack based bytecode for the filter expressions.
+     * Evaluating it hands every match to a callback as soon as it is found, no intermediate arrays are built.
+     * A query is immutable and can be evaluated from multiple threads at once.
+     */
+    class Query {
+    public:
+
+        /// Called for every match, in document order
+        using Callback = std::function<void(const Element &)>;
+
+        /// Evaluates the query on the given document and calls the callback for every match
+        void evaluate(const Element &root, const Callback &callback) const;
+
+        /// @return pointers to all matches, in document order
+        std::vector<const Element *> select(const Element &root) const;
+
+        /// @return the first match, nullptr if there is none (stops evaluating once it is found)
+        const Element *first(const Element &root) const;
+
+        /// @return amount of matches
+        size_t count(const Element &root) const;
+
+        /// @return the expression the query was compiled from
+        const std::string &toString() const;
+
+    private:
+
+        friend class QueryCompiler;
+
+        /// Steps of the path
+        enum Opcode : uint8_t {
+            CHILD,          // member with name operand
+            INDEX,          // array element at index first, negative counts from the end
+            WILDCARD,       // every member or array element
+            SLICE,          // array elements from first to second (exclusive) with step third
+            UNION,          // the selectors from first, second of them
+            DESCEND,        // the node itself and all its descendants
+            FILTER          // every member or array element for which the filter at operand holds
+        };
+
+        /// Filter bytecode, evaluated on a stack of operands
+        enum FilterOpcode : uint8_t {
+            PUSH_RELATIVE,  // value of path operand, relative to the current node
+            PUSH_ROOT,      // value of path operand, relative to the document
+            PUSH_CONSTANT,  // constant operand
+            EQUAL,
+            NOT_EQUAL,
+            LESS,
+            LESS_EQUAL,
+            GREATER,
+            GREATER_EQUAL,
+            NOT,
+            AND_JUMP,       // jumps to operand if the top is false, pops it otherwise
+            OR_JUMP,        // jumps to operand if the top is true, pops it otherwise
+            RETURN          // result is the top of the stack
+        };
+
+        struct Instruction {
+            Opcode opcode;
+            uint32_t operand;
+            int64_t first;
+            int64_t second;
+            int64_t third;
+        };
+
+        struct FilterInstruction {
+            FilterOpcode opcode;
+            uint32_t operand;
+        };
+
+        /// Name of a member, hashed when compiling
+        struct Name {
+            std::string key;
+            uint64_t hash;
+        };
+
+        /// Size of the operand stack, comparisons use two and && || pop the left operand before pushing the right one
+        static const size_t maxStack = 4;
+
+        /// Visits the matches, returns false to stop
+        using Visitor = std::function<bool(const Element &)>;
+
+        /// Runs the program from instruction pc on the given node, returns false once the visitor stops
+        bool run(size_t pc, const Element &node, const Element &root, const Visitor &visit) const;
+
+        /// Runs the program from instruction pc on all members or array elements of the node
+        bool runChildren(size_t pc, const Element &node, const Element &root, const Visitor &visit) const;
+
+        /// Applies a CHILD or INDEX instruction to the node, then runs the program from pc
+        bool runSelector(const Instruction &selector, size_t pc, const Element &node, const Element &root,
+                         const Visitor &visit) const;
+
+        /// Evaluates the filter starting at the given instruction on the given node
+        bool matches(uint32_t start, const Element &node, const Element &root) const;
+
+        /// The original expression
+        std::string expression;
+
+        /// Steps of the path
+        std::vector<Instruction> program;
+
+        /// Selectors of the UNION instructions
+        std::vector<Instruction> selectors;
+
+        /// Filter bytecode of all filters, each ends with RETURN
+        std::vector<FilterInstruction> filters;
+
+        /// Member names of CHILD instructions
+        std::vector<Name> names;
+
+        /// Paths used in the filters
+        std::vector<Path> paths;
+
+        /// Literals used in the filters
+        std::vector<Element> constants;
+
+    };
+
+    /**
+     * Compiles a JSONPath expression, for example "$.store.book[?(@.price < 10)].title"
+     * Supports member names (dotted and bracketed), wildcards, recursive descent (..), array indexes,
+     * slices, unions of names and indexes, and filters with comparisons, &&, || and !
+     * Throws a QueryException if the expression is not valid
+     */
+    Query compileQuery(const std::string &expression);
+
+}
+
+#endif //JSONMAX_QUERY_H
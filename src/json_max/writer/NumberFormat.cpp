@@ -0,0 +1,300 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "NumberFormat.h"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+
+using namespace JsonMax;
+
+namespace {
+
+    /// Floating point number f * 2^e with a 64 bit significand, the working type of Grisu
+    struct DiyFp {
+
+        DiyFp(uint64_t _f, int _e) : f(_f), e(_e) {}
+
+        DiyFp operator-(const DiyFp &other) const {
+            return DiyFp(f - other.f, e);
+        }
+
+        /// Upper 64 bits of the product, rounded
+        DiyFp operator*(const DiyFp &other) const {
+            const uint64_t mask = 0xffffffffull;
+            uint64_t a = f >> 32, b = f & mask, c = other.f >> 32, d = other.f & mask;
+            uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+            uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask) + (1ull << 31);
+            return DiyFp(ac + (ad >> 32) + (bc >> 32) + (middle >> 32), e + other.e + 64);
+        }
+
+        /// Shifts the significand until its highest bit is set
+        DiyFp normalize() const {
+            DiyFp result = *this;
+            while (not (result.f & (1ull << 63))) {
+                result.f <<= 1;
+                result.e--;
+            }
+            return result;
+        }
+
+        uint64_t f;
+        int e;
+
+    };
+
+    const uint64_t hiddenBit = 1ull << 52;
+
+    /**
+     * Normalized powers of ten from 10^-348 to 10^340 in steps of 8, rounded to 64 bits
+     * Every Grisu multiplication uses one of them, so the product lands in a fixed binary exponent range.
+     */
+    const uint64_t cachedSignificands[] = {
+            0xfa8fd5a0081c0288ull, 0xbaaee17fa23ebf76ull, 0x8b16fb203055ac76ull,
+            0xcf42894a5dce35eaull, 0x9a6bb0aa55653b2dull, 0xe61acf033d1a45dfull,
+            0xab70fe17c79ac6caull, 0xff77b1fcbebcdc4full, 0xbe5691ef416bd60cull,
+            0x8dd01fad907ffc3cull, 0xd3515c2831559a83ull, 0x9d71ac8fada6c9b5ull,
+            0xea9c227723ee8bcbull, 0xaecc49914078536dull, 0x823c12795db6ce57ull,
+            0xc21094364dfb5637ull, 0x9096ea6f3848984full, 0xd77485cb25823ac7ull,
+            0xa086cfcd97bf97f4ull, 0xef340a98172aace5ull, 0xb23867fb2a35b28eull,
+            0x84c8d4dfd2c63f3bull, 0xc5dd44271ad3cdbaull, 0x936b9fcebb25c996ull,
+            0xdbac6c247d62a584ull, 0xa3ab66580d5fdaf6ull, 0xf3e2f893dec3f126ull,
+            0xb5b5ada8aaff80b8ull, 0x87625f056c7c4a8bull, 0xc9bcff6034c13053ull,
+            0x964e858c91ba2655ull, 0xdff9772470297ebdull, 0xa6dfbd9fb8e5b88full,
+            0xf8a95fcf88747d94ull, 0xb94470938fa89bcfull, 0x8a08f0f8bf0f156bull,
+            0xcdb02555653131b6ull, 0x993fe2c6d07b7facull, 0xe45c10c42a2b3b06ull,
+            0xaa242499697392d3ull, 0xfd87b5f28300ca0eull, 0xbce5086492111aebull,
+            0x8cbccc096f5088ccull, 0xd1b71758e219652cull, 0x9c40000000000000ull,
+            0xe8d4a51000000000ull, 0xad78ebc5ac620000ull, 0x813f3978f8940984ull,
+            0xc097ce7bc90715b3ull, 0x8f7e32ce7bea5c70ull, 0xd5d238a4abe98068ull,
+            0x9f4f2726179a2245ull, 0xed63a231d4c4fb27ull, 0xb0de65388cc8ada8ull,
+            0x83c7088e1aab65dbull, 0xc45d1df942711d9aull, 0x924d692ca61be758ull,
+            0xda01ee641a708deaull, 0xa26da3999aef774aull, 0xf209787bb47d6b85ull,
+            0xb454e4a179dd1877ull, 0x865b86925b9bc5c2ull, 0xc83553c5c8965d3dull,
+            0x952ab45cfa97a0b3ull, 0xde469fbd99a05fe3ull, 0xa59bc234db398c25ull,
+            0xf6c69a72a3989f5cull, 0xb7dcbf5354e9beceull, 0x88fcf317f22241e2ull,
+            0xcc20ce9bd35c78a5ull, 0x98165af37b2153dfull, 0xe2a0b5dc971f303aull,
+            0xa8d9d1535ce3b396ull, 0xfb9b7cd9a4a7443cull, 0xbb764c4ca7a44410ull,
+            0x8bab8eefb6409c1aull, 0xd01fef10a657842cull, 0x9b10a4e5e9913129ull,
+            0xe7109bfba19c0c9dull, 0xac2820d9623bf429ull, 0x80444b5e7aa7cf85ull,
+            0xbf21e44003acdd2dull, 0x8e679c2f5e44ff8full, 0xd433179d9c8cb841ull,
+            0x9e19db92b4e31ba9ull, 0xeb96bf6ebadf77d9ull, 0xaf87023b9bf0ee6bull
+    };
+
+    const int16_t cachedExponents[] = {
+            -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+            -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+            -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+            -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+            56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+            375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+            694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+            1013, 1039, 1066
+    };
+
+    const uint64_t powersOfTen[] = {
+            1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull,
+            1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+            100000000000000ull, 1000000000000000ull, 10000000000000000ull, 100000000000000000ull,
+            1000000000000000000ull, 10000000000000000000ull
+    };
+
+    DiyFp diyFromDouble(double value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(double));
+        int biased = static_cast<int>((bits >> 52) & 0x7ff);
+        uint64_t significand = bits & (hiddenBit - 1);
+        if (biased) {
+            return DiyFp(significand + hiddenBit, biased - 1075);
+        }
+        return DiyFp(significand, -1074);
+    }
+
+    /// Boundaries halfway to the neighbouring doubles, both with the exponent of the normalized upper one
+    void boundaries(const DiyFp &value, DiyFp &minus, DiyFp &plus) {
+        plus = DiyFp((value.f << 1) + 1, value.e - 1).normalize();
+        minus = value.f == hiddenBit ? DiyFp((value.f << 2) - 1, value.e - 2) : DiyFp((value.f << 1) - 1, value.e - 1);
+        minus.f <<= minus.e - plus.e;
+        minus.e = plus.e;
+    }
+
+    /// @return the cached power of ten 10^-k that brings the binary exponent e into range
+    DiyFp cachedPower(int e, int &k) {
+        double estimate = (-61 - e) * 0.30102999566398114 + 347;
+        int ceiling = static_cast<int>(estimate);
+        if (estimate - ceiling > 0.0) {
+            ceiling++;
+        }
+        unsigned int index = static_cast<unsigned int>((ceiling >> 3) + 1);
+        k = -(-348 + static_cast<int>(index << 3));
+        return DiyFp(cachedSignificands[index], cachedExponents[index]);
+    }
+
+    /// Moves the last digit closer to the exact value while it stays within the boundaries
+    void grisuRound(char *digits, int length, uint64_t delta, uint64_t rest, uint64_t tenKappa, uint64_t distance) {
+        while (rest < distance and delta - rest >= tenKappa and
+               (rest + tenKappa < distance or distance - rest > rest + tenKappa - distance)) {
+            digits[length - 1]--;
+            rest += tenKappa;
+        }
+    }
+
+    /// Generates the shortest digits within the boundaries, the value is then digits * 10^k
+    void grisuDigits(const DiyFp &value, const DiyFp &upper, uint64_t delta, char *digits, int &length, int &k) {
+        const DiyFp one(1ull << -upper.e, upper.e);
+        const DiyFp distance = upper - value;
+        uint32_t integral = static_cast<uint32_t>(upper.f >> -one.e);
+        uint64_t fractional = upper.f & (one.f - 1);
+
+        int kappa = 1;
+        while (kappa < 10 and integral >= powersOfTen[kappa]) {
+            kappa++;
+        }
+        length = 0;
+
+        while (kappa > 0) {
+            uint32_t power = static_cast<uint32_t>(powersOfTen[kappa - 1]);
+            uint32_t digit = integral / power;
+            integral %= power;
+            if (digit or length) {
+                digits[length++] = static_cast<char>('0' + digit);
+            }
+            kappa--;
+            uint64_t rest = (static_cast<uint64_t>(integral) << -one.e) + fractional;
+            if (rest <= delta) {
+                k += kappa;
+                grisuRound(digits, length, delta, rest, powersOfTen[kappa] << -one.e, distance.f);
+                return;
+            }
+        }
+
+        while (true) {
+            fractional *= 10;
+            delta *= 10;
+            char digit = static_cast<char>(fractional >> -one.e);
+            if (digit or length) {
+                digits[length++] = static_cast<char>('0' + digit);
+            }
+            fractional &= one.f - 1;
+            kappa--;
+            if (fractional < delta) {
+                k += kappa;
+                int index = -kappa;
+                grisuRound(digits, length, delta, fractional, one.f, distance.f * (index < 20 ? powersOfTen[index] : 0));
+                return;
+            }
+        }
+    }
+
+    /// Writes the digits of a positive, finite and non zero value, returns the decimal exponent
+    void grisu2(double value, char *digits, int &length, int &k) {
+        const DiyFp exact = diyFromDouble(value);
+        DiyFp minus(0, 0), plus(0, 0);
+        boundaries(exact, minus, plus);
+
+        const DiyFp power = cachedPower(plus.e, k);
+        const DiyFp scaled = exact.normalize() * power;
+        DiyFp upper = plus * power;
+        DiyFp lower = minus * power;
+        // The products are rounded, so stay on the safe side of both boundaries
+        lower.f++;
+        upper.f--;
+        grisuDigits(scaled, upper, upper.f - lower.f, digits, length, k);
+    }
+
+    /// Places the decimal point, digits * 10^k becomes for example 12.5, 0.001 or 1.5e+300
+    size_t placePoint(char *buffer, int length, int k) {
+        const int point = length + k;
+
+        if (length <= point and point <= 21) {
+            // Whole number, pad with zeros
+            std::memset(buffer + length, '0', static_cast<size_t>(point - length));
+            buffer[point] = '.';
+            buffer[point + 1] = '0';
+            return static_cast<size_t>(point + 2);
+        }
+        if (0 < point and point <= 21) {
+            std::memmove(buffer + point + 1, buffer + point, static_cast<size_t>(length - point));
+            buffer[point] = '.';
+            return static_cast<size_t>(length + 1);
+        }
+        if (-6 < point and point <= 0) {
+            const int zeros = 2 - point;
+            std::memmove(buffer + zeros, buffer, static_cast<size_t>(length));
+            buffer[0] = '0';
+            buffer[1] = '.';
+            std::memset(buffer + 2, '0', static_cast<size_t>(-point));
+            return static_cast<size_t>(length + zeros);
+        }
+
+        // Exponent notation, the first digit followed by the others or by a zero
+        size_t size;
+        if (length == 1) {
+            buffer[1] = '.';
+            buffer[2] = '0';
+            size = 3;
+        } else {
+            std::memmove(buffer + 2, buffer + 1, static_cast<size_t>(length - 1));
+            buffer[1] = '.';
+            size = static_cast<size_t>(length + 1);
+        }
+        int exponent = point - 1;
+        buffer[size++] = 'e';
+        buffer[size++] = exponent < 0 ? '-' : '+';
+        if (exponent < 0) {
+            exponent = -exponent;
+        }
+        if (exponent >= 100) {
+            buffer[size++] = static_cast<char>('0' + exponent / 100);
+            exponent %= 100;
+            buffer[size++] = static_cast<char>('0' + exponent / 10);
+        } else if (exponent >= 10) {
+            buffer[size++] = static_cast<char>('0' + exponent / 10);
+        }
+        buffer[size++] = static_cast<char>('0' + exponent % 10);
+        return size;
+    }
+
+}
+
+size_t Utils::formatDouble(double value, char *buffer) {
+    if (value != value or value - value != 0) {
+        // NaN or infinity
+        std::memcpy(buffer, "null", 4);
+        return 4;
+    }
+
+    size_t sign = 0;
+    if (std::signbit(value)) {
+        buffer[sign++] = '-';
+        value = -value;
+    }
+    if (value == 0) {
+        std::memcpy(buffer + sign, "0.0", 3);
+        return sign + 3;
+    }
+
+    int length;
+    int k;
+    grisu2(value, buffer + sign, length, k);
+    return sign + placePoint(buffer + sign, length, k);
+}
+
+size_t Utils::formatInteger(int value, char *buffer) {
+    // Digits are written back to front, unsigned so the lowest int can be negated
+    char digits[maxIntegerLength];
+    char *position = digits + maxIntegerLength;
+    unsigned int number = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+    do {
+        *--position = static_cast<char>('0' + number % 10);
+        number /= 10;
+    } while (number);
+    if (value < 0) {
+        *--position = '-';
+    }
+    size_t size = static_cast<size_t>(digits + maxIntegerLength - position);
+    std::memcpy(buffer, position, size);
+    return size;
+}
@@ -0,0 +1,39 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_NUMBERFORMAT_H
+#define JSONMAX_NUMBERFORMAT_H
+
+#include <cstddef>
+
+namespace JsonMax {
+
+    namespace Utils {
+
+        /// Size of a buffer that fits every output of formatDouble
+        const size_t maxDoubleLength = 32;
+
+        /// Size of a buffer that fits every output of formatInteger
+        const size_t maxIntegerLength = 12;
+
+        /**
+         * Writes the shortest digits that parse back to exactly the same double (Grisu2)
+         * The output always contains a '.' so it is parsed as a fraction again, large and small values
+         * use an exponent, such as 1.5e+300. NaN and infinity have no json representation and are written as null.
+         * Independent of the locale.
+         * @return amount of characters written to the buffer, which needs maxDoubleLength characters
+         */
+        size_t formatDouble(double value, char *buffer);
+
+        /**
+         * Writes the decimal digits of the integer
+         * @return amount of characters written to the buffer, which needs maxIntegerLength characters
+         */
+        size_t formatInteger(int value, char *buffer);
+
+    }
+
+}
+
+#endif //JSONMAX_NUMBERFORMAT_H
@@ -0,0 +1,97 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "Output.h"
+#include "../model/Config.h"
+
+#include <vector>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+
+using namespace JsonMax;
+
+void Output::writeBlocks(const Block *blocks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        write(blocks[i].data, blocks[i].size);
+    }
+}
+
+StringOutput::StringOutput() : target(&own) {}
+
+StringOutput::StringOutput(std::string &_target) : target(&_target) {}
+
+void StringOutput::write(const char *data, size_t size) {
+    target->append(data, size);
+}
+
+std::string &StringOutput::getString() {
+    return *target;
+}
+
+StreamOutput::StreamOutput(std::ostream &_stream) : stream(_stream) {}
+
+void StreamOutput::write(const char *data, size_t size) {
+    stream.write(data, static_cast<std::streamsize>(size));
+}
+
+FileOutput::FileOutput(std::FILE *_file) : file(_file) {}
+
+void FileOutput::write(const char *data, size_t size) {
+    if (std::fwrite(data, 1, size, file) != size) {
+        JSONMAX_THROW(WriteException("Couldn't write the json to the file"));
+    }
+}
+
+#ifdef JSONMAX_POSIX
+
+DescriptorOutput::DescriptorOutput(int _descriptor) : descriptor(_descriptor) {}
+
+void DescriptorOutput::write(const char *data, size_t size) {
+    while (size) {
+        ssize_t written = ::write(descriptor, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            JSONMAX_THROW(WriteException("Couldn't write the json to the file descriptor"));
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+void DescriptorOutput::writeBlocks(const Block *blocks, size_t count) {
+    std::vector<iovec> vectors;
+    vectors.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        if (blocks[i].size) {
+            vectors.push_back(iovec{const_cast<char *>(blocks[i].data), blocks[i].size});
+        }
+    }
+
+    size_t first = 0;
+    while (first < vectors.size()) {
+        int amount = static_cast<int>(std::min<size_t>(vectors.size() - first, IOV_MAX));
+        ssize_t written = ::writev(descriptor, &vectors[first], amount);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            JSONMAX_THROW(WriteException("Couldn't write the json to the file descriptor"));
+        }
+        // Skip the blocks that were written completely, continue in the middle of a partially written one
+        auto remaining = static_cast<size_t>(written);
+        while (first < vectors.size() and remaining >= vectors[first].iov_len) {
+            remaining -= vectors[first].iov_len;
+            first++;
+        }
+        if (remaining) {
+            vectors[first].iov_base = static_cast<char *>(vectors[first].iov_base) + remaining;
+            vectors[first].iov_len -= remaining;
+        }
+    }
+}
+
+#endif
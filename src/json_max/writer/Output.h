@@ -0,0 +1,130 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_OUTPUT_H
+#define JSONMAX_OUTPUT_H
+
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include "../model/Config.h"
+
+namespace JsonMax {
+
+    /// Writing to a file failed
+    class WriteException : public std::runtime_error {
+    public:
+
+        explicit WriteException(const std::string &message) : std::runtime_error(message) {}
+
+    };
+
+    /// Destination of a Writer, receives the json in blocks of characters
+    class Output {
+    public:
+
+        /// Characters that are written together with others, see writeBlocks
+        struct Block {
+            const char *data;
+            size_t size;
+        };
+
+        virtual ~Output() = default;
+
+        /// Appends the given characters
+        virtual void write(const char *data, size_t size) = 0;
+
+        /// Appends the blocks in order, the parallel chunks of a Writer are handed over this way
+        virtual void writeBlocks(const Block *blocks, size_t count);
+
+    };
+
+    /// Output that appends to a string, either its own or one supplied by the caller
+    class StringOutput : public Output {
+    public:
+
+        /// Constructor, appends to a string owned by the output
+        StringOutput();
+
+        /// Constructor, appends to the given string, which must outlive the output
+        explicit StringOutput(std::string &target);
+
+        StringOutput(const StringOutput &) = delete;
+
+        StringOutput &operator=(const StringOutput &) = delete;
+
+        void write(const char *data, size_t size) override;
+
+        /// @return the string that is appended to
+        std::string &getString();
+
+    private:
+
+        /// Used when no string is supplied
+        std::string own;
+
+        /// String that is appended to
+        std::string *target;
+
+    };
+
+    /// Output that writes to a stream, errors set the state of the stream
+    class StreamOutput : public Output {
+    public:
+
+        /// Constructor, the stream must outlive the output
+        explicit StreamOutput(std::ostream &stream);
+
+        void write(const char *data, size_t size) override;
+
+    private:
+
+        std::ostream &stream;
+
+    };
+
+    /// Output that writes to a C file, throws a WriteException if not everything could be written
+    class FileOutput : public Output {
+    public:
+
+        /// Constructor, the file stays open and must outlive the output
+        explicit FileOutput(std::FILE *file);
+
+        void write(const char *data, size_t size) override;
+
+    private:
+
+        std::FILE *file;
+
+    };
+
+#ifdef JSONMAX_POSIX
+
+    /**
+     * Output that writes to a file descriptor, throws a WriteException if writing fails
+     * Blocks are written with a single writev call where possible. POSIX only.
+     */
+    class DescriptorOutput : public Output {
+    public:
+
+        /// Constructor, the descriptor stays open
+        explicit DescriptorOutput(int descriptor);
+
+        void write(const char *data, size_t size) override;
+
+        void writeBlocks(const Block *blocks, size_t count) override;
+
+    private:
+
+        int descriptor;
+
+    };
+
+#endif
+
+}
+
+#endif //JSONMAX_OUTPUT_H
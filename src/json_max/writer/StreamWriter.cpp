@@ -0,0 +1,159 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "StreamWriter.h"
+#include "NumberFormat.h"
+#include "../model/Config.h"
+
+using namespace JsonMax;
+
+StreamWriter::StreamWriter(Output &output, WriteOptions options) : writer(output, options), afterKey(false) {}
+
+StreamWriter &StreamWriter::startObject() {
+    beforeValue();
+    writer.append('{');
+    levels.push_back(Level{true, true});
+    return *this;
+}
+
+StreamWriter &StreamWriter::endObject() {
+    end(true, '}');
+    return *this;
+}
+
+StreamWriter &StreamWriter::startArray() {
+    beforeValue();
+    writer.append('[');
+    levels.push_back(Level{false, true});
+    return *this;
+}
+
+StreamWriter &StreamWriter::endArray() {
+    end(false, ']');
+    return *this;
+}
+
+StreamWriter &StreamWriter::key(const std::string &key) {
+    beforeKey();
+    writer.writeKey(key);
+    afterKey = true;
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(const std::string &string) {
+    beforeValue();
+    writer.writeString(string);
+    afterValue();
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(const char *string) {
+    return value(std::string(string));
+}
+
+StreamWriter &StreamWriter::value(int number) {
+    beforeValue();
+    char digits[Utils::maxIntegerLength];
+    writer.append(digits, Utils::formatInteger(number, digits));
+    afterValue();
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(double fraction) {
+    beforeValue();
+    char digits[Utils::maxDoubleLength];
+    writer.append(digits, Utils::formatDouble(fraction, digits));
+    afterValue();
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(bool boolean) {
+    beforeValue();
+    if (boolean) writer.append("true", 4);
+    else writer.append("false", 5);
+    afterValue();
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(std::nullptr_t) {
+    beforeValue();
+    writer.append("null", 4);
+    afterValue();
+    return *this;
+}
+
+StreamWriter &StreamWriter::value(const Element &element) {
+    beforeValue();
+    writer.writeValue(element);
+    afterValue();
+    return *this;
+}
+
+void StreamWriter::flush() {
+    writer.flush();
+}
+
+void StreamWriter::beforeValue() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (levels.empty()) {
+        return;
+    }
+#ifndef NDEBUG
+    if (levels.back().object) {
+        JSONMAX_THROW(WriteException("StreamWriter: a value in an object needs a key first."));
+    }
+#endif
+    if (levels.back().empty) {
+        levels.back().empty = false;
+        writer.openNesting();
+    } else {
+        writer.writeSeparator();
+    }
+}
+
+void StreamWriter::beforeKey() {
+#ifndef NDEBUG
+    if (levels.empty() or not levels.back().object) {
+        JSONMAX_THROW(WriteException("StreamWriter: keys can only be written in an object."));
+    }
+    if (afterKey) {
+        JSONMAX_THROW(WriteException("StreamWriter: the previous key has no value yet."));
+    }
+#endif
+    if (levels.back().empty) {
+        levels.back().empty = false;
+        writer.openNesting();
+    } else {
+        writer.writeSeparator();
+    }
+}
+
+void StreamWriter::end(bool object, char bracket) {
+#ifndef NDEBUG
+    if (levels.empty() or levels.back().object != object) {
+        JSONMAX_THROW(WriteException(object ? "StreamWriter: endObject without a matching startObject."
+                                            : "StreamWriter: endArray without a matching startArray."));
+    }
+    if (afterKey) {
+        JSONMAX_THROW(WriteException("StreamWriter: the last key has no value."));
+    }
+#else
+    (void) object;
+#endif
+    if (not levels.back().empty) {
+        writer.closeNesting();
+    }
+    levels.pop_back();
+    writer.append(bracket);
+    afterValue();
+}
+
+void StreamWriter::afterValue() {
+    if (levels.empty()) {
+        writer.flush();
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_STREAMWRITER_H
+#define JSONMAX_STREAMWRITER_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "../model/Element.h"
+#include "Output.h"
+#include "WriteOptions.h"
+#include "Writer.h"
+
+namespace JsonMax {
+
+    /**
+     * Writes json straight to an Output without building Objects or Arrays first
+     * Calls describe the document from front to back, such as startObject(), key("id"), value(7), endObject().
+     * Strings, numbers, separators and indentation are written exactly like the Writer writes them.
+     * Debug builds throw a WriteException when the calls don't describe valid json, release builds don't check.
+     */
+    class StreamWriter {
+    public:
+
+        /// Constructor, the output must outlive the writer
+        explicit StreamWriter(Output &output, WriteOptions options = WriteOptions());
+
+        StreamWriter &startObject();
+
+        StreamWriter &endObject();
+
+        StreamWriter &startArray();
+
+        StreamWriter &endArray();
+
+        /// Key of the next value, only in objects
+        StreamWriter &key(const std::string &key);
+
+        StreamWriter &value(const std::string &string);
+
+        StreamWriter &value(const char *string);
+
+        StreamWriter &value(int number);
+
+        StreamWriter &value(double fraction);
+
+        StreamWriter &value(bool boolean);
+
+        StreamWriter &value(std::nullptr_t);
+
+        /// Writes the element and everything it contains
+        StreamWriter &value(const Element &element);
+
+        /// Hands the buffered characters to the output, also done when a document is complete
+        void flush();
+
+    private:
+
+        /// Object or array that is being written
+        struct Level {
+            bool object;
+            bool empty;
+        };
+
+        /// Writes the separator or line break before a value or key, and checks if one is allowed
+        void beforeValue();
+
+        /// Checks if a key is allowed
+        void beforeKey();
+
+        /// Closes the current object or array
+        void end(bool object, char bracket);
+
+        /// Flushes once the outermost value is complete
+        void afterValue();
+
+        Writer writer;
+
+        /// Open objects and arrays, the innermost last
+        std::vector<Level> levels;
+
+        /// True between a key and its value
+        bool afterKey;
+
+    };
+
+}
+
+#endif //JSONMAX_STREAMWRITER_H
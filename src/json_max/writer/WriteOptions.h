@@ -0,0 +1,52 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_WRITEOPTIONS_H
+#define JSONMAX_WRITEOPTIONS_H
+
+namespace JsonMax {
+
+    /// Layout of the json written by a Writer
+    struct WriteOptions {
+
+        /// Constructor, the defaults give the same json as toString()
+        explicit WriteOptions(bool compact = false, unsigned int indent = 0, unsigned int threads = 1,
+                              bool exactSize = false);
+
+        /// Leaves out the space after every ',' and ':'
+        bool compact;
+
+        /// Spaces per nesting level, every value of a non empty object or array then gets its own line
+        unsigned int indent;
+
+        /**
+         * Threads used for large objects and arrays, see Writer::parallelThreshold
+         * Their values are split in one chunk per thread, each chunk is written to its own buffer
+         * and the buffers are handed to the output in order. The json is the same as with one thread.
+         * Only one object or array is split at a time, the containers in a chunk are written by its thread alone.
+         * No more threads are used than std::thread::hardware_concurrency.
+         */
+        unsigned int threads;
+
+        /// toString measures the json with Writer::serializedSize first, so the string is allocated exactly once
+        bool exactSize;
+
+        /**
+         * Every object keeps its json, which is written again as long as the object is unchanged
+         * A change marks the objects on the way to it (operator[], non const find, Path, insert, remove, ...)
+         * and the objects around it, so writing a large document again after a small edit only serializes
+         * the changed objects. Nested objects are referred to rather than copied, so the caches take about
+         * the size of the json. The caches come from the memory resource of each object.
+         * A value assigned through an element reference obtained before writing outdates every cache, and
+         * strings and arrays handed out by non-const reference are written again every time.
+         * Only used without indentation, and the json is then written with one thread. The same document should
+         * not be written with caching from multiple threads at once. Off by default.
+         */
+        bool cacheFragments;
+
+    };
+
+}
+
+#endif //JSONMAX_WRITEOPTIONS_H
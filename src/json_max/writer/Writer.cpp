@@ -0,0 +1,605 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "Writer.h"
+#include "../model/Object.h"
+#include "../model/ObjectIterator.h"
+#include "../model/FrozenObject.h"
+#include "NumberFormat.h"
+#include "../model/Utils.h"
+#include "../model/Config.h"
+
+#include <cstring>
+#include <future>
+#include <thread>
+
+using namespace JsonMax;
+
+namespace {
+
+    /// @return true if the character can't be written as is in a json string
+    inline bool needsEscape(unsigned char symbol) {
+        return symbol == '"' or symbol == '\\' or symbol < 0x20;
+    }
+
+    /**
+     * @return the first character in the range that needs escaping, end if there is none
+     * With SSE2 16 characters are checked at once, so strings without escapes are scanned at memcpy speed.
+     */
+    const char *findEscape(const char *position, const char *end) {
+#ifdef JSONMAX_SSE2
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1f);
+        while (end - position >= 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(position));
+            // Unsigned minimum with 0x1f equals the character for every control character
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                           _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(special));
+            if (mask) {
+                return position + Utils::lowestBit(mask);
+            }
+            position += 16;
+        }
+#endif
+        while (position != end and not needsEscape(static_cast<unsigned char>(*position))) {
+            position++;
+        }
+        return position;
+    }
+
+    /// Writes the escape sequence of the character, returns its length
+    size_t escapeSequence(unsigned char symbol, char *sequence) {
+        const char *hexadecimal = "0123456789abcdef";
+        sequence[0] = '\\';
+        switch (symbol) {
+            case '"': sequence[1] = '"'; return 2;
+            case '\\': sequence[1] = '\\'; return 2;
+            case '\b': sequence[1] = 'b'; return 2;
+            case '\f': sequence[1] = 'f'; return 2;
+            case '\n': sequence[1] = 'n'; return 2;
+            case '\r': sequence[1] = 'r'; return 2;
+            case '\t': sequence[1] = 't'; return 2;
+            default:
+                std::memcpy(sequence + 1, "u00", 3);
+                sequence[4] = hexadecimal[symbol >> 4];
+                sequence[5] = hexadecimal[symbol & 0xf];
+                return 6;
+        }
+    }
+
+    /// Output that appends to the text of a cached json
+    class CacheOutput : public Output {
+    public:
+
+        explicit CacheOutput(std::vector<char, Allocator<char>> &_text) : text(_text) {}
+
+        void write(const char *data, size_t size) override {
+            text.insert(text.end(), data, data + size);
+        }
+
+    private:
+
+        std::vector<char, Allocator<char>> &text;
+
+    };
+
+}
+
+const size_t Writer::bufferSize;
+
+const size_t Writer::parallelThreshold;
+
+WriteOptions::WriteOptions(bool _compact, unsigned int _indent, unsigned int _threads, bool _exactSize)
+        : compact(_compact), indent(_indent), threads(_threads), exactSize(_exactSize), cacheFragments(false) {}
+
+Writer::Writer(Output &_output, WriteOptions _options)
+        : output(_output), options(_options), lineBreak("\n"), depth(0), used(0), recording(nullptr) {}
+
+void Writer::write(const Element &element) {
+    writeValue(element);
+    flush();
+}
+
+void Writer::write(const Object &object) {
+    writeObject(object);
+    flush();
+}
+
+void Writer::write(const FrozenObject &object) {
+    writeFrozenObject(object);
+    flush();
+}
+
+void Writer::write(const Array &array) {
+    writeArray(array);
+    flush();
+}
+
+void Writer::flush() {
+    if (used) {
+        output.write(buffer, used);
+        used = 0;
+    }
+}
+
+size_t Writer::serializedSize(const Element &element, const WriteOptions &options) {
+    return measureValue(element, options, 0);
+}
+
+size_t Writer::serializedSize(const Object &object, const WriteOptions &options) {
+    return measureObject(object, options, 0);
+}
+
+size_t Writer::serializedSize(const FrozenObject &object, const WriteOptions &options) {
+    return measureFrozenObject(object, options, 0);
+}
+
+size_t Writer::serializedSize(const Array &array, const WriteOptions &options) {
+    return measureArray(array, options, 0);
+}
+
+void Writer::writeValue(const Element &element) {
+    if (recording and element.exposed) {
+        recordElement(element);
+        return;
+    }
+    switch (element.getType()) {
+        case INTEGER: {
+            char digits[Utils::maxIntegerLength];
+            append(digits, Utils::formatInteger(element.getInt(), digits));
+            break;
+        }
+        case BOOLEAN:
+            if (element.getBool()) append("true", 4);
+            else append("false", 5);
+            break;
+        case FRACTION: {
+            char digits[Utils::maxDoubleLength];
+            append(digits, Utils::formatDouble(element.getDouble(), digits));
+            break;
+        }
+        case OBJECT:
+            writeObject(element.getObject());
+            break;
+        case STRING:
+            writeString(element.getString());
+            break;
+        case ARRAY:
+            writeArray(element.getArray());
+            break;
+        case JSON_NULL:
+            append("null", 4);
+            break;
+        case UNINITIALIZED:
+            append("UNINITIALIZED", 13);
+            break;
+    }
+}
+
+void Writer::writeObject(const Object &object) {
+    if (recording) {
+        recordNested(object);
+    } else if (usesSource(object, options)) {
+        const Object::JsonCache *cache = object.jsonCache;
+        append(cache->source->data() + cache->offset, cache->size);
+    } else if (options.cacheFragments and not options.indent) {
+        writeCachedObject(object);
+    } else {
+        writeMembers(object);
+    }
+}
+
+bool Writer::usesSource(const Object &object, const WriteOptions &options) {
+    const Object::JsonCache *cache = object.jsonCache;
+    return cache and cache->valid and cache->source and not options.compact and not options.indent
+           and cache->epoch == Object::epoch.load(std::memory_order_relaxed);
+}
+
+bool Writer::usesCache(const Object &object, const WriteOptions &options) {
+    const Object::JsonCache *cache = object.jsonCache;
+    return cache and cache->valid and not cache->source and cache->compact == options.compact
+           and cache->epoch == Object::epoch.load(std::memory_order_relaxed);
+}
+
+void Writer::writeCachedObject(const Object &object) {
+    if (not usesCache(object, options)) {
+        fillCache(object);
+    }
+    const Object::JsonCache *cache = object.jsonCache;
+    size_t position = 0;
+    for (const Object::JsonCache::Nested &nested: cache->nested) {
+        append(cache->text.data() + position, nested.position - position);
+        if (nested.object) {
+            writeObject(*nested.object);
+        } else {
+            writeValue(*nested.element);
+        }
+        position = nested.position;
+    }
+    append(cache->text.data() + position, cache->text.size() - position);
+}
+
+void Writer::fillCache(const Object &object) {
+    Object::JsonCache *cache = object.jsonCache;
+    if (not cache) {
+        cache = object.jsonCache = Memory::create<Object::JsonCache>(object.resource, object.resource);
+    }
+    cache->valid = false;
+    cache->text.clear();
+    cache->nested.clear();
+    cache->source.reset();
+    cache->flat = true;
+    // Changes during the recording must leave the cache outdated
+    cache->epoch = Object::epoch.load(std::memory_order_relaxed);
+
+    // Positions in the text are only known when a single writer records it
+    WriteOptions cacheOptions = options;
+    cacheOptions.threads = 1;
+    CacheOutput fragment(cache->text);
+    Writer writer(fragment, cacheOptions);
+    writer.recording = cache;
+    writer.writeMembers(object);
+    writer.flush();
+    cache->compact = options.compact;
+    cache->valid = true;
+    object.cacheFilled();
+}
+
+void Writer::recordNested(const Object &object) {
+    recording->flat = false;
+    if (usesSource(object, options)) {
+        flush();
+        recording->nested.push_back(Object::JsonCache::Nested{recording->text.size(), &object, nullptr});
+        return;
+    }
+    if (not usesCache(object, options)) {
+        fillCache(object);
+    }
+    const Object::JsonCache *cache = object.jsonCache;
+    if (cache->flat) {
+        // Objects without nested objects are copied, so every character is stored twice at most
+        append(cache->text.data(), cache->text.size());
+    } else {
+        flush();
+        recording->nested.push_back(Object::JsonCache::Nested{recording->text.size(), &object, nullptr});
+    }
+}
+
+void Writer::recordElement(const Element &element) {
+    recording->flat = false;
+    flush();
+    recording->nested.push_back(Object::JsonCache::Nested{recording->text.size(), nullptr, &element});
+}
+
+void Writer::writeMembers(const Object &object) {
+    append('{');
+    if (parallel(object.size())) {
+        std::vector<Item> items;
+        items.reserve(object.size());
+        for (const auto &member: object) {
+            items.push_back(Item{&member.getKey(), &member.getValue()});
+        }
+        if (not items.empty()) {
+            openNesting();
+            writeParallel(items);
+            closeNesting();
+        }
+        append('}');
+        return;
+    }
+    bool first = true;
+    for (const auto &member: object) {
+        if (first) {
+            openNesting();
+        } else {
+            writeSeparator();
+        }
+        first = false;
+        writeKey(member.getKey());
+        writeValue(member.getValue());
+    }
+    if (not first) {
+        closeNesting();
+    }
+    append('}');
+}
+
+void Writer::writeFrozenObject(const FrozenObject &object) {
+    bool caching = options.cacheFragments;
+    options.cacheFragments = false;
+    writeFrozenMembers(object);
+    options.cacheFragments = caching;
+}
+
+void Writer::writeFrozenMembers(const FrozenObject &object) {
+    append('{');
+    if (parallel(object.size())) {
+        std::vector<Item> items;
+        items.reserve(object.size());
+        for (const FrozenObject::Entry &entry: object) {
+            items.push_back(Item{&entry.first, &entry.second});
+        }
+        openNesting();
+        writeParallel(items);
+        closeNesting();
+        append('}');
+        return;
+    }
+    for (const FrozenObject::Entry &entry: object) {
+        if (&entry == object.begin()) {
+            openNesting();
+        } else {
+            writeSeparator();
+        }
+        writeKey(entry.first);
+        writeValue(entry.second);
+    }
+    if (not object.empty()) {
+        closeNesting();
+    }
+    append('}');
+}
+
+void Writer::writeArray(const Array &array) {
+    append('[');
+    if (parallel(array.size())) {
+        std::vector<Item> items;
+        items.reserve(array.size());
+        for (const Element &value: array) {
+            items.push_back(Item{nullptr, &value});
+        }
+        openNesting();
+        writeParallel(items);
+        closeNesting();
+        append(']');
+        return;
+    }
+    for (size_t i = 0; i < array.size(); i++) {
+        if (i) {
+            writeSeparator();
+        } else {
+            openNesting();
+        }
+        writeValue(array[i]);
+    }
+    if (not array.empty()) {
+        closeNesting();
+    }
+    append(']');
+}
+
+void Writer::writeKey(const std::string &key) {
+    writeString(key);
+    if (options.compact) append(':');
+    else append(": ", 2);
+}
+
+void Writer::writeString(const std::string &string) {
+    append('"');
+    const char *position = string.data();
+    const char *end = position + string.size();
+    while (true) {
+        // Clean runs are copied at once
+        const char *special = findEscape(position, end);
+        append(position, static_cast<size_t>(special - position));
+        if (special == end) {
+            break;
+        }
+        char sequence[6];
+        append(sequence, escapeSequence(static_cast<unsigned char>(*special), sequence));
+        position = special + 1;
+    }
+    append('"');
+}
+
+bool Writer::parallel(size_t values) const {
+    // Caches are filled from the memory resources of the objects, which need not be thread safe
+    bool caching = options.cacheFragments and not options.indent;
+    return workers(options.threads) > 1 and values >= parallelThreshold and not caching;
+}
+
+size_t Writer::workers(unsigned int threads) {
+    // hardware_concurrency is zero when it is not known, the threads asked for are used then
+    unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware and hardware < threads ? hardware : threads;
+}
+
+void Writer::writeParallel(const std::vector<Item> &items) {
+    const size_t chunks = workers(options.threads);
+    std::vector<std::string> parts(chunks);
+
+    // Every chunk gets its own writer and buffer, nested containers are written by that thread alone,
+    // so a single object or array is split at a time and no more threads run than the hardware has
+    WriteOptions chunkOptions = options;
+    chunkOptions.threads = 1;
+    auto writeChunk = [&](size_t chunk) {
+        StringOutput partOutput(parts[chunk]);
+        Writer writer(partOutput, chunkOptions);
+        writer.depth = depth;
+        writer.writeItems(items, items.size() * chunk / chunks, items.size() * (chunk + 1) / chunks);
+        writer.flush();
+    };
+    std::vector<std::future<void>> tasks;
+    for (size_t chunk = 1; chunk < chunks; chunk++) {
+        tasks.push_back(std::async(std::launch::async, writeChunk, chunk));
+    }
+    writeChunk(0);
+    for (auto &task: tasks) {
+        task.get();
+    }
+
+    // What was buffered before goes first, all of it is handed over at once so file descriptors can use writev
+    std::vector<Output::Block> blocks;
+    blocks.reserve(chunks + 1);
+    blocks.push_back(Output::Block{buffer, used});
+    for (const std::string &part: parts) {
+        blocks.push_back(Output::Block{part.data(), part.size()});
+    }
+    output.writeBlocks(blocks.data(), blocks.size());
+    used = 0;
+}
+
+void Writer::writeItems(const std::vector<Item> &items, size_t first, size_t last) {
+    for (size_t i = first; i < last; i++) {
+        if (i) {
+            writeSeparator();
+        }
+        if (items[i].key) {
+            writeKey(*items[i].key);
+        }
+        writeValue(*items[i].value);
+    }
+}
+
+size_t Writer::measureValue(const Element &element, const WriteOptions &options, size_t depth) {
+    switch (element.getType()) {
+        case INTEGER: {
+            char digits[Utils::maxIntegerLength];
+            return Utils::formatInteger(element.getInt(), digits);
+        }
+        case BOOLEAN:
+            return element.getBool() ? 4 : 5;
+        case FRACTION: {
+            char digits[Utils::maxDoubleLength];
+            return Utils::formatDouble(element.getDouble(), digits);
+        }
+        case OBJECT:
+            return measureObject(element.getObject(), options, depth);
+        case STRING:
+            return measureString(element.getString());
+        case ARRAY:
+            return measureArray(element.getArray(), options, depth);
+        case JSON_NULL:
+            return 4;
+        case UNINITIALIZED:
+            return 13;
+    }
+    return 0;
+}
+
+size_t Writer::measureObject(const Object &object, const WriteOptions &options, size_t depth) {
+    const Object::JsonCache *cache = object.jsonCache;
+    if (usesSource(object, options)) {
+        return cache->size;
+    }
+    if (options.cacheFragments and not options.indent and usesCache(object, options)) {
+        size_t size = cache->text.size();
+        for (const Object::JsonCache::Nested &nested: cache->nested) {
+            if (nested.object) {
+                size += measureObject(*nested.object, options, depth + 1);
+            } else {
+                size += measureValue(*nested.element, options, depth + 1);
+            }
+        }
+        return size;
+    }
+    size_t size = 0;
+    size_t values = 0;
+    for (const auto &member: object) {
+        size += measureString(member.getKey()) + measureKeySeparator(options);
+        size += measureValue(member.getValue(), options, depth + 1);
+        values++;
+    }
+    return size + measureLayout(values, options, depth);
+}
+
+size_t Writer::measureFrozenObject(const FrozenObject &object, const WriteOptions &options, size_t depth) {
+    size_t size = 0;
+    for (const FrozenObject::Entry &entry: object) {
+        size += measureString(entry.first) + measureKeySeparator(options);
+        size += measureValue(entry.second, options, depth + 1);
+    }
+    return size + measureLayout(object.size(), options, depth);
+}
+
+size_t Writer::measureArray(const Array &array, const WriteOptions &options, size_t depth) {
+    size_t size = 0;
+    for (const Element &value: array) {
+        size += measureValue(value, options, depth + 1);
+    }
+    return size + measureLayout(array.size(), options, depth);
+}
+
+size_t Writer::measureString(const std::string &string) {
+    size_t size = string.size() + 2;
+    const char *position = string.data();
+    const char *end = position + string.size();
+    while ((position = findEscape(position, end)) != end) {
+        char sequence[6];
+        size += escapeSequence(static_cast<unsigned char>(*position), sequence) - 1;
+        position++;
+    }
+    return size;
+}
+
+size_t Writer::measureLayout(size_t values, const WriteOptions &options, size_t depth) {
+    if (values == 0) {
+        return 2;
+    }
+    if (options.indent) {
+        // A line break before every value and one before the closing bracket
+        size_t inner = values * (1 + (depth + 1) * options.indent);
+        return 2 + (values - 1) + inner + 1 + depth * options.indent;
+    }
+    return 2 + (values - 1) * (options.compact ? 1 : 2);
+}
+
+size_t Writer::measureKeySeparator(const WriteOptions &options) {
+    return options.compact ? 1 : 2;
+}
+
+void Writer::writeSeparator() {
+    if (options.indent) {
+        append(',');
+        writeLineBreak();
+    } else if (options.compact) {
+        append(',');
+    } else {
+        append(", ", 2);
+    }
+}
+
+void Writer::openNesting() {
+    depth++;
+    if (options.indent) {
+        writeLineBreak();
+    }
+}
+
+void Writer::closeNesting() {
+    depth--;
+    if (options.indent) {
+        writeLineBreak();
+    }
+}
+
+void Writer::writeLineBreak() {
+    size_t size = 1 + depth * options.indent;
+    if (lineBreak.size() < size) {
+        lineBreak.resize(size, ' ');
+    }
+    append(lineBreak.data(), size);
+}
+
+void Writer::append(const char *data, size_t size) {
+    if (used + size > bufferSize) {
+        flush();
+        if (size > bufferSize) {
+            // Too large to buffer, hand it over as is
+            output.write(data, size);
+            return;
+        }
+    }
+    std::memcpy(buffer + used, data, size);
+    used += size;
+}
+
+void Writer::append(char symbol) {
+    if (used == bufferSize) {
+        flush();
+    }
+    buffer[used++] = symbol;
+}
@@ -0,0 +1,190 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#ifndef JSONMAX_WRITER_H
+#define JSONMAX_WRITER_H
+
+#include <string>
+#include <cstddef>
+#include <vector>
+#include "../model/Element.h"
+#include "../model/Object.h"
+#include "Output.h"
+#include "WriteOptions.h"
+
+namespace JsonMax {
+
+    /// Forward declaration
+    class FrozenObject;
+
+    /**
+     * Serializes elements in a single traversal
+     * Characters are gathered in a fixed size buffer that is handed to the Output when full,
+     * so no intermediate strings are built for nested values.
+     */
+    class Writer {
+    public:
+
+        /// Minimal amount of values in an object or array before it is written with multiple threads
+        static const size_t parallelThreshold = 4096;
+
+        /// Constructor, the output must outlive the writer
+        explicit Writer(Output &output, WriteOptions options = WriteOptions());
+
+        Writer(const Writer &) = delete;
+
+        Writer &operator=(const Writer &) = delete;
+
+        /// Writes the element and everything it contains, then flushes
+        void write(const Element &element);
+
+        /// Same as above, for an object
+        void write(const Object &object);
+
+        /// Same as above, for a frozen object
+        void write(const FrozenObject &object);
+
+        /// Same as above, for an array
+        void write(const Array &array);
+
+        /// Hands the buffered characters to the output
+        void flush();
+
+        /**
+         * @return the exact amount of characters write would produce with the given options, nothing is written
+         * Numbers are formatted into a small stack buffer to know their width, strings are scanned for escapes.
+         */
+        static size_t serializedSize(const Element &element, const WriteOptions &options = WriteOptions());
+
+        /// Same as above, for an object
+        static size_t serializedSize(const Object &object, const WriteOptions &options = WriteOptions());
+
+        /// Same as above, for a frozen object
+        static size_t serializedSize(const FrozenObject &object, const WriteOptions &options = WriteOptions());
+
+        /// Same as above, for an array
+        static size_t serializedSize(const Array &array, const WriteOptions &options = WriteOptions());
+
+    private:
+
+        friend class StreamWriter;
+
+        /// Size of the buffer
+        static const size_t bufferSize = 4096;
+
+        /// Value of an object or array that is written in parallel, the key is nullptr for arrays
+        struct Item {
+            const std::string *key;
+            const Element *value;
+        };
+
+        void writeValue(const Element &element);
+
+        /// Writes the object, its slice of the source or its cached json with WriteOptions::cacheFragments
+        void writeObject(const Object &object);
+
+        /**
+         * @return true if the object is written as its slice of the source, see parseWithSource
+         * Only unchanged objects qualify, and only for the default layout, compact and indented json is written afresh
+         */
+        static bool usesSource(const Object &object, const WriteOptions &options);
+
+        /// @return true if the object has a cached json with the given layout
+        static bool usesCache(const Object &object, const WriteOptions &options);
+
+        /// Writes the cached json of the object, which is written and stored first if it is missing or outdated
+        void writeCachedObject(const Object &object);
+
+        /// Writes the pairs of the object into its cache, nested objects are cached as well and only referenced
+        void fillCache(const Object &object);
+
+        /// Refers to the nested object from the cache being recorded, objects without nested objects are copied
+        void recordNested(const Object &object);
+
+        /// Refers to the exposed element from the cache being recorded, its value is written again every time
+        void recordElement(const Element &element);
+
+        /// Writes the braces and the pairs of the object
+        void writeMembers(const Object &object);
+
+        /// Writes the frozen object without filling any caches of the values in it, which may be shared between threads
+        void writeFrozenObject(const FrozenObject &object);
+
+        /// Writes the braces and the pairs of the frozen object
+        void writeFrozenMembers(const FrozenObject &object);
+
+        void writeArray(const Array &array);
+
+        void writeKey(const std::string &key);
+
+        void writeString(const std::string &string);
+
+        /// @return true if an object or array with the given amount of values is split over threads
+        bool parallel(size_t values) const;
+
+        /// @return threads used for the given WriteOptions::threads, at most as many as the hardware runs at once
+        static size_t workers(unsigned int threads);
+
+        /// Writes the values and the separators between them, one chunk per thread, in order
+        void writeParallel(const std::vector<Item> &items);
+
+        /// Writes the values in the given range of the items, with a separator before all but the very first
+        void writeItems(const std::vector<Item> &items, size_t first, size_t last);
+
+        /// Writes ',' between the values of an object or array
+        void writeSeparator();
+
+        /// Size of the given value, nested at the given depth
+        static size_t measureValue(const Element &element, const WriteOptions &options, size_t depth);
+
+        static size_t measureObject(const Object &object, const WriteOptions &options, size_t depth);
+
+        static size_t measureFrozenObject(const FrozenObject &object, const WriteOptions &options, size_t depth);
+
+        static size_t measureArray(const Array &array, const WriteOptions &options, size_t depth);
+
+        static size_t measureString(const std::string &string);
+
+        /// Size of the brackets, separators and line breaks of an object or array with the given amount of values
+        static size_t measureLayout(size_t values, const WriteOptions &options, size_t depth);
+
+        /// Size of the ':' and the space after a key
+        static size_t measureKeySeparator(const WriteOptions &options);
+
+        /// Called before the first value of an object or array, starts an indented line
+        void openNesting();
+
+        /// Called after the last value of an object or array
+        void closeNesting();
+
+        /// Writes a line break and the indentation of the current depth
+        void writeLineBreak();
+
+        void append(const char *data, size_t size);
+
+        void append(char symbol);
+
+        Output &output;
+
+        WriteOptions options;
+
+        /// Line break followed by enough spaces for the deepest level so far, a prefix is written per line
+        std::string lineBreak;
+
+        /// Nesting depth of the value being written
+        size_t depth;
+
+        char buffer[bufferSize];
+
+        /// Amount of characters in the buffer
+        size_t used;
+
+        /// Cache that is being filled by this writer, nullptr when writing to the output itself
+        Object::JsonCache *recording;
+
+    };
+
+}
+
+#endif //JSONMAX_WRITER_H
@@ -0,0 +1,175 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "../catch.hpp"
+#include "../../src/json_max/parser/Parser.h"
+
+#include <new>
+#include <type_traits>
+#include <vector>
+
+using namespace JsonMax;
+
+/// Resource that keeps track of the memory it handed out
+class CountingResource : public MemoryResource {
+public:
+
+    size_t allocations = 0;
+    size_t bytesInUse = 0;
+    bool failing = false;
+
+protected:
+
+    void *do_allocate(size_t bytes, size_t alignment) override {
+        if (failing) {
+            throw std::bad_alloc();
+        }
+        allocations++;
+        bytesInUse += bytes;
+        return defaultResource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void *pointer, size_t bytes, size_t alignment) override {
+        bytesInUse -= bytes;
+        defaultResource()->deallocate(pointer, bytes, alignment);
+    }
+
+    bool do_is_equal(const MemoryResource &other) const noexcept override {
+        return this == &other;
+    }
+
+};
+
+TEST_CASE( "Parsed elements use the given memory resource", "[memory]" ) {
+    CountingResource resource;
+    {
+        Element element = parseFile("../../test/input/correct.json", &resource);
+        CHECK(element.getResource() == &resource);
+        CHECK(element.getObject().getResource() == &resource);
+        CHECK(element["object"]["object"].getResource() == &resource);
+        CHECK(element["array"].getArray().get_allocator().resource() == &resource);
+        CHECK(element["array"].getArray()[0].getObject().getResource() == &resource);
+        CHECK(resource.allocations > 0);
+        CHECK(resource.bytesInUse > 0);
+    }
+    CHECK(resource.bytesInUse == 0);
+}
+
+TEST_CASE( "Objects propagate their memory resource to new elements", "[memory]" ) {
+    CountingResource resource;
+    {
+        Object object(VECTOR, &resource);
+        object["string"] = "a string that does not fit in the small string buffer";
+        object["array"] = {1, "two", 3.0};
+        object["object"] = Object();
+        object["object"]["nested"] = true;
+
+        CHECK(object["string"].getResource() == &resource);
+        CHECK(object["array"].getArray()[1].getResource() == &resource);
+        CHECK(object["object"]["nested"].getResource() == &resource);
+
+        // Copies go to the default resource unless asked otherwise
+        Object copy = object;
+        CHECK(copy.getResource() == defaultResource());
+        CHECK(copy["object"]["nested"].getResource() == defaultResource());
+
+        Object pooledCopy(object, &resource);
+        CHECK(pooledCopy["object"]["nested"].getResource() == &resource);
+        CHECK(pooledCopy.toString() == object.toString());
+    }
+    CHECK(resource.bytesInUse == 0);
+}
+
+TEST_CASE( "Shapes come from the memory resource of their objects", "[memory]" ) {
+    std::string json = R"([{"id": 1, "name": "a"}, {"id": 2, "name": "b"}, {"id": 3, "name": "c"}])";
+    CountingResource other;
+    Object copy(SHAPED, &other);
+    {
+        CountingResource resource;
+        {
+            Element records = parse(json, &resource, SHAPED);
+            size_t parsed = resource.bytesInUse;
+            Element more = parse(json, &resource, SHAPED);
+            CHECK(resource.bytesInUse < parsed * 2);
+
+            // A copy to another resource gets shapes of its own, the records and their resource can go first
+            copy = records.getArray()[1].getObject();
+            CHECK(other.bytesInUse > 0);
+        }
+        CHECK(resource.bytesInUse == 0);
+    }
+    copy["extra"] = true;
+    copy.remove("id");
+    CHECK(copy.toString() == R"({"name": "b", "extra": true})");
+}
+
+TEST_CASE( "Moves between memory resources never throw", "[memory]" ) {
+    static_assert(std::is_nothrow_move_assignable<Element>::value, "containers must be able to move elements");
+    static_assert(std::is_nothrow_move_assignable<Object>::value, "containers must be able to move objects");
+
+    CountingResource resource;
+    {
+        std::vector<Element> elements;
+        for (int i = 0; i < 20; i++) {
+            elements.emplace_back(parse(R"({"values": [1, 2, "a string that does not fit in the small buffer"]})"));
+        }
+        CHECK(elements[19]["values"].getArray().size() == 3);
+
+        Element target(&resource);
+        Element source = parse(R"({"key": "value"})");
+        target = std::move(source);
+        CHECK(target.getResource() == &resource);
+        CHECK(target["key"].getString() == "value");
+
+        // The copy into the own resource fails, the value and its resource are taken over
+        resource.failing = true;
+        Element failed(&resource);
+        Element moved = parse(R"({"key": [1, 2, 3]})");
+        failed = std::move(moved);
+        CHECK(failed.getResource() == defaultResource());
+        CHECK(failed["key"].getArray().size() == 3);
+        CHECK(moved.getType() == UNINITIALIZED);
+        resource.failing = false;
+    }
+    CHECK(resource.bytesInUse == 0);
+}
+
+TEST_CASE( "Cached json comes from the memory resource and is not repeated per level", "[memory]" ) {
+    CountingResource resource;
+    {
+        // Fifty nested objects around one long string
+        std::string json = R"({"value": ")" + std::string(10000, 'x') + R"("})";
+        for (int i = 0; i < 50; i++) {
+            json = R"({"level": )" + json + "}";
+        }
+        Element element = parse(json, &resource);
+        size_t parsed = resource.bytesInUse;
+
+        WriteOptions cached;
+        cached.cacheFragments = true;
+        CHECK(element.toString(cached) == element.toString());
+        // Every level refers to the json of the one below it instead of holding a copy
+        CHECK(resource.bytesInUse > parsed);
+        CHECK(resource.bytesInUse - parsed < 8 * json.size());
+    }
+    CHECK(resource.bytesInUse == 0);
+}
+
+TEST_CASE( "Parsed source slices come from the memory resource and are let go when changed", "[memory]" ) {
+    CountingResource resource;
+    {
+        Element element = parseWithSource(R"({"a": {"b": 1}, "x": 0})", &resource);
+        size_t parsed = resource.bytesInUse;
+        CHECK(parse(R"({"a": {"b": 1}, "x": 0})", &resource).getResource() == &resource);
+        CHECK(resource.bytesInUse == parsed);
+
+        // The nested object still holds the source after the outer one changed
+        element["x"] = 1;
+        CHECK(resource.bytesInUse == parsed);
+        element["a"]["b"] = 2;
+        CHECK(resource.bytesInUse < parsed);
+        CHECK(element.toString() == R"({"a": {"b": 2}, "x": 1})");
+    }
+    CHECK(resource.bytesInUse == 0);
+}
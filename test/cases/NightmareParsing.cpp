@@ -36,3 +36,44 @@ TEST_CASE( "Nightmare parsing arrays from strings", "[parsing]" ) {
     };
     test(cases);
 }
+
+TEST_CASE( "Parsing without exceptions reports the error", "[parsing]" ) {
+    Element result = "untouched";
+
+    std::string json = "{\n  \"a\": [1, 2, tru]\n}";
+    ParseError error = parse(json, result);
+    CHECK(error);
+    CHECK(error.getCode() == INVALID_VALUE);
+    CHECK(error.getOffset() == json.find("tru"));
+    CHECK(error.getLine(json) == 2);
+    CHECK(error.getColumn(json) == 15);
+    CHECK(result.getString() == "untouched");
+
+    CHECK(parse(R"({"a": 1)", result).getCode() == INVALID_OBJECT_END);
+    CHECK(parse(R"({"a" 1})", result).getCode() == MISSING_COLON);
+    CHECK(parse(R"({"a": "b\x"})", result).getCode() == INVALID_STRING);
+    CHECK(parse("[1e999]", result).getCode() == NUMBER_OUT_OF_RANGE);
+    CHECK(parse("12abc", result).getCode() == INVALID_VALUE);
+    CHECK(parse("[1, 2", result).getCode() == INVALID_ARRAY_END);
+    CHECK(result.getString() == "untouched");
+
+    error = parse(R"({"a": [1, 2.5, "x"]})", result);
+    CHECK_FALSE(error);
+    CHECK(error.getCode() == PARSE_SUCCESS);
+    CHECK(result.toString() == R"({"a": [1, 2.5, "x"]})");
+
+    // The error keeps the offending json, which the exception names
+    error = parse(json, result);
+    CHECK(error.getExcerpt() == "tru");
+    CHECK(error.getDescription() == "Invalid Json, 'tru' is not valid.");
+    try {
+        parse(json);
+        FAIL("no exception");
+    } catch (ParseException &e) {
+        CHECK(std::string(e.what()) == "Error on Line 2: Invalid Json, 'tru' is not valid.");
+    }
+    CHECK(parse("[1e999]", result).getDescription() == "Cannot parse, number '1e999' is out of range.");
+    CHECK(parse(R"({"a" 1})", result).getDescription() == R"(Invalid Json, no ':' between key and value at '1}')");
+    error = parse("[" + std::string(100, '9') + "x]", result);
+    CHECK(error.getExcerpt() == std::string(32, '9') + "...");
+}
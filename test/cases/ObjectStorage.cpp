@@ -0,0 +1,732 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "../catch.hpp"
+#include "../../src/json_max/parser/Parser.h"
+#include "../../src/json_max/model/Pair.h"
+#include "../../src/json_max/model/ObjectIterator.h"
+#include "../../src/json_max/model/FrozenObject.h"
+#include "../../src/json_max/model/ObjectBuilder.h"
+#include "../../src/json_max/model/ArrayBuilder.h"
+#include "../../src/json_max/model/Path.h"
+#include "../../src/json_max/model/ArrayIndex.h"
+#include "../../src/json_max/model/Utils.h"
+
+#include <algorithm>
+#include <thread>
+
+using namespace JsonMax;
+
+TEST_CASE( "Lookups work for every storage type", "[object]" ) {
+    for (Storage storage: {HASHMAP, MAP, VECTOR, ADAPTIVE, FLAT_HASHMAP, INDEXED, SHAPED}) {
+        Object object(storage);
+        for (int i = 0; i < 100; i++) {
+            object["key" + std::to_string(i)] = i;
+        }
+
+        CHECK(object.size() == 100);
+        CHECK(object["key42"].getInt() == 42);
+        CHECK(object.find("key7")->getInt() == 7);
+        CHECK(object.find(std::string("key99"))->getInt() == 99);
+        CHECK(object.exists("key0"));
+        CHECK_FALSE(object.exists("key100"));
+
+        // Reading a missing key with find does not insert it
+        CHECK(object.find("missing") == nullptr);
+        CHECK(object.size() == 100);
+
+        // Uninitialized elements are not found
+        object["placeholder"];
+        CHECK(object.find("placeholder") == nullptr);
+        CHECK_FALSE(object.exists("placeholder"));
+    }
+}
+
+TEST_CASE( "Lookups on elements", "[object]" ) {
+    const Element element = parse(R"({"a": {"b": 1}, "c": [1, 2]})");
+
+    CHECK(element.find("a")->find("b")->getInt() == 1);
+    CHECK(element.find("x") == nullptr);
+    CHECK(element.find("c")->find("b") == nullptr);
+}
+
+namespace {
+
+    /// Describes a value, one overload per type
+    struct Describe {
+        std::string operator()(int number) const { return "int " + std::to_string(number); }
+        std::string operator()(bool boolean) const { return boolean ? "true" : "false"; }
+        std::string operator()(double) const { return "double"; }
+        std::string operator()(const std::string &string) const { return "string " + string; }
+        std::string operator()(const Object &object) const { return "object " + std::to_string(object.size()); }
+        std::string operator()(const Array &array) const { return "array " + std::to_string(array.size()); }
+        std::string operator()(std::nullptr_t) const { return "null"; }
+    };
+
+}
+
+TEST_CASE( "Mixed types are read without exceptions", "[object]" ) {
+    Element element = parse(R"([1, true, 2.5, "text", {"a": 1}, [1, 2], null])");
+    Array &array = element.getArray();
+
+    CHECK(*array[0].tryGetInt() == 1);
+    CHECK(array[0].tryGetDouble() == nullptr);
+    CHECK(*array[1].tryGetBool());
+    CHECK(*array[2].tryGetDouble() == 2.5);
+    CHECK(*array[3].tryGetString() == "text");
+    CHECK(array[4].tryGetObject()->size() == 1);
+    CHECK(array[5].tryGetArray()->size() == 2);
+    CHECK(array[6].tryGetString() == nullptr);
+
+    *array[0].tryGetInt() = 5;
+    CHECK(array[0].getInt() == 5);
+
+    CHECK(array[0].getOr(0) == 5);
+    CHECK(array[3].getOr(0) == 0);
+    CHECK(array[1].getOr(false));
+    CHECK(array[0].getOr(1.5) == 1.5);
+    CHECK(array[3].getOr(std::string("default")) == "text");
+    CHECK(std::string(array[3].getOr("default")) == "text");
+    CHECK(std::string(array[6].getOr("default")) == "default");
+
+    std::vector<std::string> descriptions;
+    for (const Element &value: array) {
+        descriptions.push_back(value.visit(Describe()));
+    }
+    CHECK(descriptions == std::vector<std::string>{"int 5", "true", "double", "string text", "object 1", "array 2",
+                                                   "null"});
+}
+
+TEST_CASE( "Adaptive objects keep insertion order while growing", "[object]" ) {
+    Object object(ADAPTIVE);
+    for (int i = 0; i < 1000; i++) {
+        object["key" + std::to_string(999 - i)] = i;
+    }
+    object.remove("key500");
+    object.remove("key999");
+
+    CHECK(object.size() == 998);
+    CHECK(object.find("key500") == nullptr);
+    CHECK(object["key0"].getInt() == 999);
+
+    int expected = 1;
+    for (const Pair &pair: object.pairs()) {
+        if (expected == 499) {
+            expected++;
+        }
+        CHECK(pair.getValue().getInt() == expected++);
+    }
+
+    Object copy = object;
+    CHECK(copy.toString() == object.toString());
+    CHECK(copy.find("key1")->getInt() == 998);
+}
+
+TEST_CASE( "Indexed objects keep insertion order", "[object]" ) {
+    Object object(INDEXED);
+    object["z"] = 1;
+    object["a"] = 2;
+    object["m"] = 3;
+    object.remove("a");
+    object["b"] = 4;
+
+    CHECK(object.toString() == R"({"z": 1, "m": 3, "b": 4})");
+    CHECK(object.find("m")->getInt() == 3);
+    CHECK(object.find("a") == nullptr);
+
+    Object copy(object);
+    copy["c"] = 5;
+    CHECK(copy.toString() == R"({"z": 1, "m": 3, "b": 4, "c": 5})");
+}
+
+TEST_CASE( "Flat hashmaps keep working after many inserts and removes", "[object]" ) {
+    Object object(FLAT_HASHMAP);
+    for (int i = 0; i < 10000; i++) {
+        object["key" + std::to_string(i)] = i;
+    }
+    // Removing and adding again reuses the slots of removed pairs
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 10000; i += 2) {
+            object.remove("key" + std::to_string(i));
+        }
+        CHECK(object.size() == 5000);
+        for (int i = 0; i < 10000; i += 2) {
+            object["key" + std::to_string(i)] = -i;
+        }
+    }
+
+    CHECK(object.size() == 10000);
+    long long sum = 0;
+    for (const Pair &pair: object.pairs()) {
+        sum += pair.getValue().getInt();
+    }
+    CHECK(sum == 25000000LL - 24995000LL);
+    CHECK(object.find("key9999")->getInt() == 9999);
+    CHECK(object.find("key9998")->getInt() == -9998);
+
+    Object copy = object;
+    CHECK(copy.size() == 10000);
+    CHECK(copy.find("key1234")->getInt() == -1234);
+    object.clear();
+    CHECK(object.empty());
+    CHECK(copy.find("key1")->getInt() == 1);
+}
+
+TEST_CASE( "Iterating objects yields references to every pair", "[object]" ) {
+    for (Storage storage: {HASHMAP, MAP, VECTOR, ADAPTIVE, FLAT_HASHMAP, INDEXED, SHAPED}) {
+        Object object(storage);
+        for (int i = 0; i < 50; i++) {
+            object["key" + std::to_string(i)] = i;
+        }
+        object["placeholder"];
+
+        int count = 0;
+        int sum = 0;
+        for (const auto &member: object) {
+            CHECK(member.getKey().compare(0, 3, "key") == 0);
+            CHECK(&member.getValue() == object.find(member.getKey()));
+            sum += member.getValue().getInt();
+            count++;
+        }
+        CHECK(count == 50);
+        CHECK(sum == 49 * 50 / 2);
+
+        for (auto &member: object) {
+            member.getValue() = member.getValue().getInt() * 2;
+        }
+        for (Element &value: object.values()) {
+            value = value.getInt() + 1;
+        }
+        CHECK(object.find("key10")->getInt() == 21);
+
+        const Object &constant = object;
+        count = 0;
+        for (const std::string &key: constant.keys()) {
+            CHECK(constant.find(key) != nullptr);
+            count++;
+        }
+        CHECK(count == 50);
+        CHECK(std::distance(constant.values().begin(), constant.values().end()) == 50);
+    }
+}
+
+TEST_CASE( "Iterating empty objects", "[object]" ) {
+    Object object(ADAPTIVE);
+    CHECK(object.begin() == object.end());
+    object["a"];
+    CHECK(object.begin() == object.end());
+    object["b"] = 1;
+    auto itr = object.begin();
+    CHECK(itr->getKey() == "b");
+    CHECK(++itr == object.end());
+}
+
+namespace {
+
+    /// Keys of 16 bytes per block that all collided under the former hash, whatever its seed
+    std::vector<std::string> collidingKeys(size_t blocks) {
+        // A difference in the top bit of one word survives the multiplications as the top bit and bit 34,
+        // which the next word cancelled again
+        const uint64_t multiplier = 0xbf58476d1ce4e5b9ull;
+        uint64_t inverse = multiplier;
+        for (int i = 0; i < 5; i++) {
+            inverse *= 2 - multiplier * inverse;
+        }
+        const uint64_t first = 0x0123456789abcdefull;
+        const uint64_t second = 0x0fedcba987654321ull;
+        const uint64_t pairs[2][2] = {
+                {first, second},
+                {first ^ (1ull << 63), inverse * ((second * multiplier) ^ (1ull << 63) ^ (1ull << 34))}
+        };
+        std::vector<std::string> keys(1);
+        for (size_t block = 0; block < blocks; block++) {
+            std::vector<std::string> longer;
+            for (const std::string &key: keys) {
+                for (const auto &pair: pairs) {
+                    std::string extended = key;
+                    extended.append(reinterpret_cast<const char *>(pair), sizeof(pair));
+                    longer.push_back(extended);
+                }
+            }
+            keys.swap(longer);
+        }
+        return keys;
+    }
+
+}
+
+TEST_CASE( "Keys crafted to collide get different hashes", "[object]" ) {
+    std::vector<std::string> keys = collidingKeys(4);
+    REQUIRE(keys.size() == 16);
+
+    std::vector<uint64_t> hashes;
+    for (const std::string &key: keys) {
+        hashes.push_back(Utils::hash(key.data(), key.size()));
+    }
+    std::sort(hashes.begin(), hashes.end());
+    CHECK(std::unique(hashes.begin(), hashes.end()) == hashes.end());
+
+    for (Storage storage: {HASHMAP, FLAT_HASHMAP, INDEXED, SHAPED}) {
+        Object object(storage);
+        for (size_t i = 0; i < keys.size(); i++) {
+            object[keys[i]] = static_cast<int>(i);
+        }
+        for (size_t i = 0; i < keys.size(); i++) {
+            CHECK(object[keys[i]].getInt() == static_cast<int>(i));
+        }
+    }
+
+    Object object;
+    for (size_t i = 0; i < keys.size(); i++) {
+        object[keys[i]] = static_cast<int>(i);
+    }
+    FrozenObject frozen = object.freeze();
+    for (size_t i = 0; i < keys.size(); i++) {
+        REQUIRE(frozen.find(keys[i]) != nullptr);
+        CHECK(frozen.find(keys[i])->getInt() == static_cast<int>(i));
+    }
+}
+
+TEST_CASE( "Frozen objects find every key of the original", "[object]" ) {
+    for (int size: {0, 1, 2, 3, 10, 100, 5000}) {
+        Object object(FLAT_HASHMAP);
+        for (int i = 0; i < size; i++) {
+            object["key" + std::to_string(i)] = i;
+        }
+        object["placeholder"];
+
+        const FrozenObject frozen = object.freeze();
+        CHECK(frozen.size() == static_cast<size_t>(size));
+        CHECK(frozen.empty() == (size == 0));
+        for (int i = 0; i < size; i++) {
+            const Element *element = frozen.find("key" + std::to_string(i));
+            REQUIRE(element != nullptr);
+            CHECK(element->getInt() == i);
+        }
+        CHECK(frozen.find("key" + std::to_string(size)) == nullptr);
+        CHECK(frozen.find("placeholder") == nullptr);
+        CHECK_FALSE(frozen.exists(""));
+
+        long long sum = 0;
+        for (const FrozenObject::Entry &entry: frozen) {
+            sum += entry.second.getInt();
+        }
+        CHECK(sum == static_cast<long long>(size) * (size - 1) / 2);
+    }
+}
+
+TEST_CASE( "Frozen objects are deep copies", "[object]" ) {
+    Element element = parse(R"({"name": "JsonMax", "tags": ["a", "b"], "nested": {"x": 1}})");
+    FrozenObject frozen(element.getObject());
+    element["name"] = "changed";
+
+    CHECK(frozen.find("name")->getString() == "JsonMax");
+    CHECK(frozen.find("nested")->find("x")->getInt() == 1);
+    CHECK(frozen.find("tags")->getArray().size() == 2);
+
+    FrozenObject moved(std::move(frozen));
+    CHECK(moved.size() == 3);
+    CHECK(frozen.empty());
+    CHECK(frozen.find("name") == nullptr);
+}
+
+TEST_CASE( "Shaped objects with the same keys share a shape", "[object]" ) {
+    Element records = parse(R"([{"id": 1, "name": "a"}, {"id": 2, "name": "b"}, {"name": "c", "id": 3}])",
+                            defaultResource(), SHAPED);
+    Array &array = records.getArray();
+
+    CHECK(array[0].getObject().find("name")->getString() == "a");
+    CHECK(array[2]["id"].getInt() == 3);
+    CHECK(array[2].toString() == R"({"name": "c", "id": 3})");
+
+    Object copy(array[1].getObject());
+    copy["extra"] = true;
+    copy.remove("id");
+    CHECK(copy.toString() == R"({"name": "b", "extra": true})");
+    CHECK(array[1].toString() == R"({"id": 2, "name": "b"})");
+
+    copy.clear();
+    CHECK(copy.empty());
+    copy["name"] = "d";
+    CHECK(copy.toString() == R"({"name": "d"})");
+}
+
+TEST_CASE( "Shaped objects with many keys switch to a dictionary", "[object]" ) {
+    Object object(SHAPED);
+    for (int i = 0; i < 200; i++) {
+        object["key" + std::to_string(i)] = i;
+    }
+    object.remove("key100");
+
+    CHECK(object.size() == 199);
+    CHECK(object.find("key100") == nullptr);
+    CHECK(object.find("key150")->getInt() == 150);
+
+    int expected = 0;
+    for (const auto &member: object) {
+        if (expected == 100) {
+            expected++;
+        }
+        CHECK(member.getValue().getInt() == expected++);
+    }
+
+    Object copy = object;
+    CHECK(copy.toString() == object.toString());
+    object.clear();
+    CHECK(object.empty());
+    CHECK(copy.size() == 199);
+}
+
+TEST_CASE( "Shaped objects are built from multiple threads at once", "[object]" ) {
+    std::string json = "[";
+    for (int record = 0; record < 100; record++) {
+        json += record ? ", {" : "{";
+        for (int key = 0; key < 20; key++) {
+            json += (key ? ", \"key" : "\"key") + std::to_string((key + record) % 20) + "\": " + std::to_string(key);
+        }
+        json += "}";
+    }
+    json += "]";
+
+    std::vector<int> found(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < found.size(); thread++) {
+        threads.emplace_back([&json, &found, thread]() {
+            Element records = parse(json, defaultResource(), SHAPED);
+            Array &array = records.getArray();
+            for (int record = 0; record < 100; record++) {
+                Object copy = array[record].getObject();
+                copy.remove("key0");
+                if (array[record].getObject().find("key" + std::to_string(record % 20))->getInt() == 0
+                        and copy.find("key0") == nullptr and copy.size() == 19) {
+                    found[thread]++;
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    for (int count: found) {
+        CHECK(count == 100);
+    }
+
+    Element records = parse(json, defaultResource(), SHAPED);
+    Array &array = records.getArray();
+    Object copy = array[7].getObject();
+    CHECK(copy == array[7].getObject());
+    CHECK(copy.toString() == array[7].toString());
+    CHECK(copy.find("key19")->getInt() == 12);
+}
+
+TEST_CASE( "Builders create objects and arrays in one go", "[object]" ) {
+    for (Storage storage: {HASHMAP, MAP, VECTOR, ADAPTIVE, FLAT_HASHMAP, INDEXED, SHAPED}) {
+        ObjectBuilder builder(storage);
+        builder.reserve(300);
+        for (int i = 0; i < 300; i++) {
+            builder.add("key" + std::to_string(i), i);
+        }
+        CHECK(builder.size() == 300);
+
+        Object object = builder.build();
+        CHECK(builder.size() == 0);
+        CHECK(object.size() == 300);
+        CHECK(object.find("key123")->getInt() == 123);
+
+        object.reserve(1000);
+        object["key300"] = 300;
+        CHECK(object.size() == 301);
+    }
+
+    ArrayBuilder builder;
+    builder.reserve(3);
+    builder.add(1);
+    builder.add("two");
+    builder.add(Object());
+    Array array = builder.build();
+    CHECK(array.size() == 3);
+    CHECK(array[1].getString() == "two");
+    CHECK(builder.size() == 0);
+}
+
+TEST_CASE( "Builders keep the last value of duplicate keys", "[object]" ) {
+    ObjectBuilder small(VECTOR);
+    small.add("a", 1);
+    small.add("b", 2);
+    small.add("a", 3);
+    small.add("a", 4);
+    CHECK(small.build().toString() == R"({"a": 4, "b": 2})");
+
+    ObjectBuilder large(INDEXED);
+    for (int i = 0; i < 100; i++) {
+        large.add("key" + std::to_string(i % 40), i);
+    }
+    Object object = large.build();
+    CHECK(object.size() == 40);
+    CHECK(object.begin()->getKey() == "key0");
+    CHECK(object.begin()->getValue().getInt() == 80);
+    CHECK(object.find("key39")->getInt() == 79);
+
+    CHECK(parse(R"({"x": 1, "y": 2, "x": 3})").toString() == R"({"x": 3, "y": 2})");
+}
+
+TEST_CASE( "Paths resolve JSON Pointers", "[object]" ) {
+    const Element document = parse(R"({"foo": ["bar", "baz"], "": 0, "a/b": 1, "m~n": 8, "10": {"01": true},
+                                       "users": [{"name": "a"}, {"name": "b", "tags": [1, 2, 3]}]})");
+
+    CHECK(document.find(Path("")) == &document);
+    CHECK(document.find(Path("/foo"))->getArray().size() == 2);
+    CHECK(document.at(Path("/foo/0")).getString() == "bar");
+    CHECK(document.at(Path("/")).getInt() == 0);
+    CHECK(document.at(Path("/a~1b")).getInt() == 1);
+    CHECK(document.at(Path("/m~0n")).getInt() == 8);
+    CHECK(document.at(Path("/10/01")).getBool());
+    CHECK(document.at(Path("/users/1/tags/2")).getInt() == 3);
+
+    CHECK(document.find(Path("/foo/2")) == nullptr);
+    CHECK(document.find(Path("/foo/01")) == nullptr);
+    CHECK(document.find(Path("/foo/-")) == nullptr);
+    CHECK(document.find(Path("/users/0/name/x")) == nullptr);
+    CHECK(document.find(Path("/missing")) == nullptr);
+    CHECK_THROWS_AS(document.at(Path("/users/2")), PathException);
+    CHECK_THROWS_AS(Path("foo"), PathException);
+    CHECK_THROWS_AS(Path("/a~2"), PathException);
+
+    // The same path works on every storage type
+    const Path path("/key42");
+    for (Storage storage: {HASHMAP, MAP, VECTOR, ADAPTIVE, FLAT_HASHMAP, INDEXED, SHAPED}) {
+        Element element = Object(storage);
+        for (int i = 0; i < 100; i++) {
+            element["key" + std::to_string(i)] = i;
+        }
+        CHECK(element.at(path).getInt() == 42);
+        element.at(path) = "changed";
+        CHECK(element["key42"].getString() == "changed");
+    }
+}
+
+TEST_CASE( "Array indexes find elements by the value of a field", "[object]" ) {
+    Element orders = parse(R"([{"id": 1, "customer": {"id": "a"}}, {"id": 2, "customer": {"id": "b"}},
+                               {"id": 3.0, "customer": {"id": "a"}}, {"id": 4}, {"id": null, "customer": {"id": 7}}])");
+    Array &array = orders.getArray();
+
+    ArrayIndex byCustomer = buildIndex(array, "/customer/id");
+    ArrayIndex byId(array, Path("/id"));
+
+    CHECK(byCustomer.find("b")->at(Path("/id")).getInt() == 2);
+    CHECK(byCustomer.count("a") == 2);
+    CHECK(byCustomer.find(7) == &array[4]);
+    CHECK(byCustomer.find("c") == nullptr);
+    CHECK(byCustomer.findAll("c").empty());
+    CHECK(byId.find(3) == &array[2]);
+    CHECK(byId.find(2.0) == &array[1]);
+    CHECK(byId.find(nullptr) == &array[4]);
+
+    std::vector<const Element *> matches;
+    for (const Element &order: byCustomer.findAll("a")) {
+        matches.push_back(&order);
+    }
+    CHECK(matches == std::vector<const Element *>{&array[0], &array[2]});
+
+    // Appended elements are picked up by the next lookup, even when the array reallocates
+    for (int i = 5; i < 1000; i++) {
+        array.push_back(parse(R"({"customer": {"id": "a"}})"));
+        array.back()["id"] = i;
+    }
+    CHECK(byCustomer.count("a") == 997);
+    CHECK(byId.find(999) == &array.back());
+
+    // Other changes need a rebuild
+    array[0]["id"] = 1000;
+    CHECK(byId.find(1000) == nullptr);
+    byId.rebuild();
+    CHECK(byId.find(1000) == &array[0]);
+    CHECK(byId.find(1) == nullptr);
+}
+
+TEST_CASE( "Equal elements have equal hashes", "[object]" ) {
+    const char *json = R"({"id": 7, "tags": ["a", "b"], "nested": {"x": 1.5, "y": null, "z": true}, "name": "n"})";
+    Element first = parse(json);
+
+    for (Storage storage: {HASHMAP, MAP, VECTOR, ADAPTIVE, FLAT_HASHMAP, INDEXED, SHAPED}) {
+        // Same pairs in a different order and storage
+        Element second = Object(storage);
+        second["name"] = "n";
+        second["nested"] = parse(R"({"z": true, "y": null, "x": 1.5})");
+        second["tags"] = {"a", "b"};
+        second["id"] = 7.0;
+
+        CHECK(first == second);
+        CHECK(second == first);
+        CHECK(first.hash() == second.hash());
+        CHECK(first.getObject().hash() == second.getObject().hash());
+
+        second["tags"].getArray().push_back("c");
+        CHECK(first != second);
+        CHECK(first.hash() != second.hash());
+    }
+
+    CHECK(Element(1) == Element(1.0));
+    CHECK(Element(1).hash() == Element(1.0).hash());
+    CHECK(Element(0.0).hash() == Element(-0.0).hash());
+    CHECK(Element("1") != Element(1));
+    CHECK(Element(nullptr) == Element(nullptr));
+    CHECK(Element(true) != Element(false));
+    CHECK(Element({1, 2}) != Element({2, 1}));
+    CHECK(Element({1, 2}).hash() != Element({2, 1}).hash());
+    CHECK(Element::hash(Array()) == Element(Array()).hash());
+
+    // Keys that were only looked up with operator[] are not part of the object
+    Element withPlaceholder = parse(json);
+    withPlaceholder["placeholder"];
+    CHECK(withPlaceholder == first);
+    CHECK(first == withPlaceholder);
+    CHECK(withPlaceholder.hash() == first.hash());
+}
+
+TEST_CASE( "Cached hashes follow changes", "[object]" ) {
+    Element document = parse(R"({"a": {"b": {"c": 1}}, "list": [{"d": 2}]})");
+    const Element copy = document;
+    uint64_t original = document.hash();
+    CHECK(copy.hash() == original);
+
+    document["a"]["b"]["c"] = 2;
+    CHECK(document.hash() != original);
+    document["a"]["b"]["c"] = 1;
+    CHECK(document.hash() == original);
+
+    document.at(Path("/a/b/c")) = 3;
+    CHECK(document.hash() != original);
+    CHECK(document != copy);
+    *document.find(Path("/a/b/c")) = 1;
+    CHECK(document.hash() == original);
+
+    document["list"].getArray()[0]["d"] = 5;
+    CHECK(document.hash() != original);
+    document["list"].getArray()[0]["d"] = 2;
+
+    for (auto member: document.getObject()) {
+        if (member.getKey() == "a") {
+            member.getValue().getObject().remove("b");
+        }
+    }
+    CHECK(document.hash() != original);
+    CHECK(document != copy);
+    document["a"]["b"] = copy.find("a")->find("b")->getObject();
+    CHECK(document.hash() == original);
+    CHECK(document == copy);
+}
+
+TEST_CASE( "Changes through kept references clear the hashes around them", "[object]" ) {
+    Element a = parse(R"({"x": {"y": 1}, "list": [{"z": 1}]})");
+    Element b = parse(R"({"x": {"y": 1}, "list": [{"z": 1}]})");
+
+    Element &ax = a["x"];
+    Element &az = a["list"].getArray()[0];
+    a.hash();
+    b.hash();
+    ax["y"] = 2;
+    b["x"]["y"] = 2;
+    CHECK(a == b);
+    CHECK(a.hash() == b.hash());
+    CHECK(parse(a.toString()) == b);
+
+    // Objects in arrays reach the enclosing object as well
+    az["z"] = 3;
+    CHECK(a != b);
+    b["list"].getArray()[0]["z"] = 3;
+    CHECK(a == b);
+    CHECK(a.hash() == b.hash());
+
+    // Also through the pointer a non-const path returns
+    Element *y = a.find(Path("/x"));
+    a.hash();
+    (*y)["extra"] = true;
+    CHECK(a.hash() != b.hash());
+    CHECK(a != b);
+    y->getObject().remove("extra");
+    CHECK(a.hash() == b.hash());
+
+    // Moving a nested object out changes its parent, the moved object no longer points to it
+    Element kept;
+    {
+        Element c = parse(R"({"inner": {"v": 1}, "other": {"w": [{"u": 1}]}})");
+        Element &inner = c["inner"];
+        Element &array = c["other"]["w"];
+        uint64_t before = c.hash();
+        kept = std::move(inner);
+        CHECK(c.hash() != before);
+        before = c.hash();
+        Element list = std::move(array);
+        CHECK(c.hash() != before);
+        list.getArray()[0]["u"] = 2;
+        Object taken = std::move(c["other"].getObject());
+        taken["w"] = 1;
+    }
+    kept["v"] = 2;
+    CHECK(kept.hash() == parse(R"({"v": 2})").hash());
+}
+
+TEST_CASE( "Writes through values handed out before hashing are never missed", "[object]" ) {
+    Element a = parse(R"({"x": 1, "s": "v", "list": [1, {"y": 1}]})");
+    Element b = parse(R"({"x": 2, "s": "w", "list": [2, {"y": 2}]})");
+
+    Element &x = a["x"];
+    std::string &s = a["s"].getString();
+    Array &list = a["list"].getArray();
+    Element &y = list[1]["y"];
+    CHECK(a.hash() != b.hash());
+    CHECK(a != b);
+
+    x = 2;
+    s = "w";
+    list[0] = 2;
+    y = 2;
+    CHECK(a == b);
+    CHECK(a.hash() == b.hash());
+
+    // The same for members whose cache was filled by an earlier comparison
+    list.push_back(3);
+    CHECK(a != b);
+    b["list"].getArray().push_back(3);
+    CHECK(a == b);
+    CHECK(a.hash() == b.hash());
+}
+
+TEST_CASE( "Arrays taken out of their object no longer point to it", "[object]" ) {
+    Array moved;
+    Array swapped;
+    Element element;
+    {
+        Element document = parse(R"({"a": [{"v": 1}], "b": [{"v": 1}], "c": [{"v": 1}]})");
+        document.hash();
+        moved = std::move(document["a"].getArray());
+        std::swap(swapped, document["b"].getArray());
+        element = std::move(document["c"]);
+    }
+    moved[0]["v"] = 2;
+    swapped[0]["v"] = 2;
+    element.getArray()[0]["v"] = 2;
+    CHECK(moved[0]["v"].getInt() == 2);
+    CHECK(swapped[0]["v"].getInt() == 2);
+    CHECK(element.getArray()[0]["v"].getInt() == 2);
+
+    // Objects that are removed or cleared from an array drop the link as well
+    Element kept;
+    {
+        Element document = parse(R"({"list": [{"v": 1}, {"v": 2}]})");
+        Element *object = new Element(document);
+        object->hash();
+        kept = std::move((*object)["list"].getArray()[1]);
+        (*object)["list"].getArray().clear();
+        delete object;
+    }
+    kept["v"] = 3;
+    CHECK(kept["v"].getInt() == 3);
+}
+
+TEST_CASE( "Parsed objects keep the order of the json", "[object]" ) {
+    std::string json = R"({"z": 1, "a": 2, "m": {"y": true, "b": null}})";
+    CHECK(parse(json).toString() == json);
+}
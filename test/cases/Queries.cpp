@@ -0,0 +1,99 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "../catch.hpp"
+#include "../../src/json_max/parser/Parser.h"
+#include "../../src/json_max/query/Query.h"
+
+using namespace JsonMax;
+
+namespace {
+
+    const char *store = R"({"store": {
+        "book": [
+            {"category": "reference", "author": "Nigel Rees", "title": "Sayings of the Century", "price": 8.95},
+            {"category": "fiction", "author": "Evelyn Waugh", "title": "Sword of Honour", "price": 12.99},
+            {"category": "fiction", "author": "Herman Melville", "title": "Moby Dick", "isbn": "0-553-21311-3",
+             "price": 8.99},
+            {"category": "fiction", "author": "J. R. R. Tolkien", "title": "The Lord of the Rings",
+             "isbn": "0-395-19395-8", "price": 22.99}
+        ],
+        "bicycle": {"color": "red", "price": 19.95}
+    }, "limit": 10})";
+
+    std::vector<std::string> strings(const Query &query, const Element &document) {
+        std::vector<std::string> result;
+        query.evaluate(document, [&result](const Element &match) {
+            result.push_back(match.getString());
+        });
+        return result;
+    }
+
+}
+
+TEST_CASE( "Queries select members, indexes and slices", "[query]" ) {
+    const Element document = parse(store);
+
+    CHECK(strings(compileQuery("$.store.book[0].title"), document) ==
+          std::vector<std::string>{"Sayings of the Century"});
+    CHECK(strings(compileQuery("$['store'][\"book\"][-1].author"), document) ==
+          std::vector<std::string>{"J. R. R. Tolkien"});
+    CHECK(strings(compileQuery("$.store.book[*].author"), document).size() == 4);
+    CHECK(strings(compileQuery("$.store.book[1:3].title"), document) ==
+          std::vector<std::string>{"Sword of Honour", "Moby Dick"});
+    CHECK(strings(compileQuery("$.store.book[::-2].title"), document) ==
+          std::vector<std::string>{"The Lord of the Rings", "Sword of Honour"});
+    CHECK(strings(compileQuery("$.store.book[0,2].title"), document) ==
+          std::vector<std::string>{"Sayings of the Century", "Moby Dick"});
+    CHECK(strings(compileQuery("$..bicycle['color', 'size']"), document) == std::vector<std::string>{"red"});
+
+    CHECK(compileQuery("$").first(document) == &document);
+    CHECK(compileQuery("$..price").count(document) == 5);
+    CHECK(compileQuery("$.store.*").count(document) == 2);
+    CHECK(compileQuery("$.store.book[4]").first(document) == nullptr);
+    CHECK(compileQuery("$.limit.nothing[0]").count(document) == 0);
+}
+
+TEST_CASE( "Queries filter with comparisons and logic", "[query]" ) {
+    const Element document = parse(store);
+
+    CHECK(strings(compileQuery("$.store.book[?(@.price < 10)].title"), document) ==
+          std::vector<std::string>{"Sayings of the Century", "Moby Dick"});
+    CHECK(strings(compileQuery("$..book[?(@.isbn)].title"), document) ==
+          std::vector<std::string>{"Moby Dick", "The Lord of the Rings"});
+    CHECK(strings(compileQuery("$..book[?(!@.isbn)].title"), document).size() == 2);
+    CHECK(strings(compileQuery("$..book[?(@.category == 'fiction' && @.price > 20)].title"), document) ==
+          std::vector<std::string>{"The Lord of the Rings"});
+    CHECK(strings(compileQuery("$..book[?(@.price < 9 || @.author == \"Evelyn Waugh\")].title"), document).size() ==
+          3);
+    CHECK(strings(compileQuery("$..book[?(@.price <= $.limit)].title"), document).size() == 2);
+    CHECK(strings(compileQuery("$..book[?(!(@.price >= 10) && @.category != 'reference')].title"), document) ==
+          std::vector<std::string>{"Moby Dick"});
+    CHECK(compileQuery("$..[?(@.price > 19 && @.price < 20)].color").count(document) == 1);
+    CHECK(compileQuery("$..book[?(@.missing == @.other)]").count(document) == 4);
+
+    const Element numbers = parse("[1, 2.5, 3, \"4\", true, null]");
+    CHECK(compileQuery("$[?(@ >= 2)]").count(numbers) == 2);
+    CHECK(compileQuery("$[?(@ == 3.0)]").first(numbers)->getInt() == 3);
+    CHECK(compileQuery("$[?(@ == null)]").count(numbers) == 1);
+    CHECK(compileQuery("$[?(@ == true)]").count(numbers) == 1);
+}
+
+TEST_CASE( "Queries stop early and can be reused", "[query]" ) {
+    Query query = compileQuery("$..price");
+    CHECK(query.toString() == "$..price");
+
+    for (int i = 0; i < 3; i++) {
+        Element document = parse(R"({"a": {"price": 1}, "b": [{"price": 2}, {"price": 3}]})");
+        CHECK(query.first(document)->getInt() == 1);
+        CHECK(query.select(document).size() == 3);
+    }
+}
+
+TEST_CASE( "Malformed queries are rejected", "[query]" ) {
+    for (const char *expression: {"", "store", "$.", "$[", "$['a'", "$[1:2,3]", "$[?(@.a <)]", "$[?(@.a == 'x)]",
+                                  "$.a b", "$[?(@[-1])]", "$[?(@.a && )]"}) {
+        CHECK_THROWS_AS(compileQuery(expression), QueryException);
+    }
+}
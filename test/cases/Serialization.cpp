@@ -0,0 +1,487 @@
+/**
+ * @author Max Van Houcke
+ */
+
+#include "../catch.hpp"
+#include "../../src/json_max/parser/Parser.h"
+#include "../../src/json_max/model/Object.h"
+#include "../../src/json_max/model/FrozenObject.h"
+#include "../../src/json_max/model/ObjectIterator.h"
+#include "../../src/json_max/model/Path.h"
+#include "../../src/json_max/writer/Writer.h"
+#include "../../src/json_max/writer/StreamWriter.h"
+
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <cstdio>
+#include <thread>
+
+using namespace JsonMax;
+
+TEST_CASE( "Writer gives the same json as toString", "[writer]" ) {
+    const char *json = R"({"id": -12, "ok": true, "tags": ["a", [], {}], "nested": {"x": 1.5, "y": null}})";
+    Element document = parse(json);
+
+    CHECK(document.toString() == json);
+    CHECK(document.toString(WriteOptions()) == json);
+    CHECK(document.getObject().toString(WriteOptions()) == json);
+    FrozenObject frozen = document.getObject().freeze();
+    CHECK(parse(frozen.toString(WriteOptions(true))) == document);
+    CHECK(parse(frozen.toString()) == document);
+
+    std::string compact = document.toString(WriteOptions(true));
+    CHECK(compact == R"({"id":-12,"ok":true,"tags":["a",[],{}],"nested":{"x":1.5,"y":null}})");
+    CHECK(parse(compact) == document);
+
+    CHECK(Element(INT_MIN).toString() == std::to_string(INT_MIN));
+    CHECK(Element(0).toString() == "0");
+    CHECK(Element(Array()).toString(WriteOptions(true)) == "[]");
+}
+
+TEST_CASE( "Writer appends to a supplied string", "[writer]" ) {
+    Element document = parse(R"({"a": [1, 2, 3]})");
+
+    std::string target = "data=";
+    StringOutput output(target);
+    Writer writer(output, WriteOptions(true));
+    writer.write(document);
+    writer.write(document["a"].getArray());
+    CHECK(target == R"(data={"a":[1,2,3]}[1,2,3])");
+}
+
+TEST_CASE( "Writer handles documents larger than its buffer", "[writer]" ) {
+    Element document = Object(VECTOR);
+    document["long"] = std::string(10000, 'x');
+    Array numbers;
+    for (int i = 0; i < 5000; i++) {
+        numbers.emplace_back(i * 7 - 1000);
+    }
+    document["numbers"] = numbers;
+
+    std::string json = document.toString();
+    CHECK(json.size() > 20000);
+    CHECK(parse(json) == document);
+    CHECK(parse(document.toString(WriteOptions(true))) == document);
+}
+
+TEST_CASE( "Writer indents nested values", "[writer]" ) {
+    Element document = parse(R"({"id": -12, "tags": ["a", [], {}, [1, {"k": "v"}]], "nested": {"y": null, "e": {}}})");
+
+    CHECK(document.toString(2) == R"({
+  "id": -12,
+  "tags": [
+    "a",
+    [],
+    {},
+    [
+      1,
+      {
+        "k": "v"
+      }
+    ]
+  ],
+  "nested": {
+    "y": null,
+    "e": {}
+  }
+})");
+    CHECK(document["nested"].toString(WriteOptions(true, 3)) == "{\n   \"y\":null,\n   \"e\":{}\n}");
+    CHECK(document.getObject().freeze().toString(1).find("\n \"id\": -12") != std::string::npos);
+    CHECK(Element(5).toString(4) == "5");
+    CHECK(Element(Array()).toString(4) == "[]");
+
+    // Placeholders are skipped, so this object is written as empty
+    Element placeholders = Object();
+    placeholders["missing"];
+    CHECK(placeholders.toString(2) == "{}");
+}
+
+TEST_CASE( "Fractions are written with the shortest round trip digits", "[writer]" ) {
+    CHECK(Element(0.1).toString() == "0.1");
+    CHECK(Element(1.5).toString() == "1.5");
+    CHECK(Element(-2.0).toString() == "-2.0");
+    CHECK(Element(100.0).toString() == "100.0");
+    CHECK(Element(0.0).toString() == "0.0");
+    CHECK(Element(-0.0).toString() == "-0.0");
+    CHECK(Element(0.000001).toString() == "0.000001");
+    CHECK(Element(1e-7).toString() == "1.0e-7");
+    CHECK(Element(1e20).toString() == "100000000000000000000.0");
+    CHECK(Element(1.5e21).toString() == "1.5e+21");
+    CHECK(Element(123456.789).toString() == "123456.789");
+    CHECK(Element(5e-324).toString() == "5.0e-324");
+    CHECK(Element(1.7976931348623157e308).toString() == "1.7976931348623157e+308");
+    CHECK(Element(std::numeric_limits<double>::quiet_NaN()).toString() == "null");
+    CHECK(Element(-std::numeric_limits<double>::infinity()).toString() == "null");
+
+    // Every finite double parses back to the same bits, and stays a fraction
+    std::mt19937_64 random(42);
+    for (int i = 0; i < 20000; i++) {
+        uint64_t bits = random();
+        double value;
+        std::memcpy(&value, &bits, sizeof(double));
+        if (not std::isfinite(value)) {
+            continue;
+        }
+        Element parsed = parse(Element(value).toString());
+        REQUIRE(parsed.isDouble());
+        uint64_t parsedBits;
+        double parsedValue = parsed.getDouble();
+        std::memcpy(&parsedBits, &parsedValue, sizeof(double));
+        REQUIRE(parsedBits == bits);
+    }
+}
+
+TEST_CASE( "Strings are escaped and parsed back", "[writer]" ) {
+    Element quote = std::string("say \"hi\"\\");
+    CHECK(quote.toString() == R"("say \"hi\"\\")");
+
+    std::string controls;
+    for (int c = 0; c < 0x20; c++) {
+        controls += static_cast<char>(c);
+    }
+    CHECK(Element(controls).toString() ==
+          R"("\u0000\u0001\u0002\u0003\u0004\u0005\u0006\u0007\b\t\n\u000b\f\r\u000e\u000f)"
+          R"(\u0010\u0011\u0012\u0013\u0014\u0015\u0016\u0017\u0018\u0019\u001a\u001b\u001c\u001d\u001e\u001f")");
+
+    // Long strings with special characters at every position of a 16 byte block
+    for (size_t i = 0; i < 40; i++) {
+        std::string text(40, 'x');
+        text[i] = '"';
+        text += "\xc3\xa9\x7f/";
+        Element document = Object();
+        document[text] = text;
+        Element parsed = parse(document.toString());
+        REQUIRE(parsed == document);
+        REQUIRE(parsed.find(text));
+    }
+
+    Element decoded = parse(R"({"a\"b": "é😀\n\/", "c{": "x\",y"})");
+    CHECK(decoded["a\"b"].getString() == "\xc3\xa9\xf0\x9f\x98\x80\n/");
+    CHECK(decoded["c{"].getString() == "x\",y");
+    CHECK(decoded.toString() == R"({"a\"b": ")" "\xc3\xa9\xf0\x9f\x98\x80" R"(\n/", "c{": "x\",y"})");
+
+    CHECK_THROWS(parse(R"("\x")"));
+    CHECK_THROWS(parse(R"("\u12g4")"));
+    CHECK_THROWS(parse(R"({"\q": 1})"));
+}
+
+TEST_CASE( "Elements are written to streams and files", "[writer]" ) {
+    Element document = parse(R"({"name": "stream", "values": [1, 2.5, "x\ny"], "nested": {"ok": true}})");
+    Array big;
+    for (int i = 0; i < 3000; i++) {
+        big.emplace_back("value " + std::to_string(i));
+    }
+    document["big"] = big;
+
+    std::ostringstream stream;
+    document.write(stream);
+    CHECK(stream.str() == document.toString());
+
+    std::ostringstream indented;
+    document.write(indented, WriteOptions(false, 2));
+    CHECK(indented.str() == document.toString(2));
+
+    std::FILE *file = std::tmpfile();
+    REQUIRE(file);
+    document.write(file, WriteOptions(true));
+    std::string content(static_cast<size_t>(std::ftell(file)), '\0');
+    std::rewind(file);
+    CHECK(std::fread(&content[0], 1, content.size(), file) == content.size());
+    std::fclose(file);
+    CHECK(content == document.toString(WriteOptions(true)));
+
+    document.writeFile("written.json");
+    CHECK(parseFile("written.json") == document);
+    std::remove("written.json");
+
+    CHECK_THROWS_AS(document.writeFile("missing/directory/written.json"), WriteException);
+}
+
+TEST_CASE( "Large containers are written in parallel", "[writer]" ) {
+    Element document = Object(VECTOR);
+    Array values;
+    for (int i = 0; i < 10000; i++) {
+        Element value = Object(VECTOR);
+        value["id"] = i;
+        value["name"] = "item \"" + std::to_string(i) + "\"";
+        values.push_back(value);
+    }
+    document["values"] = values;
+    Element wide = Object();
+    for (int i = 0; i < 5000; i++) {
+        wide[std::to_string(i)] = i * 0.5;
+    }
+    document["wide"] = wide;
+
+    for (unsigned int threads: {2u, 3u, 8u}) {
+        CHECK(document.toString(WriteOptions(false, 0, threads)) == document.toString());
+        CHECK(document.toString(WriteOptions(true, 2, threads)) == document.toString(WriteOptions(true, 2)));
+        FrozenObject frozen = wide.getObject().freeze();
+        CHECK(frozen.toString(WriteOptions(false, 0, threads)) == frozen.toString());
+    }
+
+    // Large containers nested in large containers, with far more threads than the hardware has
+    Array outer;
+    for (int i = 0; i < 4096; i++) {
+        outer.push_back(i % 512 == 0 ? values : Array{i});
+    }
+    Element nested = outer;
+    CHECK(nested.toString(WriteOptions(false, 0, 100000)) == nested.toString());
+
+    std::ostringstream stream;
+    document.write(stream, WriteOptions(false, 4, 4));
+    CHECK(stream.str() == document.toString(4));
+
+#ifdef JSONMAX_POSIX
+    std::FILE *file = std::tmpfile();
+    REQUIRE(file);
+    DescriptorOutput output(fileno(file));
+    Writer(output, WriteOptions(true, 0, 4)).write(document);
+    std::string content(static_cast<size_t>(lseek(fileno(file), 0, SEEK_CUR)), '\0');
+    lseek(fileno(file), 0, SEEK_SET);
+    CHECK(read(fileno(file), &content[0], content.size()) == static_cast<ssize_t>(content.size()));
+    std::fclose(file);
+    CHECK(content == document.toString(WriteOptions(true)));
+#endif
+}
+
+TEST_CASE( "Serialized sizes are exact", "[writer]" ) {
+    Element document = parse(R"({"id": -2147483648, "empty": {}, "list": [[], [1, 2.5e-9, true, null], {"q\"": "\t\u0001"}],
+                                 "text": "plain text that is longer than sixteen characters \\ with escapes\n", "pi": 3.14159})");
+    document["placeholder"];
+    document["frozen"] = document.getObject().freeze().toString();
+
+    for (bool compact: {false, true}) {
+        for (unsigned int indent: {0u, 1u, 4u}) {
+            WriteOptions options(compact, indent);
+            std::string json = document.toString(options);
+            CHECK(document.serializedSize(options) == json.size());
+            CHECK(Writer::serializedSize(document.getObject(), options) == json.size());
+            CHECK(Writer::serializedSize(document["list"].getArray(), options) == document["list"].toString(options).size());
+
+            FrozenObject frozen = document.getObject().freeze();
+            CHECK(Writer::serializedSize(frozen, options) == frozen.toString(options).size());
+
+            options.exactSize = true;
+            CHECK(document.toString(options) == json);
+        }
+    }
+    CHECK(Element().serializedSize() == Element().toString().size());
+}
+
+TEST_CASE( "StreamWriter writes json without a document", "[writer]" ) {
+    Element document = parse(R"({"id": 7, "name": "a \"b\"", "scores": [1.5, -2, true, null, [], {}], "owner": {"x": 1}})");
+
+    for (bool compact: {false, true}) {
+        for (unsigned int indent: {0u, 2u}) {
+            WriteOptions options(compact, indent);
+            std::string json;
+            StringOutput output(json);
+            StreamWriter writer(output, options);
+            writer.startObject()
+                    .key("id").value(7)
+                    .key("name").value("a \"b\"")
+                    .key("scores").startArray()
+                        .value(1.5).value(-2).value(true).value(nullptr)
+                        .startArray().endArray()
+                        .startObject().endObject()
+                    .endArray()
+                    .key("owner").value(document["owner"])
+                    .endObject();
+            CHECK(json == document.toString(options));
+        }
+    }
+
+    std::string values;
+    StringOutput output(values);
+    StreamWriter(output).value(std::string("top")).value(0.1);
+    CHECK(values == "\"top\"0.1");
+
+#ifndef NDEBUG
+    std::string ignored;
+    StringOutput ignoredOutput(ignored);
+    CHECK_THROWS_AS(StreamWriter(ignoredOutput).startObject().value(1), WriteException);
+    CHECK_THROWS_AS(StreamWriter(ignoredOutput).startArray().key("a"), WriteException);
+    CHECK_THROWS_AS(StreamWriter(ignoredOutput).startObject().key("a").key("b"), WriteException);
+    CHECK_THROWS_AS(StreamWriter(ignoredOutput).startObject().endArray(), WriteException);
+    CHECK_THROWS_AS(StreamWriter(ignoredOutput).startObject().key("a").endObject(), WriteException);
+    CHECK_THROWS_AS(StreamWriter(ignoredOutput).endArray(), WriteException);
+#endif
+}
+
+TEST_CASE( "Cached fragments follow changes", "[writer]" ) {
+    Element document = parse(R"({"config": {"name": "server", "limits": {"cpu": 2, "memory": 512}},
+                                 "users": [{"id": 1, "roles": {"admin": true}}, {"id": 2, "roles": {}}],
+                                 "flags": {"beta": false}})");
+    WriteOptions cached;
+    cached.cacheFragments = true;
+    WriteOptions compactCached(true);
+    compactCached.cacheFragments = true;
+
+    auto check = [&]() {
+        CHECK(document.toString(cached) == document.toString());
+        CHECK(document.toString(compactCached) == document.toString(WriteOptions(true)));
+        CHECK(document.serializedSize(compactCached) == document.toString(WriteOptions(true)).size());
+        CHECK(document.toString(cached) == document.toString());
+    };
+    check();
+
+    document["config"]["limits"]["cpu"] = 4;
+    check();
+    document["users"].getArray()[1]["roles"]["viewer"] = true;
+    check();
+    document.at(Path("/config/name")) = "proxy";
+    check();
+    document["flags"].getObject().remove("beta");
+    check();
+    document.find("config")->find("limits")->getObject().clear();
+    check();
+    for (auto member: document["users"].getArray()[0].getObject()) {
+        member.getValue() = 9;
+    }
+    check();
+
+    // Copies and moves don't share caches
+    Element copy = document;
+    copy["config"]["name"] = "copy";
+    CHECK(copy.toString(cached) == copy.toString());
+    CHECK(document.toString(cached) == document.toString());
+    Element moved = std::move(copy);
+    CHECK(moved.toString(cached) == moved.toString());
+
+    // Indentation doesn't use the caches
+    CHECK(document.toString(WriteOptions(false, 2)) == document.toString(2));
+}
+
+TEST_CASE( "Cached fragments follow changes through kept references", "[writer]" ) {
+    Element document = parse(R"({"config": {"x": 0, "limits": {"cpu": 1}}, "list": [{"id": 1}, [{"id": 2}]]})");
+    WriteOptions cached;
+    cached.cacheFragments = true;
+    WriteOptions compact(true);
+    compact.cacheFragments = true;
+    auto check = [&]() {
+        CHECK(document.toString(cached) == document.toString());
+        CHECK(document.toString(compact) == document.toString(WriteOptions(true)));
+        CHECK(document.serializedSize(cached) == document.toString().size());
+    };
+
+    Element &config = document["config"];
+    Element &nested = document["list"].getArray()[1].getArray()[0];
+    check();
+    config["x"] = 1;
+    check();
+    nested["id"] = 3;
+    check();
+
+    Element *limits = document.find(Path("/config/limits"));
+    check();
+    (*limits)["cpu"] = 2;
+    check();
+    limits->getObject().remove("cpu");
+    check();
+
+    // Replacing or moving out a cached object through a kept reference
+    config = Object();
+    check();
+    Element moved = std::move(nested);
+    check();
+    CHECK(document.toString().find("\"id\": 3") == std::string::npos);
+}
+
+TEST_CASE( "Cached fragments follow values assigned through kept references", "[writer]" ) {
+    Element document = parse(R"({"a": {"k": "v"}, "b": {"n": 1, "list": [1]}, "c": {"s": "x"}})");
+    WriteOptions cached;
+    cached.cacheFragments = true;
+    auto check = [&]() {
+        CHECK(document.toString(cached) == document.toString());
+        CHECK(document.serializedSize(cached) == document.toString().size());
+    };
+
+    Element &k = document["a"]["k"];
+    Element &n = document["b"]["n"];
+    Array &list = document["b"]["list"].getArray();
+    std::string &s = document["c"]["s"].getString();
+    check();
+    k = "w";
+    check();
+    CHECK(document.toString(cached).find("\"w\"") != std::string::npos);
+    n = 2;
+    check();
+    list.push_back(2);
+    check();
+    s = "y";
+    check();
+    CHECK(document.toString(cached) == R"({"a": {"k": "w"}, "b": {"n": 2, "list": [1, 2]}, "c": {"s": "y"}})");
+}
+
+TEST_CASE( "Frozen objects are written with cached fragments from multiple threads", "[writer]" ) {
+    Element document = parse(R"({"config": {"name": "server", "limits": {"cpu": 2}}, "users": [{"id": 1}]})");
+    FrozenObject frozen = document.getObject().freeze();
+    WriteOptions cached;
+    cached.cacheFragments = true;
+    std::string expected = frozen.toString();
+
+    std::vector<int> matches(4, 0);
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < matches.size(); thread++) {
+        threads.emplace_back([&frozen, &cached, &expected, &matches, thread]() {
+            for (int i = 0; i < 50; i++) {
+                matches[thread] += frozen.toString(cached) == expected;
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    for (int count: matches) {
+        CHECK(count == 50);
+    }
+}
+
+TEST_CASE( "Parsed source is written for unchanged objects", "[writer]" ) {
+    std::string json = R"({ "name" :"proxy", "limits": {"cpu":2,  "ratio": 1e-1, "path": "a\/bé"},
+  "users": [ {"id": 1}, {"id":2, "roles": {"admin" :true}} ] })";
+    Element document = parseWithSource(json);
+
+    // Untouched documents come out as they went in, only the default layout uses the source
+    CHECK(document.toString() == json);
+    CHECK(document.serializedSize() == json.size());
+    CHECK(document.toString(WriteOptions(true)) == parse(json).toString(WriteOptions(true)));
+    CHECK(document.toString(2) == parse(json).toString(2));
+    CHECK(document == parse(json));
+
+    // A change writes the objects on its path again, the others keep their slice
+    document["limits"]["cpu"] = 4;
+    std::string changed = document.toString();
+    CHECK(changed.find(R"("ratio": 1e-1, "path": "a\/bé")") == std::string::npos);
+    CHECK(changed.find(R"({"id":2, "roles": {"admin" :true}})") != std::string::npos);
+    CHECK(parse(changed) == document);
+    CHECK(document.serializedSize() == changed.size());
+
+    // Fragment caching replaces the slices it writes
+    WriteOptions cached;
+    cached.cacheFragments = true;
+    document["users"].getArray()[0]["id"] = 3;
+    CHECK(document.toString(cached) == document.toString());
+    CHECK(parse(document.toString(cached)) == document);
+
+    // Copies are written afresh, moved objects keep the source alive
+    Element copy = document;
+    CHECK(parse(copy.toString()) == document);
+    Element inner = std::move(parseWithSource(R"([{"a" : 1}])").getArray()[0]);
+    CHECK(inner.toString() == R"({"a" : 1})");
+    CHECK_THROWS(parseWithSource(R"({"a": })"));
+
+    // Arrays taken out of a parsed document no longer point to it
+    Array users;
+    {
+        Element parsed = parseWithSource(json);
+        users = std::move(parsed["users"].getArray());
+    }
+    users[0]["id"] = 5;
+    CHECK(users[0]["id"].getInt() == 5);
+}